@@ -142,17 +142,12 @@ void PovrayForm::generate()
 	    
 	}
 	
-	float sliceXLow = 0.0, sliceXHigh = 0.0, sliceYLow = 0.0, sliceYHigh = 0.0, sliceZLow = 0.0, sliceZHigh = 0.0;
 	float posX = 0.0, posY = 0.0, posZ = 0.0;
 	Molecule *tmpMol = 0;
 	vector<float> parameters;
 	
-	if( glWindow->getDrawSlices() == true )
-	{
-	    glWindow->getSliceBounds( sliceXLow, sliceXHigh, sliceYLow, sliceYHigh, sliceZLow, sliceZHigh );
-	}
-	
 	QTextStream ts( &line, IO_WriteOnly );
+	glWindow->updateDrawMask(); // export the same molecules as shown (slices, selection, filters)
 	for( int i = 0; i<cnf->getNumberOfMolecules(); i++ )
 	{
 	    /*    line = "";
@@ -173,12 +168,7 @@ void PovrayForm::generate()
 	    posY = ( cnf->getShowFolded() ? tmpMol->getPositionFoldedY() : tmpMol->getPositionY() );
 	    posZ = ( cnf->getShowFolded() ? tmpMol->getPositionFoldedZ() : tmpMol->getPositionZ() );
 	    
-	    if( glWindow->getDrawSlices() == true )
-	    {
-		if( posX > sliceXHigh || posX < sliceXLow || 
-		    posY > sliceYHigh || posY < sliceYLow ||
-		    posZ > sliceZHigh || posZ < sliceZLow ) { continue; }
-	    }
+	    if( glWindow->isDrawn(i) == false ) { continue; }
 	    
 	    parameters = glWindow->getObjectParams()->at(tmpMol->getType());
 	    if( parameters.at(4) == 0 ) { ts << "ellipsoid(<"; }
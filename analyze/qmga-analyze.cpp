@@ -0,0 +1,398 @@
+/******************************************************************************
+** This file is part of QMGA a tool to display convex bodies.
+** Phillips-University of Marburg (Germany)
+** qmga@users.sourceforge.net
+**
+** QMGA is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** QMGA is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with QMGA; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+// qmga-analyze: per frame analysis of whole trajectories without Qt and OpenGL.
+// The frames are distributed among the threads (one CnfFile per thread), the
+// analysis functions run serially inside every frame.
+
+#include "mga_tools.h"
+#include "mga_analysis.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+using std::ostream;
+using std::ofstream;
+using std::ifstream;
+using std::stringstream;
+using std::setw;
+using std::left;
+using std::setprecision;
+
+static const double PI = 3.14159265358979323846;
+
+void   showHelp();
+string frameFileName( const string &firstFile, unsigned int number );
+bool   fileExists( const string &file );
+string writeSeedFile();
+string findColormap( const string &colorMap, const string &program );
+string analyzeFrame( mga::CnfFile *cnf, const string &label, int histogramBins, mga::StructureFactor *structureFactor,
+		     mga::Selection *selection );
+
+//-------------------------------------------------------------------------
+//------------- main
+//-------------------------------------------------------------------------
+int main( int argc, char * argv[] )
+{
+    string format        = "gbmega";
+    string colorMap      = "color-091.map";
+    string outFile       = "";
+    string videoFile     = "";
+    string query         = "";
+    int    videoStart    = 0, videoStop = -1, videoStep = 1;
+    int    histogramBins = 9;
+    int    gridSize      = 0;
+    int    numThreads    = 0;
+    vector<string> files;
+    vector<string> labels;
+
+    for( int i = 1; i < argc; ++i )
+    {
+	string arg = argv[i];
+	if     ( arg == "-h" || arg == "--help" ) { showHelp(); return( 0 ); }
+	else if( arg == "-f" && i+1 < argc ) { format        = argv[++i]; }
+	else if( arg == "-c" && i+1 < argc ) { colorMap      = argv[++i]; }
+	else if( arg == "-o" && i+1 < argc ) { outFile       = argv[++i]; }
+	else if( arg == "-b" && i+1 < argc ) { histogramBins = atoi( argv[++i] ); }
+	else if( arg == "-s" && i+1 < argc ) { gridSize      = atoi( argv[++i] ); }
+	else if( arg == "-t" && i+1 < argc ) { numThreads    = atoi( argv[++i] ); }
+	else if( arg == "-q" && i+1 < argc ) { query         = argv[++i]; }
+	else if( arg == "-v" && i+4 < argc )
+	{
+	    videoFile  = argv[++i];
+	    videoStart = atoi( argv[++i] );
+	    videoStop  = atoi( argv[++i] );
+	    videoStep  = atoi( argv[++i] );
+	}
+	else if( arg.size() > 1 && arg[0] == '-' ) { cerr << "Error: unknown or incomplete option: " << arg << endl; showHelp(); return( 1 ); }
+	else { files.push_back( arg ); labels.push_back( arg ); }
+    }
+
+    if( !videoFile.empty() )
+    {
+	if( videoStep < 1 ) { videoStep = 1; }
+	for( int frame = videoStart; frame <= videoStop; frame += videoStep )
+	{
+	    stringstream label;
+	    label << frame;
+	    files.push_back( frameFileName( videoFile, frame ) );
+	    labels.push_back( label.str() );
+	}
+    }
+    if( files.empty() ) { showHelp(); return( 1 ); }
+
+    uint fileFormat = 0;
+    if     ( format == "gbmega" )     { fileFormat = 0; }
+    else if( format == "lammps1" )    { fileFormat = 1; }
+    else if( format == "lammps2" )    { fileFormat = 2; }
+    else if( format == "gbmegaBiax" ) { fileFormat = 3; }
+    else if( format == "cinacchi" )   { fileFormat = 4; }
+    else { cerr << "Error: unknown file format: " << format << endl; return( 1 ); }
+
+    mga::Selection selection;
+    if( selection.parse( query ) == false ) { return( 1 ); }
+    if( selection.usesField() ) { cerr << "Error: \"field\" is not available in qmga-analyze" << endl; return( 1 ); }
+
+    colorMap = findColormap( colorMap, argv[0] );
+    if( colorMap.empty() ) { cerr << "Error: cannot find a colormap, please give one with -c" << endl; return( 1 ); }
+
+    ofstream outStream;
+    if( !outFile.empty() )
+    {
+	outStream.open( outFile.c_str() );
+	if( !outStream.is_open() ) { cerr << "Error: Cannot write file: " << outFile << endl; return( 1 ); }
+    }
+    ostream &out = outFile.empty() ? cout : outStream;
+
+#ifdef _OPENMP
+    if( numThreads > 0 ) { omp_set_num_threads( numThreads ); }
+    numThreads = omp_get_max_threads();
+#else
+    numThreads = 1;
+#endif
+
+    out << "# qmga-analyze  frames: " << files.size() << "  threads: " << numThreads
+	<< "  S,P,D,C: biaxial order parameters, h_k: fraction of molecules with k*90/" << histogramBins
+	<< " <= angle to director < (k+1)*90/" << histogramBins;
+    if( selection.isAll() == false ) { out << " of the selected molecules (" << selection.getExpression() << ")"; }
+    out << endl;
+    out << "#" << left << setw(15) << "Frame" << " " << setw(10) << "N";
+    if( selection.isAll() == false ) { out << setw(10) << "Nsel"; }
+    out
+	<< setw(13) << "Lx" << setw(13) << "Ly" << setw(13) << "Lz" << setw(15) << "Volume"
+	<< setw(11) << "nx" << setw(11) << "ny" << setw(11) << "nz"
+	<< setw(11) << "S" << setw(11) << "P" << setw(11) << "D" << setw(11) << "C";
+    if( gridSize > 0 ) { out << setw(11) << "tau" << setw(11) << "spacing"; }
+    for( int k = 0; k < histogramBins; ++k ) { stringstream h; h << "h_" << k; out << setw(11) << h.str(); }
+    out << endl;
+
+    // every thread builds its CnfFile on a known good configuration and loads all frames with
+    // reloadCnfFile(), the constructor would fall back to a dummy (or exit) for a bad first frame
+    string seedFile = writeSeedFile();
+    if( seedFile.empty() ) { cerr << "Error: cannot write a temporary file" << endl; return( 1 ); }
+
+    // rows are printed in frame order as soon as all frames before them are done
+    const int       numFrames = files.size();
+    vector<string>  rows( numFrames );
+    vector<char>    done( numFrames, 0 );
+    int             nextRow   = 0;
+    int             failed    = 0;
+
+    #pragma omp parallel
+    {
+	mga::CnfFile        *cnf = 0;
+	mga::StructureFactor structureFactor( gridSize > 0 ? gridSize : 2 );
+	mga::Selection       threadSelection( selection );
+
+	#pragma omp for schedule(dynamic,1)
+	for( int f = 0; f < numFrames; ++f )
+	{
+	    string row;
+	    if( fileExists( files[f] ) == false )
+	    {
+		#pragma omp critical(messages)
+		cerr << "Warning: cannot open file: " << files[f] << endl;
+	    }
+	    else
+	    {
+		if( cnf == 0 )
+		{
+		    string seed = seedFile;
+		    cnf = new mga::CnfFile( seed, 0, "director", colorMap );
+		    cnf -> setLoadCnfFileIndex( fileFormat );
+		}
+		if( cnf -> reloadCnfFile( files[f] ) == true )
+		{
+		    row = analyzeFrame( cnf, labels[f], histogramBins, gridSize > 0 ? &structureFactor : 0,
+					threadSelection.isAll() ? 0 : &threadSelection );
+		}
+		else
+		{
+		    #pragma omp critical(messages)
+		    cerr << "Warning: cannot load file: " << files[f] << endl;
+		}
+	    }
+
+	    #pragma omp critical(output)
+	    {
+		rows[f] = row;
+		done[f] = 1;
+		if( row.empty() ) { ++failed; }
+		while( nextRow < numFrames && done[nextRow] )
+		{
+		    out << rows[nextRow];
+		    rows[nextRow].clear();
+		    ++nextRow;
+		}
+		out.flush();
+	    }
+	}
+	delete cnf;
+    }
+
+    remove( seedFile.c_str() );
+    if( failed > 0 ) { cerr << "Warning: " << failed << " of " << numFrames << " frames could not be analysed." << endl; }
+    return( failed > 0 ? 1 : 0 );
+}
+
+//-------------------------------------------------------------------------
+//------------- analyzeFrame
+//-------------------------------------------------------------------------
+/*!
+ *  Analyses one frame and returns its row of the output table.
+ *  \param cnf The loaded frame.
+ *  \param label First column of the row (frame number or file name).
+ *  \param histogramBins Number of bins of the histogram of angles to the director.
+ *  \param structureFactor Calculates smectic order and layer spacing if not 0.
+ *  \param selection If not 0, the number of selected molecules is added and the histogram
+ *  only counts them. Positions are folded into the box for the selection.
+ *  \return The row including the line break.
+ */
+string analyzeFrame( mga::CnfFile *cnf, const string &label, int histogramBins, mga::StructureFactor *structureFactor,
+		     mga::Selection *selection )
+{
+    const int n = cnf -> getNumberOfMolecules();
+    mga::PeriodicBox  box;
+    mga::BiaxialOrder order;
+    if( n < 1 || box.set( cnf ) == false || order.calculate( cnf ) == false ) { return( "" ); }
+
+    vector<vector<float> > matrix = cnf -> getBoundingBoxMatrix();
+    double length[3];
+    for( int d = 0; d < 3; ++d )
+    {
+	length[d] = sqrt( matrix[d][0]*matrix[d][0] + matrix[d][1]*matrix[d][1] + matrix[d][2]*matrix[d][2] );
+    }
+
+    vector<double> director;
+    cnf -> getDirector( director );
+    vector<char> selected( n, 1 );
+    int numSelected = n;
+    if( selection != 0 )
+    {
+	cnf -> setShowFolded( true );
+	cnf -> foldMoleculesToBoundingBox();
+	if( selection -> evaluate( cnf, selected ) == false ) { return( "" ); }
+	numSelected = mga::Selection::count( selected );
+    }
+
+    vector<double> histogram( histogramBins > 0 ? histogramBins : 0, 0.0 );
+    for( int i = 0; i < n && histogramBins > 0; ++i )
+    {
+	if( selected[i] == 0 ) { continue; }
+	double x, y, z;
+	cnf -> getMolecule(i) -> getOrientationXYZ( x, y, z );
+	double c = fabs( x*director[0] + y*director[1] + z*director[2] ) / sqrt( x*x + y*y + z*z );
+	double angle = acos( c < 1.0 ? c : 1.0 ) * 180.0 / PI;
+	int k = int( angle / 90.0 * histogramBins );
+	histogram[ k < histogramBins ? k : histogramBins - 1 ] += 1.0 / numSelected;
+    }
+
+    stringstream row;
+    row << " " << left << setw(15) << label << " " << setw(10) << n;
+    if( selection != 0 ) { row << setw(10) << numSelected; }
+    row << setprecision(6)
+	<< setw(13) << length[0] << setw(13) << length[1] << setw(13) << length[2] << setw(15) << box.getVolume()
+	<< setprecision(4)
+	<< setw(11) << director[0] << setw(11) << director[1] << setw(11) << director[2]
+	<< setw(11) << order.getOrderS() << setw(11) << order.getOrderP()
+	<< setw(11) << order.getOrderD() << setw(11) << order.getOrderC();
+    if( structureFactor != 0 )
+    {
+	structureFactor -> calculate( cnf );
+	row << setw(11) << structureFactor -> getSmecticOrder() << setw(11) << structureFactor -> getLayerSpacing();
+    }
+    for( int k = 0; k < histogramBins; ++k ) { row << setw(11) << histogram[k]; }
+    row << endl;
+    return( row.str() );
+}
+
+//-------------------------------------------------------------------------
+//------------- frameFileName
+//-------------------------------------------------------------------------
+/*!
+ *  Builds the file name of a frame like the video settings of qmga do: the last extension
+ *  of the first file is replaced by the frame number, padded with zeros to the same length.
+ *  \param firstFile e.g. "run.0000"
+ *  \param number e.g. 12, which gives "run.0012"
+ */
+string frameFileName( const string &firstFile, unsigned int number )
+{
+    string::size_type dot = firstFile.rfind( '.' );
+    string base      = ( dot == string::npos ) ? firstFile : firstFile.substr( 0, dot );
+    string extension = ( dot == string::npos ) ? string( "" ) : firstFile.substr( dot + 1 );
+    stringstream num;
+    num << number;
+    string digits = num.str();
+    if( digits.size() < extension.size() ) { digits.insert( 0, extension.size() - digits.size(), '0' ); }
+    return( base + "." + digits );
+}
+
+//-------------------------------------------------------------------------
+//------------- fileExists
+//-------------------------------------------------------------------------
+bool fileExists( const string &file )
+{
+    ifstream in( file.c_str() );
+    return( in.is_open() );
+}
+
+//-------------------------------------------------------------------------
+//------------- writeSeedFile
+//-------------------------------------------------------------------------
+/*!
+ *  Writes a configuration of two molecules in gbmega format to a new temporary file.
+ *  \return Name of the file, "" if it could not be written.
+ */
+string writeSeedFile()
+{
+    const char *directory = getenv( "TMPDIR" );
+    string pattern = string( directory != 0 && *directory != 0 ? directory : "/tmp" ) + "/qmga-analyze-XXXXXX";
+    vector<char> name( pattern.begin(), pattern.end() );
+    name.push_back( 0 );
+    int fd = mkstemp( &name[0] );
+    if( fd < 0 ) { return( "" ); }
+    const string seed =
+	"2\n4.0\n4.0\n4.0\n0.0 0.0\n"
+	"-1.0 0.0 0.0  0 0 0  0.0 0.0 1.0  0 0 0 1\n"
+	" 1.0 0.0 0.0  0 0 0  0.0 0.0 1.0  0 0 0 2\n";
+    bool written = ( ::write( fd, seed.c_str(), seed.size() ) == (ssize_t)seed.size() );
+    close( fd );
+    if( !written ) { remove( &name[0] ); return( "" ); }
+    return( string( &name[0] ) );
+}
+
+//-------------------------------------------------------------------------
+//------------- findColormap
+//-------------------------------------------------------------------------
+/*!
+ *  CnfFile needs a colormap. It is looked for as given, then next to the program and
+ *  in the directory above it (the source directory of qmga).
+ *  \return Path of the colormap, "" if there is none.
+ */
+string findColormap( const string &colorMap, const string &program )
+{
+    if( fileExists( colorMap ) ) { return( colorMap ); }
+    string::size_type slash = program.rfind( '/' );
+    string directory = ( slash == string::npos ) ? string( "." ) : program.substr( 0, slash );
+    string candidates[2] = { directory + "/" + colorMap, directory + "/../" + colorMap };
+    for( int c = 0; c < 2; ++c )
+    {
+	if( fileExists( candidates[c] ) ) { return( candidates[c] ); }
+    }
+    return( "" );
+}
+
+//-------------------------------------------------------------------------
+//------------- showHelp
+//-------------------------------------------------------------------------
+void showHelp()
+{
+    cerr << "Usage:" << endl;
+    cerr << "\tqmga-analyze [-f FILEFORMAT] [-c COLORMAP] [-o OUTFILE] [-b BINS] [-s GRID] [-t THREADS] [-q SELECTION] [-v FILE START STOP STEP] [FILES...]" << endl;
+    cerr << "eg:" << endl;
+    cerr << "\tqmga-analyze -f gbmega -v run.0000 0 5000 10 -s 64 -o run.table" << endl;
+    cerr << "\tqmga-analyze run.* > run.table" << endl;
+    cerr << "\tqmga-analyze -q \"sphere 0 0 0 10 and not type 1\" run.* > core.table" << endl;
+    cerr << "(NOTE: FILEFORMAT is one of gbmega, lammps1, lammps2, gbmegaBiax, cinacchi, default gbmega)" << endl;
+    cerr << "(NOTE: -v builds the file names like the video settings of qmga: the last extension of FILE is the zero padded frame number)" << endl;
+    cerr << "(NOTE: -b sets the bins of the histogram of angles to the director (default 9, 0 switches it off)," << endl;
+    cerr << "       -s GRID adds smectic order parameter and layer spacing from a GRID^3 structure factor," << endl;
+    cerr << "       -t sets the number of frames analysed at the same time (default: all cores)," << endl;
+    cerr << "       -q restricts the histogram to the molecules of a selection of the folded frame: box, sphere, halfspace," << endl;
+    cerr << "       type, cone, polarcone, id combined with and, or, not and parentheses, as in the selection of qmga)" << endl;
+    cerr << "(NOTE: frames that cannot be loaded are reported and skipped, the exit status is then 1)" << endl;
+}
@@ -0,0 +1,22 @@
+TEMPLATE	= app
+LANGUAGE	= C++
+TARGET		= qmga-analyze
+
+CONFIG	-= qt
+CONFIG	+= console warn_on release
+
+QMAKE_CXXFLAGS	+= -fopenmp
+QMAKE_LFLAGS	+= -fopenmp
+
+INCLUDEPATH	+= ..
+
+HEADERS	+= ../mga_tools.h \
+	../mga_analysis.h
+
+SOURCES	+= qmga-analyze.cpp \
+	../mga_tools.cpp \
+	../mga_analysis.cpp
+
+unix {
+  OBJECTS_DIR = .obj
+}
@@ -40,11 +40,23 @@ class SliceForm;
 class ColorForm;
 class DirectoryView;
 class PovrayForm;
+class PlotWidget;
 class QProcess;
 
 namespace mga
 {
   class CnfFile;  
+  class DirectorField;
+  class DefectFinder;
+  class IsoSurface;
+  class ClusterAnalysis;
+  class FrameDifference;
+  class Selection;
+  class StructureFactor;
+  class TimeCorrelation;
+  class BiaxialOrder;
+  class OrientationDistribution;
+  class AnalysisCache;
 }
 
 using std::vector;
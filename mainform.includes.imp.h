@@ -24,6 +24,7 @@
 
 //--------- my includes
 #include "mga_tools.h"
+#include "mga_analysis.h"
 #include "renderer.h"
 #include "colorform.h"
 #include "modelsform.h"	
@@ -31,11 +32,13 @@
 #include "aboutform.h"
 #include "sliceform.h"
 #include "PovForm.h"
+#include "plotwidget.h"
 
 //--------- STL includes
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <cmath>
 
 //--------- QT includes
 #include <qtimer.h>
@@ -46,6 +49,8 @@
 #include <qstatusbar.h>
 #include <qdockarea.h>
 #include <qsettings.h>
+#include <qinputdialog.h>
+#include <qcursor.h>
 #include <dirview.h>
 
 //--------- usings
@@ -80,6 +80,20 @@ void MainForm::init()
     sshRoot    = NULL;
     modelsForm = new ModelsForm( this );
     models     = new vector<vector<float> >;
+    directorField = new mga::DirectorField( 10 );
+    defectFinder  = new mga::DefectFinder( 0.3 );
+    isoSurface    = new mga::IsoSurface( 20 );
+    clusterAnalysis = new mga::ClusterAnalysis( 1.5, 90.0, -1 );
+    clusterMinSize  = 1;
+    clustersCalculated = false;
+    frameDifference = new mga::FrameDifference();
+    diffTopMovers   = 0;
+    selection       = new mga::Selection();
+    selectedMolecules = -1;
+    structureFactor = new mga::StructureFactor( 64 );
+    orientationDistribution = new mga::OrientationDistribution();
+    analysisCache   = new mga::AnalysisCache();
+    plotWindow      = NULL;
     
     modelNames << "ellipsoid" << "spherocylinder" << "spheroplatelet" << "cut sphere"<<"eyelens";
     modelsForm -> setModelNames( modelNames );
@@ -94,14 +108,27 @@ void MainForm::init()
     setDefaultModels();
     modelsForm -> setModelsVector( models );
     
-    gnuplot = new QProcess( QString("gnuplot"), this, "gnuplot" );
-    gnuplot -> addArgument( "-" );
-    
     QSettings settings;
     settings.insertSearchPath( QSettings::Windows, WINDOWS_REGISTRY );
     action_useDirector            -> setOn( settings.readBoolEntry( APP_KEY + "UseDirector", true ) );
     action_useUserDefined         -> setOn( settings.readBoolEntry( APP_KEY + "UseUserDefined", false ) );
     action_useColorByModel        -> setOn( settings.readBoolEntry( APP_KEY + "UseColorByModel", false ) );    
+    action_useLocalDirector       -> setOn( settings.readBoolEntry( APP_KEY + "UseLocalDirector", false ) );
+    action_useClusterColor        -> setOn( settings.readBoolEntry( APP_KEY + "UseClusterColor", false ) );
+    action_useDisplacementColor   -> setOn( settings.readBoolEntry( APP_KEY + "UseDisplacementColor", false ) );
+    diffByRotation                = settings.readBoolEntry( APP_KEY + "DiffByRotation", false );
+    action_toggleAnalysisCache    -> setOn( settings.readBoolEntry( APP_KEY + "AnalysisCache", true ) );
+    action_toggleMortonOrder      -> setOn( settings.readBoolEntry( APP_KEY + "MortonOrder", false ) );
+    directorField                 -> setResolution( settings.readNumEntry( APP_KEY + "LocalDirectorResolution", 10 ) );
+    defectFinder                  -> setOrderThreshold( settings.readDoubleEntry( APP_KEY + "DefectThreshold", 0.3 ) );
+    isoSurface                    -> setResolution( settings.readNumEntry( APP_KEY + "IsoResolution", 20 ) );
+    isoSurface                    -> setQuantity( settings.readNumEntry( APP_KEY + "IsoQuantity", mga::IsoSurface::LOCAL_ORDER ),
+						  settings.readNumEntry( APP_KEY + "IsoType", 0 ) );
+    isoSurface                    -> setIsoValue( settings.readDoubleEntry( APP_KEY + "IsoValue", 0.5 ) );
+    clusterAnalysis               -> setCutoff( settings.readDoubleEntry( APP_KEY + "ClusterCutoff", 1.5 ) );
+    clusterAnalysis               -> setMaximumAngle( settings.readDoubleEntry( APP_KEY + "ClusterAngle", 90.0 ) );
+    clusterAnalysis               -> setType( settings.readNumEntry( APP_KEY + "ClusterType", -1 ) );
+    structureFactor               -> setGridSize( settings.readNumEntry( APP_KEY + "StructureFactorGrid", 64 ) );
     action_toggleObjectsChangable -> setOn( settings.readBoolEntry( APP_KEY + "ObjectsChangable", false ) );
     action_toggleObjects          -> setOn( settings.readBoolEntry( APP_KEY + "Objects", true ) );
     if( action_toggleObjectsChangable -> isOn() ) { action_toggleObjects -> setEnabled( true ); }
@@ -112,6 +139,10 @@ void MainForm::init()
     updateModelsVector();
     
     toggleOptimized( action_toggleOptimized -> isOn() );
+    toggleInstancing( action_toggleInstancing -> isOn() );
+    toggleImpostors( action_toggleImpostors -> isOn() );
+    toggleOctree( action_toggleOctree -> isOn() );
+    toggleTimings( action_toggleTimings -> isOn() );
     toggleLOD      ( action_toggleLOD -> isOn()       );
     
     numberMeanFps = 1;
@@ -280,6 +311,7 @@ void MainForm::show()
     //cout << "MainForm::show mainform beg" << endl;
     initializeScene();
     initSliceWindow();
+    initPlotWindow();
     
     updateModelsLineEdits( false );
     
@@ -344,6 +376,7 @@ void MainForm::show()
     
     spinBox_zoom     -> setValue( settings.readNumEntry( APP_KEY + "Zoom" , 16 ) );
     spinBox_lineSize -> setValue( settings.readNumEntry( APP_KEY + "LineSize" , 0 ) );
+    spinBox_frameBudget -> setValue( settings.readNumEntry( APP_KEY + "FrameBudget" , 40 ) );
     
     showCalled = true;
     
@@ -371,7 +404,7 @@ bool MainForm::newInputFile( QString newFile, bool reloadSameName )
     if( (cnfFile != newFile || reloadSameName) && newFile != "" )
     {
 	//cnf -> setColorScheme( "director" );
-	if( (cnf -> reloadCnfFile( newFile )) == true )
+	if( reloadFrame( newFile ) == true )
 	{
 	    //toggleFold();
 	    cnf -> setShowFolded( action_toggleFold->isOn() );
@@ -466,9 +499,13 @@ void MainForm::initializeScene()
     if     ( action_useUserDefined  -> isOn() ) {  colorschemeTmp = "userDefined"; }
     else if( action_useDirector     -> isOn() ) {  colorschemeTmp = "director";    }
     else if( action_useColorByModel -> isOn() ) {  colorschemeTmp = "byModel";     }
+    else if( action_useLocalDirector-> isOn() ) {  colorschemeTmp = "director";    } // field is set in changeColorisation()
+    else if( action_useClusterColor -> isOn() ) {  colorschemeTmp = "director";    } // field is set in changeColorisation()
+    else if( action_useDisplacementColor -> isOn() ) {  colorschemeTmp = "director"; } // field is set in changeColorisation()
     
     string tmpFile = cnfFile;
     cnf = new CnfFile( tmpFile, comboBox_fileType->currentItem(), colorschemeTmp, colorMap );
+    clustersCalculated = false;
     cnfFile = tmpFile;
     lineEditFileOpen -> setText( cnfFile );
     updateHistory( cnfFile );
@@ -478,6 +515,7 @@ void MainForm::initializeScene()
     
     connect( action_toggleFold, SIGNAL(toggled(bool)), this, SLOT(toggleFold()) );
     cnf -> setShowFolded( action_toggleFold->isOn() );
+    cnf -> setMortonOrder( action_toggleMortonOrder -> isOn() );
     //toggleFold();
     
     
@@ -553,6 +591,13 @@ void MainForm::paintScene( bool resetDistance, bool blockRepaint )
     //cout << "MainForm::paintScene blockRepaint: " << blockRepaint << endl;
     
     fillModelVectors();
+    if( action_translate -> isOn() )
+    {
+	glWindow -> setBoxMatrix( cnf->getBoundingBoxMatrix(), float(spinBox_translateX->value()) / 10.0,
+							       float(spinBox_translateY->value()) / 10.0,
+							       float(spinBox_translateZ->value()) / 10.0 );
+    }
+    else { glWindow -> setBoxMatrix( cnf->getBoundingBoxMatrix(), 0.0, 0.0, 0.0 ); }
     glWindow -> setModels( middle, rot, color, modelType, cnf->getBoxX(), cnf->getBoxY(), cnf->getBoxZ() );
     
     vector<vector<float> > tmpBox = cnf->getBoundingBoxCoordinates();
@@ -571,6 +616,12 @@ void MainForm::paintScene( bool resetDistance, bool blockRepaint )
     glWindow -> setBoundingBox( tmpBox, resetDistance );
     //glWindow -> setBoundingBox( cnf->getBoundingBoxCoordinates(), resetDistance );
     
+    if( action_toggleDefects -> isOn() ) { updateDefectLines(); }
+    if( action_toggleIsoSurface -> isOn() ) { updateIsoSurface(); }
+    if( action_toggleOrientationGlyph -> isOn() ) { updateOrientationGlyph(); }
+    updateModelMask();
+    updateSmecticPlot();
+    
     if( blockRepaint == false ) 
     {
 	glWindow -> repaint(); 
@@ -645,7 +696,6 @@ void MainForm::fillModelVectors()
     if( fold ) { cnf -> foldMoleculesToBoundingBox(); } 
     
     MoleculeBiax *mc = NULL;
-    vector<double> r;
     for( int i = 0; i < numMolecules; i++ ) 
     {
 	mc = cnf -> getMolecule(i);
@@ -676,12 +726,11 @@ void MainForm::fillModelVectors()
 	color->at(i)->at(2) = (float) ( mc -> getBlue()/255.0f  );
 	
 	// INITIAL OPENGL AXES: camera looks down -Z with Y upwards 
-	r = mc->QuaternionToAxisAngle();
-	
-	rot->at(i)->at(0) = r[0]; 
-	rot->at(i)->at(1) = r[1]; 
-	rot->at(i)->at(2) = r[2];
-	rot->at(i)->at(3) = r[3]; 
+	// the renderer rotates with the quaternion itself (x, y, z, w), no axis/angle conversion
+	rot->at(i)->at(0) = (float) ( mc -> getOrientationXQ() ); 
+	rot->at(i)->at(1) = (float) ( mc -> getOrientationYQ() ); 
+	rot->at(i)->at(2) = (float) ( mc -> getOrientationZQ() );
+	rot->at(i)->at(3) = (float) ( mc -> getOrientationW()  ); 
 	
 	if( !action_toggleObjectsChangable -> isOn() ) { modelType -> at(i) = mc -> getType(); }
 	else if( !action_toggleObjects -> isOn() )     { modelType -> at(i) = 0;               }
@@ -774,6 +823,28 @@ void MainForm::toggleFold()
     //cout << "MainForm::toggleFold end" << endl;
 }
 
+//-------------------------------------------------------------------------
+//------------- toggleMortonOrder
+//-------------------------------------------------------------------------
+/*!
+ *  Sorts the molecules along a Z-order curve (or back into file order). The grid boxes
+ *  of the renderer and the cell based analysis then walk through memory in order.
+ */
+void MainForm::toggleMortonOrder( bool state )
+{
+    //cout << "MainForm::toggleMortonOrder beg" << endl;
+    if( cnf == 0 ) { return; }
+    statusBar()->message( state ? "molecules sorted along a Z-order curve." : "molecules in file order.", 3000 );
+    cnf -> setMortonOrder( state );
+    clustersCalculated = false;
+    buildScene( false, true );
+    forceChangeColorization = true;                                       // per molecule color fields follow the new order
+    changeColorisation();
+    forceChangeColorization = false;
+    glWindow -> repaint();
+    //cout << "MainForm::toggleMortonOrder end" << endl;
+}
+
 //-------------------------------------------------------------------------
 //------------- changeColorisation
 //-------------------------------------------------------------------------
@@ -821,8 +892,69 @@ void MainForm::changeColorisation()
 	y=0;
 	z=0;
     }
+    else if( action_useLocalDirector -> isOn() )
+    {
+	statusBar()->message( "switch to local director as color axis.", 3000 );
+	if( directorField -> calculate( cnf ) == true )
+	{
+	    vector<double> angles;
+	    directorField -> getAlignmentAngles( cnf, angles );
+	    cnf -> setColorField( angles, 0.0, 90.0 );
+	    cnf -> setColorScheme( "field" );
+	}
+	else
+	{
+	    cnf -> setColorScheme( "director" );
+	}
+	x=0;
+	y=0;
+	z=0;
+    }
+    else if( action_useClusterColor -> isOn() )
+    {
+	statusBar()->message( "switch to clusters for colorization.", 3000 );
+	if( calculateClusters() == true )
+	{
+	    // golden ratio steps give neighboring cluster ids well separated colors
+	    vector<double> field( cnf -> getNumberOfMolecules(), 0.0 );
+	    for( uint i = 0; i < field.size(); ++i )
+	    {
+		int id = clusterAnalysis -> getClusterOfMolecule(i);
+		if( id >= 0 ) { field.at(i) = fmod( id * 0.6180339887, 1.0 ); }
+	    }
+	    cnf -> setColorField( field, 0.0, 1.0 );
+	    cnf -> setColorScheme( "field" );
+	}
+	else
+	{
+	    cnf -> setColorScheme( "director" );
+	}
+	x=0;
+	y=0;
+	z=0;
+    }
+    else if( action_useDisplacementColor -> isOn() )
+    {
+	if( frameDifference -> calculate( cnf ) == true )
+	{
+	    statusBar()->message( QString( "switch to %1 since %2 for colorization." ).arg( diffByRotation ? "rotation" : "displacement" )
+				  .arg( frameDifference -> getReferenceName() ), 3000 );
+	    double maximum = frameDifference -> getMaximum( diffByRotation );
+	    cnf -> setColorField( diffByRotation ? frameDifference -> getRotations() : frameDifference -> getDisplacements(),
+				  0.0, maximum > 0.0 ? maximum : 1.0 );
+	    cnf -> setColorScheme( "field" );
+	}
+	else
+	{
+	    statusBar()->message( "no reference frame, see Analysis - Set Reference Frame.", 3000 );
+	    cnf -> setColorScheme( "director" );
+	}
+	x=0;
+	y=0;
+	z=0;
+    }
     
-    if( x != xOld || y != yOld || z != zOld || action_useColorByModel -> isOn() || forceChangeColorization )
+    if( x != xOld || y != yOld || z != zOld || action_useColorByModel -> isOn() || action_useLocalDirector -> isOn() || action_useClusterColor -> isOn() || action_useDisplacementColor -> isOn() || forceChangeColorization )
     {
 	xOld = x;
 	yOld = y;
@@ -1238,6 +1370,108 @@ void MainForm::toggleOptimized( bool state )
     //cout << "MainForm::toggleOptimized end" << endl;
 }
 
+//-------------------------------------------------------------------------
+//------------- toggleInstancing
+//-------------------------------------------------------------------------
+/*!
+ *  Switches between instanced drawing and one display list call per object.
+ *  \param state true to draw all objects of a type with one call.
+ */
+void MainForm::toggleInstancing( bool state )
+{
+    //cout << "MainForm::toggleInstancing beg" << endl;
+    statusBar()->message( state ? "switch instanced drawing on." : "switch instanced drawing off.", 3000 );
+    glWindow->setInstancing(state);
+    //cout << "MainForm::toggleInstancing end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- toggleImpostors
+//-------------------------------------------------------------------------
+/*!
+ *  Switches between meshes and ray-cast impostors for ellipsoids,
+ *  spherocylinders and spheroplatelets.
+ *  \param state true to ray cast the objects per pixel.
+ */
+void MainForm::toggleImpostors( bool state )
+{
+    //cout << "MainForm::toggleImpostors beg" << endl;
+    statusBar()->message( state ? "switch ray-cast impostors on." : "switch ray-cast impostors off.", 3000 );
+    glWindow->setImpostors(state);
+    //cout << "MainForm::toggleImpostors end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- toggleOctree
+//-------------------------------------------------------------------------
+/*!
+ *  Switches between the uniform grid and the adaptive octree, which the
+ *  optimized drawing and the culling work on.
+ *  \param state true to use the octree.
+ */
+void MainForm::toggleOctree( bool state )
+{
+    //cout << "MainForm::toggleOctree beg" << endl;
+    statusBar()->message( state ? "switch adaptive octree on." : "switch adaptive octree off.", 3000 );
+    glWindow->setOctree(state);
+    //cout << "MainForm::toggleOctree end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- toggleTimings
+//-------------------------------------------------------------------------
+/*!
+ *  Shows or hides the CPU and GPU time of every stage of the last frame
+ *  (input, camera, models, culling, draw, bounding box, overlay) in the view.
+ *  \param state true to show the timings.
+ */
+void MainForm::toggleTimings( bool state )
+{
+    //cout << "MainForm::toggleTimings beg" << endl;
+    glWindow->setDrawTimings(state);
+    //cout << "MainForm::toggleTimings end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- toggleTimingLog
+//-------------------------------------------------------------------------
+/*!
+ *  Asks for a file and logs the stage times of every frame to it, or stops
+ *  logging. A file ending with .json gets one JSON object per frame, any
+ *  other a CSV table.
+ *  \param state true to start logging.
+ */
+void MainForm::toggleTimingLog( bool state )
+{
+    //cout << "MainForm::toggleTimingLog beg" << endl;
+    if( !state )
+    {
+	glWindow -> setTimingLog( QString::null );
+	return;
+    }
+    
+    QString file = QFileDialog::getSaveFileName( "./qmga-timings.csv",
+						 "Timing Logs (*.csv *.json)",
+						 this,
+						 "timing log",
+						 "Choose Filename - .json writes JSON, anything else CSV" );
+    if( file.isEmpty() )
+    {
+	action_toggleTimingLog -> setOn( false );
+	return;
+    }
+    if( glWindow -> setTimingLog( file ) == false )
+    {
+	action_toggleTimingLog -> setOn( false );
+	QMessageBox::warning( this, "QMGA -- Warning",
+			      "Warning: cannot write the timing log\n" + file + "\n\n",
+			      "OK" );
+	return;
+    }
+    statusBar()->message( "logging the frame timings to " + file, 3000 );
+    //cout << "MainForm::toggleTimingLog end" << endl;
+}
+
 //-------------------------------------------------------------------------
 //------------- toggleLOD
 //-------------------------------------------------------------------------
@@ -1663,6 +1897,7 @@ void MainForm::fileExit()
 {
     //cout << "MainForm::fileExit beg" << endl;
     saveSettings();
+    analysisCache -> flush();
     QApplication::exit( 0 );
     //cout << "MainForm::fileExit end" << endl;
 }
@@ -2059,23 +2294,14 @@ void MainForm::videoNextScene()
     //cout << "MainForm::videoNextScene beg" << endl;
     if( lineEdit_videoFile -> text() == "" ) { return; }
     QString fileName = "";
-    QString tmpNum   = "";
-    QString strMask  = "";
     statusBar() -> message( "animation running." );
     
     if( videoCount >= videoStartVal && videoCount <= videoStopVal )
     {
-	fileName  = lineEdit_videoFile -> text();
-	fileName  . truncate( fileName.findRev(".") );
-	tmpNum    . sprintf( "%u", videoCount );
-	strMask   = lineEdit_videoFile -> text() . section('.', -1, -1 );
-	strMask   . fill('0');
-	strMask   . truncate( strMask.length() - tmpNum.length() );
-	fileName += '.' + strMask + tmpNum;
-	
+	fileName = videoFileName( videoCount );
 	
 	cnf -> setColorScheme( "director" );
-	if( (cnf -> reloadCnfFile( fileName )) == true )
+	if( reloadFrame( fileName ) == true )
 	{  
 	    QString tmp = "";
 	    cnfFile = fileName;
@@ -2131,6 +2357,33 @@ void MainForm::videoNextScene()
     //cout << "MainForm::videoNextScene end" << endl;
 }
 
+//-------------------------------------------------------------------------
+//------------- videoFileName
+//-------------------------------------------------------------------------
+/*!
+ *  Builds the name of a trajectory file from the file given in the video section.
+ *  The extension of that file is replaced by the given number, padded with zeros to the same length.
+ *  \param number Number of the frame.
+ *  \return Name of the file.
+ */
+QString MainForm::videoFileName( unsigned int number )
+{
+    //cout << "MainForm::videoFileName beg" << endl;
+    QString fileName = lineEdit_videoFile -> text();
+    QString tmpNum   = "";
+    QString strMask  = "";
+    
+    fileName  . truncate( fileName.findRev(".") );
+    tmpNum    . sprintf( "%u", number );
+    strMask   = lineEdit_videoFile -> text() . section('.', -1, -1 );
+    strMask   . fill('0');
+    strMask   . truncate( strMask.length() - tmpNum.length() );
+    fileName += '.' + strMask + tmpNum;
+    
+    //cout << "MainForm::videoFileName end" << endl;
+    return( fileName );
+}
+
 //-------------------------------------------------------------------------
 //------------- videoCapture
 //-------------------------------------------------------------------------
@@ -2334,6 +2587,10 @@ void MainForm::saveSettings()
     settings.writeEntry( APP_KEY + "Colormap"        , action_toggleColormap         -> isOn() );
     settings.writeEntry( APP_KEY + "Fold"            , action_toggleFold             -> isOn() );
     settings.writeEntry( APP_KEY + "Optimized"       , action_toggleOptimized        -> isOn() );
+    settings.writeEntry( APP_KEY + "Instancing"      , action_toggleInstancing       -> isOn() );
+    settings.writeEntry( APP_KEY + "Impostors"       , action_toggleImpostors        -> isOn() );
+    settings.writeEntry( APP_KEY + "Octree"          , action_toggleOctree           -> isOn() );
+    settings.writeEntry( APP_KEY + "Timings"         , action_toggleTimings          -> isOn() );
     settings.writeEntry( APP_KEY + "Lod"             , action_toggleLOD              -> isOn() );
     settings.writeEntry( APP_KEY + "Png"             , action_togglePng              -> isOn() );
     settings.writeEntry( APP_KEY + "Eps"             , action_toggleEps              -> isOn() );
@@ -2342,6 +2599,22 @@ void MainForm::saveSettings()
     settings.writeEntry( APP_KEY + "UseDirector"     , action_useDirector            -> isOn() );
     settings.writeEntry( APP_KEY + "UseUserDefined"  , action_useUserDefined         -> isOn() );
     settings.writeEntry( APP_KEY + "UseColorByModel" , action_useColorByModel        -> isOn() );
+    settings.writeEntry( APP_KEY + "UseLocalDirector", action_useLocalDirector       -> isOn() );
+    settings.writeEntry( APP_KEY + "UseClusterColor" , action_useClusterColor        -> isOn() );
+    settings.writeEntry( APP_KEY + "UseDisplacementColor", action_useDisplacementColor -> isOn() );
+    settings.writeEntry( APP_KEY + "DiffByRotation"  , diffByRotation );
+    settings.writeEntry( APP_KEY + "AnalysisCache"   , action_toggleAnalysisCache    -> isOn() );
+    settings.writeEntry( APP_KEY + "MortonOrder"     , action_toggleMortonOrder      -> isOn() );
+    settings.writeEntry( APP_KEY + "LocalDirectorResolution", directorField -> getResolution() );
+    settings.writeEntry( APP_KEY + "DefectThreshold", defectFinder -> getOrderThreshold() );
+    settings.writeEntry( APP_KEY + "IsoResolution"  , isoSurface -> getResolution() );
+    settings.writeEntry( APP_KEY + "IsoQuantity"    , isoSurface -> getQuantity() );
+    settings.writeEntry( APP_KEY + "IsoType"        , isoSurface -> getType() );
+    settings.writeEntry( APP_KEY + "IsoValue"       , isoSurface -> getIsoValue() );
+    settings.writeEntry( APP_KEY + "ClusterCutoff"  , clusterAnalysis -> getCutoff() );
+    settings.writeEntry( APP_KEY + "ClusterAngle"   , clusterAnalysis -> getMaximumAngle() );
+    settings.writeEntry( APP_KEY + "ClusterType"    , clusterAnalysis -> getType() );
+    settings.writeEntry( APP_KEY + "StructureFactorGrid", structureFactor -> getGridSize() );
     
     settings.writeEntry( APP_KEY + "ObjectsChangable", action_toggleObjectsChangable -> isOn() );
     settings.writeEntry( APP_KEY + "Objects"         , action_toggleObjects          -> isOn() );
@@ -2422,6 +2695,8 @@ void MainForm::saveSettings()
     
     settings.writeEntry( APP_KEY + "LineSize" ,spinBox_lineSize -> value() );
     
+    settings.writeEntry( APP_KEY + "FrameBudget" ,spinBox_frameBudget -> value() );
+    
     if( colorForm != 0 )
     {
 	float red = 0.0, green = 0.0, blue = 0.0;
@@ -2471,6 +2746,7 @@ void MainForm::saveSettings()
     
     settings.writeEntry( APP_KEY + "TreeSideBar", treeWindow -> isShown() );
     settings.writeEntry( APP_KEY + "SliceSideBar", sliceWindow -> isShown() );
+    settings.writeEntry( APP_KEY + "PlotSideBar", plotWindow -> isShown() );
     //cout << "MainForm::saveSettings end" << endl;
 }
 
@@ -2508,6 +2784,10 @@ void MainForm::loadSettings()
     action_toggleColormap    -> setOn( settings.readBoolEntry( APP_KEY + "Colormap"    , true  ) );
     action_toggleFold        -> setOn( settings.readBoolEntry( APP_KEY + "Fold"        , false ) );
     action_toggleOptimized   -> setOn( settings.readBoolEntry( APP_KEY + "Optimized"   , false ) );
+    action_toggleInstancing  -> setOn( settings.readBoolEntry( APP_KEY + "Instancing"  , true  ) );
+    action_toggleImpostors   -> setOn( settings.readBoolEntry( APP_KEY + "Impostors"   , false ) );
+    action_toggleOctree      -> setOn( settings.readBoolEntry( APP_KEY + "Octree"      , false ) );
+    action_toggleTimings     -> setOn( settings.readBoolEntry( APP_KEY + "Timings"     , false ) );
     action_toggleLOD         -> setOn( settings.readBoolEntry( APP_KEY + "Lod"         , true  ) );
     action_togglePng         -> setOn( settings.readBoolEntry( APP_KEY + "Png"         , true  ) );
     action_toggleEps         -> setOn( settings.readBoolEntry( APP_KEY + "Eps"         , false ) );
@@ -2697,6 +2977,21 @@ void MainForm::lineSizeChanged( int lineSize )
     //cout << "MainForm::lineSizeChanged end" << endl;
 }
 
+//-------------------------------------------------------------------------
+//------------- frameBudgetChanged
+//-------------------------------------------------------------------------
+/*!
+ *  Slot to call, when the time a frame may take is changed. The auto LOD
+ *  adjusts the detail of the models to it.
+ *  \param ms Frame time budget in milliseconds.
+ */
+void MainForm::frameBudgetChanged( int ms )
+{
+    //cout << "MainForm::frameBudgetChanged beg" << endl;
+    glWindow -> setFrameTimeBudget( ms );
+    //cout << "MainForm::frameBudgetChanged end" << endl;
+}
+
 /*
 //-------------------------------------------------------------------------
 //------------- moveEvent
@@ -2741,6 +3036,7 @@ void MainForm::setConnections()
     connect( glWindow, SIGNAL(keyPress(int))           , this, SLOT(slotKeyPress(int)) );
     connect( glWindow, SIGNAL(dropAccepted(QString))   , this, SLOT(dropInRenderArea(QString)) );
     connect( glWindow, SIGNAL(fpsUpdate(double))       , this, SLOT(updateFps(double)) );
+    connect( glWindow, SIGNAL(culledBoxesUpdate(int))  , this, SLOT(updateCulledBoxes(int)) );
     connect( glWindow, SIGNAL(translate(vector<float>)), this, SLOT(updateTranslationBoxes(vector<float>)) );
     
     connect( action_fileOpen              , SIGNAL(activated())  , this, SLOT(fileOpen()) );
@@ -2759,6 +3055,12 @@ void MainForm::setConnections()
     connect( action_toggleView            , SIGNAL(toggled(bool)), this, SLOT(toggleView()) );
     connect( action_toggleOpenSave        , SIGNAL(toggled(bool)), this, SLOT(toggleOpenSave()) );
     connect( action_toggleOptimized       , SIGNAL(toggled(bool)), this, SLOT(toggleOptimized(bool)) );
+    connect( action_toggleInstancing      , SIGNAL(toggled(bool)), this, SLOT(toggleInstancing(bool)) );
+    connect( action_toggleImpostors       , SIGNAL(toggled(bool)), this, SLOT(toggleImpostors(bool)) );
+    connect( action_toggleOctree          , SIGNAL(toggled(bool)), this, SLOT(toggleOctree(bool)) );
+    connect( action_toggleTimings         , SIGNAL(toggled(bool)), this, SLOT(toggleTimings(bool)) );
+    connect( action_toggleTimingLog       , SIGNAL(toggled(bool)), this, SLOT(toggleTimingLog(bool)) );
+    connect( action_toggleMortonOrder     , SIGNAL(toggled(bool)), this, SLOT(toggleMortonOrder(bool)) );
     connect( action_toggleLOD             , SIGNAL(toggled(bool)), this, SLOT(toggleLOD(bool)) );
     connect( action_togglePixel           , SIGNAL(activated())  , this, SLOT(togglePixel()) );
     connect( action_togglePosition        , SIGNAL(toggled(bool)), this, SLOT(togglePosition()) );
@@ -2783,6 +3085,27 @@ void MainForm::setConnections()
     connect( action_openHist_3            , SIGNAL(activated())  , this, SLOT(loadOpenHist_3()) );
     connect( action_openHist_4            , SIGNAL(activated())  , this, SLOT(loadOpenHist_4()) );
     connect( action_saveHistogram         , SIGNAL(activated())  , this, SLOT(printHistogram()) );
+    connect( action_pairDistribution      , SIGNAL(activated())  , this, SLOT(printPairDistribution()) );
+    connect( action_timeCorrelation       , SIGNAL(activated())  , this, SLOT(printTimeCorrelation()) );
+    connect( action_biaxialOrder          , SIGNAL(activated())  , this, SLOT(printBiaxialOrder()) );
+    connect( action_toggleOrientationGlyph, SIGNAL(toggled(bool)), this, SLOT(toggleOrientationGlyph(bool)) );
+    connect( action_orientationSeries     , SIGNAL(activated())  , this, SLOT(printOrientationDistribution()) );
+    connect( action_clearAnalysisCache    , SIGNAL(activated())  , this, SLOT(clearAnalysisCache()) );
+    connect( action_localDirectorResolution, SIGNAL(activated()) , this, SLOT(setLocalDirectorResolution()) );
+    connect( action_exportDirectorField   , SIGNAL(activated())  , this, SLOT(exportDirectorField()) );
+    connect( action_toggleDefects         , SIGNAL(toggled(bool)), this, SLOT(toggleDefects(bool)) );
+    connect( action_defectThreshold       , SIGNAL(activated())  , this, SLOT(setDefectThreshold()) );
+    connect( action_toggleMolecules       , SIGNAL(toggled(bool)), this, SLOT(toggleMolecules(bool)) );
+    connect( action_toggleIsoSurface      , SIGNAL(toggled(bool)), this, SLOT(toggleIsoSurface(bool)) );
+    connect( action_isoSurfaceSettings    , SIGNAL(activated())  , this, SLOT(setIsoSurfaceParameters()) );
+    connect( action_clusterAnalysis       , SIGNAL(activated())  , this, SLOT(printClusters()) );
+    connect( action_clusterFilter         , SIGNAL(activated())  , this, SLOT(setClusterFilter()) );
+    connect( action_setDiffReference      , SIGNAL(activated())  , this, SLOT(setDiffReference()) );
+    connect( action_frameDifference       , SIGNAL(activated())  , this, SLOT(setFrameDifference()) );
+    connect( action_setSelection          , SIGNAL(activated())  , this, SLOT(setSelection()) );
+    connect( action_toggleSmecticWindow   , SIGNAL(toggled(bool)), this, SLOT(toggleSmecticWindow()) );
+    connect( action_smecticSeries         , SIGNAL(activated())  , this, SLOT(smecticSeries()) );
+    connect( action_structureFactorGrid   , SIGNAL(activated())  , this, SLOT(setStructureFactorGrid()) );
     connect( action_loadModelsFile        , SIGNAL(activated())  , this, SLOT(openModelsFile()) );
     connect( action_saveModelsFile        , SIGNAL(activated())  , this, SLOT(saveModelsFile()) );
     connect( action_translate             , SIGNAL(toggled(bool)), this, SLOT(translate()) );
@@ -2896,6 +3219,7 @@ void MainForm::setConnections()
     connect( modelsForm, SIGNAL(modelDataChanged(bool)), this, SLOT(updateModelsLineEdits(bool)) );
     
     connect( spinBox_lineSize, SIGNAL(valueChanged(int)), this, SLOT(lineSizeChanged(int)) );
+    connect( spinBox_frameBudget, SIGNAL(valueChanged(int)), this, SLOT(frameBudgetChanged(int)) );
     
     //cout << "MainForm::setConnections end" << endl;
 }
@@ -3685,96 +4009,1159 @@ void MainForm::loadOpenHist_4()
 //------------- printHistogram()
 //-------------------------------------------------------------------------
 /*!
- *  Opens gnuplot with a histogram of the current colors.
- *  Also writes a file in the current working directory called like the file + ".hist"
+ *  Writes a histogram of the current colors to a data file
+ *  in the current working directory called like the file + ".hist"
  *  \author Adrian Gabriel 
  *  \date Apr 2007
  */
 void MainForm::printHistogram()
 {
     //cout << "MainForm::printHistogram beg" << endl;
+    if( cnf == 0 ) { return; }
     QString hist = QString("./") + cnfFile.section( '/', -1 ) + ".hist";
-    ofstream out( hist );
-    if( out.is_open() )
+    
+    vector<int> colorHist( cnf -> getNumberOfColorsInMap(), 0 );
+    Molecule *mc = NULL;
+    for( int i = 0; i < cnf -> getNumberOfMolecules(); i++ ) 
+    {
+	mc = cnf -> getMolecule(i);
+	
+	colorHist.at( mc -> getColorIndex() )++;
+    }
+    
+    float mean = 0.0, num  = 0.0;
+    vector<string> names;
+    vector<vector<double> > columns( 2 );
+    names.push_back( "Angle" );
+    names.push_back( "Frequency" );
+    for( unsigned int i = 0; i<colorHist.size(); i++ )
+    {
+	mean += i * colorHist.at(i);
+	num  += colorHist.at(i);
+	columns.at(0).push_back( i + 0.5 );
+	columns.at(1).push_back( colorHist.at(i)/double(cnf -> getNumberOfMolecules()) );
+    }
+    
+    QString comment = "file: " + cnfFile + "  mean = " + QString::number( mean/num );
+    if( mga::writeDataFile( hist, comment, names, columns ) == true )
     {
-	vector<int> colorHist( cnf -> getNumberOfColorsInMap(), 0 );
-	Molecule *mc = NULL;
-	for( int i = 0; i < cnf -> getNumberOfMolecules(); i++ ) 
-	{
-	    mc = cnf -> getMolecule(i);
-	    
-	    colorHist.at( mc -> getColorIndex() )++;
-	}	
-	float mean = 0.0, num  = 0.0;	
-	out << "# file: " << cnfFile << endl;
-	out << "#" << right << setw(5) << "Angle" << setw(10) << "Frequency" << endl;
-	for( unsigned int i = 0; i<colorHist.size(); i++ )
-	{
-	    mean += i * colorHist.at(i);
-	    num  += colorHist.at(i);
-	    out << right << setw(5) << i + 0.5 << setw(3) << "" << left << setw(10) << setprecision(5) << colorHist.at(i)/double(cnf -> getNumberOfMolecules()) << endl;
-	}
-	out << "# mean = " << mean/num << endl << endl;
-	out.close();
 	statusBar() -> message( QString("Wrote: ") + hist );
+    }
+    else
+    {
+	statusBar() -> message( QString("ERROR: Cannot write file: ") + hist );
+    }
+    //cout << "MainForm::printHistogram end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- printPairDistribution()
+//-------------------------------------------------------------------------
+/*!
+ *  Calculates the pair distribution functions g(r), g_par(r) and g_perp(r) with respect to the director
+ *  and writes them to a file in the current working directory called like the file + ".gr".
+ *  If the video settings are filled in, the functions can be averaged over all frames given there.
+ */
+void MainForm::printPairDistribution()
+{
+    //cout << "MainForm::printPairDistribution beg" << endl;
+    if( cnf == 0 || videoStartPressed ) { return; }
+    
+    bool ok = false;
+    double rMax = QInputDialog::getDouble( "QMGA - pair distribution", "Maximum distance r:", 5.0, 0.1, 1000.0, 2, &ok, this );
+    if( !ok ) { return; }
+    
+    mga::PairDistribution pairDistribution( rMax );
+    QString grFile  = "";
+    QString comment = "";
+    
+    bool rangeGiven = ( lineEdit_videoFile  -> text() != "" && lineEdit_videoStart -> text() != "" && 
+			lineEdit_videoStop  -> text() != "" && lineEdit_videoStep  -> text() != ""    );
+    
+    if( rangeGiven && QMessageBox::question( this,
+					     "QMGA - pair distribution",
+					     "Average over all frames given in the video settings?",
+					     QMessageBox::Yes, QMessageBox::No ) == QMessageBox::Yes ) 
+    {
+	unsigned int start = lineEdit_videoStart -> text().toUInt();
+	unsigned int stop  = lineEdit_videoStop  -> text().toUInt();
+	unsigned int step  = lineEdit_videoStep  -> text().toUInt();
+	if( step == 0 ) { step = 1; }
 	
-	if( gnuplot -> isRunning() == false ) { gnuplot -> start(); }
-	if( gnuplot -> isRunning() == true  )
+	QApplication::setOverrideCursor( QCursor( Qt::WaitCursor ) );
+	for( unsigned int frame = start; frame <= stop; frame += step )
 	{
-	    // gnuplot -> writeToStdin( "set terminal x11 enhanced\n" );	    
-	    gnuplot -> writeToStdin( "set grid; set xlabel '|theta|'; set ylabel 'P(|theta|)'\n" );
-	    gnuplot -> writeToStdin( "p '" + hist + "' w histeps\n" );
-	    deleteHistogram( hist );
+	    QString fileName = videoFileName( frame );
+	    if( cnf -> reloadCnfFile( fileName ) == true )
+	    {
+		pairDistribution.addFrame( cnf );
+		statusBar() -> message( "pair distribution: " + fileName );
+		qApp -> processEvents();
+	    }
+	    else { cerr << "Warning: could not load file: " << fileName << endl; }
 	}
+	QApplication::restoreOverrideCursor();
+	newInputFile( cnfFile, RELOADSAME );                                       // restore the displayed frame
+	
+	grFile  = QString("./") + videoFileName( start ).section( '/', -1 ) + ".gr";
+	comment = "files: " + videoFileName( start ) + " ... " + videoFileName( stop );
     }
     else
     {
-	cerr << "ERROR: Cannot write file: " << hist << endl;
-	statusBar() -> message( QString("ERROR: Cannot write file: ") + hist );
+	pairDistribution.addFrame( cnf );
+	grFile  = QString("./") + cnfFile.section( '/', -1 ) + ".gr";
+	comment = "file: " + cnfFile;
     }
-    //cout << "MainForm::printHistogram end" << endl;
+    
+    if( pairDistribution.getNumberOfFrames() > 0 && pairDistribution.writeDataFile( grFile, comment ) == true )
+    {
+	statusBar() -> message( QString("Wrote: ") + grFile );
+    }
+    else
+    {
+	cerr << "ERROR: Cannot calculate pair distribution or write file: " << grFile << endl;
+	statusBar() -> message( QString("ERROR: Cannot write file: ") + grFile );
+    }
+    //cout << "MainForm::printPairDistribution end" << endl;
 }
 
 //-------------------------------------------------------------------------
-//------------- deleteHistogram
+//------------- printBiaxialOrder()
 //-------------------------------------------------------------------------
 /*!
- *  Opens a dialog and asks if given file is to be deleted.
- *  \param histFile Filename of the histogram file in question.
- *  \author Adrian Gabriel 
- *  \date Apr 2007
+ *  Shows the directors and order parameters of mga::BiaxialOrder for the current frame.
+ */
+void MainForm::printBiaxialOrder()
+{
+    //cout << "MainForm::printBiaxialOrder beg" << endl;
+    mga::BiaxialOrder biaxialOrder;
+    if( cnf == 0 || biaxialOrder.calculate( cnf ) == false ) { return; }
+    
+    double n[3], m[3];
+    biaxialOrder.getPrimaryDirector( n );
+    biaxialOrder.getSecondaryDirector( m );
+    QString text = QString( "file: %1\n\n" ).arg( cnfFile )
+	+ QString( "primary director Z:    ( %1, %2, %3 )\n" ).arg( n[0], 0, 'f', 4 ).arg( n[1], 0, 'f', 4 ).arg( n[2], 0, 'f', 4 )
+	+ QString( "secondary director X:  ( %1, %2, %3 )\n\n" ).arg( m[0], 0, 'f', 4 ).arg( m[1], 0, 'f', 4 ).arg( m[2], 0, 'f', 4 )
+	+ QString( "S = %1\nP = %2\nD = %3\nC = %4\n\n" ).arg( biaxialOrder.getOrderS(), 0, 'f', 4 ).arg( biaxialOrder.getOrderP(), 0, 'f', 4 )
+	                                             .arg( biaxialOrder.getOrderD(), 0, 'f', 4 ).arg( biaxialOrder.getOrderC(), 0, 'f', 4 )
+	+ QString( "largest eigenvalues of Q_x, Q_y, Q_z: %1, %2, %3" ).arg( biaxialOrder.getAxisOrder(0), 0, 'f', 4 )
+	                                             .arg( biaxialOrder.getAxisOrder(1), 0, 'f', 4 ).arg( biaxialOrder.getAxisOrder(2), 0, 'f', 4 );
+    cout << text.ascii() << endl;
+    QMessageBox::information( this, "QMGA -- Biaxial Order", text );
+    //cout << "MainForm::printBiaxialOrder end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- reloadFrame
+//-------------------------------------------------------------------------
+/*!
+ *  Loads a configuration file into cnf. With the analysis cache switched on, a director
+ *  known from an earlier visit of the file is handed to cnf instead of calculating it again,
+ *  a calculated one is stored.
+ *  \param fileName The configuration file.
+ *  \return false if the file could not be loaded.
+ */
+bool MainForm::reloadFrame( QString fileName )
+{
+    //cout << "MainForm::reloadFrame beg" << endl;
+    vector<double> director;
+    string file       = string( fileName.ascii() );
+    string parameters = string( QString( "format %1" ).arg( cnf -> getLoadCnfFileIndex() ).ascii() );
+    bool   useCache   = action_toggleAnalysisCache -> isOn();
+    
+    if( useCache && analysisCache -> lookup( file, "director", parameters, director ) && director.size() == 3 )
+    {
+	cnf -> setNextDirector( director.at(0), director.at(1), director.at(2) );
+    }
+    else
+    {
+	director.clear();
+    }
+    
+    clustersCalculated = false;
+    if( cnf -> reloadCnfFile( file ) == false ) { return( false ); }
+    
+    if( useCache && director.empty() )
+    {
+	cnf -> getDirector( director );
+	analysisCache -> store( file, "director", parameters, director );
+    }
+    //cout << "MainForm::reloadFrame end" << endl;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- clearAnalysisCache
+//-------------------------------------------------------------------------
+void MainForm::clearAnalysisCache()
+{
+    //cout << "MainForm::clearAnalysisCache beg" << endl;
+    analysisCache -> clear();
+    analysisCache -> flush();
+    structureFactor -> clearCache();
+    statusBar() -> message( "analysis cache cleared", 3000 );
+    //cout << "MainForm::clearAnalysisCache end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- toggleOrientationGlyph
+//-------------------------------------------------------------------------
+void MainForm::toggleOrientationGlyph( bool state )
+{
+    //cout << "MainForm::toggleOrientationGlyph beg" << endl;
+    if( state == true && cnf != 0 ) { updateOrientationGlyph(); }
+    glWindow -> setDrawOrientationGlyph( state );
+    //cout << "MainForm::toggleOrientationGlyph end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- updateOrientationGlyph
+//-------------------------------------------------------------------------
+/*!
+ *  Bins the molecule axes of the current frame and shows them on the sphere.
+ *  With the default 18 x 36 cells this is cheap enough for every frame of a video.
  */
-void MainForm::deleteHistogram( QString histFile )
+void MainForm::updateOrientationGlyph()
 {
-    //cout << "MainForm::deleteHistogram beg" << endl;
-    if( QMessageBox::question( this,
-			       "QMGA - show histogram",
-			       QString("Delete histogram file:\n")+histFile,
-			       QMessageBox::Yes, QMessageBox::No ) == QMessageBox::Yes ) 
+    //cout << "MainForm::updateOrientationGlyph beg" << endl;
+    vector<double> values;
+    string file = string( cnfFile.ascii() );
+    bool   useCache = action_toggleAnalysisCache -> isOn();
+    if( useCache && analysisCache -> lookup( file, "orientation_distribution", orientationDistribution -> getParameters(), values ) &&
+	orientationDistribution -> setValues( values ) )
+    {
+	showOrientationDistribution( *orientationDistribution );
+	return;
+    }
+    
+    orientationDistribution -> reset();
+    if( orientationDistribution -> addFrame( cnf ) == true )
     {
-	if( QFile::remove(histFile) == false ) 
+	if( useCache )
 	{
-	    cerr << "Warning: could not remove file: " << histFile << endl;
+	    orientationDistribution -> getValues( values );
+	    analysisCache -> store( file, "orientation_distribution", orientationDistribution -> getParameters(), values );
 	}
+	showOrientationDistribution( *orientationDistribution );
     }
-    //cout << "MainForm::deleteHistogram end" << endl;
+    //cout << "MainForm::updateOrientationGlyph end" << endl;
 }
 
 //-------------------------------------------------------------------------
-//------------- updateFps
+//------------- showOrientationDistribution
 //-------------------------------------------------------------------------
 /*!
- *  Sets a new value to the fps lcdnumber.
- *  \param newVal New fps value to be displayed.
- *  \author Adrian Gabriel 
- *  \date Apr 2007
+ *  Colors the cells of the sphere by their density with the current color map,
+ *  the first color is zero, the last one the largest density.
+ *  \param distribution The distribution to show.
  */
-void MainForm::updateFps( double newVal )
+void MainForm::showOrientationDistribution( const mga::OrientationDistribution &distribution )
 {
-    //cout << "MainForm::updateFps beg" << endl;
-    lCDNumber_fps -> display( newVal );
-    meanFps( newVal, false );
-    //cout << "MainForm::updateFps end" << endl;
+    //cout << "MainForm::showOrientationDistribution beg" << endl;
+    const int    bands   = distribution.getNumberOfBands();
+    const int    sectors = distribution.getNumberOfSectors();
+    const int    colors  = cnf -> getNumberOfColorsInMap();
+    const double maximum = distribution.getMaximum();
+    vector<float> cellColors( 3 * bands * sectors, 0.0 );
+    
+    for( int b = 0; b < bands; ++b )
+    {
+	for( int s = 0; s < sectors; ++s )
+	{
+	    int index = 0;
+	    if( maximum > 0.0 ) { index = int( distribution.getDensity( b, s ) / maximum * ( colors - 1 ) + 0.5 ); }
+	    index = QMAX( 0, QMIN( colors - 1, index ) );
+	    int c = 3 * ( b*sectors + s );
+	    cellColors.at(c)   = cnf -> getRedAt  ( index );
+	    cellColors.at(c+1) = cnf -> getGreenAt( index );
+	    cellColors.at(c+2) = cnf -> getBlueAt ( index );
+	}
+    }
+    glWindow -> setOrientationGlyph( cellColors, bands, sectors );
+    //cout << "MainForm::showOrientationDistribution end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- printOrientationDistribution()
+//-------------------------------------------------------------------------
+/*!
+ *  Accumulates the orientation distribution over all frames given in the video settings
+ *  (or takes the current frame only), writes it to a file in the current working directory
+ *  called like the first file + ".odf" and shows it on the sphere until the next frame is loaded.
+ */
+void MainForm::printOrientationDistribution()
+{
+    //cout << "MainForm::printOrientationDistribution beg" << endl;
+    if( cnf == 0 || videoStartPressed ) { return; }
+    
+    mga::OrientationDistribution distribution( orientationDistribution -> getNumberOfBands(),
+					       orientationDistribution -> getNumberOfSectors() );
+    QString odfFile = QString("./") + cnfFile.section( '/', -1 ) + ".odf";
+    QString comment = "file: " + cnfFile;
+    
+    if( lineEdit_videoFile  -> text() != "" && lineEdit_videoStart -> text() != "" && 
+	lineEdit_videoStop  -> text() != "" && lineEdit_videoStep  -> text() != "" )
+    {
+	unsigned int start = lineEdit_videoStart -> text().toUInt();
+	unsigned int stop  = lineEdit_videoStop  -> text().toUInt();
+	unsigned int step  = lineEdit_videoStep  -> text().toUInt();
+	if( step == 0 ) { step = 1; }
+	
+	QApplication::setOverrideCursor( QCursor( Qt::WaitCursor ) );
+	for( unsigned int frame = start; frame <= stop; frame += step )
+	{
+	    QString fileName = videoFileName( frame );
+	    if( cnf -> reloadCnfFile( fileName ) == true )
+	    {
+		distribution.addFrame( cnf );
+		statusBar() -> message( "orientation distribution: " + fileName );
+		qApp -> processEvents();
+	    }
+	    else { cerr << "Warning: could not load file: " << fileName << endl; }
+	}
+	QApplication::restoreOverrideCursor();
+	newInputFile( cnfFile, RELOADSAME );                                       // restore the displayed frame
+	
+	odfFile = QString("./") + videoFileName( start ).section( '/', -1 ) + ".odf";
+	comment = "files: " + videoFileName( start ) + " ... " + videoFileName( stop );
+    }
+    else
+    {
+	distribution.addFrame( cnf );
+    }
+    
+    if( distribution.getNumberOfFrames() > 0 && distribution.writeDataFile( odfFile, comment ) == true )
+    {
+	statusBar() -> message( QString("Wrote: ") + odfFile );
+    }
+    else
+    {
+	cerr << "ERROR: Cannot calculate orientation distribution or write file: " << odfFile << endl;
+	statusBar() -> message( QString("ERROR: Cannot write file: ") + odfFile );
+    }
+    
+    if( distribution.getNumberOfFrames() > 0 )
+    {
+	showOrientationDistribution( distribution );
+	action_toggleOrientationGlyph -> blockSignals( true );                     // do not replace it by the current frame
+	action_toggleOrientationGlyph -> setOn( true );
+	action_toggleOrientationGlyph -> blockSignals( false );
+	glWindow -> setDrawOrientationGlyph( true );
+    }
+    //cout << "MainForm::printOrientationDistribution end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- printTimeCorrelation()
+//-------------------------------------------------------------------------
+/*!
+ *  Streams all frames given in the video settings through a mga::TimeCorrelation and writes
+ *  the mean squared displacement and the rotational correlation functions C1(t), C2(t) to
+ *  a file in the current working directory called like the first file + ".msd".
+ *  The lag is given in units of the video step.
+ */
+void MainForm::printTimeCorrelation()
+{
+    //cout << "MainForm::printTimeCorrelation beg" << endl;
+    if( cnf == 0 || videoStartPressed ) { return; }
+    if( lineEdit_videoFile  -> text() == "" || lineEdit_videoStart -> text() == "" || 
+	lineEdit_videoStop  -> text() == "" || lineEdit_videoStep  -> text() == "" )
+    {
+	statusBar() -> message( "Please fill in the video settings to select the frames.", 3000 );
+	return;
+    }
+    
+    unsigned int start = lineEdit_videoStart -> text().toUInt();
+    unsigned int stop  = lineEdit_videoStop  -> text().toUInt();
+    unsigned int step  = lineEdit_videoStep  -> text().toUInt();
+    if( step == 0 ) { step = 1; }
+    
+    mga::TimeCorrelation timeCorrelation;
+    QApplication::setOverrideCursor( QCursor( Qt::WaitCursor ) );
+    for( unsigned int frame = start; frame <= stop; frame += step )
+    {
+	QString fileName = videoFileName( frame );
+	if( cnf -> reloadCnfFile( fileName ) == false ) { cerr << "Warning: could not load file: " << fileName << endl; break; }
+	if( timeCorrelation.addFrame( cnf ) == false )   { break; }                // a gap in the trajectory would spoil all lags
+	statusBar() -> message( "time correlation: " + fileName );
+	qApp -> processEvents();
+    }
+    QApplication::restoreOverrideCursor();
+    newInputFile( cnfFile, RELOADSAME );                                           // restore the displayed frame
+    
+    QString msdFile = QString("./") + videoFileName( start ).section( '/', -1 ) + ".msd";
+    QString comment = "files: " + videoFileName( start ) + " ... " + videoFileName( stop ) + "  lag unit: " + QString::number( step ) + " frames";
+    if( timeCorrelation.getNumberOfFrames() > 1 && timeCorrelation.writeDataFile( msdFile, comment ) == true )
+    {
+	statusBar() -> message( QString("Wrote: ") + msdFile );
+    }
+    else
+    {
+	cerr << "ERROR: Cannot calculate time correlation or write file: " << msdFile << endl;
+	statusBar() -> message( QString("ERROR: Cannot write file: ") + msdFile );
+    }
+    //cout << "MainForm::printTimeCorrelation end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- setLocalDirectorResolution()
+//-------------------------------------------------------------------------
+/*!
+ *  Asks for the number of grid cells per box vector of the local director field.
+ */
+void MainForm::setLocalDirectorResolution()
+{
+    //cout << "MainForm::setLocalDirectorResolution beg" << endl;
+    bool ok = false;
+    int resolution = QInputDialog::getInteger( "QMGA - local director", "Grid cells per box vector:",
+					       directorField -> getResolution(), 1, 512, 1, &ok, this );
+    if( ok )
+    {
+	directorField -> setResolution( resolution );
+	if( action_useLocalDirector -> isOn() )
+	{
+	    forceChangeColorization = true;
+	    changeColorisation();
+	    forceChangeColorization = false;
+	}
+    }
+    //cout << "MainForm::setLocalDirectorResolution end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- exportDirectorField()
+//-------------------------------------------------------------------------
+/*!
+ *  Calculates the local director field of the current frame and writes it
+ *  to a file in the current working directory called like the file + ".field".
+ */
+void MainForm::exportDirectorField()
+{
+    //cout << "MainForm::exportDirectorField beg" << endl;
+    if( cnf == 0 ) { return; }
+    QString fieldFile = QString("./") + cnfFile.section( '/', -1 ) + ".field";
+    
+    if( directorField -> calculate( cnf ) == true && directorField -> writeDataFile( fieldFile, "file: " + cnfFile ) == true )
+    {
+	statusBar() -> message( QString("Wrote: ") + fieldFile );
+    }
+    else
+    {
+	statusBar() -> message( QString("ERROR: Cannot write file: ") + fieldFile );
+    }
+    //cout << "MainForm::exportDirectorField end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- toggleDefects
+//-------------------------------------------------------------------------
+/*!
+ *  Switches the disclination lines of the local director field on and off.
+ *  \param state true to show the defect lines.
+ */
+void MainForm::toggleDefects( bool state )
+{
+    //cout << "MainForm::toggleDefects beg" << endl;
+    if( state == true && cnf != 0 ) { updateDefectLines(); }
+    glWindow -> setDrawDefects( state );
+    //cout << "MainForm::toggleDefects end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- setDefectThreshold
+//-------------------------------------------------------------------------
+/*!
+ *  Asks for the local order parameter below which a grid cell is a defect.
+ */
+void MainForm::setDefectThreshold()
+{
+    //cout << "MainForm::setDefectThreshold beg" << endl;
+    bool ok = false;
+    double threshold = QInputDialog::getDouble( "QMGA - defect lines", "Local order parameter threshold:",
+						defectFinder -> getOrderThreshold(), -0.5, 1.0, 2, &ok, this );
+    if( ok )
+    {
+	defectFinder -> setOrderThreshold( threshold );
+	if( action_toggleDefects -> isOn() && cnf != 0 )
+	{
+	    updateDefectLines();
+	    glWindow -> repaint();
+	}
+    }
+    //cout << "MainForm::setDefectThreshold end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- toggleMolecules
+//-------------------------------------------------------------------------
+/*!
+ *  Switches drawing of the molecules on and off, e.g. to look at the defect lines only.
+ *  \param state true to draw the molecules.
+ */
+void MainForm::toggleMolecules( bool state )
+{
+    //cout << "MainForm::toggleMolecules beg" << endl;
+    switch( state )
+    {
+    case true: statusBar()->message( "switch molecules on.", 3000 );
+	break;
+    case false: statusBar()->message( "switch molecules off.", 3000 );
+	break;
+    }
+    glWindow -> setDrawModels( state );
+    //cout << "MainForm::toggleMolecules end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- updateDefectLines
+//-------------------------------------------------------------------------
+/*!
+ *  Calculates the local director field of the current frame, finds the defect lines
+ *  and sends them to the render engine. The tube radius is a quarter of a grid cell.
+ */
+void MainForm::updateDefectLines()
+{
+    //cout << "MainForm::updateDefectLines beg" << endl;
+    vector<vector<float> > lines;
+    float radius = 0.0;
+    if( directorField -> calculate( cnf ) == true && defectFinder -> find( *directorField ) == true )
+    {
+	lines = defectFinder -> getLines();
+	const mga::CellList &cells = directorField -> getCellList();
+	radius = float( cells.getBox().getWidth(0) / cells.getCellsAlong(0) );
+	for( int d = 1; d < 3; ++d )
+	{
+	    radius = QMIN( radius, float( cells.getBox().getWidth(d) / cells.getCellsAlong(d) ) );
+	}
+	radius *= 0.25;
+	
+	if( action_translate -> isOn() )
+	{
+	    for( uint l = 0; l < lines.size(); ++l )
+	    {
+		for( uint k = 0; k + 2 < lines.at(l).size(); k += 3 )
+		{
+		    lines.at(l).at(k)   += float(spinBox_translateX->value()) / 10.0; 
+		    lines.at(l).at(k+1) += float(spinBox_translateY->value()) / 10.0; 
+		    lines.at(l).at(k+2) += float(spinBox_translateZ->value()) / 10.0; 
+		}
+	    }
+	}
+	statusBar() -> message( QString("defect cells: %1, lines: %2").arg( defectFinder -> getNumberOfDefectCells() ).arg( lines.size() ), 3000 );
+    }
+    glWindow -> setDefectLines( lines, radius );
+    //cout << "MainForm::updateDefectLines end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- toggleIsoSurface
+//-------------------------------------------------------------------------
+/*!
+ *  Switches between the isosurface and the molecules.
+ *  \param state true to draw the isosurface.
+ */
+void MainForm::toggleIsoSurface( bool state )
+{
+    //cout << "MainForm::toggleIsoSurface beg" << endl;
+    if( state == true && cnf != 0 ) { updateIsoSurface(); }
+    glWindow -> setDrawSurface( state );
+    //cout << "MainForm::toggleIsoSurface end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- setIsoSurfaceParameters
+//-------------------------------------------------------------------------
+/*!
+ *  Asks for the grid resolution, the scalar field and the iso value of the isosurface.
+ *  The iso value is asked last, so the range of the field of the current frame can be shown.
+ */
+void MainForm::setIsoSurfaceParameters()
+{
+    //cout << "MainForm::setIsoSurfaceParameters beg" << endl;
+    if( cnf == 0 ) { return; }
+    bool ok = false;
+    int resolution = QInputDialog::getInteger( "QMGA - isosurface", "Grid cells per box vector:",
+					       isoSurface -> getResolution(), 2, 512, 1, &ok, this );
+    if( !ok ) { return; }
+    
+    QStringList quantities;
+    quantities << "local order parameter" << "density" << "type fraction";
+    QString quantityName = QInputDialog::getItem( "QMGA - isosurface", "Scalar field:", quantities,
+						  isoSurface -> getQuantity(), false, &ok, this );
+    if( !ok ) { return; }
+    int quantity = quantities.findIndex( quantityName );
+    
+    int type = isoSurface -> getType();
+    if( quantity == mga::IsoSurface::TYPE_FRACTION )
+    {
+	type = QInputDialog::getInteger( "QMGA - isosurface", "Fraction of molecules of type:",
+					 type, 0, QMAX( 0, int( cnf -> getNumberOfTypes() ) - 1 ), 1, &ok, this );
+	if( !ok ) { return; }
+    }
+    
+    isoSurface -> setResolution( resolution );
+    isoSurface -> setQuantity( quantity, type );
+    QApplication::setOverrideCursor( QCursor( Qt::WaitCursor ) );
+    isoSurface -> calculate( cnf );
+    QApplication::restoreOverrideCursor();
+    
+    double isoValue = QInputDialog::getDouble( "QMGA - isosurface", 
+					       QString( "Iso value (field: %1 ... %2):" ).arg( isoSurface -> getMinimum() ).arg( isoSurface -> getMaximum() ),
+					       isoSurface -> getIsoValue(), -1e9, 1e9, 3, &ok, this );
+    if( ok ) { isoSurface -> setIsoValue( isoValue ); }
+    
+    if( action_toggleIsoSurface -> isOn() )
+    {
+	updateIsoSurface();
+	glWindow -> repaint();
+    }
+    //cout << "MainForm::setIsoSurfaceParameters end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- updateIsoSurface
+//-------------------------------------------------------------------------
+/*!
+ *  Calculates the isosurface of the current frame and sends it to the render engine.
+ */
+void MainForm::updateIsoSurface()
+{
+    //cout << "MainForm::updateIsoSurface beg" << endl;
+    vector<float> vertices;
+    vector<float> normals;
+    if( isoSurface -> calculate( cnf ) == true )
+    {
+	vertices = isoSurface -> getVertices();
+	normals  = isoSurface -> getNormals();
+	if( action_translate -> isOn() )
+	{
+	    for( uint k = 0; k + 2 < vertices.size(); k += 3 )
+	    {
+		vertices.at(k)   += float(spinBox_translateX->value()) / 10.0; 
+		vertices.at(k+1) += float(spinBox_translateY->value()) / 10.0; 
+		vertices.at(k+2) += float(spinBox_translateZ->value()) / 10.0; 
+	    }
+	}
+	statusBar() -> message( QString("isosurface triangles: %1").arg( isoSurface -> getNumberOfTriangles() ), 3000 );
+    }
+    glWindow -> setSurface( vertices, normals );
+    //cout << "MainForm::updateIsoSurface end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- printClusters
+//-------------------------------------------------------------------------
+/*!
+ *  Asks for the cluster criteria, finds the clusters of the current frame and writes
+ *  the cluster size distribution to a file in the current working directory called
+ *  like the file + ".clusters". Coloring and filter are updated with the new criteria.
+ */
+void MainForm::printClusters()
+{
+    //cout << "MainForm::printClusters beg" << endl;
+    if( cnf == 0 ) { return; }
+    bool ok = false;
+    double cutoff = QInputDialog::getDouble( "QMGA - clusters", "Largest distance of bonded molecules:",
+					     clusterAnalysis -> getCutoff(), 0.01, 1000.0, 3, &ok, this );
+    if( !ok ) { return; }
+    double angle = QInputDialog::getDouble( "QMGA - clusters", "Largest angle (deg) between bonded molecules (90 = any):",
+					    clusterAnalysis -> getMaximumAngle(), 0.0, 90.0, 1, &ok, this );
+    if( !ok ) { return; }
+    int type = QInputDialog::getInteger( "QMGA - clusters", "Type of clustered molecules (-1 = all):",
+					 clusterAnalysis -> getType(), -1, QMAX( 0, int( cnf -> getNumberOfTypes() ) - 1 ), 1, &ok, this );
+    if( !ok ) { return; }
+    
+    clusterAnalysis -> setCutoff( cutoff );
+    clusterAnalysis -> setMaximumAngle( angle );
+    clusterAnalysis -> setType( type );
+    
+    QString clusterFile = QString("./") + cnfFile.section( '/', -1 ) + ".clusters";
+    QApplication::setOverrideCursor( QCursor( Qt::WaitCursor ) );
+    clustersCalculated = false;
+    bool success = calculateClusters() && clusterAnalysis -> writeDataFile( clusterFile, "file: " + cnfFile );
+    QApplication::restoreOverrideCursor();
+    
+    if( success )
+    {
+	statusBar() -> message( QString("Wrote: %1  (clusters: %2, largest: %3)").arg( clusterFile )
+				.arg( clusterAnalysis -> getNumberOfClusters() )
+				.arg( clusterAnalysis -> getNumberOfClusters() > 0 ? clusterAnalysis -> getClusterSize(0) : 0 ) );
+    }
+    else
+    {
+	statusBar() -> message( QString("ERROR: Cannot write file: ") + clusterFile );
+    }
+    
+    updateModelMask();
+    if( action_useClusterColor -> isOn() )
+    {
+	forceChangeColorization = true;
+	changeColorisation();
+	forceChangeColorization = false;
+    }
+    glWindow -> repaint();
+    //cout << "MainForm::printClusters end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- calculateClusters
+//-------------------------------------------------------------------------
+/*!
+ *  Finds the clusters of the current frame once. Cluster coloring and the cluster filter
+ *  share the result until another frame is loaded, the molecules are reordered or the
+ *  criteria change.
+ *  \return false if there are no clusters for the current frame.
+ */
+bool MainForm::calculateClusters()
+{
+    if( clustersCalculated == false && cnf != 0 )
+    {
+	clustersCalculated = clusterAnalysis -> calculate( cnf );
+    }
+    return( clustersCalculated );
+}
+
+//-------------------------------------------------------------------------
+//------------- setClusterFilter
+//-------------------------------------------------------------------------
+/*!
+ *  Asks for the smallest cluster size that is drawn. 1 draws all molecules.
+ */
+void MainForm::setClusterFilter()
+{
+    //cout << "MainForm::setClusterFilter beg" << endl;
+    bool ok = false;
+    int size = QInputDialog::getInteger( "QMGA - clusters", "Draw only clusters with at least this many molecules:",
+					 clusterMinSize, 1, 2147483647, 1, &ok, this );
+    if( ok )
+    {
+	clusterMinSize = size;
+	updateModelMask();
+	glWindow -> repaint();
+    }
+    //cout << "MainForm::setClusterFilter end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- updateModelMask
+//-------------------------------------------------------------------------
+/*!
+ *  Hides all molecules in smaller clusters than clusterMinSize (and the molecules not of the
+ *  clustered type), if diffTopMovers is set, all but the diffTopMovers molecules that moved
+ *  (or rotated) most since the reference frame, and all molecules outside the selection.
+ */
+void MainForm::updateModelMask()
+{
+    //cout << "MainForm::updateModelMask beg" << endl;
+    vector<char> mask;
+    if( clusterMinSize > 1 && cnf != 0 && calculateClusters() == true )
+    {
+	mask.assign( cnf -> getNumberOfMolecules(), 0 );
+	for( uint i = 0; i < mask.size(); ++i )
+	{
+	    int id = clusterAnalysis -> getClusterOfMolecule(i);
+	    if( id >= 0 && clusterAnalysis -> getClusterSize(id) >= clusterMinSize ) { mask.at(i) = 1; }
+	}
+    }
+    if( diffTopMovers > 0 && cnf != 0 && frameDifference -> calculate( cnf ) == true )
+    {
+	vector<int> movers;
+	frameDifference -> getTopMovers( diffTopMovers, diffByRotation, movers );
+	vector<char> moverMask( cnf -> getNumberOfMolecules(), 0 );
+	for( uint k = 0; k < movers.size(); ++k ) { moverMask.at( movers.at(k) ) = 1; }
+	if( mask.empty() ) { mask.swap( moverMask ); }
+	else
+	{
+	    for( uint i = 0; i < mask.size(); ++i ) { mask.at(i) = mask.at(i) && moverMask.at(i); }
+	}
+    }
+    selectedMolecules = -1;
+    if( selection -> isAll() == false && cnf != 0 )
+    {
+	vector<char> selected;
+	if( selection -> usesField() ) { selection -> setField( cnf -> getColorField() ); }
+	if( selection -> evaluate( cnf, selected ) == false )
+	{
+	    statusBar() -> message( "selection needs a per molecule color (local director, clusters, displacement).", 3000 );
+	}
+	else
+	{
+	    selectedMolecules = mga::Selection::count( selected );
+	    if( mask.empty() ) { mask.swap( selected ); }
+	    else
+	    {
+		for( uint i = 0; i < mask.size(); ++i ) { mask.at(i) = mask.at(i) && selected.at(i); }
+	    }
+	}
+    }
+    glWindow -> setModelMask( mask );
+    //cout << "MainForm::updateModelMask end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- setDiffReference
+//-------------------------------------------------------------------------
+/*!
+ *  Keeps the current frame as reference for displacements and rotations.
+ */
+void MainForm::setDiffReference()
+{
+    //cout << "MainForm::setDiffReference beg" << endl;
+    if( cnf == 0 ) { return; }
+    if( frameDifference -> setReference( cnf, cnfFile.section( '/', -1 ).ascii() ) == true )
+    {
+	statusBar() -> message( QString("reference frame: %1").arg( cnfFile ), 3000 );
+    }
+    updateModelMask();
+    if( action_useDisplacementColor -> isOn() )
+    {
+	forceChangeColorization = true;
+	changeColorisation();
+	forceChangeColorization = false;
+    }
+    glWindow -> repaint();
+    //cout << "MainForm::setDiffReference end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- setFrameDifference
+//-------------------------------------------------------------------------
+/*!
+ *  Asks whether displacement or rotation is used for coloring and filtering and how many
+ *  of the molecules that moved most are drawn (0 draws all). Without reference frame the
+ *  current frame becomes the reference.
+ */
+void MainForm::setFrameDifference()
+{
+    //cout << "MainForm::setFrameDifference beg" << endl;
+    if( cnf == 0 ) { return; }
+    if( frameDifference -> hasReference() == false ) { setDiffReference(); }
+    
+    bool ok = false;
+    QStringList quantities;
+    quantities << "displacement" << "rotation";
+    QString quantity = QInputDialog::getItem( "QMGA - frame difference", "Compare molecules by:",
+					      quantities, diffByRotation ? 1 : 0, false, &ok, this );
+    if( !ok ) { return; }
+    int top = QInputDialog::getInteger( "QMGA - frame difference", "Draw only this many molecules that moved most (0 = all):",
+					diffTopMovers, 0, 2147483647, 1, &ok, this );
+    if( !ok ) { return; }
+    
+    diffByRotation = ( quantity == "rotation" );
+    diffTopMovers  = top;
+    
+    QApplication::setOverrideCursor( QCursor( Qt::WaitCursor ) );
+    if( frameDifference -> calculate( cnf ) == true )
+    {
+	statusBar() -> message( QString("matched molecules: %1 of %2, largest %3: %4")
+				.arg( frameDifference -> getNumberMatched() ).arg( cnf -> getNumberOfMolecules() )
+				.arg( quantity ).arg( frameDifference -> getMaximum( diffByRotation ) ) );
+    }
+    updateModelMask();
+    if( action_useDisplacementColor -> isOn() )
+    {
+	forceChangeColorization = true;
+	changeColorisation();
+	forceChangeColorization = false;
+    }
+    QApplication::restoreOverrideCursor();
+    glWindow -> repaint();
+    //cout << "MainForm::setFrameDifference end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- setSelection
+//-------------------------------------------------------------------------
+/*!
+ *  Asks for a selection like "sphere 0 0 0 5 and not type 1" (see mga::Selection::parse()),
+ *  only the selected molecules are drawn and exported. "field low high" selects by the
+ *  values of the current per molecule coloring. An empty selection draws all molecules.
+ */
+void MainForm::setSelection()
+{
+    //cout << "MainForm::setSelection beg" << endl;
+    bool ok = false;
+    QString expression = QInputDialog::getText( "QMGA - selection",
+						"box, sphere, halfspace, type, cone, polarcone, id, field, combined with and, or, not, ( ):",
+						QLineEdit::Normal, selection -> isAll() ? QString("") : QString( selection -> getExpression() ),
+						&ok, this );
+    if( !ok ) { return; }
+    if( selection -> parse( expression.ascii() ? expression.ascii() : "" ) == false )
+    {
+	QMessageBox::warning( this, "QMGA -- Warning", "The selection \"" + expression + "\" is not valid." );
+	return;
+    }
+    
+    QApplication::setOverrideCursor( QCursor( Qt::WaitCursor ) );
+    updateModelMask();
+    if( selectedMolecules >= 0 && cnf != 0 )
+    {
+	statusBar() -> message( QString("selected molecules: %1 of %2").arg( selectedMolecules ).arg( cnf -> getNumberOfMolecules() ), 3000 );
+    }
+    QApplication::restoreOverrideCursor();
+    glWindow -> repaint();
+    //cout << "MainForm::setSelection end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- initPlotWindow
+//-------------------------------------------------------------------------
+/*!
+ *  Creates the dock window with the structure factor of the current frame
+ *  and the smectic order parameter of all cached frames.
+ */
+void MainForm::initPlotWindow()
+{
+    //cout << "MainForm::initPlotWindow beg" << endl;
+    plotWindow = new QDockWindow( QDockWindow::InDock, this );
+    plotWindow -> setCaption( "QMGA -- Structure Factor" );
+    plotWindow -> setResizeEnabled( true );
+    plotWindow -> setAcceptDrops( false );
+    plotWindow -> setCloseMode( QDockWindow::Always );
+    moveDockWindow( plotWindow, Qt::DockRight );
+    
+    structurePlot = new PlotWidget( plotWindow, "structurePlot" );
+    structurePlot -> setLabels( "q", "S(q)" );
+    structurePlot -> setLogY( true );
+    smecticPlot   = new PlotWidget( plotWindow, "smecticPlot" );
+    smecticPlot   -> setLabels( "frame", "tau" );
+    plotWindow -> boxLayout() -> addWidget( structurePlot );
+    plotWindow -> boxLayout() -> addWidget( smecticPlot );
+    
+    QSettings settings;
+    settings.insertSearchPath( QSettings::Windows, WINDOWS_REGISTRY );
+    if( settings.readBoolEntry( APP_KEY + "PlotSideBar", false ) == true )
+    {
+	plotWindow -> show();
+	action_toggleSmecticWindow -> setOn( true );
+    }
+    else
+    {
+	plotWindow -> hide();
+	action_toggleSmecticWindow -> setOn( false );
+    }
+    
+    connect( plotWindow, SIGNAL(visibilityChanged(bool)), action_toggleSmecticWindow, SLOT(setOn(bool)) );
+    updateSmecticPlot();
+    //cout << "MainForm::initPlotWindow end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- toggleSmecticWindow
+//-------------------------------------------------------------------------
+void MainForm::toggleSmecticWindow()
+{
+    //cout << "MainForm::toggleSmecticWindow beg" << endl;
+    if( plotWindow == 0 ) { return; }
+    if( action_toggleSmecticWindow -> isOn() ) { plotWindow -> show(); updateSmecticPlot(); }
+    else                                       { plotWindow -> hide(); }    
+    //cout << "MainForm::toggleSmecticWindow end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- updateSmecticPlot
+//-------------------------------------------------------------------------
+/*!
+ *  Calculates (or takes from the cache) the structure factor of the current frame and
+ *  plots it. The smectic order parameter is plotted for all frames of the video settings
+ *  that are cached, so playing a trajectory once fills the second plot.
+ */
+void MainForm::updateSmecticPlot()
+{
+    //cout << "MainForm::updateSmecticPlot beg" << endl;
+    if( plotWindow == 0 || plotWindow -> isShown() == false || cnf == 0 ) { return; }
+    bool known = restoreStructureFactor( cnfFile );
+    if( structureFactor -> calculate( cnf, string( cnfFile.ascii() ) ) == false ) { return; }
+    if( known == false ) { keepStructureFactor( cnfFile ); }
+    
+    vector<double> q, s, sPar;
+    structureFactor -> getResult( q, s, sPar );
+    structurePlot -> clear();
+    structurePlot -> addCurve( q, s   , Qt::blue, "S(q)" );
+    structurePlot -> addCurve( q, sPar, Qt::red , "S(q) along director" );
+    structurePlot -> setTitle( QString( "tau = %1   d = %2" ).arg( structureFactor -> getSmecticOrder(), 0, 'f', 3 )
+			       .arg( structureFactor -> getLayerSpacing(), 0, 'f', 3 ) );
+    structurePlot -> update();
+    
+    vector<double> frames, orders, spacings;
+    if( lineEdit_videoFile -> text() != "" && lineEdit_videoStart -> text() != "" && lineEdit_videoStop -> text() != "" )
+    {
+	unsigned int start = lineEdit_videoStart -> text().toUInt();
+	unsigned int stop  = lineEdit_videoStop  -> text().toUInt();
+	unsigned int step  = QMAX( 1u, lineEdit_videoStep -> text().toUInt() );
+	for( unsigned int frame = start; frame <= stop; frame += step )
+	{
+	    double order = 0.0, spacing = 0.0;
+	    if( restoreStructureFactor( videoFileName( frame ) ) &&
+		structureFactor -> getCached( string( videoFileName( frame ).ascii() ), order, spacing ) )
+	    {
+		frames.push_back( frame );
+		orders.push_back( order );
+		spacings.push_back( spacing );
+	    }
+	}
+    }
+    smecticPlot -> clear();
+    smecticPlot -> addCurve( frames, orders, Qt::darkGreen, "tau", frames.size() < 2 );
+    smecticPlot -> setTitle( QString( "%1 cached frames" ).arg( frames.size() ) );
+    smecticPlot -> update();
+    //cout << "MainForm::updateSmecticPlot end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- restoreStructureFactor
+//-------------------------------------------------------------------------
+/*!
+ *  Makes sure the structure factor of a file is in the memory cache of structureFactor,
+ *  taking it from the analysis cache if necessary.
+ *  \param fileName The configuration file.
+ *  \return true if the structure factor of the file is known, i.e. need not be calculated.
+ */
+bool MainForm::restoreStructureFactor( QString fileName )
+{
+    string key = string( fileName.ascii() );
+    if( structureFactor -> isCached( key ) ) { return( true ); }
+    if( action_toggleAnalysisCache -> isOn() == false ) { return( false ); }
+    
+    vector<double> values;
+    return( analysisCache -> lookup( key, "structure_factor", structureFactor -> getParameters(), values ) &&
+	    structureFactor -> setCachedValues( key, values ) );
+}
+
+//-------------------------------------------------------------------------
+//------------- keepStructureFactor
+//-------------------------------------------------------------------------
+/*!
+ *  Puts the freshly calculated structure factor of a file into the analysis cache.
+ *  \param fileName The configuration file.
+ */
+void MainForm::keepStructureFactor( QString fileName )
+{
+    vector<double> values;
+    string key = string( fileName.ascii() );
+    if( action_toggleAnalysisCache -> isOn() && structureFactor -> getCachedValues( key, values ) )
+    {
+	analysisCache -> store( key, "structure_factor", structureFactor -> getParameters(), values );
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- smecticSeries
+//-------------------------------------------------------------------------
+/*!
+ *  Calculates the smectic order parameter and the layer spacing of all frames given in
+ *  the video settings (cached frames are not calculated again) and writes them to a file
+ *  in the current working directory called like the first file + ".smectic".
+ */
+void MainForm::smecticSeries()
+{
+    //cout << "MainForm::smecticSeries beg" << endl;
+    if( cnf == 0 || videoStartPressed ) { return; }
+    if( lineEdit_videoFile  -> text() == "" || lineEdit_videoStart -> text() == "" || 
+	lineEdit_videoStop  -> text() == "" || lineEdit_videoStep  -> text() == "" )
+    {
+	statusBar() -> message( "Please fill in the video settings to select the frames.", 3000 );
+	return;
+    }
+    
+    unsigned int start = lineEdit_videoStart -> text().toUInt();
+    unsigned int stop  = lineEdit_videoStop  -> text().toUInt();
+    unsigned int step  = QMAX( 1u, lineEdit_videoStep -> text().toUInt() );
+    vector<vector<double> > columns( 3 );
+    
+    QApplication::setOverrideCursor( QCursor( Qt::WaitCursor ) );
+    for( unsigned int frame = start; frame <= stop; frame += step )
+    {
+	QString fileName = videoFileName( frame );
+	string  key      = string( fileName.ascii() );
+	if( restoreStructureFactor( fileName ) == false )
+	{
+	    if( cnf -> reloadCnfFile( fileName ) == false ) { cout << "Warning: cannot load file: " << key << endl; continue; }
+	    structureFactor -> calculate( cnf, key );
+	    keepStructureFactor( fileName );
+	    statusBar() -> message( "structure factor: " + fileName );
+	    qApp -> processEvents();
+	}
+	double order = 0.0, spacing = 0.0;
+	structureFactor -> getCached( key, order, spacing );
+	columns[0].push_back( frame );
+	columns[1].push_back( order );
+	columns[2].push_back( spacing );
+    }
+    QApplication::restoreOverrideCursor();
+    newInputFile( cnfFile, RELOADSAME );                                           // restore the displayed frame
+    analysisCache -> flush();
+    
+    vector<string> names;
+    names.push_back( "Frame" );
+    names.push_back( "tau" );
+    names.push_back( "Spacing" );
+    QString smecticFile = QString("./") + videoFileName( start ).section( '/', -1 ) + ".smectic";
+    QString comment     = "files: " + videoFileName( start ) + " ... " + videoFileName( stop );
+    if( mga::writeDataFile( smecticFile, comment, names, columns ) == true )
+    {
+	statusBar() -> message( QString("Wrote: ") + smecticFile );
+    }
+    else
+    {
+	statusBar() -> message( QString("ERROR: Cannot write file: ") + smecticFile );
+    }
+    
+    action_toggleSmecticWindow -> setOn( true );
+    updateSmecticPlot();
+    //cout << "MainForm::smecticSeries end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- setStructureFactorGrid
+//-------------------------------------------------------------------------
+/*!
+ *  Asks for the number of FFT grid points per box vector. Changing it clears the cache.
+ */
+void MainForm::setStructureFactorGrid()
+{
+    //cout << "MainForm::setStructureFactorGrid beg" << endl;
+    bool ok = false;
+    int size = QInputDialog::getInteger( "QMGA - structure factor", "FFT grid points per box vector (power of two):",
+					 structureFactor -> getGridSize(), 8, 512, 8, &ok, this );
+    if( ok && size != structureFactor -> getGridSize() )
+    {
+	structureFactor -> setGridSize( size );
+	updateSmecticPlot();
+    }
+    //cout << "MainForm::setStructureFactorGrid end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- updateFps
+//-------------------------------------------------------------------------
+/*!
+ *  Sets a new value to the fps lcdnumber.
+ *  \param newVal New fps value to be displayed.
+ *  \author Adrian Gabriel 
+ *  \date Apr 2007
+ */
+void MainForm::updateFps( double newVal )
+{
+    //cout << "MainForm::updateFps beg" << endl;
+    lCDNumber_fps -> display( newVal );
+    meanFps( newVal, false );
+    //cout << "MainForm::updateFps end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- updateCulledBoxes
+//-------------------------------------------------------------------------
+/*!
+ *  Sets a new value to the culled grid boxes lcdnumber.
+ *  \param newVal Number of grid boxes skipped in the last frame.
+ */
+void MainForm::updateCulledBoxes( int newVal )
+{
+    //cout << "MainForm::updateCulledBoxes beg" << endl;
+    lCDNumber_culled -> display( newVal );
+    //cout << "MainForm::updateCulledBoxes end" << endl;
 }
 
 //-------------------------------------------------------------------------
@@ -0,0 +1,3493 @@
+/******************************************************************************
+** This file is part of QMGA a tool to display convex bodies.
+** Phillips-University of Marburg (Germany)
+** qmga@users.sourceforge.net
+**
+** QMGA is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** QMGA is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with QMGA; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include "mga_analysis.h"
+
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <iomanip>
+#include <algorithm>
+#include <sstream>
+#include <utility>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <sys/stat.h>
+#include <climits>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using std::ofstream;
+using std::ifstream;
+using std::cerr;
+using std::setw;
+using std::left;
+using std::setprecision;
+using std::sqrt;
+using std::floor;
+using std::fabs;
+using std::sort;
+using std::unique;
+using std::min;
+using std::max;
+using std::stringstream;
+
+using mga::PeriodicBox;
+using mga::CellList;
+using mga::DirectorField;
+using mga::PairDistribution;
+using mga::DefectFinder;
+using mga::IsoSurface;
+using mga::ClusterAnalysis;
+using mga::StructureFactor;
+using mga::TimeCorrelation;
+using mga::BiaxialOrder;
+using mga::OrientationDistribution;
+using mga::AnalysisCache;
+using mga::FrameDifference;
+using mga::Selection;
+using mga::CnfFile;
+using mga::MoleculeBiax;
+
+static const double PI = 3.14159265358979323846;
+
+//-------------------------------------------------------------------------
+//------------- numberOfThreads
+//-------------------------------------------------------------------------
+/*!
+ *  \return The number of threads the parallel loops of the analysis functions run with (1 without OpenMP
+ *  and inside a parallel region, where the inner loops run serially unless nesting is switched on).
+ */
+int mga::numberOfThreads()
+{
+#ifdef _OPENMP
+    if( omp_in_parallel() && omp_get_nested() == 0 ) { return( 1 ); }            // e.g. called per frame from a parallel loop over frames
+    return( omp_get_max_threads() );
+#else
+    return( 1 );
+#endif
+}
+
+//-------------------------------------------------------------------------
+//------------- threadIndex
+//-------------------------------------------------------------------------
+/*!
+ *  \return The index of the calling thread inside a parallel region (0 without OpenMP).
+ */
+static int threadIndex()
+{
+#ifdef _OPENMP
+    return( omp_get_thread_num() );
+#else
+    return( 0 );
+#endif
+}
+
+//-------------------------------------------------------------------------
+//------------- writeDataFile
+//-------------------------------------------------------------------------
+/*!
+ *  Writes a set of equally long vectors as columns into a plain text file,
+ *  which can directly be plotted with e.g. gnuplot or xmgrace.
+ *  \param filename Name of the file to write.
+ *  \param comment Written as "# comment" in the first line (if not empty).
+ *  \param names Column headers.
+ *  \param columns Data, one vector per column.
+ *  \return true on success.
+ */
+bool mga::writeDataFile( string filename, string comment,
+			 const vector<string> &names, const vector<vector<double> > &columns )
+{
+    if( names.size() != columns.size() || columns.empty() )
+    {
+	cerr << "Error: mga::writeDataFile: number of column names and columns differ" << endl;
+	return( false );
+    }
+
+    ofstream out( filename.c_str() );
+    if( !out.is_open() )
+    {
+	cerr << "Error: Cannot write file: " << filename << endl;
+	return( false );
+    }
+
+    if( !comment.empty() ) { out << "# " << comment << endl; }
+    out << "#";
+    for( unsigned int c = 0; c < names.size(); ++c ) { out << left << setw(15) << names.at(c); }
+    out << endl;
+
+    unsigned int rows = columns.at(0).size();
+    for( unsigned int i = 0; i < rows; ++i )
+    {
+	out << " ";
+	for( unsigned int c = 0; c < columns.size(); ++c )
+	{
+	    out << left << setw(15) << setprecision(6) << ( i < columns.at(c).size() ? columns.at(c).at(i) : 0.0 );
+	}
+	out << endl;
+    }
+    out.close();
+    return( true );
+}
+
+
+//--------------------------------------------
+//------------ PeriodicBox
+//--------------------------------------------
+
+//-------------------------------------------------------------------------
+//------------- PeriodicBox
+//-------------------------------------------------------------------------
+mga::PeriodicBox::PeriodicBox()
+{
+    volume = 0.0;
+    for( int i = 0; i < 3; ++i )
+    {
+	for( int j = 0; j < 3; ++j ) { boxMatrix[i][j] = inverseBox[i][j] = 0.0; }
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- set
+//-------------------------------------------------------------------------
+/*!
+ *  Takes the box vectors of the given configuration and inverts the box matrix.
+ *  \param cnf The configuration.
+ *  \return false if the bounding box has no volume.
+ */
+bool mga::PeriodicBox::set( CnfFile *cnf )
+{
+    if( cnf == 0 ) { return( false ); }
+
+    if( invertBoundingBox( cnf -> getBoundingBoxMatrix(), boxMatrix, inverseBox ) == false )
+    {
+	cerr << "Error: bounding box has no volume." << endl;
+	volume = 0.0;
+	return( false );
+    }
+
+    double (*h)[3] = boxMatrix;
+    double det = h[0][0]*(h[1][1]*h[2][2]-h[1][2]*h[2][1])
+	       - h[0][1]*(h[1][0]*h[2][2]-h[1][2]*h[2][0])
+	       + h[0][2]*(h[1][0]*h[2][1]-h[1][1]*h[2][0]);
+    volume = fabs(det);
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- toFractional
+//-------------------------------------------------------------------------
+void mga::PeriodicBox::toFractional( double x, double y, double z, double s[3] ) const
+{
+    for( int d = 0; d < 3; ++d )
+    {
+	s[d] = inverseBox[d][0]*x + inverseBox[d][1]*y + inverseBox[d][2]*z;
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- toCartesian
+//-------------------------------------------------------------------------
+void mga::PeriodicBox::toCartesian( const double s[3], double &x, double &y, double &z ) const
+{
+    x = boxMatrix[0][0]*s[0] + boxMatrix[0][1]*s[1] + boxMatrix[0][2]*s[2];
+    y = boxMatrix[1][0]*s[0] + boxMatrix[1][1]*s[1] + boxMatrix[1][2]*s[2];
+    z = boxMatrix[2][0]*s[0] + boxMatrix[2][1]*s[1] + boxMatrix[2][2]*s[2];
+}
+
+//-------------------------------------------------------------------------
+//------------- minimumImage
+//-------------------------------------------------------------------------
+/*!
+ *  Replaces the given distance vector by the one to the nearest periodic image.
+ */
+void mga::PeriodicBox::minimumImage( double &dx, double &dy, double &dz ) const
+{
+    double s[3];
+    toFractional( dx, dy, dz, s );
+    s[0] -= rint( s[0] );
+    s[1] -= rint( s[1] );
+    s[2] -= rint( s[2] );
+    toCartesian( s, dx, dy, dz );
+}
+
+//-------------------------------------------------------------------------
+//------------- gradientToCartesian
+//-------------------------------------------------------------------------
+/*!
+ *  Converts the derivatives of a function with respect to the fractional coordinates
+ *  into its cartesian gradient.
+ */
+void mga::PeriodicBox::gradientToCartesian( const double g[3], double &x, double &y, double &z ) const
+{
+    x = inverseBox[0][0]*g[0] + inverseBox[1][0]*g[1] + inverseBox[2][0]*g[2];
+    y = inverseBox[0][1]*g[0] + inverseBox[1][1]*g[1] + inverseBox[2][1]*g[2];
+    z = inverseBox[0][2]*g[0] + inverseBox[1][2]*g[1] + inverseBox[2][2]*g[2];
+}
+
+//-------------------------------------------------------------------------
+//------------- getWidth
+//-------------------------------------------------------------------------
+/*!
+ *  \param d Index of the box vector.
+ *  \return The distance between the two box faces spanned by the other two box vectors.
+ */
+double mga::PeriodicBox::getWidth( int d ) const
+{
+    double norm = sqrt( inverseBox[d][0]*inverseBox[d][0] + inverseBox[d][1]*inverseBox[d][1] + inverseBox[d][2]*inverseBox[d][2] );
+    return( norm > 0.0 ? 1.0 / norm : 0.0 );
+}
+
+
+//--------------------------------------------
+//------------ CellList
+//--------------------------------------------
+
+//-------------------------------------------------------------------------
+//------------- CellList
+//-------------------------------------------------------------------------
+mga::CellList::CellList()
+{
+    maxCutoff    = 0.0;
+    numParticles = 0;
+    numCells     = 0;
+    cells[0] = cells[1] = cells[2] = 0;
+}
+
+//-------------------------------------------------------------------------
+//------------- build
+//-------------------------------------------------------------------------
+/*!
+ *  Folds all molecules into the bounding box of the given configuration and
+ *  sorts them into cells that are at least as large as the cutoff.
+ *  \param cnf The configuration.
+ *  \param cutoff Smallest allowed cell size, usually the interaction or histogram range.
+ *  \return false if the configuration has no usable bounding box.
+ */
+bool mga::CellList::build( CnfFile *cnf, double cutoff )
+{
+    if( cnf == 0 || box.set( cnf ) == false ) { return( false ); }
+
+    for( int d = 0; d < 3; ++d )
+    {
+	cells[d] = ( cutoff > 0.0 ) ? int( floor( box.getWidth(d) / cutoff ) ) : 1;
+	if( cells[d] < 1 ) { cells[d] = 1; }
+    }
+    return( sortIntoCells( cnf ) );
+}
+
+//-------------------------------------------------------------------------
+//------------- build
+//-------------------------------------------------------------------------
+/*!
+ *  Folds all molecules into the bounding box of the given configuration and
+ *  sorts them into the given number of cells along each box vector.
+ *  \param cnf The configuration.
+ *  \return false if the configuration has no usable bounding box.
+ */
+bool mga::CellList::build( CnfFile *cnf, int cellsX, int cellsY, int cellsZ )
+{
+    if( cnf == 0 || box.set( cnf ) == false ) { return( false ); }
+
+    cells[0] = cellsX > 0 ? cellsX : 1;
+    cells[1] = cellsY > 0 ? cellsY : 1;
+    cells[2] = cellsZ > 0 ? cellsZ : 1;
+    return( sortIntoCells( cnf ) );
+}
+
+//-------------------------------------------------------------------------
+//------------- sortIntoCells
+//-------------------------------------------------------------------------
+/*!
+ *  Folds the molecules in fractional coordinates (in parallel) and sorts them
+ *  into the cells with a counting sort, so the cells are stored contiguously.
+ *  \param cnf The configuration.
+ *  \return true.
+ */
+bool mga::CellList::sortIntoCells( CnfFile *cnf )
+{
+    //cout << "CellList::sortIntoCells beg" << endl;
+    maxCutoff = 0.5 * min( box.getWidth(0), min( box.getWidth(1), box.getWidth(2) ) );
+    numCells  = cells[0] * cells[1] * cells[2];
+
+    numParticles = cnf -> getNumberOfMolecules();
+    positions     .resize( 3*numParticles );
+    cellOfParticle.resize( numParticles );
+
+    #pragma omp parallel for schedule(static)
+    for( int i = 0; i < numParticles; ++i )
+    {
+	double r[3], s[3];
+	cnf -> getMolecule(i) -> getPositionXYZ( r[0], r[1], r[2] );
+	box.toFractional( r[0], r[1], r[2], s );
+	int index = 0;
+	for( int d = 0; d < 3; ++d )
+	{
+	    s[d] -= rint( s[d] );                                                  // fractional coordinates in [-0.5,0.5]
+	    int c = int( (s[d] + 0.5) * cells[d] );
+	    if( c >= cells[d] ) { c = cells[d] - 1; }
+	    if( c < 0 )         { c = 0; }
+	    index = index * cells[d] + c;
+	}
+	box.toCartesian( s, positions[3*i], positions[3*i+1], positions[3*i+2] );
+	cellOfParticle[i] = index;
+    }
+
+    cellOffset.assign( numCells + 1, 0 );
+    for( int i = 0; i < numParticles; ++i ) { ++cellOffset[ cellOfParticle[i] + 1 ]; }
+    for( int c = 0; c < numCells; ++c )     { cellOffset[c+1] += cellOffset[c]; }
+
+    vector<int> fill( cellOffset.begin(), cellOffset.end() - 1 );
+    cellParticles.resize( numParticles );
+    for( int i = 0; i < numParticles; ++i ) { cellParticles[ fill[ cellOfParticle[i] ]++ ] = i; }
+
+    //cout << "CellList::sortIntoCells end" << endl;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- getNeighborCells
+//-------------------------------------------------------------------------
+/*!
+ *  Returns the cell itself and its periodic neighbors. If there are less than three
+ *  cells along a box vector, duplicates are removed, so every cell appears only once.
+ *  \param cell Index of the cell.
+ *  \param neighbors Is filled with the cell indices.
+ */
+void mga::CellList::getNeighborCells( int cell, vector<int> &neighbors ) const
+{
+    neighbors.clear();
+    int cz =  cell % cells[2];
+    int cy = (cell / cells[2]) % cells[1];
+    int cx =  cell / (cells[2] * cells[1]);
+
+    for( int dx = -1; dx <= 1; ++dx )
+    {
+	int nx = (cx + dx + cells[0]) % cells[0];
+	for( int dy = -1; dy <= 1; ++dy )
+	{
+	    int ny = (cy + dy + cells[1]) % cells[1];
+	    for( int dz = -1; dz <= 1; ++dz )
+	    {
+		int nz = (cz + dz + cells[2]) % cells[2];
+		neighbors.push_back( (nx * cells[1] + ny) * cells[2] + nz );
+	    }
+	}
+    }
+    if( cells[0] < 3 || cells[1] < 3 || cells[2] < 3 )
+    {
+	sort( neighbors.begin(), neighbors.end() );
+	neighbors.erase( unique( neighbors.begin(), neighbors.end() ), neighbors.end() );
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- getCellCenter
+//-------------------------------------------------------------------------
+void mga::CellList::getCellCenter( int cell, double &x, double &y, double &z ) const
+{
+    double s[3];
+    s[2] = (  cell % cells[2]                       + 0.5 ) / cells[2] - 0.5;
+    s[1] = ( (cell / cells[2]) % cells[1]           + 0.5 ) / cells[1] - 0.5;
+    s[0] = (  cell / (cells[2] * cells[1])          + 0.5 ) / cells[0] - 0.5;
+    box.toCartesian( s, x, y, z );
+}
+
+
+//--------------------------------------------
+//------------ PairDistribution
+//--------------------------------------------
+
+//-------------------------------------------------------------------------
+//------------- PairDistribution
+//-------------------------------------------------------------------------
+/*!
+ *  \param rMaxTmp Largest distance of the histograms.
+ *  \param numBinsTmp Number of bins of every histogram.
+ *  \param sliceWidthTmp Radius of the cylinder used for g_par and half thickness of the slab used for g_perp.
+ */
+mga::PairDistribution::PairDistribution( double rMaxTmp, int numBinsTmp, double sliceWidthTmp )
+{
+    rMax       = rMaxTmp    > 0.0 ? rMaxTmp    : 5.0;
+    numBins    = numBinsTmp > 0   ? numBinsTmp : 250;
+    sliceWidth = sliceWidthTmp > 0.0 ? sliceWidthTmp : 0.5;
+    binWidth   = rMax / numBins;
+    reset();
+}
+
+//-------------------------------------------------------------------------
+//------------- reset
+//-------------------------------------------------------------------------
+void mga::PairDistribution::reset()
+{
+    numFrames  = 0;
+    sumDensity = 0.0;
+    histG   .assign( numBins, 0.0 );
+    histPar .assign( numBins, 0.0 );
+    histPerp.assign( numBins, 0.0 );
+}
+
+//-------------------------------------------------------------------------
+//------------- addFrame
+//-------------------------------------------------------------------------
+/*!
+ *  Accumulates all pairs of the given configuration that are closer than rMax.
+ *  The parallel and perpendicular distances are taken with respect to the director
+ *  that was calculated while loading the configuration.
+ *  \param cnf The configuration.
+ *  \return false if the configuration could not be analysed.
+ */
+bool mga::PairDistribution::addFrame( CnfFile *cnf )
+{
+    //cout << "PairDistribution::addFrame beg" << endl;
+    CellList cellList;
+    const double cutoff = sqrt( rMax*rMax + sliceWidth*sliceWidth );               // corners of cylinder and slab reach beyond rMax
+    if( cnf == 0 || cnf -> getNumberOfMolecules() < 2 ) { return( false ); }
+    if( cellList.build( cnf, cutoff ) == false )        { return( false ); }
+
+    if( cutoff > cellList.getMaximumCutoff() )
+    {
+	cout << "Warning: rMax = " << rMax << " exceeds half the box width (" << cellList.getMaximumCutoff()
+	     << "), larger distances are not counted correctly." << endl;
+    }
+
+    vector<double> director;
+    cnf -> getDirector( director );
+    const double nx = director.at(0), ny = director.at(1), nz = director.at(2);
+
+    const int    nThreads = numberOfThreads();
+    const double cutoff2  = cutoff * cutoff;
+    const double slice2   = sliceWidth * sliceWidth;
+    vector<vector<double> > localG   ( nThreads, vector<double>( numBins, 0.0 ) );  // thread local histograms,
+    vector<vector<double> > localPar ( nThreads, vector<double>( numBins, 0.0 ) );  // merged after the parallel loop
+    vector<vector<double> > localPerp( nThreads, vector<double>( numBins, 0.0 ) );
+
+    #pragma omp parallel
+    {
+	const int thread = threadIndex();
+	vector<double> &g    = localG   .at( thread );
+	vector<double> &par  = localPar .at( thread );
+	vector<double> &perp = localPerp.at( thread );
+	vector<int> neighbors;
+
+	#pragma omp for schedule(dynamic,8)
+	for( int c = 0; c < cellList.getNumberOfCells(); ++c )
+	{
+	    cellList.getNeighborCells( c, neighbors );
+	    for( int a = cellList.getCellBegin(c); a < cellList.getCellEnd(c); ++a )
+	    {
+		const int i = cellList.getParticle(a);
+		for( unsigned int n = 0; n < neighbors.size(); ++n )
+		{
+		    const int cn = neighbors[n];
+		    for( int b = cellList.getCellBegin(cn); b < cellList.getCellEnd(cn); ++b )
+		    {
+			const int j = cellList.getParticle(b);
+			if( j <= i ) { continue; }                             // every pair only once
+
+			double dx = cellList.getX(j) - cellList.getX(i);
+			double dy = cellList.getY(j) - cellList.getY(i);
+			double dz = cellList.getZ(j) - cellList.getZ(i);
+			cellList.minimumImage( dx, dy, dz );
+
+			double r2 = dx*dx + dy*dy + dz*dz;
+			if( r2 >= cutoff2 ) { continue; }
+
+			double rPar   = fabs( dx*nx + dy*ny + dz*nz );
+			double rPerp2 = r2 - rPar*rPar;
+
+			int k = int( sqrt(r2) / binWidth );
+			if( k < numBins ) { g[k] += 1.0; }
+			if( rPerp2 < slice2 )
+			{
+			    k = int( rPar / binWidth );
+			    if( k < numBins ) { par[k] += 1.0; }
+			}
+			if( rPar < sliceWidth )
+			{
+			    k = int( sqrt( rPerp2 > 0.0 ? rPerp2 : 0.0 ) / binWidth );
+			    if( k < numBins ) { perp[k] += 1.0; }
+			}
+		    }
+		}
+	    }
+	}
+    }
+
+    for( int t = 0; t < nThreads; ++t )
+    {
+	for( int k = 0; k < numBins; ++k )
+	{
+	    histG   .at(k) += localG   .at(t).at(k);
+	    histPar .at(k) += localPar .at(t).at(k);
+	    histPerp.at(k) += localPerp.at(t).at(k);
+	}
+    }
+
+    double n = double( cellList.getNumberOfParticles() );
+    sumDensity += n * n / cellList.getVolume();
+    ++numFrames;
+    //cout << "PairDistribution::addFrame end" << endl;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- getResult
+//-------------------------------------------------------------------------
+/*!
+ *  Normalizes the accumulated pair counts by the counts of an ideal gas of the same density.
+ *  \param r Bin centers.
+ *  \param g Radial distribution function g(r).
+ *  \param gPar Distribution along the director g_par(r_par).
+ *  \param gPerp Distribution perpendicular to the director g_perp(r_perp).
+ */
+void mga::PairDistribution::getResult( vector<double> &r, vector<double> &g,
+				       vector<double> &gPar, vector<double> &gPerp ) const
+{
+    r    .assign( numBins, 0.0 );
+    g    .assign( numBins, 0.0 );
+    gPar .assign( numBins, 0.0 );
+    gPerp.assign( numBins, 0.0 );
+    if( sumDensity <= 0.0 ) { return; }
+
+    for( int k = 0; k < numBins; ++k )
+    {
+	double rLow  = k * binWidth;
+	double rHigh = rLow + binWidth;
+	r.at(k) = rLow + 0.5 * binWidth;
+
+	double shell    = 4.0 / 3.0 * PI * ( rHigh*rHigh*rHigh - rLow*rLow*rLow );
+	double cylinder = 2.0 * PI * sliceWidth * sliceWidth * binWidth;          // both sides of the particle
+	double slab     = 2.0 * sliceWidth * PI * ( rHigh*rHigh - rLow*rLow );
+
+	g    .at(k) = 2.0 * histG   .at(k) / ( sumDensity * shell    );              // factor 2: pairs were counted once
+	gPar .at(k) = 2.0 * histPar .at(k) / ( sumDensity * cylinder );
+	gPerp.at(k) = 2.0 * histPerp.at(k) / ( sumDensity * slab     );
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- writeDataFile
+//-------------------------------------------------------------------------
+/*!
+ *  Writes the columns r, g(r), g_par(r), g_perp(r) to the given file.
+ *  \param filename Name of the file to write.
+ *  \param comment Additional comment for the header (e.g. the analysed files).
+ *  \return true on success.
+ */
+bool mga::PairDistribution::writeDataFile( string filename, string comment ) const
+{
+    vector<string> names;
+    names.push_back( "r" );
+    names.push_back( "g(r)" );
+    names.push_back( "g_par(r)" );
+    names.push_back( "g_perp(r)" );
+
+    vector<vector<double> > columns( 4 );
+    getResult( columns.at(0), columns.at(1), columns.at(2), columns.at(3) );
+
+    stringstream header;
+    header << comment << ( comment.empty() ? "" : "  " ) << "frames: " << numFrames << "  slice width: " << sliceWidth;
+    return( mga::writeDataFile( filename, header.str(), names, columns ) );
+}
+
+//-------------------------------------------------------------------------
+//------------- largestEigenpair
+//-------------------------------------------------------------------------
+/*!
+ *  Closed form solution for the largest eigenvalue of a real symmetric 3x3 matrix
+ *  and the corresponding normalized eigenvector. Much cheaper than a general solver,
+ *  which matters when it is called for every cell of a field.
+ *  \param q Upper triangle of the matrix: xx, xy, xz, yy, yz, zz.
+ *  \param lambda Largest eigenvalue.
+ *  \param v Eigenvector of lambda (set to {0,0,1} if it is not unique).
+ */
+void mga::largestEigenpair( const double q[6], double &lambda, double v[3] )
+{
+    const double xx = q[0], xy = q[1], xz = q[2], yy = q[3], yz = q[4], zz = q[5];
+    const double p1 = xy*xy + xz*xz + yz*yz;
+    const double tr = ( xx + yy + zz ) / 3.0;
+    const double p2 = (xx-tr)*(xx-tr) + (yy-tr)*(yy-tr) + (zz-tr)*(zz-tr) + 2.0*p1;
+
+    if( p2 <= 1e-24 )                                                            // multiple of the identity
+    {
+	lambda = tr;
+	v[0] = 0.0; v[1] = 0.0; v[2] = 1.0;
+	return;
+    }
+
+    const double p = sqrt( p2 / 6.0 );
+    const double bxx = (xx-tr)/p, byy = (yy-tr)/p, bzz = (zz-tr)/p;
+    const double bxy = xy/p, bxz = xz/p, byz = yz/p;
+    double r = 0.5 * ( bxx*(byy*bzz-byz*byz) - bxy*(bxy*bzz-byz*bxz) + bxz*(bxy*byz-byy*bxz) );
+    if( r < -1.0 ) { r = -1.0; }
+    if( r >  1.0 ) { r =  1.0; }
+    lambda = tr + 2.0 * p * cos( acos( r ) / 3.0 );
+
+    const double r0[3] = { xx-lambda, xy, xz };                                  // rows of (Q - lambda I), the eigenvector
+    const double r1[3] = { xy, yy-lambda, yz };                                  // is perpendicular to all of them
+    const double r2[3] = { xz, yz, zz-lambda };
+    double c[3][3];
+    c[0][0] = r0[1]*r1[2]-r0[2]*r1[1]; c[0][1] = r0[2]*r1[0]-r0[0]*r1[2]; c[0][2] = r0[0]*r1[1]-r0[1]*r1[0];
+    c[1][0] = r0[1]*r2[2]-r0[2]*r2[1]; c[1][1] = r0[2]*r2[0]-r0[0]*r2[2]; c[1][2] = r0[0]*r2[1]-r0[1]*r2[0];
+    c[2][0] = r1[1]*r2[2]-r1[2]*r2[1]; c[2][1] = r1[2]*r2[0]-r1[0]*r2[2]; c[2][2] = r1[0]*r2[1]-r1[1]*r2[0];
+
+    int best = 0;
+    double bestNorm = 0.0;
+    for( int k = 0; k < 3; ++k )
+    {
+	double n = c[k][0]*c[k][0] + c[k][1]*c[k][1] + c[k][2]*c[k][2];
+	if( n > bestNorm ) { bestNorm = n; best = k; }
+    }
+    if( bestNorm <= 1e-30 )
+    {
+	v[0] = 0.0; v[1] = 0.0; v[2] = 1.0;
+	return;
+    }
+    bestNorm = sqrt( bestNorm );
+    v[0] = c[best][0] / bestNorm;
+    v[1] = c[best][1] / bestNorm;
+    v[2] = c[best][2] / bestNorm;
+}
+
+
+//--------------------------------------------
+//------------ DirectorField
+//--------------------------------------------
+
+//-------------------------------------------------------------------------
+//------------- DirectorField
+//-------------------------------------------------------------------------
+/*!
+ *  \param resolutionTmp Number of cells along each box vector.
+ */
+mga::DirectorField::DirectorField( int resolutionTmp )
+{
+    setResolution( resolutionTmp );
+}
+
+//-------------------------------------------------------------------------
+//------------- calculate
+//-------------------------------------------------------------------------
+/*!
+ *  Sorts the molecules into the cells of the field and calculates the local order tensor,
+ *  the local order parameter and the local director of every cell. Empty cells get S = 0
+ *  and a zero director.
+ *  \param cnf The configuration.
+ *  \return false if the configuration has no usable bounding box.
+ */
+bool mga::DirectorField::calculate( CnfFile *cnf )
+{
+    //cout << "DirectorField::calculate beg" << endl;
+    if( cellList.build( cnf, resolution, resolution, resolution ) == false ) { return( false ); }
+
+    const int numCells = cellList.getNumberOfCells();
+    order    .assign(   numCells, 0.0 );
+    directors.assign( 3*numCells, 0.0 );
+
+    #pragma omp parallel for schedule(dynamic,64)
+    for( int c = 0; c < numCells; ++c )
+    {
+	const int count = getCount( c );
+	if( count == 0 ) { continue; }
+
+	double q[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+	double ux = 0.0, uy = 0.0, uz = 0.0;
+	for( int a = cellList.getCellBegin(c); a < cellList.getCellEnd(c); ++a )
+	{
+	    cnf -> getMolecule( cellList.getParticle(a) ) -> getOrientationXYZ( ux, uy, uz );
+	    q[0] += ux*ux; q[1] += ux*uy; q[2] += ux*uz;
+	    q[3] += uy*uy; q[4] += uy*uz; q[5] += uz*uz;
+	}
+	const double factor = 3.0 / ( 2.0 * count );
+	for( int k = 0; k < 6; ++k ) { q[k] *= factor; }
+	q[0] -= 0.5; q[3] -= 0.5; q[5] -= 0.5;
+
+	double lambda = 0.0, v[3];
+	largestEigenpair( q, lambda, v );
+	order[c]         = lambda;
+	directors[3*c]   = v[0];
+	directors[3*c+1] = v[1];
+	directors[3*c+2] = v[2];
+    }
+    //cout << "DirectorField::calculate end" << endl;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- getDirector
+//-------------------------------------------------------------------------
+void mga::DirectorField::getDirector( int cell, double &x, double &y, double &z ) const
+{
+    x = directors[3*cell];
+    y = directors[3*cell+1];
+    z = directors[3*cell+2];
+}
+
+//-------------------------------------------------------------------------
+//------------- getAlignmentAngles
+//-------------------------------------------------------------------------
+/*!
+ *  Calculates the angle between the long axis of every molecule and the director of
+ *  the cell it belongs to, in degrees between 0 and 90.
+ *  \param cnf The configuration the field was calculated for.
+ *  \param angles Is filled with one angle per molecule.
+ */
+void mga::DirectorField::getAlignmentAngles( CnfFile *cnf, vector<double> &angles ) const
+{
+    const int numMolecules = cellList.getNumberOfParticles();
+    angles.assign( numMolecules, 0.0 );
+    if( cnf == 0 || cnf -> getNumberOfMolecules() != numMolecules ) { return; }
+
+    #pragma omp parallel for schedule(static)
+    for( int i = 0; i < numMolecules; ++i )
+    {
+	double ux = 0.0, uy = 0.0, uz = 0.0;
+	const int c = cellList.getCellOfParticle(i);
+	cnf -> getMolecule(i) -> getOrientationXYZ( ux, uy, uz );
+	double product = fabs( ux*directors[3*c] + uy*directors[3*c+1] + uz*directors[3*c+2] );
+	if( product > 1.0 ) { product = 1.0; }
+	angles[i] = acos( product ) * 180.0 / PI;
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- writeDataFile
+//-------------------------------------------------------------------------
+/*!
+ *  Writes one line per cell with the cell center, the number of molecules,
+ *  the local order parameter and the local director.
+ *  \param filename Name of the file to write.
+ *  \param comment Additional comment for the header.
+ *  \return true on success.
+ */
+bool mga::DirectorField::writeDataFile( string filename, string comment ) const
+{
+    const char *namesTmp[] = { "x", "y", "z", "count", "S", "nx", "ny", "nz" };
+    vector<string> names( namesTmp, namesTmp + 8 );
+    vector<vector<double> > columns( 8, vector<double>( getNumberOfCells(), 0.0 ) );
+
+    for( int c = 0; c < getNumberOfCells(); ++c )
+    {
+	getCellCenter( c, columns[0][c], columns[1][c], columns[2][c] );
+	columns[3][c] = getCount( c );
+	columns[4][c] = order[c];
+	getDirector( c, columns[5][c], columns[6][c], columns[7][c] );
+    }
+
+    stringstream header;
+    header << comment << ( comment.empty() ? "" : "  " ) << "resolution: " << resolution;
+    return( mga::writeDataFile( filename, header.str(), names, columns ) );
+}
+
+
+//--------------------------------------------
+//------------ DefectFinder
+//--------------------------------------------
+
+//-------------------------------------------------------------------------
+//------------- DefectFinder
+//-------------------------------------------------------------------------
+/*!
+ *  \param threshold Cells with a lower local order parameter are defect cells.
+ */
+mga::DefectFinder::DefectFinder( double threshold )
+{
+    orderThreshold = threshold;
+    numDefectCells = 0;
+    cells[0] = cells[1] = cells[2] = 0;
+}
+
+//-------------------------------------------------------------------------
+//------------- find
+//-------------------------------------------------------------------------
+/*!
+ *  Marks the defect cells of the field (in parallel) and connects them into polylines.
+ *  Lines are started at end points first, remaining cells belong to loops or branches.
+ *  A branch starts at the center of the junction cell it is attached to.
+ *  \param field A calculated director field.
+ *  \return false if the field is empty.
+ */
+bool mga::DefectFinder::find( const DirectorField &field )
+{
+    //cout << "DefectFinder::find beg" << endl;
+    const CellList &cellList = field.getCellList();
+    const int numCells = field.getNumberOfCells();
+    lines.clear();
+    defect.assign( numCells, 0 );
+    numDefectCells = 0;
+    if( numCells == 0 ) { return( false ); }
+    for( int d = 0; d < 3; ++d ) { cells[d] = cellList.getCellsAlong( d ); }
+
+    int count = 0;
+    #pragma omp parallel for schedule(dynamic,64) reduction(+:count)
+    for( int c = 0; c < numCells; ++c )
+    {
+	if( field.getCount( c ) == 0 ) { continue; }
+	const int cz =  c % cells[2];
+	const int cy = (c / cells[2]) % cells[1];
+	const int cx =  c / (cells[2] * cells[1]);
+	if( field.getOrder( c ) < orderThreshold || hasWinding( field, cx, cy, cz ) )
+	{
+	    defect[c] = 1;
+	    ++count;
+	}
+    }
+    numDefectCells = count;
+
+    vector<char> visited( numCells, 0 );
+    vector<int>  neighbors;
+    for( int pass = 0; pass < 2; ++pass )
+    {
+	for( int c = 0; c < numCells; ++c )
+	{
+	    if( defect[c] == 0 || visited[c] != 0 ) { continue; }
+	    getDefectNeighbors( c, neighbors );
+	    if( neighbors.empty() ) { visited[c] = 1; continue; }            // isolated cell
+	    if( pass == 0 && neighbors.size() != 1 ) { continue; }           // first pass: end points only
+
+	    vector<float> line;
+	    for( unsigned int n = 0; n < neighbors.size(); ++n )
+	    {
+		if( visited[neighbors[n]] != 0 ) { addPoint( field, neighbors[n], line ); break; }
+	    }
+
+	    int current = c;
+	    int length  = 0;
+	    while( true )
+	    {
+		visited[current] = 1;
+		addPoint( field, current, line );
+		++length;
+		getDefectNeighbors( current, neighbors );
+		int next = -1;
+		for( unsigned int n = 0; n < neighbors.size(); ++n )
+		{
+		    if( visited[neighbors[n]] == 0 ) { next = neighbors[n]; break; }
+		}
+		if( next < 0 ) { break; }
+		current = next;
+	    }
+	    if( length > 2 )                                                 // close loops
+	    {
+		for( unsigned int n = 0; n < neighbors.size(); ++n )
+		{
+		    if( neighbors[n] == c ) { addPoint( field, c, line ); break; }
+		}
+	    }
+	    if( line.size() >= 6 ) { lines.push_back( line ); }
+	}
+    }
+    //cout << "DefectFinder::find end" << endl;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- hasWinding
+//-------------------------------------------------------------------------
+/*!
+ *  Tests the xy, yz and zx plaquettes that have the given cell as lower corner.
+ *  Plaquettes touching an empty cell are skipped.
+ *  \return true if any of the plaquettes has a half integer winding.
+ */
+bool mga::DefectFinder::hasWinding( const DirectorField &field, int cx, int cy, int cz ) const
+{
+    const int c[3] = { cx, cy, cz };
+    for( int a = 0; a < 3; ++a )
+    {
+	const int b = ( a + 1 ) % 3;
+	if( cells[a] < 2 || cells[b] < 2 ) { continue; }
+
+	int corner[4];
+	for( int k = 0; k < 4; ++k )
+	{
+	    int p[3] = { c[0], c[1], c[2] };
+	    if( k == 1 || k == 2 ) { p[a] = ( p[a] + 1 ) % cells[a]; }
+	    if( k == 2 || k == 3 ) { p[b] = ( p[b] + 1 ) % cells[b]; }
+	    corner[k] = cellIndex( p[0], p[1], p[2] );
+	}
+
+	int  flips = 0;
+	bool empty = false;
+	for( int k = 0; k < 4 && empty == false; ++k )
+	{
+	    const int i = corner[k], j = corner[(k+1)%4];
+	    if( field.getCount(i) == 0 || field.getCount(j) == 0 ) { empty = true; break; }
+	    double ix, iy, iz, jx, jy, jz;
+	    field.getDirector( i, ix, iy, iz );
+	    field.getDirector( j, jx, jy, jz );
+	    if( ix*jx + iy*jy + iz*jz < 0.0 ) { ++flips; }
+	}
+	if( empty == false && flips % 2 == 1 ) { return( true ); }
+    }
+    return( false );
+}
+
+//-------------------------------------------------------------------------
+//------------- getDefectNeighbors
+//-------------------------------------------------------------------------
+/*!
+ *  Returns the defect cells adjacent to a cell, face neighbors first, then edge
+ *  and corner neighbors, so that lines preferably follow the faces of the cells.
+ *  Neighbors across the periodic boundaries are not taken into account.
+ */
+void mga::DefectFinder::getDefectNeighbors( int cell, vector<int> &neighbors ) const
+{
+    neighbors.clear();
+    const int cz =  cell % cells[2];
+    const int cy = (cell / cells[2]) % cells[1];
+    const int cx =  cell / (cells[2] * cells[1]);
+
+    for( int order = 1; order <= 3; ++order )
+    {
+	for( int dx = -1; dx <= 1; ++dx )
+	{
+	    const int nx = cx + dx;
+	    if( nx < 0 || nx >= cells[0] ) { continue; }
+	    for( int dy = -1; dy <= 1; ++dy )
+	    {
+		const int ny = cy + dy;
+		if( ny < 0 || ny >= cells[1] ) { continue; }
+		for( int dz = -1; dz <= 1; ++dz )
+		{
+		    const int nz = cz + dz;
+		    if( nz < 0 || nz >= cells[2] ) { continue; }
+		    if( dx*dx + dy*dy + dz*dz != order ) { continue; }
+		    const int n = cellIndex( nx, ny, nz );
+		    if( defect[n] != 0 ) { neighbors.push_back( n ); }
+		}
+	    }
+	}
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- addPoint
+//-------------------------------------------------------------------------
+void mga::DefectFinder::addPoint( const DirectorField &field, int cell, vector<float> &line ) const
+{
+    double x, y, z;
+    field.getCellCenter( cell, x, y, z );
+    line.push_back( float(x) );
+    line.push_back( float(y) );
+    line.push_back( float(z) );
+}
+
+
+//--------------------------------------------
+//------------ IsoSurface
+//--------------------------------------------
+
+//-------------------------------------------------------------------------
+//------------- IsoSurface
+//-------------------------------------------------------------------------
+/*!
+ *  \param resolution Number of grid cells along each box vector.
+ */
+mga::IsoSurface::IsoSurface( int resolution ) : field( resolution )
+{
+    quantity = LOCAL_ORDER;
+    type     = 0;
+    isoValue = 0.5;
+    minimum  = 0.0;
+    maximum  = 0.0;
+}
+
+//-------------------------------------------------------------------------
+//------------- calculate
+//-------------------------------------------------------------------------
+/*!
+ *  Calculates the selected scalar field and extracts the surface at the iso value.
+ *  \param cnf The configuration.
+ *  \return false if the configuration has no usable bounding box.
+ */
+bool mga::IsoSurface::calculate( CnfFile *cnf )
+{
+    //cout << "IsoSurface::calculate beg" << endl;
+    vertices.clear();
+    normals.clear();
+    if( calculateField( cnf ) == false ) { return( false ); }
+
+    const CellList &cells = field.getCellList();
+    const int n[3] = { cells.getCellsAlong(0), cells.getCellsAlong(1), cells.getCellsAlong(2) };
+    if( n[0] < 2 || n[1] < 2 || n[2] < 2 ) { return( true ); }
+    calculateGradients();
+
+    static const int tetrahedra[6][4] = { {0,7,1,3}, {0,7,3,2}, {0,7,2,6},
+					  {0,7,6,4}, {0,7,4,5}, {0,7,5,1} }; // corner bits: x = 1, y = 2, z = 4
+    const int numCubes   = field.getNumberOfCells();
+    const int numThreads = numberOfThreads();
+    vector<vector<float> > threadVertices( numThreads );
+    vector<vector<float> > threadNormals ( numThreads );
+
+    #pragma omp parallel
+    {
+	vector<float> &verticesTmp = threadVertices[threadIndex()];
+	vector<float> &normalsTmp  = threadNormals [threadIndex()];
+
+	#pragma omp for schedule(static)
+	for( int c = 0; c < numCubes; ++c )
+	{
+	    const int cz =  c % n[2];
+	    const int cy = (c / n[2]) % n[1];
+	    const int cx =  c / (n[2] * n[1]);
+
+	    double p[8][3], v[8], g[8][3];
+	    bool above = false, below = false;
+	    for( int k = 0; k < 8; ++k )
+	    {
+		const int i[3] = { cx + (k & 1), cy + ((k >> 1) & 1), cz + ((k >> 2) & 1) };
+		const int corner = ( (i[0] % n[0]) * n[1] + i[1] % n[1] ) * n[2] + i[2] % n[2];
+		v[k] = values[corner];
+		if( v[k] >= isoValue ) { above = true; } else { below = true; }
+		double s[3];                                                 // unwrapped, so cubes across the boundary stay in one piece
+		for( int d = 0; d < 3; ++d ) { s[d] = ( i[d] + 0.5 ) / n[d] - 0.5; }
+		cells.getBox().toCartesian( s, p[k][0], p[k][1], p[k][2] );
+		for( int d = 0; d < 3; ++d ) { g[k][d] = gradients[3*corner+d]; }
+	    }
+	    if( above == false || below == false ) { continue; }
+
+	    for( int t = 0; t < 6; ++t )
+	    {
+		double tp[4][3], tv[4], tg[4][3];
+		for( int k = 0; k < 4; ++k )
+		{
+		    const int corner = tetrahedra[t][k];
+		    tv[k] = v[corner];
+		    for( int d = 0; d < 3; ++d ) { tp[k][d] = p[corner][d]; tg[k][d] = g[corner][d]; }
+		}
+		polygonize( tp, tv, tg, verticesTmp, normalsTmp );
+	    }
+	}
+    }
+
+    for( int t = 0; t < numThreads; ++t )
+    {
+	vertices.insert( vertices.end(), threadVertices[t].begin(), threadVertices[t].end() );
+	normals .insert( normals .end(), threadNormals [t].begin(), threadNormals [t].end() );
+    }
+    //cout << "IsoSurface::calculate end" << endl;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- calculateField
+//-------------------------------------------------------------------------
+/*!
+ *  Fills the grid with the local order parameter, the number density (molecules per
+ *  volume) or the fraction of molecules of the selected type. Empty cells get 0.
+ */
+bool mga::IsoSurface::calculateField( CnfFile *cnf )
+{
+    if( field.calculate( cnf ) == false ) { return( false ); }
+
+    const CellList &cells = field.getCellList();
+    const int numCells = field.getNumberOfCells();
+    const double cellVolume = cells.getVolume() / numCells;
+    values.assign( numCells, 0.0 );
+
+    #pragma omp parallel for schedule(static)
+    for( int c = 0; c < numCells; ++c )
+    {
+	const int count = field.getCount( c );
+	if( count == 0 ) { continue; }
+	switch( quantity )
+	{
+	case DENSITY:
+	    values[c] = count / cellVolume;
+	    break;
+	case TYPE_FRACTION:
+	    {
+		int numType = 0;
+		for( int a = cells.getCellBegin(c); a < cells.getCellEnd(c); ++a )
+		{
+		    if( cnf -> getMolecule( cells.getParticle(a) ) -> getType() == type ) { ++numType; }
+		}
+		values[c] = double( numType ) / count;
+	    }
+	    break;
+	default:
+	    values[c] = field.getOrder( c );
+	}
+    }
+
+    minimum = maximum = ( numCells > 0 ? values[0] : 0.0 );
+    for( int c = 1; c < numCells; ++c )
+    {
+	minimum = min( minimum, values[c] );
+	maximum = max( maximum, values[c] );
+    }
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- calculateGradients
+//-------------------------------------------------------------------------
+/*!
+ *  Central differences along the box vectors (periodic), converted to cartesian gradients.
+ */
+void mga::IsoSurface::calculateGradients()
+{
+    const CellList &cells = field.getCellList();
+    const int n[3] = { cells.getCellsAlong(0), cells.getCellsAlong(1), cells.getCellsAlong(2) };
+    const int numCells = field.getNumberOfCells();
+    gradients.assign( 3*numCells, 0.0 );
+
+    #pragma omp parallel for schedule(static)
+    for( int c = 0; c < numCells; ++c )
+    {
+	const int i[3] = { c / (n[2] * n[1]), (c / n[2]) % n[1], c % n[2] };
+	double g[3];
+	for( int d = 0; d < 3; ++d )
+	{
+	    int up[3]   = { i[0], i[1], i[2] };
+	    int down[3] = { i[0], i[1], i[2] };
+	    up[d]   = ( i[d] + 1 ) % n[d];
+	    down[d] = ( i[d] - 1 + n[d] ) % n[d];
+	    const double vUp   = values[ (up[0]   * n[1] + up[1]  ) * n[2] + up[2]   ];
+	    const double vDown = values[ (down[0] * n[1] + down[1]) * n[2] + down[2] ];
+	    g[d] = 0.5 * ( vUp - vDown ) * n[d];                           // derivative with respect to the fractional coordinate
+	}
+	cells.getBox().gradientToCartesian( g, gradients[3*c], gradients[3*c+1], gradients[3*c+2] );
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- polygonize
+//-------------------------------------------------------------------------
+/*!
+ *  Appends the zero, one or two triangles where the surface cuts a tetrahedron.
+ *  Vertices are linearly interpolated along the edges, the triangles are wound
+ *  counter clockwise seen from the lower values.
+ *  \param p Corner positions.
+ *  \param v Field values at the corners.
+ *  \param g Field gradients at the corners.
+ */
+void mga::IsoSurface::polygonize( const double p[4][3], const double v[4], const double g[4][3],
+				  vector<float> &verticesTmp, vector<float> &normalsTmp ) const
+{
+    int inside[4], outside[4];
+    int numInside = 0, numOutside = 0;
+    for( int k = 0; k < 4; ++k )
+    {
+	if( v[k] >= isoValue ) { inside[numInside++] = k; } else { outside[numOutside++] = k; }
+    }
+    if( numInside == 0 || numOutside == 0 ) { return; }
+
+    // cut edges, ordered so that consecutive edges share a corner
+    int edges[4][2];
+    int numEdges = 0;
+    if( numInside == 1 || numOutside == 1 )
+    {
+	const int  apex  = ( numInside == 1 ? inside[0] : outside[0] );
+	const int *other = ( numInside == 1 ? outside : inside );
+	for( int k = 0; k < 3; ++k ) { edges[numEdges][0] = apex; edges[numEdges][1] = other[k]; ++numEdges; }
+    }
+    else
+    {
+	edges[0][0] = inside[0]; edges[0][1] = outside[0];
+	edges[1][0] = inside[0]; edges[1][1] = outside[1];
+	edges[2][0] = inside[1]; edges[2][1] = outside[1];
+	edges[3][0] = inside[1]; edges[3][1] = outside[0];
+	numEdges = 4;
+    }
+
+    double q[4][3], nq[4][3];
+    for( int e = 0; e < numEdges; ++e )
+    {
+	const int a = edges[e][0], b = edges[e][1];
+	const double t = ( v[b] != v[a] ) ? ( isoValue - v[a] ) / ( v[b] - v[a] ) : 0.5;
+	double norm = 0.0;
+	for( int d = 0; d < 3; ++d )
+	{
+	    q[e][d]  =   p[a][d] + t * ( p[b][d] - p[a][d] );
+	    nq[e][d] = -( g[a][d] + t * ( g[b][d] - g[a][d] ) );
+	    norm += nq[e][d] * nq[e][d];
+	}
+	norm = sqrt( norm );
+	for( int d = 0; d < 3; ++d ) { nq[e][d] = ( norm > 0.0 ? nq[e][d] / norm : 0.0 ); }
+    }
+
+    // the face normal has to point from the inside corners to the outside corners
+    double face[3], toOutside[3];
+    const double u[3] = { q[1][0]-q[0][0], q[1][1]-q[0][1], q[1][2]-q[0][2] };
+    const double w[3] = { q[2][0]-q[0][0], q[2][1]-q[0][1], q[2][2]-q[0][2] };
+    face[0] = u[1]*w[2] - u[2]*w[1];
+    face[1] = u[2]*w[0] - u[0]*w[2];
+    face[2] = u[0]*w[1] - u[1]*w[0];
+    for( int d = 0; d < 3; ++d ) { toOutside[d] = p[outside[0]][d] - p[inside[0]][d]; }
+    const bool flip = ( face[0]*toOutside[0] + face[1]*toOutside[1] + face[2]*toOutside[2] < 0.0 );
+
+    const int triangles[2][3] = { {0,1,2}, {0,2,3} };
+    for( int t = 0; t < numEdges - 2; ++t )
+    {
+	for( int k = 0; k < 3; ++k )
+	{
+	    const int e = triangles[t][ flip ? 2-k : k ];
+	    for( int d = 0; d < 3; ++d )
+	    {
+		verticesTmp.push_back( float( q[e][d] ) );
+		normalsTmp .push_back( float( nq[e][d] ) );
+	    }
+	}
+    }
+}
+
+
+//--------------------------------------------
+//------------ ClusterAnalysis
+//--------------------------------------------
+
+//-------------------------------------------------------------------------
+//------------- ClusterAnalysis
+//-------------------------------------------------------------------------
+/*!
+ *  \param cutoffTmp Largest bond length.
+ *  \param maxAngleTmp Largest angle (deg) between the long axes of bonded molecules.
+ *  \param typeTmp Only molecules of this type are clustered, -1 for all.
+ */
+mga::ClusterAnalysis::ClusterAnalysis( double cutoffTmp, double maxAngleTmp, int typeTmp )
+{
+    cutoff   = cutoffTmp;
+    maxAngle = maxAngleTmp;
+    type     = typeTmp;
+}
+
+//-------------------------------------------------------------------------
+//------------- findRoot
+//-------------------------------------------------------------------------
+/*!
+ *  Follows the parent links to the root. Every visited link is replaced by a link to the
+ *  grandparent (path halving); a failing compare and swap only means another thread
+ *  changed the link in between, which is harmless.
+ */
+int mga::ClusterAnalysis::findRoot( int i )
+{
+    volatile int *p = &parent[0];
+    while( true )
+    {
+	const int up = p[i];
+	if( up == i ) { return( i ); }
+	const int upUp = p[up];
+	if( upUp != up ) { __sync_bool_compare_and_swap( &parent[i], up, upUp ); }
+	i = upUp;
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- unite
+//-------------------------------------------------------------------------
+/*!
+ *  Links the root with the larger index to the one with the smaller index. The link only
+ *  succeeds if the root is still a root, otherwise the roots are searched again.
+ */
+void mga::ClusterAnalysis::unite( int i, int j )
+{
+    while( true )
+    {
+	i = findRoot( i );
+	j = findRoot( j );
+	if( i == j ) { return; }
+	if( i < j ) { const int tmp = i; i = j; j = tmp; }
+	if( __sync_bool_compare_and_swap( &parent[i], i, j ) ) { return; }
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- calculate
+//-------------------------------------------------------------------------
+/*!
+ *  Finds all bonds in parallel and merges the bonded molecules into clusters.
+ *  \param cnf The configuration.
+ *  \return false if the configuration has no usable bounding box.
+ */
+bool mga::ClusterAnalysis::calculate( CnfFile *cnf )
+{
+    //cout << "ClusterAnalysis::calculate beg" << endl;
+    clusterIds.clear();
+    sizes.clear();
+    if( cnf == 0 ) { return( false ); }
+
+    CellList cellList;
+    if( cellList.build( cnf, cutoff ) == false ) { return( false ); }
+    if( cutoff > cellList.getMaximumCutoff() )
+    {
+	cout << "Warning: cluster cutoff = " << cutoff << " exceeds half the box width (" << cellList.getMaximumCutoff()
+	     << "), bonds may be missed." << endl;
+    }
+
+    const int numMolecules = cellList.getNumberOfParticles();
+    const double cutoff2   = cutoff * cutoff;
+    const double minCos    = ( maxAngle < 90.0 ? cos( maxAngle * PI / 180.0 ) : -1.0 );
+    vector<double> axes( 3*numMolecules );
+    vector<char>   selected( numMolecules );
+    parent.resize( numMolecules );
+
+    #pragma omp parallel for schedule(static)
+    for( int i = 0; i < numMolecules; ++i )
+    {
+	MoleculeBiax *mc = cnf -> getMolecule(i);
+	mc -> getOrientationXYZ( axes[3*i], axes[3*i+1], axes[3*i+2] );
+	selected[i] = ( type < 0 || mc -> getType() == type );
+	parent[i] = i;
+    }
+
+    #pragma omp parallel
+    {
+	vector<int> neighbors;
+
+	#pragma omp for schedule(dynamic,8)
+	for( int c = 0; c < cellList.getNumberOfCells(); ++c )
+	{
+	    cellList.getNeighborCells( c, neighbors );
+	    for( int a = cellList.getCellBegin(c); a < cellList.getCellEnd(c); ++a )
+	    {
+		const int i = cellList.getParticle(a);
+		if( selected[i] == 0 ) { continue; }
+		for( unsigned int n = 0; n < neighbors.size(); ++n )
+		{
+		    const int cn = neighbors[n];
+		    for( int b = cellList.getCellBegin(cn); b < cellList.getCellEnd(cn); ++b )
+		    {
+			const int j = cellList.getParticle(b);
+			if( j <= i || selected[j] == 0 ) { continue; }
+
+			double dx = cellList.getX(j) - cellList.getX(i);
+			double dy = cellList.getY(j) - cellList.getY(i);
+			double dz = cellList.getZ(j) - cellList.getZ(i);
+			cellList.minimumImage( dx, dy, dz );
+			if( dx*dx + dy*dy + dz*dz >= cutoff2 ) { continue; }
+
+			const double product = fabs( axes[3*i]*axes[3*j] + axes[3*i+1]*axes[3*j+1] + axes[3*i+2]*axes[3*j+2] );
+			if( product < minCos ) { continue; }
+			unite( i, j );
+		    }
+		}
+	    }
+	}
+    }
+
+    // number the clusters by decreasing size
+    vector<int> rootSize( numMolecules, 0 );
+    clusterIds.assign( numMolecules, -1 );
+    for( int i = 0; i < numMolecules; ++i )
+    {
+	if( selected[i] != 0 ) { ++rootSize[ findRoot(i) ]; }
+    }
+    vector<std::pair<int,int> > order;
+    for( int i = 0; i < numMolecules; ++i )
+    {
+	if( rootSize[i] > 0 ) { order.push_back( std::make_pair( -rootSize[i], i ) ); }
+    }
+    sort( order.begin(), order.end() );
+    vector<int> rootId( numMolecules, -1 );
+    sizes.resize( order.size() );
+    for( unsigned int k = 0; k < order.size(); ++k )
+    {
+	rootId[ order[k].second ] = k;
+	sizes[k] = -order[k].first;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for( int i = 0; i < numMolecules; ++i )
+    {
+	if( selected[i] != 0 ) { clusterIds[i] = rootId[ parent[i] == i ? i : findRoot(i) ]; }
+    }
+    //cout << "ClusterAnalysis::calculate end" << endl;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- getSizeDistribution
+//-------------------------------------------------------------------------
+/*!
+ *  \param size Is filled with every occurring cluster size, increasing.
+ *  \param count Is filled with the number of clusters of that size.
+ */
+void mga::ClusterAnalysis::getSizeDistribution( vector<double> &size, vector<double> &count ) const
+{
+    size.clear();
+    count.clear();
+    for( int k = int( sizes.size() ) - 1; k >= 0; --k )                        // sizes are decreasing
+    {
+	if( size.empty() || size.back() != sizes[k] )
+	{
+	    size.push_back( sizes[k] );
+	    count.push_back( 0.0 );
+	}
+	count.back() += 1.0;
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- writeDataFile
+//-------------------------------------------------------------------------
+/*!
+ *  Writes the cluster size distribution, one line per occurring size.
+ *  \param filename Name of the file to write.
+ *  \param comment Additional comment for the header.
+ *  \return true on success.
+ */
+bool mga::ClusterAnalysis::writeDataFile( string filename, string comment ) const
+{
+    const char *namesTmp[] = { "Size", "Clusters" };
+    vector<string> names( namesTmp, namesTmp + 2 );
+    vector<vector<double> > columns( 2 );
+    getSizeDistribution( columns[0], columns[1] );
+
+    stringstream header;
+    header << comment << ( comment.empty() ? "" : "  " ) << "cutoff: " << cutoff << "  max. angle: " << maxAngle
+	   << "  type: " << type << "  clusters: " << getNumberOfClusters()
+	   << "  largest: " << ( sizes.empty() ? 0 : sizes[0] );
+    return( mga::writeDataFile( filename, header.str(), names, columns ) );
+}
+
+
+//--------------------------------------------
+//------------ StructureFactor
+//--------------------------------------------
+
+//-------------------------------------------------------------------------
+//------------- StructureFactor
+//-------------------------------------------------------------------------
+/*!
+ *  \param size Grid points per box vector (rounded up to a power of two).
+ *  \param numBinsTmp Number of |q| shells.
+ */
+mga::StructureFactor::StructureFactor( int size, int numBinsTmp )
+{
+    numBins = numBinsTmp > 0 ? numBinsTmp : 1;
+    setGridSize( size );
+    current.order = current.spacing = current.binWidth = 0.0;
+    current.normal[0] = current.normal[1] = current.normal[2] = 0.0;
+}
+
+//-------------------------------------------------------------------------
+//------------- setGridSize
+//-------------------------------------------------------------------------
+void mga::StructureFactor::setGridSize( int size )
+{
+    gridSize = 2;
+    while( gridSize < size ) { gridSize *= 2; }
+    cache.clear();
+}
+
+//-------------------------------------------------------------------------
+//------------- fft
+//-------------------------------------------------------------------------
+/*!
+ *  Iterative radix-2 FFT with the sign convention exp(-2 pi i k m / n).
+ *  \param data n values, replaced by their transform.
+ *  \param n Number of values, a power of two.
+ */
+void mga::StructureFactor::fft( complex<double> *data, int n )
+{
+    for( int i = 1, j = 0; i < n; ++i )                                          // bit reversal
+    {
+	int bit = n >> 1;
+	for( ; j & bit; bit >>= 1 ) { j ^= bit; }
+	j ^= bit;
+	if( i < j ) { std::swap( data[i], data[j] ); }
+    }
+    for( int length = 2; length <= n; length <<= 1 )
+    {
+	const complex<double> step = std::polar( 1.0, -2.0 * PI / length );
+	for( int i = 0; i < n; i += length )
+	{
+	    complex<double> w( 1.0, 0.0 );
+	    for( int k = 0; k < length/2; ++k )
+	    {
+		const complex<double> u = data[i+k];
+		const complex<double> v = data[i+k+length/2] * w;
+		data[i+k]          = u + v;
+		data[i+k+length/2] = u - v;
+		w *= step;
+	    }
+	}
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- calculate
+//-------------------------------------------------------------------------
+/*!
+ *  Calculates S(q), the smectic order parameter and the layer spacing of a configuration.
+ *  If the key is not empty and already cached, the cached results are used instead.
+ *  \param cnf The configuration.
+ *  \param key Cache key, e.g. the file name of the configuration.
+ *  \return false if the configuration is empty or has no usable bounding box.
+ */
+bool mga::StructureFactor::calculate( CnfFile *cnf, string key )
+{
+    //cout << "StructureFactor::calculate beg" << endl;
+    if( key.empty() == false )
+    {
+	map<string, Frame>::const_iterator it = cache.find( key );
+	if( it != cache.end() )
+	{
+	    current = it -> second;
+	    return( true );
+	}
+    }
+
+    PeriodicBox box;
+    if( cnf == 0 || cnf -> getNumberOfMolecules() == 0 ) { return( false ); }
+    if( box.set( cnf ) == false )                         { return( false ); }
+
+    const int M  = gridSize;
+    const int M3 = M * M * M;
+    const int numMolecules = cnf -> getNumberOfMolecules();
+    const int numThreads   = numberOfThreads();
+
+    // cloud in cell assignment into thread local grids
+    vector<vector<double> > localGrid( numThreads );
+    #pragma omp parallel
+    {
+	vector<double> &grid = localGrid[threadIndex()];
+	grid.assign( M3, 0.0 );
+
+	#pragma omp for schedule(static)
+	for( int i = 0; i < numMolecules; ++i )
+	{
+	    MoleculeBiax *mc = cnf -> getMolecule(i);
+	    double s[3];
+	    box.toFractional( mc -> getPositionX(), mc -> getPositionY(), mc -> getPositionZ(), s );
+	    int    lower[3], upper[3];
+	    double weight[3];
+	    for( int d = 0; d < 3; ++d )
+	    {
+		double u = ( s[d] - floor( s[d] + 0.5 ) + 0.5 ) * M;
+		int    k = int( floor( u ) );
+		weight[d] = u - k;
+		lower[d]  = ( k % M + M ) % M;
+		upper[d]  = ( lower[d] + 1 ) % M;
+	    }
+	    for( int corner = 0; corner < 8; ++corner )
+	    {
+		const int x = ( corner & 1 ) ? upper[0] : lower[0];
+		const int y = ( corner & 2 ) ? upper[1] : lower[1];
+		const int z = ( corner & 4 ) ? upper[2] : lower[2];
+		const double w = ( ( corner & 1 ) ? weight[0] : 1.0 - weight[0] )
+			       * ( ( corner & 2 ) ? weight[1] : 1.0 - weight[1] )
+			       * ( ( corner & 4 ) ? weight[2] : 1.0 - weight[2] );
+		grid[ ( x * M + y ) * M + z ] += w;
+	    }
+	}
+    }
+
+    vector<complex<double> > data( M3 );
+    #pragma omp parallel for schedule(static)
+    for( int k = 0; k < M3; ++k )
+    {
+	double sum = 0.0;
+	for( int t = 0; t < numThreads; ++t ) { sum += localGrid[t][k]; }
+	data[k] = complex<double>( sum, 0.0 );
+    }
+    localGrid.clear();
+
+    // 3D FFT: one dimension after the other, the lines are distributed among threads
+    const int strides[3] = { 1, M, M*M };
+    for( int d = 0; d < 3; ++d )
+    {
+	const int stride = strides[d];
+	#pragma omp parallel
+	{
+	    vector<complex<double> > line( M );
+
+	    #pragma omp for schedule(static)
+	    for( int l = 0; l < M*M; ++l )
+	    {
+		// first element of line l: the index with a zero coordinate along d
+		const int start = ( stride == 1 ) ? l * M : ( l / stride ) * stride * M + l % stride;
+		for( int k = 0; k < M; ++k ) { line[k] = data[ start + k * stride ]; }
+		fft( &line[0], M );
+		for( int k = 0; k < M; ++k ) { data[ start + k * stride ] = line[k]; }
+	    }
+	}
+    }
+
+    // shell averages and the peak along the director
+    vector<double> director;
+    cnf -> getDirector( director );
+    const double nx = director.at(0), ny = director.at(1), nz = director.at(2);
+    const double minCos = cos( 10.0 * PI / 180.0 );
+    const double qMax   = PI * M / std::max( box.getWidth(0), std::max( box.getWidth(1), box.getWidth(2) ) );
+    Frame frame;
+    frame.binWidth = qMax / numBins;
+    frame.radial  .assign( numBins, 0.0 );
+    frame.parallel.assign( numBins, 0.0 );
+
+    vector<vector<double> > localSum  ( numThreads, vector<double>( numBins, 0.0 ) );
+    vector<vector<double> > localCount( numThreads, vector<double>( numBins, 0.0 ) );
+    vector<vector<double> > localPar  ( numThreads, vector<double>( numBins, 0.0 ) );
+    vector<double> localPeak( numThreads, 0.0 );
+    vector<int>    localPeakIndex( numThreads, -1 );
+
+    #pragma omp parallel
+    {
+	const int thread = threadIndex();
+
+	#pragma omp for schedule(static)
+	for( int k = 1; k < M3; ++k )                                            // k = 0 is q = 0
+	{
+	    const int index[3] = { k / (M*M), (k / M) % M, k % M };
+	    double m[3], window = 1.0;
+	    for( int d = 0; d < 3; ++d )
+	    {
+		m[d] = ( index[d] < M/2 ) ? index[d] : index[d] - M;
+		if( index[d] != 0 )
+		{
+		    const double x = PI * m[d] / M;
+		    const double sinc = sin( x ) / x;
+		    window *= sinc * sinc;
+		}
+	    }
+	    double qx, qy, qz;
+	    box.gradientToCartesian( m, qx, qy, qz );
+	    qx *= 2.0 * PI; qy *= 2.0 * PI; qz *= 2.0 * PI;
+	    const double q = sqrt( qx*qx + qy*qy + qz*qz );
+	    const int bin = int( q / frame.binWidth );
+	    if( bin >= numBins ) { continue; }
+
+	    const double S = std::norm( data[k] ) / numMolecules / ( window * window );
+	    localSum  [thread][bin] += S;
+	    localCount[thread][bin] += 1.0;
+	    if( fabs( qx*nx + qy*ny + qz*nz ) >= minCos * q )
+	    {
+		if( S > localPar[thread][bin] ) { localPar[thread][bin] = S; }
+		if( S > localPeak[thread] ) { localPeak[thread] = S; localPeakIndex[thread] = k; }
+	    }
+	}
+    }
+
+    int peakIndex = -1;
+    double peak = 0.0;
+    for( int t = 0; t < numThreads; ++t )
+    {
+	for( int b = 0; b < numBins; ++b )
+	{
+	    frame.radial[b]  += localSum[t][b];
+	    frame.parallel[b] = std::max( frame.parallel[b], localPar[t][b] );
+	    localCount[0][b] += ( t > 0 ? localCount[t][b] : 0.0 );
+	}
+	if( localPeakIndex[t] >= 0 && localPeak[t] > peak ) { peak = localPeak[t]; peakIndex = localPeakIndex[t]; }
+    }
+    for( int b = 0; b < numBins; ++b )
+    {
+	if( localCount[0][b] > 0.0 ) { frame.radial[b] /= localCount[0][b]; }
+    }
+
+    // exact smectic order parameter at the peak
+    frame.order = frame.spacing = 0.0;
+    frame.normal[0] = frame.normal[1] = frame.normal[2] = 0.0;
+    if( peakIndex > 0 )
+    {
+	const int index[3] = { peakIndex / (M*M), (peakIndex / M) % M, peakIndex % M };
+	double m[3];
+	for( int d = 0; d < 3; ++d ) { m[d] = ( index[d] < M/2 ) ? index[d] : index[d] - M; }
+	double qx, qy, qz;
+	box.gradientToCartesian( m, qx, qy, qz );
+	qx *= 2.0 * PI; qy *= 2.0 * PI; qz *= 2.0 * PI;
+
+	double re = 0.0, im = 0.0;
+	#pragma omp parallel for schedule(static) reduction(+:re,im)
+	for( int i = 0; i < numMolecules; ++i )
+	{
+	    MoleculeBiax *mc = cnf -> getMolecule(i);
+	    const double phase = qx * mc -> getPositionX() + qy * mc -> getPositionY() + qz * mc -> getPositionZ();
+	    re += cos( phase );
+	    im += sin( phase );
+	}
+	frame.order     = sqrt( re*re + im*im ) / numMolecules;
+	frame.spacing   = 2.0 * PI / sqrt( qx*qx + qy*qy + qz*qz );
+	frame.normal[0] = qx;
+	frame.normal[1] = qy;
+	frame.normal[2] = qz;
+    }
+
+    current = frame;
+    if( key.empty() == false ) { cache[key] = frame; }
+    //cout << "StructureFactor::calculate end" << endl;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- getCached
+//-------------------------------------------------------------------------
+/*!
+ *  \param key Cache key used in calculate().
+ *  \param order Is set to the smectic order parameter.
+ *  \param spacing Is set to the layer spacing.
+ *  \return false if nothing is cached for key.
+ */
+bool mga::StructureFactor::getCached( string key, double &order, double &spacing ) const
+{
+    map<string, Frame>::const_iterator it = cache.find( key );
+    if( it == cache.end() ) { return( false ); }
+    order   = it -> second.order;
+    spacing = it -> second.spacing;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- getCachedValues
+//-------------------------------------------------------------------------
+/*!
+ *  Flattens the cached results of key into order, spacing, normal, bin width, number
+ *  of bins, radial and parallel S(q), e.g. to keep them in an AnalysisCache.
+ *  \param key Cache key used in calculate().
+ *  \param values The flattened results.
+ *  \return false if nothing is cached for key.
+ */
+bool mga::StructureFactor::getCachedValues( string key, vector<double> &values ) const
+{
+    map<string, Frame>::const_iterator it = cache.find( key );
+    if( it == cache.end() ) { return( false ); }
+    const Frame &f = it -> second;
+    values.clear();
+    values.push_back( f.order );
+    values.push_back( f.spacing );
+    values.insert( values.end(), f.normal, f.normal + 3 );
+    values.push_back( f.binWidth );
+    values.push_back( f.radial.size() );
+    values.insert( values.end(), f.radial.begin(), f.radial.end() );
+    values.insert( values.end(), f.parallel.begin(), f.parallel.end() );
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- setCachedValues
+//-------------------------------------------------------------------------
+/*!
+ *  Puts results flattened by getCachedValues() into the cache, so that calculate() with
+ *  the same key takes them.
+ *  \param key Cache key.
+ *  \param values The flattened results.
+ *  \return false if values has the wrong size.
+ */
+bool mga::StructureFactor::setCachedValues( string key, const vector<double> &values )
+{
+    if( values.size() < 7 ) { return( false ); }
+    const unsigned int bins = (unsigned int)( values[6] );
+    if( values.size() != 7 + 2*bins ) { return( false ); }
+    Frame f;
+    f.order    = values[0];
+    f.spacing  = values[1];
+    f.normal[0] = values[2]; f.normal[1] = values[3]; f.normal[2] = values[4];
+    f.binWidth = values[5];
+    f.radial  .assign( values.begin() + 7       , values.begin() + 7 + bins   );
+    f.parallel.assign( values.begin() + 7 + bins, values.begin() + 7 + 2*bins );
+    cache[key] = f;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- getParameters
+//-------------------------------------------------------------------------
+string mga::StructureFactor::getParameters() const
+{
+    stringstream text;
+    text << "grid " << gridSize << " bins " << numBins;
+    return( text.str() );
+}
+
+//-------------------------------------------------------------------------
+//------------- getLayerNormal
+//-------------------------------------------------------------------------
+void mga::StructureFactor::getLayerNormal( double q[3] ) const
+{
+    q[0] = current.normal[0];
+    q[1] = current.normal[1];
+    q[2] = current.normal[2];
+}
+
+//-------------------------------------------------------------------------
+//------------- getResult
+//-------------------------------------------------------------------------
+/*!
+ *  \param q Is filled with the centers of the |q| shells.
+ *  \param s Is filled with the shell averaged S(q).
+ *  \param sPar Is filled with the largest S(q) within 10 degrees of the director.
+ */
+void mga::StructureFactor::getResult( vector<double> &q, vector<double> &s, vector<double> &sPar ) const
+{
+    q.resize( current.radial.size() );
+    for( unsigned int b = 0; b < q.size(); ++b ) { q[b] = ( b + 0.5 ) * current.binWidth; }
+    s    = current.radial;
+    sPar = current.parallel;
+}
+
+//-------------------------------------------------------------------------
+//------------- writeDataFile
+//-------------------------------------------------------------------------
+/*!
+ *  Writes q, the shell averaged S(q) and S(q) along the director of the last frame.
+ *  The smectic order parameter and the layer spacing are written to the header.
+ *  \param filename Name of the file to write.
+ *  \param comment Additional comment for the header.
+ *  \return true on success.
+ */
+bool mga::StructureFactor::writeDataFile( string filename, string comment ) const
+{
+    const char *namesTmp[] = { "q", "S(q)", "S_par(q)" };
+    vector<string> names( namesTmp, namesTmp + 3 );
+    vector<vector<double> > columns( 3 );
+    getResult( columns[0], columns[1], columns[2] );
+
+    stringstream header;
+    header << comment << ( comment.empty() ? "" : "  " ) << "grid: " << gridSize
+	   << "  smectic order: " << current.order << "  layer spacing: " << current.spacing;
+    return( mga::writeDataFile( filename, header.str(), names, columns ) );
+}
+
+
+//--------------------------------------------
+//------------ TimeCorrelation
+//--------------------------------------------
+
+//-------------------------------------------------------------------------
+//------------- TimeCorrelation
+//-------------------------------------------------------------------------
+/*!
+ *  The constructor.
+ *  \param pointsPerLevelTmp Samples kept per level (rounded up to a multiple of averagingTmp).
+ *  \param averagingTmp Every level takes every averagingTmp-th sample of the level below.
+ *  \param maxLevelsTmp Largest number of levels, limits the largest lag.
+ */
+mga::TimeCorrelation::TimeCorrelation( int pointsPerLevelTmp, int averagingTmp, int maxLevelsTmp )
+{
+    averaging      = max( 2, averagingTmp );
+    pointsPerLevel = max( 2, ( pointsPerLevelTmp + averaging - 1 ) / averaging ) * averaging;
+    maxLevels      = max( 1, min( 30, maxLevelsTmp ) );                          // averaging^maxLevels has to fit into a long
+    reset();
+}
+
+//-------------------------------------------------------------------------
+//------------- reset
+//-------------------------------------------------------------------------
+void mga::TimeCorrelation::reset()
+{
+    numParticles = 0;
+    numFrames    = 0;
+    previous .clear();
+    unwrapped.clear();
+    axis     .clear();
+    levels   .clear();
+}
+
+//-------------------------------------------------------------------------
+//------------- addFrame
+//-------------------------------------------------------------------------
+/*!
+ *  Unwraps the positions of the given frame with respect to the previous one, takes the
+ *  molecule axes from the quaternions and hands the frame to every level it is due for.
+ *  \param cnf The next frame of the trajectory.
+ *  \return false if the frame could not be used (e.g. the number of molecules changed).
+ */
+bool mga::TimeCorrelation::addFrame( CnfFile *cnf )
+{
+    //cout << "TimeCorrelation::addFrame beg" << endl;
+    PeriodicBox box;
+    if( cnf == 0 || cnf -> getNumberOfMolecules() < 1 ) { return( false ); }
+    if( box.set( cnf ) == false )                        { return( false ); }
+
+    const bool first = ( numFrames == 0 );
+    if( first )
+    {
+	numParticles = cnf -> getNumberOfMolecules();
+	previous .assign( 3*numParticles, 0.0 );
+	unwrapped.assign( 3*numParticles, 0.0 );
+	axis     .assign( 3*numParticles, 0.0 );
+    }
+    else if( cnf -> getNumberOfMolecules() != numParticles )
+    {
+	cerr << "Error: TimeCorrelation: number of molecules changed from " << numParticles
+	     << " to " << cnf -> getNumberOfMolecules() << endl;
+	return( false );
+    }
+
+    #pragma omp parallel for schedule(static)
+    for( int i = 0; i < numParticles; ++i )
+    {
+	const MoleculeBiax *mol = cnf -> getMolecule(i);
+	const int j = cnf -> getFileIndex(i);                                          // same slot in every frame, also in Z-order
+	double x, y, z, s[3], w, qx, qy, qz;
+	mol -> getPositionXYZ( x, y, z );
+	box.toFractional( x, y, z, s );
+	if( first )
+	{
+	    unwrapped[3*j] = x; unwrapped[3*j+1] = y; unwrapped[3*j+2] = z;
+	}
+	else
+	{
+	    double ds[3], dx, dy, dz;
+	    for( int d = 0; d < 3; ++d )
+	    {
+		ds[d] = s[d] - previous[3*j+d];
+		ds[d] -= rint( ds[d] );                                                // the fold that happened in between
+	    }
+	    box.toCartesian( ds, dx, dy, dz );
+	    unwrapped[3*j] += dx; unwrapped[3*j+1] += dy; unwrapped[3*j+2] += dz;
+	}
+	previous[3*j] = s[0]; previous[3*j+1] = s[1]; previous[3*j+2] = s[2];
+
+	mol -> getOrientationWXYZ( w, qx, qy, qz );                                   // body z axis, see MoleculeBiax::QuatToVector
+	axis[3*j]   =       2.0 * (  w*qy + qx*qz );
+	axis[3*j+1] =       2.0 * ( -w*qx + qy*qz );
+	axis[3*j+2] = 1.0 - 2.0 * ( qx*qx + qy*qy );
+    }
+
+    long stride = 1;
+    for( int k = 0; k < maxLevels && numFrames % stride == 0; ++k )
+    {
+	addToLevel( k );
+	stride *= averaging;
+    }
+    ++numFrames;
+    //cout << "TimeCorrelation::addFrame end" << endl;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- addToLevel
+//-------------------------------------------------------------------------
+/*!
+ *  Stores the current frame in the ring buffer of the given level and correlates it with
+ *  the samples kept there. Level 0 covers the lags 0 ... pointsPerLevel-1, every higher
+ *  level only the lags that are not already covered by the level below.
+ *  \param level The level, which is created if it is not in use yet.
+ */
+void mga::TimeCorrelation::addToLevel( int level )
+{
+    const int p     = pointsPerLevel;
+    const int width = 3 * numParticles;
+    if( level >= int( levels.size() ) )
+    {
+	Level l;
+	l.count = 0;
+	l.positions.assign( p * width, 0.0 );
+	l.axes     .assign( p * width, 0.0f );
+	l.sumMsd   .assign( p, 0.0 );
+	l.sumC1    .assign( p, 0.0 );
+	l.sumC2    .assign( p, 0.0 );
+	l.samples  .assign( p, 0.0 );
+	levels.push_back( l );
+    }
+    Level &l = levels.at( level );
+
+    const int slot   = l.count % p;
+    const int stored = min( l.count + 1, p );
+    const int first  = ( level == 0 ) ? 0 : p / averaging;
+    double *pos = &l.positions[ slot * width ];
+    float  *ax  = &l.axes     [ slot * width ];
+    for( int n = 0; n < width; ++n )
+    {
+	pos[n] = unwrapped[n];
+	ax [n] = float( axis[n] );
+    }
+    ++l.count;
+    if( first >= stored ) { return; }
+
+    const int nThreads = numberOfThreads();
+    vector<vector<double> > local( nThreads, vector<double>( 3*p, 0.0 ) );       // msd, c1, c2 of every lag, merged below
+
+    #pragma omp parallel
+    {
+	vector<double> &sum = local.at( threadIndex() );
+
+	#pragma omp for schedule(static)
+	for( int i = 0; i < numParticles; ++i )
+	{
+	    const double *r = &unwrapped[3*i];
+	    const double *u = &axis[3*i];
+	    for( int j = first; j < stored; ++j )
+	    {
+		const int    old = ( ( slot - j + p ) % p ) * width + 3*i;
+		const double dx  = r[0] - l.positions[old];
+		const double dy  = r[1] - l.positions[old+1];
+		const double dz  = r[2] - l.positions[old+2];
+		const double c   = u[0]*l.axes[old] + u[1]*l.axes[old+1] + u[2]*l.axes[old+2];
+		sum[3*j]   += dx*dx + dy*dy + dz*dz;
+		sum[3*j+1] += c;
+		sum[3*j+2] += 1.5*c*c - 0.5;
+	    }
+	}
+    }
+
+    for( int t = 0; t < nThreads; ++t )
+    {
+	for( int j = first; j < stored; ++j )
+	{
+	    l.sumMsd[j] += local[t][3*j];
+	    l.sumC1 [j] += local[t][3*j+1];
+	    l.sumC2 [j] += local[t][3*j+2];
+	}
+    }
+    for( int j = first; j < stored; ++j ) { l.samples[j] += 1.0; }
+}
+
+//-------------------------------------------------------------------------
+//------------- getMemoryUsage
+//-------------------------------------------------------------------------
+double mga::TimeCorrelation::getMemoryUsage() const
+{
+    double bytes = 0.0;
+    for( unsigned int k = 0; k < levels.size(); ++k )
+    {
+	bytes += levels[k].positions.size() * sizeof(double) + levels[k].axes.size() * sizeof(float);
+    }
+    return( bytes );
+}
+
+//-------------------------------------------------------------------------
+//------------- getResult
+//-------------------------------------------------------------------------
+/*!
+ *  Averages the accumulated sums over time origins and molecules.
+ *  \param lag Lags in frames, increasing.
+ *  \param msd Mean squared displacement.
+ *  \param c1 First rank rotational correlation <u(0).u(t)>.
+ *  \param c2 Second rank rotational correlation <P2(u(0).u(t))>.
+ *  \param samples Number of time origins averaged at each lag.
+ */
+void mga::TimeCorrelation::getResult( vector<double> &lag, vector<double> &msd, vector<double> &c1,
+				 vector<double> &c2, vector<double> &samples ) const
+{
+    lag.clear(); msd.clear(); c1.clear(); c2.clear(); samples.clear();
+    double stride = 1.0;
+    for( unsigned int k = 0; k < levels.size(); ++k )
+    {
+	const Level &l = levels[k];
+	for( int j = ( k == 0 ? 0 : pointsPerLevel / averaging ); j < pointsPerLevel; ++j )
+	{
+	    if( l.samples[j] <= 0.0 ) { continue; }
+	    const double norm = 1.0 / ( l.samples[j] * numParticles );
+	    lag.push_back( j * stride );
+	    msd.push_back( l.sumMsd[j] * norm );
+	    c1 .push_back( l.sumC1 [j] * norm );
+	    c2 .push_back( l.sumC2 [j] * norm );
+	    samples.push_back( l.samples[j] );
+	}
+	stride *= averaging;
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- writeDataFile
+//-------------------------------------------------------------------------
+/*!
+ *  Writes the columns lag, MSD, C1, C2 and the number of samples to the given file.
+ *  \param filename Name of the file to write.
+ *  \param comment Additional comment for the header (e.g. the analysed files).
+ *  \return true on success.
+ */
+bool mga::TimeCorrelation::writeDataFile( string filename, string comment ) const
+{
+    vector<string> names;
+    names.push_back( "Lag" );
+    names.push_back( "MSD" );
+    names.push_back( "C1" );
+    names.push_back( "C2" );
+    names.push_back( "Samples" );
+
+    vector<vector<double> > columns( 5 );
+    getResult( columns.at(0), columns.at(1), columns.at(2), columns.at(3), columns.at(4) );
+
+    stringstream header;
+    header << comment << ( comment.empty() ? "" : "  " ) << "frames: " << numFrames << "  molecules: " << numParticles;
+    return( mga::writeDataFile( filename, header.str(), names, columns ) );
+}
+
+
+//--------------------------------------------
+//------------ BiaxialOrder
+//--------------------------------------------
+
+//-------------------------------------------------------------------------
+//------------- BiaxialOrder
+//-------------------------------------------------------------------------
+mga::BiaxialOrder::BiaxialOrder()
+{
+    for( int a = 0; a < 3; ++a )
+    {
+	for( int k = 0; k < 6; ++k ) { tensor[a][k] = 0.0; }
+	primary[a] = secondary[a] = axisOrder[a] = 0.0;
+    }
+    primary[2] = secondary[0] = 1.0;
+    orderS = orderP = orderD = orderC = 0.0;
+}
+
+//-------------------------------------------------------------------------
+//------------- calculate
+//-------------------------------------------------------------------------
+/*!
+ *  Sums the three order tensors in a single pass over the quaternions and derives the
+ *  directors and order parameters from them.
+ *  \param cnf The configuration.
+ *  \return false if there are no molecules.
+ */
+bool mga::BiaxialOrder::calculate( CnfFile *cnf )
+{
+    //cout << "BiaxialOrder::calculate beg" << endl;
+    if( cnf == 0 || cnf -> getNumberOfMolecules() < 1 ) { return( false ); }
+    const int n        = cnf -> getNumberOfMolecules();
+    const int nThreads = numberOfThreads();
+    vector<vector<double> > local( nThreads, vector<double>( 18, 0.0 ) );        // x x, y y, z z of every thread
+
+    #pragma omp parallel
+    {
+	double sum[18];
+	for( int k = 0; k < 18; ++k ) { sum[k] = 0.0; }
+
+	#pragma omp for schedule(static)
+	for( int i = 0; i < n; ++i )
+	{
+	    double w, x, y, z;
+	    cnf -> getMolecule(i) -> getOrientationWXYZ( w, x, y, z );
+	    const double axes[3][3] = { { 1.0 - 2.0*(y*y + z*z),       2.0*(w*z + x*y),       2.0*(x*z - w*y) },   // columns of the
+					{       2.0*(x*y - w*z), 1.0 - 2.0*(x*x + z*z),       2.0*(w*x + y*z) },   // rotation matrix,
+					{       2.0*(w*y + x*z),       2.0*(y*z - w*x), 1.0 - 2.0*(x*x + y*y) } }; // see QuatToVector
+	    for( int a = 0; a < 3; ++a )
+	    {
+		const double *u = axes[a];
+		sum[6*a]   += u[0]*u[0];
+		sum[6*a+1] += u[0]*u[1];
+		sum[6*a+2] += u[0]*u[2];
+		sum[6*a+3] += u[1]*u[1];
+		sum[6*a+4] += u[1]*u[2];
+		sum[6*a+5] += u[2]*u[2];
+	    }
+	}
+
+	vector<double> &mine = local.at( threadIndex() );
+	for( int k = 0; k < 18; ++k ) { mine[k] = sum[k]; }
+    }
+
+    const double factor = 1.5 / double(n);
+    for( int a = 0; a < 3; ++a )
+    {
+	for( int k = 0; k < 6; ++k )
+	{
+	    double total = 0.0;
+	    for( int t = 0; t < nThreads; ++t ) { total += local[t][6*a+k]; }
+	    tensor[a][k] = factor * total - ( ( k == 0 || k == 3 || k == 5 ) ? 0.5 : 0.0 );
+	}
+    }
+
+    double lambda, v[3];
+    for( int a = 0; a < 3; ++a )
+    {
+	largestEigenpair( tensor[a], lambda, v );
+	axisOrder[a] = lambda;
+	if( a == 2 ) { primary[0] = v[0]; primary[1] = v[1]; primary[2] = v[2]; }
+    }
+
+    // Q_x + I projected onto the plane perpendicular to Z: the in plane eigenvalues are
+    // positive, the one of Z is zero, so the largest eigenvector lies in the plane.
+    double proj[3][3], shifted[6];
+    for( int r = 0; r < 3; ++r )
+    {
+	for( int c = 0; c < 3; ++c ) { proj[r][c] = ( r == c ? 1.0 : 0.0 ) - primary[r]*primary[c]; }
+    }
+    const int idx[3][3] = { { 0, 1, 2 }, { 1, 3, 4 }, { 2, 4, 5 } };
+    const int upper[6][2] = { { 0, 0 }, { 0, 1 }, { 0, 2 }, { 1, 1 }, { 1, 2 }, { 2, 2 } };
+    for( int k = 0; k < 6; ++k )
+    {
+	const int r = upper[k][0], c = upper[k][1];
+	double value = 0.0;
+	for( int a = 0; a < 3; ++a )
+	{
+	    for( int b = 0; b < 3; ++b )
+	    {
+		value += proj[r][a] * ( tensor[0][ idx[a][b] ] + ( a == b ? 1.0 : 0.0 ) ) * proj[b][c];
+	    }
+	}
+	shifted[k] = value;
+    }
+    largestEigenpair( shifted, lambda, v );
+    double dot = v[0]*primary[0] + v[1]*primary[1] + v[2]*primary[2];             // remove what is left of Z numerically
+    for( int d = 0; d < 3; ++d ) { v[d] -= dot * primary[d]; }
+    double norm = sqrt( v[0]*v[0] + v[1]*v[1] + v[2]*v[2] );
+    if( norm < 1e-12 )                                                             // any vector perpendicular to Z will do
+    {
+	double e[3] = { 1.0, 0.0, 0.0 };
+	if( fabs( primary[0] ) > 0.9 ) { e[0] = 0.0; e[1] = 1.0; }
+	dot = e[0]*primary[0] + e[1]*primary[1] + e[2]*primary[2];
+	for( int d = 0; d < 3; ++d ) { v[d] = e[d] - dot * primary[d]; }
+	norm = sqrt( v[0]*v[0] + v[1]*v[1] + v[2]*v[2] );
+    }
+    for( int d = 0; d < 3; ++d ) { secondary[d] = v[d] / norm; }
+
+    const double *Z = primary, *X = secondary;
+    const double Y[3] = { Z[1]*X[2] - Z[2]*X[1], Z[2]*X[0] - Z[0]*X[2], Z[0]*X[1] - Z[1]*X[0] };
+    orderS = project( tensor[2], Z, Z );
+    orderP = project( tensor[2], X, X ) - project( tensor[2], Y, Y );
+    orderD = project( tensor[0], Z, Z ) - project( tensor[1], Z, Z );
+    orderC = ( project( tensor[0], X, X ) - project( tensor[0], Y, Y )
+	     - project( tensor[1], X, X ) + project( tensor[1], Y, Y ) ) / 3.0;
+    //cout << "BiaxialOrder::calculate end" << endl;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- project
+//-------------------------------------------------------------------------
+double mga::BiaxialOrder::project( const double q[6], const double a[3], const double b[3] )
+{
+    return( a[0] * ( q[0]*b[0] + q[1]*b[1] + q[2]*b[2] ) +
+	    a[1] * ( q[1]*b[0] + q[3]*b[1] + q[4]*b[2] ) +
+	    a[2] * ( q[2]*b[0] + q[4]*b[1] + q[5]*b[2] ) );
+}
+
+//-------------------------------------------------------------------------
+//------------- getTensor
+//-------------------------------------------------------------------------
+void mga::BiaxialOrder::getTensor( int axis, double q[6] ) const
+{
+    for( int k = 0; k < 6; ++k ) { q[k] = tensor[axis][k]; }
+}
+
+//-------------------------------------------------------------------------
+//------------- getPrimaryDirector
+//-------------------------------------------------------------------------
+void mga::BiaxialOrder::getPrimaryDirector( double n[3] ) const
+{
+    n[0] = primary[0]; n[1] = primary[1]; n[2] = primary[2];
+}
+
+//-------------------------------------------------------------------------
+//------------- getSecondaryDirector
+//-------------------------------------------------------------------------
+void mga::BiaxialOrder::getSecondaryDirector( double m[3] ) const
+{
+    m[0] = secondary[0]; m[1] = secondary[1]; m[2] = secondary[2];
+}
+
+
+//--------------------------------------------
+//------------ OrientationDistribution
+//--------------------------------------------
+
+//-------------------------------------------------------------------------
+//------------- OrientationDistribution
+//-------------------------------------------------------------------------
+/*!
+ *  The constructor.
+ *  \param bandsTmp Number of bands of equal height in z.
+ *  \param sectorsTmp Number of sectors of equal width in phi.
+ *  \param apolarTmp If true, head and tail of a molecule are equivalent.
+ */
+mga::OrientationDistribution::OrientationDistribution( int bandsTmp, int sectorsTmp, bool apolarTmp )
+{
+    bands   = max( 1, bandsTmp );
+    sectors = max( 1, sectorsTmp );
+    apolar  = apolarTmp;
+    reset();
+}
+
+//-------------------------------------------------------------------------
+//------------- reset
+//-------------------------------------------------------------------------
+void mga::OrientationDistribution::reset()
+{
+    numFrames = 0;
+    total     = 0.0;
+    histogram.assign( bands * sectors, 0.0 );
+}
+
+//-------------------------------------------------------------------------
+//------------- getBin
+//-------------------------------------------------------------------------
+int mga::OrientationDistribution::getBin( double x, double y, double z ) const
+{
+    int band   = int( ( z + 1.0 ) * 0.5 * bands );
+    double phi = atan2( y, x ) + PI;                                               // [0,2pi]
+    int sector = int( phi / ( 2.0*PI ) * sectors );
+    band   = min( max( band, 0 ), bands - 1 );
+    sector = min( max( sector, 0 ), sectors - 1 );
+    return( band * sectors + sector );
+}
+
+//-------------------------------------------------------------------------
+//------------- addFrame
+//-------------------------------------------------------------------------
+/*!
+ *  Bins the z axes of all molecules of the given configuration.
+ *  \param cnf The configuration.
+ *  \return false if there are no molecules.
+ */
+bool mga::OrientationDistribution::addFrame( CnfFile *cnf )
+{
+    //cout << "OrientationDistribution::addFrame beg" << endl;
+    if( cnf == 0 || cnf -> getNumberOfMolecules() < 1 ) { return( false ); }
+    const int n        = cnf -> getNumberOfMolecules();
+    const int nThreads = numberOfThreads();
+    vector<vector<double> > local( nThreads, vector<double>( histogram.size(), 0.0 ) );
+
+    #pragma omp parallel
+    {
+	vector<double> &h = local.at( threadIndex() );
+
+	#pragma omp for schedule(static)
+	for( int i = 0; i < n; ++i )
+	{
+	    double w, x, y, z;
+	    cnf -> getMolecule(i) -> getOrientationWXYZ( w, x, y, z );
+	    const double ux =       2.0 * (  w*y + x*z );
+	    const double uy =       2.0 * ( -w*x + y*z );
+	    const double uz = 1.0 - 2.0 * (  x*x + y*y );
+	    h[ getBin( ux, uy, uz ) ] += 1.0;
+	    if( apolar ) { h[ getBin( -ux, -uy, -uz ) ] += 1.0; }
+	}
+    }
+
+    #pragma omp parallel for schedule(static)
+    for( int b = 0; b < int( histogram.size() ); ++b )
+    {
+	for( int t = 0; t < nThreads; ++t ) { histogram[b] += local[t][b]; }
+    }
+
+    total += apolar ? 2.0 * n : double(n);
+    ++numFrames;
+    //cout << "OrientationDistribution::addFrame end" << endl;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- getDensity
+//-------------------------------------------------------------------------
+double mga::OrientationDistribution::getDensity( int band, int sector ) const
+{
+    if( total <= 0.0 ) { return( 0.0 ); }
+    return( histogram.at( band * sectors + sector ) * histogram.size() / total ); // all cells have the same area
+}
+
+//-------------------------------------------------------------------------
+//------------- getMaximum
+//-------------------------------------------------------------------------
+double mga::OrientationDistribution::getMaximum() const
+{
+    if( total <= 0.0 ) { return( 0.0 ); }
+    return( *std::max_element( histogram.begin(), histogram.end() ) * histogram.size() / total );
+}
+
+//-------------------------------------------------------------------------
+//------------- writeDataFile
+//-------------------------------------------------------------------------
+/*!
+ *  Writes the cell centers (cos(theta), phi in degrees) and the densities to the given file.
+ *  \param filename Name of the file to write.
+ *  \param comment Additional comment for the header (e.g. the analysed files).
+ *  \return true on success.
+ */
+bool mga::OrientationDistribution::writeDataFile( string filename, string comment ) const
+{
+    vector<string> names;
+    names.push_back( "cos(theta)" );
+    names.push_back( "phi" );
+    names.push_back( "density" );
+
+    vector<vector<double> > columns( 3 );
+    for( int b = 0; b < bands; ++b )
+    {
+	for( int s = 0; s < sectors; ++s )
+	{
+	    columns.at(0).push_back( -1.0 + ( b + 0.5 ) * 2.0 / bands );
+	    columns.at(1).push_back( -180.0 + ( s + 0.5 ) * 360.0 / sectors );
+	    columns.at(2).push_back( getDensity( b, s ) );
+	}
+    }
+
+    stringstream header;
+    header << comment << ( comment.empty() ? "" : "  " ) << "frames: " << numFrames << "  bands: " << bands
+	   << "  sectors: " << sectors << ( apolar ? "  apolar" : "" );
+    return( mga::writeDataFile( filename, header.str(), names, columns ) );
+}
+
+//-------------------------------------------------------------------------
+//------------- getValues
+//-------------------------------------------------------------------------
+/*!
+ *  Flattens frames, number of binned vectors and the counts, e.g. to keep them in an AnalysisCache.
+ *  \param values The flattened counts.
+ */
+void mga::OrientationDistribution::getValues( vector<double> &values ) const
+{
+    values.clear();
+    values.push_back( numFrames );
+    values.push_back( total );
+    values.insert( values.end(), histogram.begin(), histogram.end() );
+}
+
+//-------------------------------------------------------------------------
+//------------- setValues
+//-------------------------------------------------------------------------
+/*!
+ *  Restores counts flattened by getValues() of a distribution with the same cells.
+ *  \param values The flattened counts.
+ *  \return false if values has the wrong size.
+ */
+bool mga::OrientationDistribution::setValues( const vector<double> &values )
+{
+    if( values.size() != histogram.size() + 2 ) { return( false ); }
+    numFrames = int( values[0] );
+    total     = values[1];
+    histogram.assign( values.begin() + 2, values.end() );
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- getParameters
+//-------------------------------------------------------------------------
+string mga::OrientationDistribution::getParameters() const
+{
+    stringstream text;
+    text << "bands " << bands << " sectors " << sectors << " apolar " << apolar;
+    return( text.str() );
+}
+
+
+//--------------------------------------------
+//------------ AnalysisCache
+//--------------------------------------------
+
+//-------------------------------------------------------------------------
+//------------- AnalysisCache
+//-------------------------------------------------------------------------
+/*!
+ *  The constructor.
+ *  \param storeNameTmp File name of the store in every directory.
+ */
+mga::AnalysisCache::AnalysisCache( string storeNameTmp )
+{
+    storeName = storeNameTmp;
+    hits      = 0;
+    misses    = 0;
+}
+
+//-------------------------------------------------------------------------
+//------------- ~AnalysisCache
+//-------------------------------------------------------------------------
+mga::AnalysisCache::~AnalysisCache()
+{
+    flush();
+}
+
+//-------------------------------------------------------------------------
+//------------- stampOf
+//-------------------------------------------------------------------------
+string mga::AnalysisCache::stampOf( const string &file )
+{
+    struct stat info;
+    if( stat( file.c_str(), &info ) != 0 ) { return( "" ); }
+    stringstream stamp;
+    stamp << (long long)( info.st_size ) << " " << (long long)( info.st_mtime );
+    return( stamp.str() );
+}
+
+//-------------------------------------------------------------------------
+//------------- storeOf
+//-------------------------------------------------------------------------
+/*!
+ *  Splits a path into directory and file name and returns the store of the directory,
+ *  which is read from disk the first time. The directory is made canonical, so different
+ *  paths to the same directory (e.g. "run.0001" and "./run.0001") share one store.
+ *  \param file Path of a configuration file.
+ *  \param name Is set to the file name without the directory.
+ *  \return The store of the directory.
+ */
+mga::AnalysisCache::Store& mga::AnalysisCache::storeOf( const string &file, string &name )
+{
+    string::size_type slash = file.find_last_of( "/\\" );
+    string directory = ( slash == string::npos ) ? string( "." ) : file.substr( 0, slash );
+    name = ( slash == string::npos ) ? file : file.substr( slash + 1 );
+    char canonical[PATH_MAX];
+    if( realpath( directory.c_str(), canonical ) != 0 ) { directory = canonical; }
+
+    map<string, Store>::iterator it = stores.find( directory );
+    if( it == stores.end() )
+    {
+	Store s;
+	s.modified = false;
+	read( directory, s );
+	it = stores.insert( std::make_pair( directory, s ) ).first;
+    }
+    return( it -> second );
+}
+
+//-------------------------------------------------------------------------
+//------------- lookup
+//-------------------------------------------------------------------------
+/*!
+ *  \param file Path of the configuration file.
+ *  \param quantity Name of the result.
+ *  \param parameters Parameters the result has to be calculated with.
+ *  \param values Is set to the result.
+ *  \return true if a result with these parameters is stored and the file did not change since.
+ */
+bool mga::AnalysisCache::lookup( string file, string quantity, string parameters, vector<double> &values )
+{
+    string name;
+    Store &s = storeOf( file, name );
+    map<string, Record>::iterator r = s.records.find( name );
+    if( r == s.records.end() ) { ++misses; return( false ); }
+
+    if( r -> second.stamp != stampOf( file ) )                                    // the file was changed, nothing of it is valid
+    {
+	s.records.erase( r );
+	s.modified = true;
+	++misses;
+	return( false );
+    }
+
+    map<string, Entry>::const_iterator e = r -> second.entries.find( quantity );
+    if( e == r -> second.entries.end() || e -> second.parameters != parameters ) { ++misses; return( false ); }
+    values = e -> second.values;
+    ++hits;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- store
+//-------------------------------------------------------------------------
+/*!
+ *  Stores a result, replacing one of the same quantity.
+ *  \param file Path of the configuration file.
+ *  \param quantity Name of the result (must not contain white space).
+ *  \param parameters Parameters the result was calculated with (must not contain line breaks).
+ *  \param values The result.
+ */
+void mga::AnalysisCache::store( string file, string quantity, string parameters, const vector<double> &values )
+{
+    string stamp = stampOf( file );
+    if( stamp.empty() ) { return; }
+
+    string name;
+    Store  &s = storeOf( file, name );
+    Record &r = s.records[name];
+    if( r.stamp != stamp )
+    {
+	r.entries.clear();
+	r.stamp = stamp;
+    }
+    Entry &e = r.entries[quantity];
+    e.parameters = parameters;
+    e.values     = values;
+    s.modified   = true;
+}
+
+//-------------------------------------------------------------------------
+//------------- invalidate
+//-------------------------------------------------------------------------
+void mga::AnalysisCache::invalidate( string file )
+{
+    string name;
+    Store &s = storeOf( file, name );
+    if( s.records.erase( name ) > 0 ) { s.modified = true; }
+}
+
+//-------------------------------------------------------------------------
+//------------- clear
+//-------------------------------------------------------------------------
+void mga::AnalysisCache::clear()
+{
+    for( map<string, Store>::iterator it = stores.begin(); it != stores.end(); ++it )
+    {
+	it -> second.records.clear();
+	it -> second.modified = true;
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- flush
+//-------------------------------------------------------------------------
+/*!
+ *  Writes all stores that changed since they were read.
+ *  \return false if a store could not be written (it is kept in memory).
+ */
+bool mga::AnalysisCache::flush()
+{
+    bool success = true;
+    for( map<string, Store>::iterator it = stores.begin(); it != stores.end(); ++it )
+    {
+	if( it -> second.modified == false ) { continue; }
+	if( write( it -> first, it -> second ) ) { it -> second.modified = false; }
+	else                                     { success = false; }
+    }
+    return( success );
+}
+
+//-------------------------------------------------------------------------
+//------------- read
+//-------------------------------------------------------------------------
+/*!
+ *  Reads the store file of a directory. The format is line based:
+ *  "file <size> <mtime> <name>" starts the record of a file, it is followed by
+ *  "entry <quantity> <count> <parameters>" lines, each followed by a line with count values.
+ *  \param directory The directory.
+ *  \param s Is filled with the records.
+ *  \return false if there is no readable store file.
+ */
+bool mga::AnalysisCache::read( const string &directory, Store &s ) const
+{
+    ifstream in( ( directory + "/" + storeName ).c_str() );
+    if( !in.is_open() ) { return( false ); }
+
+    string  line;
+    Record *record = 0;
+    while( getline( in, line ) )
+    {
+	stringstream words( line );
+	string tag;
+	words >> tag;
+	if( tag == "file" )
+	{
+	    long long size = 0, time = 0;
+	    string name;
+	    words >> size >> time;
+	    getline( words >> std::ws, name );
+	    stringstream stamp;
+	    stamp << size << " " << time;
+	    record = &s.records[name];
+	    record -> stamp = stamp.str();
+	}
+	else if( tag == "entry" && record != 0 )
+	{
+	    string quantity, parameters, valueLine;
+	    unsigned int count = 0;
+	    words >> quantity >> count;
+	    getline( words >> std::ws, parameters );
+	    if( !getline( in, valueLine ) ) { break; }
+
+	    Entry e;
+	    e.parameters = parameters;
+	    stringstream values( valueLine );
+	    double v;
+	    while( e.values.size() < count && values >> v ) { e.values.push_back( v ); }
+	    if( e.values.size() == count ) { record -> entries[quantity] = e; }
+	    else { cout << "Warning: AnalysisCache: damaged entry " << quantity << " in " << directory + "/" + storeName << endl; }
+	}
+    }
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- write
+//-------------------------------------------------------------------------
+/*!
+ *  Writes the store file of a directory. It is written to a temporary file first, which
+ *  then replaces the store, so a crash or a second qmga never leaves a truncated store.
+ *  \param directory The directory.
+ *  \param s The records.
+ *  \return false if the store could not be written.
+ */
+bool mga::AnalysisCache::write( const string &directory, const Store &s ) const
+{
+    string fileName = directory + "/" + storeName;
+    if( s.records.empty() )
+    {
+	remove( fileName.c_str() );
+	return( true );
+    }
+
+    stringstream tmpName;
+    tmpName << fileName << "." << getpid() << ".tmp";
+    ofstream out( tmpName.str().c_str() );
+    if( !out.is_open() ) { return( false ); }                                   // read only directory, keep it in memory
+    out << "# QMGA analysis cache, results are dropped when the file changes" << endl;
+    out << setprecision(12);
+    for( map<string, Record>::const_iterator r = s.records.begin(); r != s.records.end(); ++r )
+    {
+	out << "file " << r -> second.stamp << " " << r -> first << endl;
+	for( map<string, Entry>::const_iterator e = r -> second.entries.begin(); e != r -> second.entries.end(); ++e )
+	{
+	    out << "entry " << e -> first << " " << e -> second.values.size() << " " << e -> second.parameters << endl;
+	    for( unsigned int k = 0; k < e -> second.values.size(); ++k )
+	    {
+		out << ( k == 0 ? "" : " " ) << e -> second.values[k];
+	    }
+	    out << endl;
+	}
+    }
+    out.close();
+    if( !out.good() || rename( tmpName.str().c_str(), fileName.c_str() ) != 0 )
+    {
+	remove( tmpName.str().c_str() );
+	return( false );
+    }
+    return( true );
+}
+
+
+//--------------------------------------------
+//------------ FrameDifference
+//--------------------------------------------
+
+//-------------------------------------------------------------------------
+//------------- FrameDifference
+//-------------------------------------------------------------------------
+mga::FrameDifference::FrameDifference()
+{
+    uniqueIds  = true;
+    numMatched = 0;
+}
+
+//-------------------------------------------------------------------------
+//------------- setReference
+//-------------------------------------------------------------------------
+/*!
+ *  Copies positions (unfolded), quaternions and ids of a configuration in file order
+ *  (CnfFile::getFileIndex()), so the reference stays valid when the CnfFile loads another frame.
+ *  \param cnf The reference configuration.
+ *  \param name Shown to the user, e.g. the file name.
+ *  \return false if the configuration is empty.
+ */
+bool mga::FrameDifference::setReference( CnfFile *cnf, string name )
+{
+    //cout << "FrameDifference::setReference beg" << endl;
+    referenceIds.clear();
+    sortedIds.clear();
+    referenceName = name;
+    if( cnf == 0 || cnf -> getNumberOfMolecules() < 1 ) { return( false ); }
+
+    const int n = cnf -> getNumberOfMolecules();
+    referenceIds        .resize( n );
+    sortedIds           .resize( n );
+    referencePositions  .resize( 3*n );
+    referenceQuaternions.resize( 4*n );
+
+    #pragma omp parallel for schedule(static)
+    for( int i = 0; i < n; ++i )
+    {
+	MoleculeBiax *m = cnf -> getMolecule(i);
+	const int r = cnf -> getFileIndex(i);                                          // stored in file order
+	m -> getPositionXYZ( referencePositions[3*r], referencePositions[3*r+1], referencePositions[3*r+2] );
+	m -> getOrientationWXYZ( referenceQuaternions[4*r], referenceQuaternions[4*r+1], referenceQuaternions[4*r+2], referenceQuaternions[4*r+3] );
+	referenceIds[r] = m -> getNumber();
+	sortedIds[i]    = std::make_pair( referenceIds[r], r );
+    }
+
+    sort( sortedIds.begin(), sortedIds.end() );
+    uniqueIds = true;
+    for( int i = 1; i < n && uniqueIds; ++i )
+    {
+	if( sortedIds[i].first == sortedIds[i-1].first ) { uniqueIds = false; }
+    }
+    if( uniqueIds == false ) { cout << "Warning: molecule ids of the reference are not unique, molecules are matched by index." << endl; }
+    //cout << "FrameDifference::setReference end" << endl;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- findReference
+//-------------------------------------------------------------------------
+int mga::FrameDifference::findReference( unsigned int id, int i ) const
+{
+    if( uniqueIds == false ) { return( i < int( referenceIds.size() ) ? i : -1 ); }
+    if( i < int( referenceIds.size() ) && referenceIds[i] == id ) { return( i ); }     // same order as the reference, the usual case
+    vector<std::pair<unsigned int,int> >::const_iterator it =
+	std::lower_bound( sortedIds.begin(), sortedIds.end(), std::make_pair( id, -1 ) );
+    if( it == sortedIds.end() || it -> first != id ) { return( -1 ); }
+    return( it -> second );
+}
+
+//-------------------------------------------------------------------------
+//------------- calculate
+//-------------------------------------------------------------------------
+/*!
+ *  Compares a configuration with the reference. The displacement is taken under the
+ *  minimum image convention of the box of cnf, so molecules that crossed the box
+ *  boundary are not counted as movers. The rotation angle of q_ref^-1 q is
+ *  2 acos(|w|), which is the same for q and -q.
+ *  \param cnf The configuration to compare.
+ *  \return false without reference or box.
+ */
+bool mga::FrameDifference::calculate( CnfFile *cnf )
+{
+    //cout << "FrameDifference::calculate beg" << endl;
+    displacement.clear();
+    rotation.clear();
+    numMatched = 0;
+    if( cnf == 0 || hasReference() == false ) { return( false ); }
+
+    PeriodicBox box;
+    if( box.set( cnf ) == false ) { return( false ); }
+
+    const int n = cnf -> getNumberOfMolecules();
+    displacement.assign( n, -1.0 );
+    rotation    .assign( n, -1.0 );
+    int matched = 0;
+
+    #pragma omp parallel for schedule(static) reduction(+:matched)
+    for( int i = 0; i < n; ++i )
+    {
+	MoleculeBiax *m = cnf -> getMolecule(i);
+	int r = findReference( m -> getNumber(), cnf -> getFileIndex(i) );
+	if( r < 0 ) { continue; }
+
+	double x, y, z;
+	m -> getPositionXYZ( x, y, z );
+	x -= referencePositions[3*r];
+	y -= referencePositions[3*r+1];
+	z -= referencePositions[3*r+2];
+	box.minimumImage( x, y, z );
+	displacement[i] = sqrt( x*x + y*y + z*z );
+
+	// w component of conj(q_ref) * q, the other components are not needed for the angle
+	double w, qx, qy, qz;
+	m -> getOrientationWXYZ( w, qx, qy, qz );
+	const double *q0 = &referenceQuaternions[4*r];
+	double dot  = fabs( q0[0]*w + q0[1]*qx + q0[2]*qy + q0[3]*qz );
+	double norm = sqrt( ( q0[0]*q0[0] + q0[1]*q0[1] + q0[2]*q0[2] + q0[3]*q0[3] ) * ( w*w + qx*qx + qy*qy + qz*qz ) );
+	if( norm > 0.0 ) { dot /= norm; }
+	rotation[i] = 2.0 * acos( min( 1.0, dot ) ) * MoleculeBiax::RadToDeg;
+	++matched;
+    }
+    numMatched = matched;
+    //cout << "FrameDifference::calculate end" << endl;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- getMaximum
+//-------------------------------------------------------------------------
+double mga::FrameDifference::getMaximum( bool ofRotation ) const
+{
+    const vector<double> &values = ofRotation ? rotation : displacement;
+    double maximum = 0.0;
+    for( unsigned int i = 0; i < values.size(); ++i ) { maximum = max( maximum, values[i] ); }
+    return( maximum );
+}
+
+//-------------------------------------------------------------------------
+//------------- getTopMovers
+//-------------------------------------------------------------------------
+/*!
+ *  Returns the molecules with the largest displacements (or rotations) of the last
+ *  calculate(), largest first. Only a partial sort is done, so this is cheap for
+ *  a few molecules of a huge system.
+ *  \param k Number of molecules, all matched molecules if k is larger.
+ *  \param byRotation Sort by rotation angle instead of displacement.
+ *  \param indices Is filled with the molecule indices.
+ */
+void mga::FrameDifference::getTopMovers( int k, bool byRotation, vector<int> &indices ) const
+{
+    const vector<double> &values = byRotation ? rotation : displacement;
+    vector<std::pair<double,int> > movers;
+    movers.reserve( numMatched );
+    for( unsigned int i = 0; i < values.size(); ++i )
+    {
+	if( values[i] >= 0.0 ) { movers.push_back( std::make_pair( -values[i], int(i) ) ); }
+    }
+    k = max( 0, min( k, int( movers.size() ) ) );
+    std::partial_sort( movers.begin(), movers.begin() + k, movers.end() );
+
+    indices.resize( k );
+    for( int i = 0; i < k; ++i ) { indices[i] = movers[i].second; }
+}
+
+//-------------------------------------------------------------------------
+//------------- Selection
+//-------------------------------------------------------------------------
+mga::Selection::Selection()
+{
+    root     = -1;
+    useCells = false;
+}
+
+//-------------------------------------------------------------------------
+//------------- clear
+//-------------------------------------------------------------------------
+void mga::Selection::clear()
+{
+    terms.clear();
+    root = -1;
+}
+
+//-------------------------------------------------------------------------
+//------------- add
+//-------------------------------------------------------------------------
+/*!
+ *  Appends a term. The new term becomes the root, so the last added term is
+ *  the one that is evaluated unless setRoot() is called.
+ *  \return The index of the term.
+ */
+int mga::Selection::add( Kind kind, const double *p, int np, int a, int b )
+{
+    Term term;
+    term.kind = kind;
+    for( int k = 0; k < 6; ++k ) { term.p[k] = ( k < np ) ? p[k] : 0.0; }
+    term.a = a;
+    term.b = b;
+    terms.push_back( term );
+    root = int( terms.size() ) - 1;
+    return( root );
+}
+
+int mga::Selection::addAll()
+{
+    return( add( ALL, 0, 0 ) );
+}
+
+int mga::Selection::addBox( double xLow, double xHigh, double yLow, double yHigh, double zLow, double zHigh )
+{
+    double p[6] = { xLow, xHigh, yLow, yHigh, zLow, zHigh };
+    return( add( BOX, p, 6 ) );
+}
+
+int mga::Selection::addSphere( double x, double y, double z, double radius )
+{
+    double p[4] = { x, y, z, radius };
+    return( add( SPHERE, p, 4 ) );
+}
+
+int mga::Selection::addHalfSpace( double nx, double ny, double nz, double d )
+{
+    double p[4] = { nx, ny, nz, d };
+    return( add( HALF_SPACE, p, 4 ) );
+}
+
+int mga::Selection::addType( int type )
+{
+    return( add( TYPE, 0, 0, type ) );
+}
+
+//-------------------------------------------------------------------------
+//------------- addCone
+//-------------------------------------------------------------------------
+/*!
+ *  Selects molecules whose axis (Molecule::getOrientationXYZ()) encloses at most
+ *  the given angle with the axis of the cone. Without polar the molecules are taken
+ *  as head-tail symmetric, so the cone around -axis is selected, too.
+ */
+int mga::Selection::addCone( double ax, double ay, double az, double angle, bool polar )
+{
+    double norm = sqrt( ax*ax + ay*ay + az*az );
+    if( norm > 0.0 ) { ax /= norm; ay /= norm; az /= norm; }
+    double p[5] = { ax, ay, az, cos( angle / MoleculeBiax::RadToDeg ), angle };
+    return( add( CONE, p, 5, polar ? 1 : 0 ) );
+}
+
+int mga::Selection::addIdRange( unsigned int low, unsigned int high )
+{
+    double p[2] = { double( low ), double( high ) };
+    return( add( ID_RANGE, p, 2 ) );
+}
+
+int mga::Selection::addFieldRange( double low, double high )
+{
+    double p[2] = { low, high };
+    return( add( FIELD_RANGE, p, 2 ) );
+}
+
+int mga::Selection::addAnd( int a, int b )
+{
+    return( add( AND, 0, 0, a, b ) );
+}
+
+int mga::Selection::addOr( int a, int b )
+{
+    return( add( OR, 0, 0, a, b ) );
+}
+
+int mga::Selection::addNot( int a )
+{
+    return( add( NOT, 0, 0, a ) );
+}
+
+//-------------------------------------------------------------------------
+//------------- isAll
+//-------------------------------------------------------------------------
+bool mga::Selection::isAll() const
+{
+    return( root < 0 || terms[root].kind == ALL );
+}
+
+//-------------------------------------------------------------------------
+//------------- usesField
+//-------------------------------------------------------------------------
+bool mga::Selection::usesField() const
+{
+    for( unsigned int t = 0; t < terms.size(); ++t )
+    {
+	if( terms[t].kind == FIELD_RANGE ) { return( true ); }
+    }
+    return( false );
+}
+
+//-------------------------------------------------------------------------
+//------------- parse
+//-------------------------------------------------------------------------
+/*!
+ *  Builds the selection from an expression. Keywords are
+ *  - all
+ *  - box xLow xHigh yLow yHigh zLow zHigh
+ *  - sphere x y z radius
+ *  - halfspace nx ny nz d (n.r >= d)
+ *  - type n
+ *  - cone ax ay az angle, polarcone ax ay az angle (angle in deg)
+ *  - id low high
+ *  - field low high
+ *
+ *  combined with "and", "or", "not" and parentheses; "not" binds strongest, "or"
+ *  weakest. An empty expression selects all molecules.
+ *  \param expression The expression.
+ *  \return false if the expression is not valid, the selection is then unchanged.
+ */
+bool mga::Selection::parse( string expression )
+{
+    //cout << "Selection::parse beg" << endl;
+    vector<string> tokens;
+    string token;
+    for( unsigned int k = 0; k <= expression.size(); ++k )
+    {
+	char c = ( k < expression.size() ) ? expression[k] : ' ';
+	if( c == ' ' || c == '\t' || c == '\n' || c == '(' || c == ')' )
+	{
+	    if( token.size() > 0 ) { tokens.push_back( token ); token = ""; }
+	    if( c == '(' || c == ')' ) { tokens.push_back( string( 1, c ) ); }
+	}
+	else { token += char( tolower( c ) ); }
+    }
+
+    vector<Term> oldTerms = terms;
+    int oldRoot = root;
+    clear();
+    if( tokens.empty() ) { return( true ); }
+
+    unsigned int pos = 0;
+    int top = parseOr( tokens, pos );
+    if( top >= 0 && pos < tokens.size() )
+    {
+	cerr << "Error: unexpected \"" << tokens[pos] << "\" in selection." << endl;
+	top = -1;
+    }
+    if( top < 0 )
+    {
+	terms = oldTerms;
+	root  = oldRoot;
+	return( false );
+    }
+    root = top;
+    //cout << "Selection::parse end" << endl;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- parseOr
+//-------------------------------------------------------------------------
+int mga::Selection::parseOr( const vector<string> &tokens, unsigned int &pos )
+{
+    int left = parseAnd( tokens, pos );
+    while( left >= 0 && pos < tokens.size() && tokens[pos] == "or" )
+    {
+	++pos;
+	int right = parseAnd( tokens, pos );
+	left = ( right >= 0 ) ? addOr( left, right ) : -1;
+    }
+    return( left );
+}
+
+//-------------------------------------------------------------------------
+//------------- parseAnd
+//-------------------------------------------------------------------------
+int mga::Selection::parseAnd( const vector<string> &tokens, unsigned int &pos )
+{
+    int left = parseNot( tokens, pos );
+    while( left >= 0 && pos < tokens.size() && tokens[pos] == "and" )
+    {
+	++pos;
+	int right = parseNot( tokens, pos );
+	left = ( right >= 0 ) ? addAnd( left, right ) : -1;
+    }
+    return( left );
+}
+
+//-------------------------------------------------------------------------
+//------------- parseNot
+//-------------------------------------------------------------------------
+int mga::Selection::parseNot( const vector<string> &tokens, unsigned int &pos )
+{
+    if( pos >= tokens.size() )
+    {
+	cerr << "Error: selection ends unexpectedly." << endl;
+	return( -1 );
+    }
+    string keyword = tokens[pos++];
+    double v[6];
+
+    if( keyword == "not" )
+    {
+	int a = parseNot( tokens, pos );
+	return( a >= 0 ? addNot( a ) : -1 );
+    }
+    if( keyword == "(" )
+    {
+	int a = parseOr( tokens, pos );
+	if( a < 0 ) { return( -1 ); }
+	if( pos >= tokens.size() || tokens[pos] != ")" )
+	{
+	    cerr << "Error: missing \")\" in selection." << endl;
+	    return( -1 );
+	}
+	++pos;
+	return( a );
+    }
+    if( keyword == "all" )       { return( addAll() ); }
+    if( keyword == "box" )       { return( readNumbers( tokens, pos, 6, v ) ? addBox( v[0], v[1], v[2], v[3], v[4], v[5] ) : -1 ); }
+    if( keyword == "sphere" )    { return( readNumbers( tokens, pos, 4, v ) ? addSphere( v[0], v[1], v[2], v[3] ) : -1 ); }
+    if( keyword == "halfspace" ) { return( readNumbers( tokens, pos, 4, v ) ? addHalfSpace( v[0], v[1], v[2], v[3] ) : -1 ); }
+    if( keyword == "type" )      { return( readNumbers( tokens, pos, 1, v ) ? addType( int( v[0] ) ) : -1 ); }
+    if( keyword == "cone" )      { return( readNumbers( tokens, pos, 4, v ) ? addCone( v[0], v[1], v[2], v[3], false ) : -1 ); }
+    if( keyword == "polarcone" ) { return( readNumbers( tokens, pos, 4, v ) ? addCone( v[0], v[1], v[2], v[3], true ) : -1 ); }
+    if( keyword == "field" )     { return( readNumbers( tokens, pos, 2, v ) ? addFieldRange( v[0], v[1] ) : -1 ); }
+    if( keyword == "id" )
+    {
+	if( readNumbers( tokens, pos, 2, v ) == false ) { return( -1 ); }
+	return( addIdRange( (unsigned int)( max( 0.0, v[0] ) ), (unsigned int)( max( 0.0, v[1] ) ) ) );
+    }
+    cerr << "Error: unknown keyword \"" << keyword << "\" in selection." << endl;
+    return( -1 );
+}
+
+//-------------------------------------------------------------------------
+//------------- readNumbers
+//-------------------------------------------------------------------------
+bool mga::Selection::readNumbers( const vector<string> &tokens, unsigned int &pos, int n, double *values )
+{
+    string keyword = tokens[pos-1];
+    for( int k = 0; k < n; ++k, ++pos )
+    {
+	char *end = 0;
+	if( pos < tokens.size() ) { values[k] = strtod( tokens[pos].c_str(), &end ); }
+	if( pos >= tokens.size() || end == tokens[pos].c_str() || *end != '\0' )
+	{
+	    cerr << "Error: \"" << keyword << "\" needs " << n << " numbers in selection." << endl;
+	    return( false );
+	}
+    }
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- getExpression
+//-------------------------------------------------------------------------
+string mga::Selection::getExpression() const
+{
+    return( root < 0 ? string( "all" ) : describe( root ) );
+}
+
+//-------------------------------------------------------------------------
+//------------- describe
+//-------------------------------------------------------------------------
+string mga::Selection::describe( int t ) const
+{
+    const Term &term = terms[t];
+    stringstream s;
+    switch( term.kind )
+    {
+    case ALL:         s << "all"; break;
+    case BOX:         s << "box " << term.p[0] << " " << term.p[1] << " " << term.p[2] << " "
+			<< term.p[3] << " " << term.p[4] << " " << term.p[5]; break;
+    case SPHERE:      s << "sphere " << term.p[0] << " " << term.p[1] << " " << term.p[2] << " " << term.p[3]; break;
+    case HALF_SPACE:  s << "halfspace " << term.p[0] << " " << term.p[1] << " " << term.p[2] << " " << term.p[3]; break;
+    case TYPE:        s << "type " << term.a; break;
+    case CONE:        s << ( term.a ? "polarcone " : "cone " ) << term.p[0] << " " << term.p[1] << " " << term.p[2] << " " << term.p[4]; break;
+    case ID_RANGE:    s << "id " << (unsigned int)( term.p[0] ) << " " << (unsigned int)( term.p[1] ); break;
+    case FIELD_RANGE: s << "field " << term.p[0] << " " << term.p[1]; break;
+    case AND:         s << "( " << describe( term.a ) << " and " << describe( term.b ) << " )"; break;
+    case OR:          s << "( " << describe( term.a ) << " or " << describe( term.b ) << " )"; break;
+    case NOT:         s << "not " << describe( term.a ); break;
+    }
+    return( s.str() );
+}
+
+//-------------------------------------------------------------------------
+//------------- evaluate
+//-------------------------------------------------------------------------
+/*!
+ *  Evaluates the selection for a configuration. The molecule data is gathered once
+ *  (in parallel), then the tree is evaluated on masks: the right operand of an "and"
+ *  only tests the molecules the left one selected, the right operand of an "or" only
+ *  those the left one did not select. If spatial terms are used on a folded
+ *  configuration, the molecules are sorted into cells of about eight molecules, and
+ *  every cell is first classified as completely outside, completely inside or cut
+ *  by the region.
+ *  \param cnf The configuration.
+ *  \param mask Is filled with 1 for selected and 0 for other molecules.
+ *  \return false without configuration or if a needed field does not fit the configuration.
+ */
+bool mga::Selection::evaluate( CnfFile *cnf, vector<char> &mask )
+{
+    //cout << "Selection::evaluate beg" << endl;
+    if( cnf == 0 ) { return( false ); }
+    const int n = cnf -> getNumberOfMolecules();
+    if( isAll() )
+    {
+	mask.assign( n, 1 );
+	return( true );
+    }
+    if( usesField() && int( field.size() ) != n )
+    {
+	cerr << "Error: the selection needs a field with one value per molecule." << endl;
+	return( false );
+    }
+
+    const bool folded = cnf -> getShowFolded();
+    positions.resize( 3*n );
+    axes     .resize( 3*n );
+    types    .resize( n );
+    ids      .resize( n );
+
+    #pragma omp parallel for schedule(static)
+    for( int i = 0; i < n; ++i )
+    {
+	MoleculeBiax *m = cnf -> getMolecule(i);
+	if( folded )
+	{
+	    positions[3*i]   = m -> getPositionFoldedX();
+	    positions[3*i+1] = m -> getPositionFoldedY();
+	    positions[3*i+2] = m -> getPositionFoldedZ();
+	}
+	else { m -> getPositionXYZ( positions[3*i], positions[3*i+1], positions[3*i+2] ); }
+	m -> getOrientationXYZ( axes[3*i], axes[3*i+1], axes[3*i+2] );
+	types[i] = m -> getType();
+	ids[i]   = m -> getNumber();
+    }
+
+    // the cells only pay off for spatial terms, and they fold the molecules like the display does
+    bool spatial = false;
+    for( unsigned int t = 0; t < terms.size(); ++t )
+    {
+	if( terms[t].kind == BOX || terms[t].kind == SPHERE || terms[t].kind == HALF_SPACE ) { spatial = true; }
+    }
+    useCells = false;
+    if( spatial && folded && n > 0 )
+    {
+	PeriodicBox box;
+	if( box.set( cnf ) ) { useCells = cells.build( cnf, pow( 8.0 * box.getVolume() / n, 1.0 / 3.0 ) ); }
+    }
+
+    vector<char> all( n, 1 );
+    evaluateTerm( root, all, mask );
+    //cout << "Selection::evaluate end" << endl;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- evaluateTerm
+//-------------------------------------------------------------------------
+void mga::Selection::evaluateTerm( int t, const vector<char> &candidates, vector<char> &result ) const
+{
+    const Term &term = terms[t];
+    const int n = int( candidates.size() );
+    result.assign( n, 0 );
+
+    switch( term.kind )
+    {
+    case AND:
+    {
+	vector<char> left;
+	evaluateTerm( term.a, candidates, left );
+	evaluateTerm( term.b, left, result );
+	return;
+    }
+    case OR:
+    {
+	vector<char> left, rest( n ), right;
+	evaluateTerm( term.a, candidates, left );
+	#pragma omp parallel for schedule(static)
+	for( int i = 0; i < n; ++i ) { rest[i] = candidates[i] && !left[i]; }
+	evaluateTerm( term.b, rest, right );
+	#pragma omp parallel for schedule(static)
+	for( int i = 0; i < n; ++i ) { result[i] = left[i] || right[i]; }
+	return;
+    }
+    case NOT:
+    {
+	vector<char> inner;
+	evaluateTerm( term.a, candidates, inner );
+	#pragma omp parallel for schedule(static)
+	for( int i = 0; i < n; ++i ) { result[i] = candidates[i] && !inner[i]; }
+	return;
+    }
+    default:
+	break;
+    }
+
+    if( evaluateCells( term, candidates, result ) ) { return; }
+
+    #pragma omp parallel for schedule(static)
+    for( int i = 0; i < n; ++i )
+    {
+	if( candidates[i] ) { result[i] = isInside( term, i ); }
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- evaluateCells
+//-------------------------------------------------------------------------
+/*!
+ *  Evaluates a box, sphere or half-space cell by cell. The regions are convex, so a
+ *  cell whose eight corners are inside is completely inside. A cell is completely
+ *  outside if its bounding box misses the box or the sphere, or if all corners are
+ *  on the wrong side of the plane. Only the molecules of the remaining cells are tested.
+ *  \return false if the term is not spatial or there are no cells.
+ */
+bool mga::Selection::evaluateCells( const Term &term, const vector<char> &candidates, vector<char> &result ) const
+{
+    if( useCells == false || ( term.kind != BOX && term.kind != SPHERE && term.kind != HALF_SPACE ) ) { return( false ); }
+
+    // half edges of a cell
+    double edge[3][3];
+    for( int d = 0; d < 3; ++d )
+    {
+	double s[3] = { 0.0, 0.0, 0.0 };
+	s[d] = 0.5 / cells.getCellsAlong(d);
+	cells.getBox().toCartesian( s, edge[d][0], edge[d][1], edge[d][2] );
+    }
+
+    const int numCells = cells.getNumberOfCells();
+    #pragma omp parallel for schedule(dynamic,16)
+    for( int c = 0; c < numCells; ++c )
+    {
+	double center[3], low[3], high[3];
+	cells.getCellCenter( c, center[0], center[1], center[2] );
+	int inside = 0;
+	for( int k = 0; k < 8; ++k )
+	{
+	    double r[3];
+	    for( int j = 0; j < 3; ++j )
+	    {
+		r[j] = center[j] + ( k & 1 ? edge[0][j] : -edge[0][j] )
+		                 + ( k & 2 ? edge[1][j] : -edge[1][j] )
+		                 + ( k & 4 ? edge[2][j] : -edge[2][j] );
+		low[j]  = ( k == 0 ) ? r[j] : min( low[j],  r[j] );
+		high[j] = ( k == 0 ) ? r[j] : max( high[j], r[j] );
+	    }
+	    if( isInside( term, r[0], r[1], r[2] ) ) { ++inside; }
+	}
+
+	bool outside = false;
+	if( term.kind == BOX )
+	{
+	    outside = high[0] < term.p[0] || low[0] > term.p[1] || high[1] < term.p[2] || low[1] > term.p[3]
+		   || high[2] < term.p[4] || low[2] > term.p[5];
+	}
+	else if( term.kind == SPHERE )
+	{
+	    double distance = 0.0;
+	    for( int j = 0; j < 3; ++j )
+	    {
+		double delta = max( 0.0, max( low[j] - term.p[j], term.p[j] - high[j] ) );
+		distance += delta * delta;
+	    }
+	    outside = distance > term.p[3] * term.p[3];
+	}
+	else { outside = ( inside == 0 ); }
+	if( outside ) { continue; }
+
+	for( int slot = cells.getCellBegin(c); slot < cells.getCellEnd(c); ++slot )
+	{
+	    int i = cells.getParticle( slot );
+	    if( candidates[i] ) { result[i] = ( inside == 8 ) ? 1 : isInside( term, i ); }
+	}
+    }
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- isInside
+//-------------------------------------------------------------------------
+bool mga::Selection::isInside( const Term &term, int i ) const
+{
+    switch( term.kind )
+    {
+    case ALL:
+	return( true );
+    case BOX:
+    case SPHERE:
+    case HALF_SPACE:
+	return( isInside( term, positions[3*i], positions[3*i+1], positions[3*i+2] ) );
+    case TYPE:
+	return( types[i] == term.a );
+    case CONE:
+    {
+	const double *u = &axes[3*i];
+	double norm = sqrt( u[0]*u[0] + u[1]*u[1] + u[2]*u[2] );
+	if( norm <= 0.0 ) { return( false ); }
+	double c = ( u[0]*term.p[0] + u[1]*term.p[1] + u[2]*term.p[2] ) / norm;
+	return( ( term.a ? c : fabs( c ) ) >= term.p[3] );
+    }
+    case ID_RANGE:
+	return( ids[i] >= term.p[0] && ids[i] <= term.p[1] );
+    case FIELD_RANGE:
+	return( field[i] >= term.p[0] && field[i] <= term.p[1] );
+    default:
+	return( false );
+    }
+}
+
+bool mga::Selection::isInside( const Term &term, double x, double y, double z ) const
+{
+    switch( term.kind )
+    {
+    case BOX:
+	return( x >= term.p[0] && x <= term.p[1] && y >= term.p[2] && y <= term.p[3] && z >= term.p[4] && z <= term.p[5] );
+    case SPHERE:
+	x -= term.p[0];
+	y -= term.p[1];
+	z -= term.p[2];
+	return( x*x + y*y + z*z <= term.p[3] * term.p[3] );
+    case HALF_SPACE:
+	return( x*term.p[0] + y*term.p[1] + z*term.p[2] >= term.p[3] );
+    default:
+	return( false );
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- count
+//-------------------------------------------------------------------------
+int mga::Selection::count( const vector<char> &mask )
+{
+    const int n = int( mask.size() );
+    int selected = 0;
+    #pragma omp parallel for schedule(static) reduction(+:selected)
+    for( int i = 0; i < n; ++i ) { if( mask[i] ) { ++selected; } }
+    return( selected );
+}
+
+//-------------------------------------------------------------------------
+//------------- getIndices
+//-------------------------------------------------------------------------
+void mga::Selection::getIndices( const vector<char> &mask, vector<int> &indices )
+{
+    indices.clear();
+    for( unsigned int i = 0; i < mask.size(); ++i )
+    {
+	if( mask[i] ) { indices.push_back( int(i) ); }
+    }
+}
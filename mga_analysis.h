@@ -0,0 +1,665 @@
+/******************************************************************************
+** This file is part of QMGA a tool to display convex bodies.
+** Phillips-University of Marburg (Germany)
+** qmga@users.sourceforge.net
+**
+** QMGA is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** QMGA is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with QMGA; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef MGA_ANALYSIS_H
+#define MGA_ANALYSIS_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <complex>
+
+#include "mga_tools.h"
+
+using std::string;
+using std::vector;
+using std::map;
+using std::complex;
+
+namespace mga
+{
+  //-------------------------------------------------------------------------
+  //------------- PeriodicBox
+  //-------------------------------------------------------------------------
+  //! The periodic bounding box of a configuration.
+  /*!
+   *  Holds the box vectors (rows of CnfFile::getBoundingBoxMatrix(), the box is centered at
+   *  the origin) and their inverse to convert between cartesian and fractional coordinates.
+   *  Fractional coordinates of positions inside the box are in [-0.5,0.5).
+   */
+  class PeriodicBox
+  {
+  public:
+    PeriodicBox();                                                                 //!< The constructor.
+    bool   set( CnfFile *cnf );                                                    //!< Takes the box vectors of the given configuration.
+    void   toFractional( double x, double y, double z, double s[3] ) const;       //!< Converts a cartesian position to fractional coordinates.
+    void   toCartesian( const double s[3], double &x, double &y, double &z ) const; //!< Converts fractional coordinates to a cartesian position.
+    void   minimumImage( double &dx, double &dy, double &dz ) const;               //!< Applies the minimum image convention to a distance vector.
+    void   gradientToCartesian( const double g[3], double &x, double &y, double &z ) const; //!< Converts a gradient in fractional coordinates to a cartesian one.
+    double getVolume() const { return( volume ); }                                 //!< Returns the volume of the box.
+    double getWidth( int d ) const;                                                //!< Returns the perpendicular width of the box along box vector d.
+
+  private:
+    double boxMatrix[3][3];                                                        //!< Box vectors in columns.
+    double inverseBox[3][3];                                                       //!< Inverse of boxMatrix.
+    double volume;                                                                 //!< Volume of the box.
+  };
+
+  //-------------------------------------------------------------------------
+  //------------- CellList
+  //-------------------------------------------------------------------------
+  //! A periodic cell list over the molecules of a CnfFile.
+  /*!
+   *  The molecule positions are folded into the bounding box (the rows of
+   *  CnfFile::getBoundingBoxMatrix() are the box vectors) and sorted into cells
+   *  of at least the size of the cutoff. The cells are stored flat: the
+   *  molecules of cell c are getParticle(getCellBegin(c)) ... getParticle(getCellEnd(c)-1).
+   */
+  class CellList
+  {
+  public:
+    CellList();                                                                    //!< The constructor.
+    bool   build( CnfFile *cnf, double cutoff );                                   //!< Folds positions and sorts molecules into cells.
+    bool   build( CnfFile *cnf, int cellsX, int cellsY, int cellsZ );              //!< Same as above with a given number of cells along each box vector.
+    int    getNumberOfParticles() const { return( numParticles ); }                //!< Returns the number of sorted molecules.
+    int    getNumberOfCells() const { return( numCells ); }                        //!< Returns the total number of cells.
+    int    getCellBegin( int cell ) const { return( cellOffset[cell] ); }          //!< Returns the first slot of cell "cell".
+    int    getCellEnd  ( int cell ) const { return( cellOffset[cell+1] ); }        //!< Returns one past the last slot of cell "cell".
+    int    getParticle ( int slot ) const { return( cellParticles[slot] ); }       //!< Returns the molecule index stored in slot "slot".
+    int    getCellOfParticle( int i ) const { return( cellOfParticle[i] ); }       //!< Returns the cell molecule i was sorted into.
+    int    getCellsAlong( int d ) const { return( cells[d] ); }                    //!< Returns the number of cells along box vector d.
+    void   getNeighborCells( int cell, vector<int> &neighbors ) const;             //!< Returns the distinct cells surrounding (and including) "cell".
+    void   getCellCenter( int cell, double &x, double &y, double &z ) const;      //!< Returns the cartesian center of a cell.
+    double getX( int i ) const { return( positions[3*i]   ); }                     //!< Returns folded x position of molecule i.
+    double getY( int i ) const { return( positions[3*i+1] ); }                     //!< Returns folded y position of molecule i.
+    double getZ( int i ) const { return( positions[3*i+2] ); }                     //!< Returns folded z position of molecule i.
+    void   minimumImage( double &dx, double &dy, double &dz ) const { box.minimumImage( dx, dy, dz ); } //!< Applies the minimum image convention to a distance vector.
+    double getVolume() const { return( box.getVolume() ); }                        //!< Returns the volume of the bounding box.
+    double getMaximumCutoff() const { return( maxCutoff ); }                       //!< Returns half the smallest perpendicular box width.
+    const PeriodicBox& getBox() const { return( box ); }                           //!< Returns the periodic box.
+
+  private:
+    bool   sortIntoCells( CnfFile *cnf );                                          //!< Folds positions and sorts molecules into the current cells.
+    PeriodicBox    box;                                                            //!< The bounding box of the configuration.
+    vector<double> positions;                                                      //!< Folded positions, xyz interleaved.
+    vector<int>    cellOffset;                                                     //!< Start slot of every cell, numCells+1 entries.
+    vector<int>    cellParticles;                                                  //!< Molecule indices sorted by cell.
+    vector<int>    cellOfParticle;                                                 //!< Cell index of every molecule.
+    double maxCutoff;                                                              //!< Largest cutoff that is consistent with the minimum image convention.
+    int    numParticles;                                                           //!< Number of sorted molecules.
+    int    numCells;                                                               //!< Number of cells.
+    int    cells[3];                                                               //!< Number of cells along each box vector.
+  };
+
+  //-------------------------------------------------------------------------
+  //------------- PairDistribution
+  //-------------------------------------------------------------------------
+  //! Radial and anisotropic pair distribution functions.
+  /*!
+   *  Calculates g(r) and, with respect to the nematic director of every frame,
+   *  g_par(r_par) (pairs within a cylinder of radius sliceWidth around the director)
+   *  and g_perp(r_perp) (pairs within a slab of half thickness sliceWidth).
+   *  Every call of addFrame() accumulates another configuration, so that the
+   *  result is averaged over all added frames. Pairs are found with a CellList,
+   *  the cells are distributed among threads, which fill their own histograms
+   *  that are merged at the end of every frame.
+   */
+  class PairDistribution
+  {
+  public:
+    PairDistribution( double rMax = 5.0, int numBins = 250, double sliceWidth = 0.5 ); //!< The constructor.
+    void   reset();                                                                //!< Clears all accumulated frames.
+    bool   addFrame( CnfFile *cnf );                                               //!< Accumulates pair statistics of one configuration.
+    bool   writeDataFile( string filename, string comment = "" ) const;            //!< Writes r, g, g_par and g_perp columns to a file.
+    int    getNumberOfFrames() const { return( numFrames ); }                      //!< Returns the number of accumulated frames.
+    int    getNumberOfBins() const { return( numBins ); }                          //!< Returns the number of histogram bins.
+    double getBinWidth() const { return( binWidth ); }                             //!< Returns the width of a histogram bin.
+    void   getResult( vector<double> &r, vector<double> &g,
+		      vector<double> &gPar, vector<double> &gPerp ) const;             //!< Returns the normalized distribution functions.
+
+  private:
+    double rMax;                                                                   //!< Largest distance taken into account.
+    int    numBins;                                                                //!< Number of histogram bins.
+    double binWidth;                                                               //!< rMax / numBins.
+    double sliceWidth;                                                             //!< Radius of the cylinder (g_par) and half thickness of the slab (g_perp).
+    int    numFrames;                                                              //!< Number of accumulated frames.
+    double sumDensity;                                                             //!< Sum over frames of N*N/V, needed for normalization.
+    vector<double> histG;                                                          //!< Pair counts binned by |r|.
+    vector<double> histPar;                                                        //!< Pair counts binned by |r_par|.
+    vector<double> histPerp;                                                       //!< Pair counts binned by r_perp.
+  };
+
+  //-------------------------------------------------------------------------
+  //------------- DirectorField
+  //-------------------------------------------------------------------------
+  //! Coarse grained local director and order parameter field.
+  /*!
+   *  The box is divided into resolution^3 periodic cells. For every cell the order tensor
+   *  Q = 3/2 <u u> - 1/2 I of the long axes of the molecules inside is accumulated and
+   *  diagonalized, giving the local director (eigenvector of the largest eigenvalue)
+   *  and the local order parameter S (largest eigenvalue). Cells are processed in parallel.
+   */
+  class DirectorField
+  {
+  public:
+    DirectorField( int resolution = 10 );                                          //!< The constructor.
+    void   setResolution( int resolutionTmp ) { resolution = resolutionTmp > 0 ? resolutionTmp : 1; } //!< Sets the number of cells along each box vector.
+    int    getResolution() const { return( resolution ); }                         //!< Returns the number of cells along each box vector.
+    bool   calculate( CnfFile *cnf );                                              //!< Calculates the field for the given configuration.
+    int    getNumberOfCells() const { return( cellList.getNumberOfCells() ); }     //!< Returns the number of cells.
+    int    getCellOfMolecule( int i ) const { return( cellList.getCellOfParticle(i) ); } //!< Returns the cell molecule i belongs to.
+    int    getCount( int cell ) const { return( cellList.getCellEnd(cell) - cellList.getCellBegin(cell) ); } //!< Returns the number of molecules in a cell.
+    double getOrder( int cell ) const { return( order[cell] ); }                   //!< Returns the local order parameter of a cell.
+    void   getDirector( int cell, double &x, double &y, double &z ) const;        //!< Returns the local director of a cell.
+    void   getCellCenter( int cell, double &x, double &y, double &z ) const { cellList.getCellCenter( cell, x, y, z ); } //!< Returns the center of a cell.
+    const CellList& getCellList() const { return( cellList ); }                    //!< Returns the cells the field is based on.
+    void   getAlignmentAngles( CnfFile *cnf, vector<double> &angles ) const;       //!< Angle (deg) between every molecule and its local director.
+    bool   writeDataFile( string filename, string comment = "" ) const;            //!< Writes cell centers, counts, S and directors to a file.
+
+  private:
+    int            resolution;                                                     //!< Number of cells along each box vector.
+    CellList       cellList;                                                       //!< Molecules sorted into the cells of the field.
+    vector<double> order;                                                          //!< Local order parameter of every cell.
+    vector<double> directors;                                                      //!< Local director of every cell, xyz interleaved.
+  };
+
+  //-------------------------------------------------------------------------
+  //------------- DefectFinder
+  //-------------------------------------------------------------------------
+  //! Disclination lines in a coarse grained director field.
+  /*!
+   *  A cell of a DirectorField is a defect cell, if its local order parameter is
+   *  below the threshold, or if one of the three plaquettes spanned by the cell and
+   *  its upper neighbors has a half integer winding: going around the four directors
+   *  of the plaquette, the sign of the director has to be flipped an odd number of times
+   *  to keep neighboring directors parallel. Cells are classified in parallel.
+   *  Adjacent (26-neighborhood, not across the periodic boundaries) defect cells are then
+   *  connected into polylines through the cell centers. Isolated defect cells are dropped.
+   */
+  class DefectFinder
+  {
+  public:
+    DefectFinder( double orderThreshold = 0.3 );                                   //!< The constructor.
+    void   setOrderThreshold( double threshold ) { orderThreshold = threshold; }   //!< Cells with a lower local order parameter are defects.
+    double getOrderThreshold() const { return( orderThreshold ); }                 //!< Returns the order parameter threshold.
+    bool   find( const DirectorField &field );                                     //!< Classifies the cells of the field and connects the defect cells.
+    bool   isDefect( int cell ) const { return( defect[cell] != 0 ); }             //!< Returns true if the cell is a defect cell.
+    int    getNumberOfDefectCells() const { return( numDefectCells ); }            //!< Returns the number of defect cells.
+    const vector<vector<float> >& getLines() const { return( lines ); }            //!< Returns the polylines, xyz interleaved.
+
+  private:
+    bool   hasWinding( const DirectorField &field, int cx, int cy, int cz ) const; //!< Tests the plaquettes of a cell for a half integer winding.
+    int    cellIndex( int cx, int cy, int cz ) const { return( (cx * cells[1] + cy) * cells[2] + cz ); } //!< Flat index of a cell.
+    void   getDefectNeighbors( int cell, vector<int> &neighbors ) const;          //!< Defect cells adjacent to a cell.
+    void   addPoint( const DirectorField &field, int cell, vector<float> &line ) const; //!< Appends the center of a cell to a line.
+    double orderThreshold;                                                         //!< Order parameter threshold.
+    int    numDefectCells;                                                         //!< Number of defect cells.
+    int    cells[3];                                                               //!< Number of cells along each box vector.
+    vector<char> defect;                                                           //!< Defect flag of every cell.
+    vector<vector<float> > lines;                                                  //!< Polylines through the defect cells.
+  };
+
+  //-------------------------------------------------------------------------
+  //------------- IsoSurface
+  //-------------------------------------------------------------------------
+  //! Isosurfaces of a coarse grained scalar field.
+  /*!
+   *  A scalar field (local order parameter, number density or the fraction of molecules
+   *  of one type) is calculated on the cells of a DirectorField. The cell centers are the
+   *  grid points, every cube between eight neighboring grid points (including the cubes
+   *  across the periodic boundaries) is split into six tetrahedra that are polygonized
+   *  independently, so there are no ambiguous cases. The cubes are distributed among
+   *  threads, which fill their own triangle lists. The number of triangles scales with
+   *  the area of the surface, not with the number of molecules.
+   *  Vertex normals are taken from the gradient of the field and point to lower values.
+   */
+  class IsoSurface
+  {
+  public:
+    enum Quantity { LOCAL_ORDER = 0, DENSITY = 1, TYPE_FRACTION = 2 };           //!< Available scalar fields.
+
+    IsoSurface( int resolution = 20 );                                             //!< The constructor.
+    void   setResolution( int resolutionTmp ) { field.setResolution( resolutionTmp ); } //!< Sets the number of grid cells along each box vector.
+    int    getResolution() const { return( field.getResolution() ); }              //!< Returns the number of grid cells along each box vector.
+    void   setQuantity( int quantityTmp, int typeTmp = 0 ) { quantity = quantityTmp; type = typeTmp; } //!< Selects the scalar field (and the type for TYPE_FRACTION).
+    int    getQuantity() const { return( quantity ); }                             //!< Returns the selected scalar field.
+    int    getType() const { return( type ); }                                     //!< Returns the type used for TYPE_FRACTION.
+    void   setIsoValue( double value ) { isoValue = value; }                       //!< Sets the value of the surface.
+    double getIsoValue() const { return( isoValue ); }                             //!< Returns the value of the surface.
+    bool   calculate( CnfFile *cnf );                                              //!< Calculates the field and extracts the surface.
+    double getMinimum() const { return( minimum ); }                               //!< Smallest value of the field.
+    double getMaximum() const { return( maximum ); }                               //!< Largest value of the field.
+    int    getNumberOfTriangles() const { return( vertices.size() / 9 ); }         //!< Returns the number of triangles.
+    const vector<float>& getVertices() const { return( vertices ); }               //!< Three vertices per triangle, xyz interleaved.
+    const vector<float>& getNormals() const { return( normals ); }                 //!< One normal per vertex, xyz interleaved.
+
+  private:
+    bool   calculateField( CnfFile *cnf );                                         //!< Fills values with the selected quantity.
+    void   calculateGradients();                                                   //!< Cartesian gradient of the field at every grid point.
+    void   polygonize( const double p[4][3], const double v[4], const double g[4][3],
+		       vector<float> &verticesTmp, vector<float> &normalsTmp ) const; //!< Triangles of one tetrahedron.
+    DirectorField  field;                                                          //!< Grid cells and local order parameter.
+    int            quantity;                                                       //!< Selected scalar field.
+    int            type;                                                           //!< Type used for TYPE_FRACTION.
+    double         isoValue;                                                       //!< Value of the surface.
+    double         minimum;                                                        //!< Smallest value of the field.
+    double         maximum;                                                        //!< Largest value of the field.
+    vector<double> values;                                                         //!< Field value of every grid cell.
+    vector<double> gradients;                                                      //!< Gradient at every grid cell, xyz interleaved.
+    vector<float>  vertices;                                                       //!< Triangle vertices.
+    vector<float>  normals;                                                        //!< Vertex normals.
+  };
+
+  //-------------------------------------------------------------------------
+  //------------- ClusterAnalysis
+  //-------------------------------------------------------------------------
+  //! Connected clusters of neighboring molecules.
+  /*!
+   *  Two molecules are bonded if they are closer than the cutoff (minimum image), their
+   *  long axes (taken from the quaternions) enclose an angle below the maximum angle and
+   *  both are of the selected type (-1 selects all types). The bonds are found with a
+   *  CellList, the cells are distributed among threads, which merge the clusters in a
+   *  common lock-free union-find structure (compare and swap on the parent links, roots
+   *  are always linked to the smaller index). Afterwards the clusters are numbered by
+   *  decreasing size, so cluster 0 is the largest one.
+   */
+  class ClusterAnalysis
+  {
+  public:
+    ClusterAnalysis( double cutoff = 1.5, double maxAngle = 90.0, int type = -1 ); //!< The constructor.
+    void   setCutoff( double cutoffTmp ) { cutoff = cutoffTmp; }                   //!< Sets the largest bond length.
+    double getCutoff() const { return( cutoff ); }                                 //!< Returns the largest bond length.
+    void   setMaximumAngle( double angle ) { maxAngle = angle; }                   //!< Sets the largest angle (deg) between bonded molecules, 90 disables the criterion.
+    double getMaximumAngle() const { return( maxAngle ); }                         //!< Returns the largest angle between bonded molecules.
+    void   setType( int typeTmp ) { type = typeTmp; }                              //!< Only molecules of this type are clustered, -1 for all.
+    int    getType() const { return( type ); }                                     //!< Returns the selected type.
+    bool   calculate( CnfFile *cnf );                                              //!< Finds the clusters of the given configuration.
+    int    getNumberOfClusters() const { return( sizes.size() ); }                 //!< Returns the number of clusters (including single molecules).
+    int    getClusterOfMolecule( int i ) const { return( clusterIds[i] ); }        //!< Returns the cluster of molecule i, -1 if it has not the selected type.
+    int    getClusterSize( int cluster ) const { return( sizes[cluster] ); }       //!< Returns the number of molecules in a cluster.
+    const vector<int>& getClusterIds() const { return( clusterIds ); }             //!< Returns the cluster id of every molecule.
+    void   getSizeDistribution( vector<double> &size, vector<double> &count ) const; //!< Number of clusters of every occurring size.
+    bool   writeDataFile( string filename, string comment = "" ) const;            //!< Writes the cluster size distribution to a file.
+
+  private:
+    int    findRoot( int i );                                                      //!< Root of the tree of molecule i, halves the path.
+    void   unite( int i, int j );                                                  //!< Merges the trees of molecules i and j.
+    double cutoff;                                                                 //!< Largest bond length.
+    double maxAngle;                                                               //!< Largest angle between bonded molecules in degrees.
+    int    type;                                                                   //!< Selected type, -1 for all types.
+    vector<int> parent;                                                            //!< Union-find parent links.
+    vector<int> clusterIds;                                                        //!< Cluster of every molecule.
+    vector<int> sizes;                                                             //!< Size of every cluster, decreasing.
+  };
+
+  //-------------------------------------------------------------------------
+  //------------- StructureFactor
+  //-------------------------------------------------------------------------
+  //! Static structure factor and smectic order parameter.
+  /*!
+   *  The molecule centers are assigned to a periodic grid of gridSize^3 points in fractional
+   *  coordinates (cloud in cell), the grid is Fourier transformed with a threaded radix-2
+   *  FFT and S(q) = |rho(q)|^2 / N is corrected for the assignment window. S(q) is averaged
+   *  over shells of |q| and, for the wave vectors within 10 degrees of the director, the
+   *  largest value of every shell is kept. The largest peak along the director gives the
+   *  layer normal; the smectic order parameter tau = |sum exp(i q r)| / N is then evaluated
+   *  exactly at this wave vector and the layer spacing is 2 pi / |q|.
+   *  Results can be cached by a key (e.g. the file name), so frames of a trajectory only
+   *  have to be calculated once.
+   */
+  class StructureFactor
+  {
+  public:
+    StructureFactor( int gridSize = 64, int numBins = 100 );                       //!< The constructor.
+    void   setGridSize( int size );                                                //!< Sets the grid points per box vector (rounded up to a power of two), clears the cache.
+    int    getGridSize() const { return( gridSize ); }                             //!< Returns the grid points per box vector.
+    bool   calculate( CnfFile *cnf, string key = "" );                             //!< Calculates S(q) or takes it from the cache if key is known.
+    bool   isCached( string key ) const { return( cache.find( key ) != cache.end() ); } //!< Returns true if results for key are cached.
+    bool   getCached( string key, double &order, double &spacing ) const;          //!< Returns cached smectic order parameter and layer spacing.
+    void   clearCache() { cache.clear(); }                                         //!< Removes all cached results.
+    double getSmecticOrder() const { return( current.order ); }                    //!< Smectic order parameter of the last frame.
+    double getLayerSpacing() const { return( current.spacing ); }                  //!< Layer spacing of the last frame.
+    void   getLayerNormal( double q[3] ) const;                                    //!< Wave vector of the smectic peak of the last frame.
+    void   getResult( vector<double> &q, vector<double> &s, vector<double> &sPar ) const; //!< Shell averaged S(q) and S(q) along the director.
+    bool   writeDataFile( string filename, string comment = "" ) const;            //!< Writes q, S(q) and S_par(q) to a file.
+    bool   getCachedValues( string key, vector<double> &values ) const;            //!< Flattens the cached results of key (for AnalysisCache).
+    bool   setCachedValues( string key, const vector<double> &values );            //!< Caches results flattened by getCachedValues().
+    string getParameters() const;                                                  //!< Parameters the results depend on, as text.
+
+  private:
+    struct Frame                                                                   //!< Results of one configuration.
+    {
+      double order;                                                                //!< Smectic order parameter.
+      double spacing;                                                              //!< Layer spacing.
+      double normal[3];                                                            //!< Wave vector of the smectic peak.
+      double binWidth;                                                             //!< Width of the |q| shells.
+      vector<double> radial;                                                       //!< Shell averaged S(q).
+      vector<double> parallel;                                                     //!< Largest S(q) along the director per shell.
+    };
+    static void fft( complex<double> *data, int n );                              //!< In place forward FFT of n (power of two) values.
+    int    gridSize;                                                               //!< Grid points per box vector.
+    int    numBins;                                                                //!< Number of |q| shells.
+    Frame  current;                                                                //!< Results of the last frame.
+    map<string, Frame> cache;                                                      //!< Results by key.
+  };
+
+  //-------------------------------------------------------------------------
+  //------------- TimeCorrelation
+  //-------------------------------------------------------------------------
+  //! Mean squared displacement and rotational correlation functions of a trajectory.
+  /*!
+   *  Frames are consumed one after another by addFrame(). Positions are unwrapped by
+   *  adding the minimum image displacement (in fractional coordinates) between successive
+   *  frames, so they may be folded or not, but no molecule may move more than half a box
+   *  between two frames. The molecule axis is taken from the quaternions.
+   *  The correlator is of the multiple-tau kind: level k keeps the last pointsPerLevel
+   *  samples of every averaging^k-th frame and correlates every new sample with them,
+   *  which covers lags up to pointsPerLevel * averaging^(maxLevels-1) frames. Memory
+   *  grows with the number of levels only, not with the length of the trajectory.
+   *  Molecules are identified by their index in the file, which must not change.
+   *  The molecules are distributed among threads, that sum into their own accumulators.
+   */
+  class TimeCorrelation
+  {
+  public:
+    TimeCorrelation( int pointsPerLevel = 16, int averaging = 2, int maxLevels = 20 ); //!< The constructor.
+    void   reset();                                                                //!< Clears all samples and accumulated correlations.
+    bool   addFrame( CnfFile *cnf );                                               //!< Unwraps and correlates one more frame.
+    int    getNumberOfFrames() const { return( numFrames ); }                      //!< Returns the number of added frames.
+    int    getNumberOfLevels() const { return( levels.size() ); }                  //!< Returns the number of levels in use.
+    double getMemoryUsage() const;                                                 //!< Returns the size of the sample buffers in bytes.
+    void   getResult( vector<double> &lag, vector<double> &msd, vector<double> &c1,
+		      vector<double> &c2, vector<double> &samples ) const;         //!< Returns MSD, C1, C2 and the number of samples by lag (in frames).
+    bool   writeDataFile( string filename, string comment = "" ) const;            //!< Writes lag, MSD, C1, C2 and the number of samples to a file.
+
+  private:
+    struct Level                                                                   //!< Samples and sums of one level.
+    {
+      int    count;                                                                //!< Number of samples this level received.
+      vector<double> positions;                                                    //!< Unwrapped positions, pointsPerLevel slots of 3N values.
+      vector<float>  axes;                                                         //!< Molecule axes, same layout.
+      vector<double> sumMsd;                                                       //!< Sums of squared displacements by lag.
+      vector<double> sumC1;                                                        //!< Sums of u(0).u(t) by lag.
+      vector<double> sumC2;                                                        //!< Sums of P2(u(0).u(t)) by lag.
+      vector<double> samples;                                                      //!< Number of time origins by lag.
+    };
+    void   addToLevel( int level );                                                //!< Stores the current frame on a level and correlates it.
+    int    pointsPerLevel;                                                         //!< Samples kept per level.
+    int    averaging;                                                              //!< Spacing ratio of successive levels.
+    int    maxLevels;                                                              //!< Largest number of levels.
+    int    numParticles;                                                           //!< Number of molecules of the first frame.
+    int    numFrames;                                                              //!< Number of added frames.
+    vector<double> previous;                                                       //!< Fractional positions of the last frame.
+    vector<double> unwrapped;                                                      //!< Unwrapped positions of the current frame.
+    vector<double> axis;                                                           //!< Molecule axes of the current frame.
+    vector<Level>  levels;                                                         //!< Levels in use.
+  };
+
+  //-------------------------------------------------------------------------
+  //------------- BiaxialOrder
+  //-------------------------------------------------------------------------
+  //! Order tensors of all three molecular axes and the biaxial order parameters.
+  /*!
+   *  The body axes x, y, z of every molecule are the columns of the rotation matrix of its
+   *  quaternion (z is the axis CnfFile::calculateDirector() uses). One pass over the
+   *  molecules, distributed among threads, sums the three tensors Q_a = < 3/2 a a - 1/2 I >.
+   *  The primary director Z is the eigenvector of the largest eigenvalue of Q_z, the
+   *  secondary director X the one of Q_x within the plane perpendicular to Z, Y = Z x X.
+   *  The order parameters are taken in this frame:
+   *  S = Q_z(ZZ), P = Q_z(XX) - Q_z(YY), D = Q_x(ZZ) - Q_y(ZZ) and
+   *  C = ( Q_x(XX) - Q_x(YY) - Q_y(XX) + Q_y(YY) ) / 3, so a perfectly biaxial
+   *  configuration has S = C = 1 and P = D = 0.
+   */
+  class BiaxialOrder
+  {
+  public:
+    BiaxialOrder();                                                                //!< The constructor.
+    bool   calculate( CnfFile *cnf );                                              //!< Calculates tensors, directors and order parameters.
+    double getOrderS() const { return( orderS ); }                                 //!< Uniaxial order of the molecular z axis.
+    double getOrderP() const { return( orderP ); }                                 //!< Phase biaxiality of the molecular z axis.
+    double getOrderD() const { return( orderD ); }                                 //!< Molecular biaxiality along the primary director.
+    double getOrderC() const { return( orderC ); }                                 //!< Biaxial order of the molecular x and y axes.
+    double getAxisOrder( int axis ) const { return( axisOrder[axis] ); }           //!< Largest eigenvalue of the tensor of axis 0 (x), 1 (y) or 2 (z).
+    void   getTensor( int axis, double q[6] ) const;                               //!< Upper triangle (xx, xy, xz, yy, yz, zz) of the tensor of an axis.
+    void   getPrimaryDirector  ( double n[3] ) const;                              //!< Returns Z.
+    void   getSecondaryDirector( double m[3] ) const;                              //!< Returns X.
+
+  private:
+    static double project( const double q[6], const double a[3], const double b[3] ); //!< Returns a.Q.b.
+    double tensor[3][6];                                                           //!< Q_x, Q_y and Q_z, upper triangles.
+    double primary[3];                                                             //!< Primary director Z.
+    double secondary[3];                                                           //!< Secondary director X.
+    double axisOrder[3];                                                           //!< Largest eigenvalues of the three tensors.
+    double orderS;                                                                 //!< S.
+    double orderP;                                                                 //!< P.
+    double orderD;                                                                 //!< D.
+    double orderC;                                                                 //!< C.
+  };
+
+  //-------------------------------------------------------------------------
+  //------------- OrientationDistribution
+  //-------------------------------------------------------------------------
+  //! Distribution of the molecule axes on an equal area grid on the unit sphere.
+  /*!
+   *  The sphere is divided into bands of equal height in z = cos(theta) and sectors of equal
+   *  width in phi, which by Archimedes' theorem gives cells of equal area. The molecule axes
+   *  (taken from the quaternions, see BiaxialOrder) are binned by threads into their own
+   *  histograms. Head and tail of a molecule are equivalent by default, every axis is then
+   *  also counted as its inverse. Successive calls of addFrame() accumulate.
+   */
+  class OrientationDistribution
+  {
+  public:
+    OrientationDistribution( int bands = 18, int sectors = 36, bool apolar = true ); //!< The constructor.
+    void   reset();                                                                //!< Clears all accumulated frames.
+    bool   addFrame( CnfFile *cnf );                                               //!< Bins the axes of one configuration.
+    int    getNumberOfFrames() const { return( numFrames ); }                      //!< Returns the number of accumulated frames.
+    int    getNumberOfBands() const { return( bands ); }                           //!< Returns the number of bands in z.
+    int    getNumberOfSectors() const { return( sectors ); }                       //!< Returns the number of sectors in phi.
+    int    getBin( double x, double y, double z ) const;                           //!< Returns the cell of a unit vector.
+    double getDensity( int band, int sector ) const;                               //!< Probability density of a cell, 1 for an isotropic distribution.
+    double getMaximum() const;                                                     //!< Returns the largest density.
+    bool   writeDataFile( string filename, string comment = "" ) const;            //!< Writes cos(theta), phi and the density of every cell.
+    void   getValues( vector<double> &values ) const;                              //!< Flattens the accumulated counts (for AnalysisCache).
+    bool   setValues( const vector<double> &values );                              //!< Restores counts flattened by getValues().
+    string getParameters() const;                                                  //!< Parameters the results depend on, as text.
+
+  private:
+    int    bands;                                                                  //!< Number of bands in z.
+    int    sectors;                                                                //!< Number of sectors in phi.
+    bool   apolar;                                                                 //!< If true, u and -u are counted.
+    int    numFrames;                                                              //!< Number of accumulated frames.
+    double total;                                                                  //!< Number of binned vectors.
+    vector<double> histogram;                                                      //!< Counts, band major.
+  };
+
+  //-------------------------------------------------------------------------
+  //------------- AnalysisCache
+  //-------------------------------------------------------------------------
+  //! Per frame analysis results, kept in a sidecar file next to the frames.
+  /*!
+   *  Results are stored as vectors of doubles keyed by the configuration file, the name of
+   *  the quantity (e.g. "director") and a text describing the parameters it was calculated
+   *  with. All files of one directory share the store file storeName in that directory, which
+   *  is read when a file of the directory is used the first time and written by flush().
+   *  Every file is stamped with its size and modification time; if the file changes, all its
+   *  results are dropped. A lookup with different parameters misses and the next store()
+   *  replaces the old result. If the directory is not writable, the cache works in memory only.
+   */
+  class AnalysisCache
+  {
+  public:
+    AnalysisCache( string storeName = ".qmga-cache" );                             //!< The constructor.
+    ~AnalysisCache();                                                              //!< The destructor, flushes all stores.
+    bool   lookup( string file, string quantity, string parameters,
+		   vector<double> &values );                                          //!< Returns true and the values if a valid result is stored.
+    void   store( string file, string quantity, string parameters,
+		  const vector<double> &values );                                     //!< Stores a result.
+    void   invalidate( string file );                                              //!< Drops all results of a file.
+    void   clear();                                                                //!< Drops all results of all stores (the store files are emptied by flush()).
+    bool   flush();                                                                //!< Writes all changed stores.
+    int    getHits() const { return( hits ); }                                     //!< Returns the number of successful lookups.
+    int    getMisses() const { return( misses ); }                                 //!< Returns the number of failed lookups.
+
+  private:
+    struct Entry                                                                   //!< One result.
+    {
+      string parameters;                                                           //!< Parameters of the result.
+      vector<double> values;                                                       //!< The result.
+    };
+    struct Record                                                                  //!< All results of one file.
+    {
+      string stamp;                                                                //!< Size and modification time of the file.
+      map<string, Entry> entries;                                                  //!< Results by quantity.
+    };
+    struct Store                                                                   //!< All files of one directory.
+    {
+      bool modified;                                                               //!< True if the store has to be written.
+      map<string, Record> records;                                                 //!< Records by file name (without directory).
+    };
+    Store& storeOf( const string &file, string &name );                           //!< Returns (and loads) the store of a file's directory.
+    static string stampOf( const string &file );                                   //!< Returns "size mtime" of a file, "" if it does not exist.
+    bool   read( const string &directory, Store &s ) const;                        //!< Reads a store file.
+    bool   write( const string &directory, const Store &s ) const;                 //!< Writes a store file.
+    string storeName;                                                              //!< File name of the store in every directory.
+    map<string, Store> stores;                                                     //!< Stores by directory.
+    int    hits;                                                                   //!< Number of successful lookups.
+    int    misses;                                                                 //!< Number of failed lookups.
+  };
+
+  //-------------------------------------------------------------------------
+  //------------- FrameDifference
+  //-------------------------------------------------------------------------
+  //! Per molecule displacement and rotation between a reference frame and the current one.
+  /*!
+   *  setReference() keeps positions, quaternions and ids of a frame. calculate() matches the
+   *  molecules of another frame by id (Molecule::getNumber()), or by index if the ids are not
+   *  unique, and gives every molecule the length of its displacement under the minimum image
+   *  convention of the current box and the angle of its rotation, i.e. of the quaternion
+   *  q_ref^-1 q (see MoleculeBiax::MultiplyQ). Molecules without partner get -1.
+   */
+  class FrameDifference
+  {
+  public:
+    FrameDifference();                                                             //!< The constructor.
+    bool   setReference( CnfFile *cnf, string name = "" );                         //!< Keeps the given configuration as reference.
+    bool   hasReference() const { return( referenceIds.size() > 0 ); }             //!< Returns true if a reference is set.
+    string getReferenceName() const { return( referenceName ); }                   //!< Returns the name given to setReference().
+    bool   calculate( CnfFile *cnf );                                              //!< Compares the configuration with the reference.
+    int    getNumberMatched() const { return( numMatched ); }                      //!< Returns the number of molecules found in the reference.
+    double getDisplacement( int i ) const { return( displacement[i] ); }          //!< Displacement of molecule i, -1 without partner.
+    double getRotation( int i ) const { return( rotation[i] ); }                  //!< Rotation angle (deg) of molecule i, -1 without partner.
+    const vector<double>& getDisplacements() const { return( displacement ); }     //!< Displacements of all molecules.
+    const vector<double>& getRotations() const { return( rotation ); }             //!< Rotation angles of all molecules.
+    double getMaximum( bool ofRotation ) const;                                    //!< Largest displacement or rotation.
+    void   getTopMovers( int k, bool byRotation, vector<int> &indices ) const;     //!< Indices of the k molecules that moved (rotated) most.
+
+  private:
+    int    findReference( unsigned int id, int i ) const;                          //!< Index of the partner of the molecule at file position i with id id, -1 if none.
+    vector<unsigned int> referenceIds;                                             //!< Ids of the reference molecules.
+    vector<std::pair<unsigned int,int> > sortedIds;                                //!< (id, index) pairs of the reference, sorted by id.
+    vector<double> referencePositions;                                             //!< Reference positions, xyz interleaved.
+    vector<double> referenceQuaternions;                                           //!< Reference quaternions, wxyz interleaved.
+    vector<double> displacement;                                                   //!< Displacements of the last calculate().
+    vector<double> rotation;                                                       //!< Rotation angles of the last calculate().
+    string referenceName;                                                          //!< Name of the reference frame.
+    bool   uniqueIds;                                                              //!< False if the reference ids are not unique, molecules are then matched by index.
+    int    numMatched;                                                             //!< Number of molecules with a partner.
+  };
+
+  //-------------------------------------------------------------------------
+  //------------- Selection
+  //-------------------------------------------------------------------------
+  //! A compiled query over the molecules of a configuration.
+  /*!
+   *  The selection is a tree of predicates (box, sphere, half-space, type, orientation cone,
+   *  id range, range of a scalar field) combined with and, or and not. It is built with the
+   *  add...() functions or parsed from an expression like
+   *  "sphere 0 0 0 5 and not ( type 1 or cone 0 0 1 20 )", see parse(). evaluate() turns it
+   *  into a mask with one entry per molecule, which is used by the renderer, the POV-Ray
+   *  export and the analysis alike. Positions are taken as shown (folded or not), without
+   *  the translation of the view. Spatial predicates of folded configurations are tested
+   *  cell by cell with a CellList first, so only molecules of cells that cut the border
+   *  of a region are tested one by one.
+   */
+  class Selection
+  {
+  public:
+    enum Kind { ALL, BOX, SPHERE, HALF_SPACE, TYPE, CONE, ID_RANGE, FIELD_RANGE, AND, OR, NOT }; //!< Kinds of terms.
+
+    Selection();                                                                   //!< The constructor, selects all molecules.
+    void   clear();                                                                //!< Removes all terms, the selection then selects all molecules.
+    int    addAll();                                                               //!< All molecules.
+    int    addBox( double xLow, double xHigh, double yLow, double yHigh, double zLow, double zHigh ); //!< Molecules inside an axis aligned box.
+    int    addSphere( double x, double y, double z, double radius );               //!< Molecules inside a sphere.
+    int    addHalfSpace( double nx, double ny, double nz, double d );              //!< Molecules with n.r >= d.
+    int    addType( int type );                                                    //!< Molecules of a type (Molecule::getType()).
+    int    addCone( double ax, double ay, double az, double angle, bool polar = false ); //!< Molecules whose axis is within angle (deg) of the given axis.
+    int    addIdRange( unsigned int low, unsigned int high );                      //!< Molecules with low <= Molecule::getNumber() <= high.
+    int    addFieldRange( double low, double high );                               //!< Molecules with low <= field value <= high, see setField().
+    int    addAnd( int a, int b );                                                 //!< Both terms.
+    int    addOr( int a, int b );                                                  //!< Any of the terms.
+    int    addNot( int a );                                                        //!< Not the term.
+    void   setRoot( int term ) { root = term; }                                    //!< Sets the term that is evaluated.
+    bool   parse( string expression );                                             //!< Builds the selection from an expression.
+    string getExpression() const;                                                  //!< Returns the selection as an expression that parse() accepts.
+    bool   isAll() const;                                                          //!< Returns true if the selection selects all molecules.
+    bool   usesField() const;                                                      //!< Returns true if a term needs the scalar field.
+    void   setField( const vector<double> &values ) { field = values; }            //!< Sets the scalar field, one value per molecule.
+    bool   evaluate( CnfFile *cnf, vector<char> &mask );                           //!< Fills mask with 1 for every selected molecule.
+    static int  count( const vector<char> &mask );                                 //!< Number of selected molecules of a mask.
+    static void getIndices( const vector<char> &mask, vector<int> &indices );      //!< Indices of the selected molecules of a mask.
+
+  private:
+    //! One node of the selection tree.
+    struct Term
+    {
+      Kind   kind;                                                                 //!< Kind of the term.
+      double p[6];                                                                 //!< Parameters of the predicate.
+      int    a, b;                                                                 //!< Operands of and, or, not; type, polar flag.
+    };
+    int    add( Kind kind, const double *p, int np, int a = -1, int b = -1 );      //!< Appends a term and returns its index.
+    void   evaluateTerm( int t, const vector<char> &candidates, vector<char> &result ) const; //!< Evaluates term t for the candidates.
+    bool   evaluateCells( const Term &term, const vector<char> &candidates, vector<char> &result ) const; //!< Evaluates a spatial term cell by cell.
+    bool   isInside( const Term &term, int i ) const;                              //!< Tests one molecule against a predicate.
+    bool   isInside( const Term &term, double x, double y, double z ) const;      //!< Tests a position against a spatial predicate.
+    string describe( int t ) const;                                                //!< Expression of term t.
+    int    parseOr( const vector<string> &tokens, unsigned int &pos );             //!< Parses "a or b or ...".
+    int    parseAnd( const vector<string> &tokens, unsigned int &pos );            //!< Parses "a and b and ...".
+    int    parseNot( const vector<string> &tokens, unsigned int &pos );            //!< Parses "not a", "( a )" and predicates.
+    bool   readNumbers( const vector<string> &tokens, unsigned int &pos, int n, double *values ); //!< Reads n numbers after a keyword.
+    vector<Term>   terms;                                                          //!< The terms, operands come before the operators.
+    int            root;                                                           //!< Index of the evaluated term, -1 for all molecules.
+    vector<double> field;                                                          //!< Scalar field for FIELD_RANGE.
+    vector<double> positions;                                                      //!< Positions of the evaluated frame, xyz interleaved.
+    vector<double> axes;                                                           //!< Orientations of the evaluated frame, xyz interleaved.
+    vector<int>    types;                                                          //!< Types of the evaluated frame.
+    vector<unsigned int> ids;                                                      //!< Ids of the evaluated frame.
+    CellList       cells;                                                          //!< Cells of folded frames.
+    bool           useCells;                                                       //!< True if cells is valid for the evaluated frame.
+  };
+
+  void largestEigenpair( const double q[6], double &lambda, double v[3] );         //!< Largest eigenvalue and eigenvector of a symmetric 3x3 matrix.
+  bool writeDataFile( string filename, string comment,
+		      const vector<string> &names, const vector<vector<double> > &columns ); //!< Writes equally long vectors as columns to a file.
+  int  numberOfThreads();                                                          //!< Returns the number of threads used by the analysis functions.
+}
+
+#endif //MGA_ANALYSIS_H
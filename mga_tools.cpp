@@ -31,6 +31,10 @@
 #include <sstream>
 #include <map>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #define FUNC (*this.*func)
 
 using std::ifstream;
@@ -263,6 +267,47 @@ Molecule* mga::Colormap::setColor( Molecule* moleculeTmp, vector<vector<float> >
     return( moleculeTmp );
 }
 
+//-------------------------------------------------------------------------
+//------------- setColor
+//-------------------------------------------------------------------------
+/*! 
+ *  \param moleculeTmp Pointer to the Molecule-object which color is to be set.
+ *  \param fraction Value between 0 (first line of the colormap) and 1 (last line), values outside are clamped.
+ *  \param models If a model forces its own color, that one is used instead.
+ *  \return The pointer to the Molecule-object of which the color has been set.
+ */
+Molecule* mga::Colormap::setColor( Molecule* moleculeTmp, double fraction, vector<vector<float> > *models ) const
+{
+    if( moleculeTmp == 0 )
+    {
+	cerr << "Error: no molecule given to setColor." << endl;
+	return( moleculeTmp );
+    }
+    
+    int numOfMapLines = redVector.size();
+    if( !(fraction > 0.0) ) { fraction = 0.0; }  // also catches nan
+    if( fraction > 1.0 )    { fraction = 1.0; }
+    
+    int mapLineNr = int( fraction * numOfMapLines );
+    if( mapLineNr >= numOfMapLines ) { mapLineNr = numOfMapLines - 1; }
+    
+    moleculeTmp -> setRGB( getRed( mapLineNr ), getGreen( mapLineNr ), getBlue( mapLineNr ) );
+    moleculeTmp -> setColorIndex( mapLineNr );
+    
+    if( models != 0 )
+    {
+	int typeTmp = moleculeTmp->getType();
+	if( typeTmp >= 0 && typeTmp < int(models->size()) )
+	{
+	    if( models->at(typeTmp).at(13) != 0.0 )
+	    {
+		setColor( moleculeTmp, models );
+	    }
+	}
+    }
+    return( moleculeTmp );
+}
+
 //--------------------------------------------
 //------------ Molecule
 //--------------------------------------------
@@ -1035,6 +1080,7 @@ mga::CnfFile::CnfFile( string &cnffile, uint loadIndex, string colorscheme, stri
 	}
     }
     if( !checkIntegrity()  ) { cerr << cnffile  << " - Beware! : cnf file integrity corrupt" << endl; } //exit(1); }
+    fileIndex.clear();
 }
 
 //-------------------------------------------------------------------------
@@ -1129,10 +1175,14 @@ void mga::CnfFile::initMembers( string    colorscheme, int    numMolFileTmp, int
     
     setColorScheme( colorscheme );
     
+    colorFieldMin = 0.0;
+    colorFieldMax = 1.0;
+    
     boundingBox.resize(3,vector<float>(3,0.0));
     boundingBoxCoordinates.resize(24,vector<float>(3,0.0));
     showFolded    = false;
     alreadyFolded = false;
+    mortonOrder   = false;
     
     loadCnfFileIndex = 0;
     loadCnfFile[0] = &mga::CnfFile::loadCnfFile_gbmega;
@@ -1151,6 +1201,7 @@ void mga::CnfFile::initMembers( string    colorscheme, int    numMolFileTmp, int
 //-------------------------------------------------------------------------
 /*!
  *  By the use of this function all molecules position values are folded back into the bounding box.
+ *  Non rectangular (triclinic) boxes are folded in fractional coordinates, see foldFractional().
  *  \note Note that doing so will not loose any information, because the folded positions are stored separately.
  *  \author Adrian Gabriel
  *  \date Sept 2005
@@ -1160,22 +1211,166 @@ void mga::CnfFile::foldMoleculesToBoundingBox()
     if( alreadyFolded == true ) { /*cout << "-- alreadyFolded is true" << endl;*/ return; }
     else                        { /*cout << "-- set alreadyFolded to true" << endl;*/ alreadyFolded = true; }
     
-    double posX = 0, posY = 0, posZ = 0;
-    
-    if( !(boundingBox.at(0).at(1) == 0.0 && boundingBox.at(0).at(2) == 0.0 &&
-	  boundingBox.at(1).at(0) == 0.0 && boundingBox.at(1).at(2) == 0.0 &&
-	  boundingBox.at(2).at(0) == 0.0 && boundingBox.at(2).at(1) == 0.0)   )
+    double box[3][3], inverse[3][3];
+    if( invertBoundingBox( boundingBox, box, inverse ) == false )
     {
-	cout << "Warning: Folding of non rectangular bounding boxes is not yet implemented. sorry." << endl;
+	cout << "Warning: The bounding box has no volume, molecules are not folded." << endl;
 	return;
     }
     
-    for( unsigned int i = 0; i < moleculeVector.size(); ++i ) // loop over all molecules
+    const int n = moleculeVector.size();
+    vector<double> posX( n ), posY( n ), posZ( n );
+    
+    #pragma omp parallel for schedule(static)
+    for( int i = 0; i < n; ++i ) { moleculeVector[i] -> getPositionXYZ( posX[i], posY[i], posZ[i] ); }
+    
+    if( n > 0 ) { foldFractional( &posX[0], &posY[0], &posZ[0], n, box, inverse ); }
+    
+    #pragma omp parallel for schedule(static)
+    for( int i = 0; i < n; ++i ) { moleculeVector[i] -> setPositionFoldedXYZ( posX[i], posY[i], posZ[i] ); }
+}
+
+//-------------------------------------------------------------------------
+//------------- invertBoundingBox
+//-------------------------------------------------------------------------
+/*!
+ *  Converts the bounding box matrix of a CnfFile (box vectors in rows) to a matrix with the box
+ *  vectors in columns and calculates its inverse, which maps cartesian to fractional coordinates.
+ *  \param boundingBox As returned by CnfFile::getBoundingBoxMatrix().
+ *  \param box Is filled with the box vectors as columns.
+ *  \param inverse Is filled with the inverse of box.
+ *  \return false if the box has no volume.
+ */
+bool mga::invertBoundingBox( const vector<vector<float> > &boundingBox, double box[3][3], double inverse[3][3] )
+{
+    if( boundingBox.size() != 3 ) { return( false ); }
+    for( int i = 0; i < 3; ++i )
+    {
+	if( boundingBox[i].size() != 3 ) { return( false ); }
+	for( int j = 0; j < 3; ++j ) { box[j][i] = boundingBox[i][j]; }
+    }
+    
+    double det = box[0][0]*(box[1][1]*box[2][2]-box[1][2]*box[2][1])
+	       - box[0][1]*(box[1][0]*box[2][2]-box[1][2]*box[2][0])
+	       + box[0][2]*(box[1][0]*box[2][1]-box[1][1]*box[2][0]);
+    if( fabs(det) < 1e-12 ) { return( false ); }
+    
+    inverse[0][0] =  (box[1][1]*box[2][2]-box[1][2]*box[2][1]) / det;
+    inverse[0][1] = -(box[0][1]*box[2][2]-box[0][2]*box[2][1]) / det;
+    inverse[0][2] =  (box[0][1]*box[1][2]-box[0][2]*box[1][1]) / det;
+    inverse[1][0] = -(box[1][0]*box[2][2]-box[1][2]*box[2][0]) / det;
+    inverse[1][1] =  (box[0][0]*box[2][2]-box[0][2]*box[2][0]) / det;
+    inverse[1][2] = -(box[0][0]*box[1][2]-box[0][2]*box[1][0]) / det;
+    inverse[2][0] =  (box[1][0]*box[2][1]-box[1][1]*box[2][0]) / det;
+    inverse[2][1] = -(box[0][0]*box[2][1]-box[0][1]*box[2][0]) / det;
+    inverse[2][2] =  (box[0][0]*box[1][1]-box[0][1]*box[1][0]) / det;
+    return( true );
+}
+
+//-------------------------------------------------------------------------
+//------------- foldFractional
+//-------------------------------------------------------------------------
+/*!
+ *  Folds positions into the (possibly triclinic) box centered at the origin: every position is
+ *  converted to fractional coordinates s, wrapped to s - rint(s) and converted back.
+ *  The coordinates are passed as separate arrays and the box is copied to scalars, so the
+ *  loop body has no function calls besides rint and can be vectorized by the compiler.
+ *  \param x,y,z Positions, overwritten with the folded positions.
+ *  \param n Number of positions.
+ *  \param box Box vectors in columns, see invertBoundingBox().
+ *  \param inverse Inverse of box.
+ */
+void mga::foldFractional( double *x, double *y, double *z, int n, const double box[3][3], const double inverse[3][3] )
+{
+    const double h00 = box[0][0], h01 = box[0][1], h02 = box[0][2];
+    const double h10 = box[1][0], h11 = box[1][1], h12 = box[1][2];
+    const double h20 = box[2][0], h21 = box[2][1], h22 = box[2][2];
+    const double i00 = inverse[0][0], i01 = inverse[0][1], i02 = inverse[0][2];
+    const double i10 = inverse[1][0], i11 = inverse[1][1], i12 = inverse[1][2];
+    const double i20 = inverse[2][0], i21 = inverse[2][1], i22 = inverse[2][2];
+    
+    #pragma omp parallel for schedule(static)
+    for( int i = 0; i < n; ++i )
     {
-	moleculeVector.at(i) -> getPositionXYZ      ( posX, posY, posZ );
-	moleculeVector.at(i) -> setPositionFoldedXYZ( posX -= rint( posX / boundingBox.at(0).at(0) ) * boundingBox.at(0).at(0),
-						      posY -= rint( posY / boundingBox.at(1).at(1) ) * boundingBox.at(1).at(1),
-						      posZ -= rint( posZ / boundingBox.at(2).at(2) ) * boundingBox.at(2).at(2) );
+	double sa = i00*x[i] + i01*y[i] + i02*z[i];
+	double sb = i10*x[i] + i11*y[i] + i12*z[i];
+	double sc = i20*x[i] + i21*y[i] + i22*z[i];
+	sa -= rint( sa );
+	sb -= rint( sb );
+	sc -= rint( sc );
+	x[i] = h00*sa + h01*sb + h02*sc;
+	y[i] = h10*sa + h11*sb + h12*sc;
+	z[i] = h20*sa + h21*sb + h22*sc;
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- radixSort
+//-------------------------------------------------------------------------
+/*!
+ *  Sorts keys with a least significant digit radix sort (8 bits per pass, passes above the
+ *  highest set bit are skipped). Every thread counts the digits of its part of the keys, the
+ *  counts are summed up by digit and thread, so every thread knows where to scatter its keys
+ *  and the sort stays stable.
+ *  \param keys The keys, sorted on return.
+ *  \param order Is filled with the original index of every sorted key.
+ */
+void mga::radixSort( vector<unsigned int> &keys, vector<int> &order )
+{
+    const int n = keys.size();
+    order.resize( n );
+    unsigned int maxKey = 0;
+    for( int i = 0; i < n; ++i ) { order[i] = i; maxKey = max( maxKey, keys[i] ); }
+    
+    int maxThreads = 1;
+#ifdef _OPENMP
+    maxThreads = omp_get_max_threads();
+#endif
+    vector<unsigned int> keysTmp( n );
+    vector<int>          orderTmp( n );
+    vector<int>          counts( 256 * maxThreads );
+    
+    for( int shift = 0; shift < 32 && ( maxKey >> shift ) > 0; shift += 8 )
+    {
+	int numThreads = 1;
+	#pragma omp parallel num_threads(maxThreads)
+	{
+	    int thread = 0;
+#ifdef _OPENMP
+	    thread = omp_get_thread_num();
+	    #pragma omp single
+	    numThreads = omp_get_num_threads();
+#endif
+	    const int begin = int( (long long)( n ) * thread / numThreads );
+	    const int end   = int( (long long)( n ) * ( thread + 1 ) / numThreads );
+	    int *count = &counts[ 256 * thread ];
+	    for( int d = 0; d < 256; ++d ) { count[d] = 0; }
+	    for( int i = begin; i < end; ++i ) { ++count[ ( keys[i] >> shift ) & 255u ]; }
+	    
+	    #pragma omp barrier
+	    #pragma omp single
+	    {
+		int offset = 0;
+		for( int d = 0; d < 256; ++d )
+		{
+		    for( int t = 0; t < numThreads; ++t )
+		    {
+			int c = counts[ 256 * t + d ];
+			counts[ 256 * t + d ] = offset;
+			offset += c;
+		    }
+		}
+	    }
+	    
+	    for( int i = begin; i < end; ++i )
+	    {
+		int slot = count[ ( keys[i] >> shift ) & 255u ]++;
+		keysTmp [slot] = keys[i];
+		orderTmp[slot] = order[i];
+	    }
+	}
+	keys .swap( keysTmp );
+	order.swap( orderTmp );
     }
 }
 
@@ -2149,7 +2344,107 @@ bool mga::CnfFile::reloadCnfFile( string cnffile )
 {
     //cout << "CnfFile::reloadCnfFile beg" << endl;
     alreadyFolded = false;
-    return( (*this.*loadCnfFile[loadCnfFileIndex])( cnffile, true ) );
+    bool success = (*this.*loadCnfFile[loadCnfFileIndex])( cnffile, true );
+    nextDirector.clear();                                                 // only meant for this file
+    fileIndex.clear();                                                    // the loaders fill the molecules in file order
+    if( success && mortonOrder ) { sortMolecules(); }
+    return( success );
+}
+
+//-------------------------------------------------------------------------
+//------------- setMortonOrder
+//-------------------------------------------------------------------------
+/*!
+ *  Switches between molecules in file order and molecules sorted along a Z-order (Morton)
+ *  curve, which keeps molecules that are close in space close in memory. The order is
+ *  applied at once and after every reload. getFileIndex() gives the position in the file.
+ *  \param on true for Z-order, false for file order.
+ */
+void mga::CnfFile::setMortonOrder( bool on )
+{
+    mortonOrder = on;
+    if( mortonOrder ) { sortMolecules(); }
+    else if( !fileIndex.empty() )
+    {
+	vector<int> order( fileIndex.size() );
+	for( unsigned int k = 0; k < fileIndex.size(); ++k ) { order[ fileIndex[k] ] = k; }
+	permuteMolecules( order );
+	fileIndex.clear();
+    }
+}
+
+//-------------------------------------------------------------------------
+//------------- sortMolecules
+//-------------------------------------------------------------------------
+/*!
+ *  Sorts the molecules along a Z-order curve through the bounding box: the fractional
+ *  coordinates (10 bits each) are interleaved to a 30 bit key, which is sorted with radixSort().
+ *  Without usable bounding box the range of the positions is used instead.
+ */
+void mga::CnfFile::sortMolecules()
+{
+    //cout << "CnfFile::sortMolecules beg" << endl;
+    const int n = moleculeVector.size();
+    if( n < 2 ) { return; }
+    
+    double box[3][3], inverse[3][3];
+    if( invertBoundingBox( boundingBox, box, inverse ) == false )
+    {
+	for( int d = 0; d < 3; ++d )
+	{
+	    for( int e = 0; e < 3; ++e ) { inverse[d][e] = 0.0; }
+	}
+	inverse[0][0] = boxX > 0.0 ? 1.0 / boxX : 0.0;
+	inverse[1][1] = boxY > 0.0 ? 1.0 / boxY : 0.0;
+	inverse[2][2] = boxZ > 0.0 ? 1.0 / boxZ : 0.0;
+    }
+    
+    vector<unsigned int> keys( n );
+    #pragma omp parallel for schedule(static)
+    for( int i = 0; i < n; ++i )
+    {
+	double r[3];
+	moleculeVector[i] -> getPositionXYZ( r[0], r[1], r[2] );
+	unsigned int key = 0;
+	for( int d = 0; d < 3; ++d )
+	{
+	    double s = inverse[d][0]*r[0] + inverse[d][1]*r[1] + inverse[d][2]*r[2];
+	    s -= floor( s + 0.5 );                                                       // periodic image in [-0.5,0.5)
+	    unsigned int c = (unsigned int)( ( s + 0.5 ) * 1024.0 );
+	    if( c > 1023 ) { c = 1023; }
+	    for( int b = 0; b < 10; ++b ) { key |= ( ( c >> b ) & 1u ) << ( 3*b + d ); }
+	}
+	keys[i] = key;
+    }
+    
+    vector<int> order;
+    radixSort( keys, order );
+    permuteMolecules( order );
+    
+    vector<int> index( n );
+    for( int k = 0; k < n; ++k ) { index[k] = getFileIndex( order[k] ); }
+    fileIndex.swap( index );
+    //cout << "CnfFile::sortMolecules end" << endl;
+}
+
+//-------------------------------------------------------------------------
+//------------- permuteMolecules
+//-------------------------------------------------------------------------
+/*!
+ *  Copies the data of the molecules instead of reordering the pointers, so the molecule
+ *  objects, which were allocated one after another, are visited in memory order, too.
+ *  \param order Molecule k gets the data of molecule order[k].
+ */
+void mga::CnfFile::permuteMolecules( const vector<int> &order )
+{
+    const int n = moleculeVector.size();
+    if( n == 0 || int( order.size() ) != n ) { return; }
+    vector<MoleculeBiax> copies( n, *moleculeVector[0] );
+    
+    #pragma omp parallel for schedule(static)
+    for( int k = 0; k < n; ++k ) { copies[k] = *moleculeVector[ order[k] ]; }
+    #pragma omp parallel for schedule(static)
+    for( int k = 0; k < n; ++k ) { *moleculeVector[k] = copies[k]; }
 }
 
 //-------------------------------------------------------------------------
@@ -2202,6 +2497,13 @@ void  mga::CnfFile::setUserDefinedDirector( float x, float y, float z )
 bool mga::CnfFile::calculateDirector()
 {
     //cout << "CnfFile::calculateDirector beg" << endl;
+    if( nextDirector.size() == 3 )                                        // known from the analysis cache
+    {
+	director = nextDirector;
+	nextDirector.clear();
+	return( true );
+    }
+    
     Array2D<double> orderTensor( 3, 3, 0.0 );
     Array2D<double> eigenVectorsInColumns( 3, 3, 0.0 );
     
@@ -2333,6 +2635,16 @@ void mga::CnfFile::colorizeMolecules( vector<vector<float> > *models )
 	    colorMap -> setColor( moleculeVector.at(i), models );              // send each molecule to the colormap for colorization
 	}      
     }
+    else if( useColorField == true && colorField.size() == moleculeVector.size() )
+    {
+	//cout << "useColorField" << endl;
+	double range = colorFieldMax - colorFieldMin;
+	if( range == 0.0 ) { range = 1.0; }
+	for( unsigned int i = 0; i < moleculeVector.size(); ++i )              // loop over all molecules
+	{
+	    colorMap -> setColor( moleculeVector.at(i), (colorField.at(i) - colorFieldMin) / range, models );
+	}
+    }
     else
     {
 	cerr << "Warning! No valid color scheme set. Using director..." << endl;
@@ -2356,6 +2668,7 @@ void mga::CnfFile::colorizeMolecules( vector<vector<float> > *models )
 void mga::CnfFile::setColorScheme( string scheme )
 {
     //cout << "CnfFile::setColorScheme beg" << endl;
+    useColorField = false;
     if( scheme == "director" )
     {
 	useDirector = true;
@@ -2371,6 +2684,11 @@ void mga::CnfFile::setColorScheme( string scheme )
 	useColorByModel = true;
 	useUserDefinedDirector = useDirector = false;
     }
+    else if( scheme == "field" )
+    {
+	useColorField = true;
+	useUserDefinedDirector = useDirector = useColorByModel = false;
+    }
     else
     {
 	useUserDefinedDirector = useDirector = useColorByModel = false;
@@ -2378,6 +2696,39 @@ void mga::CnfFile::setColorScheme( string scheme )
     //cout << "CnfFile::setColorScheme end" << endl;
 }
 
+//-------------------------------------------------------------------------
+//------------- setColorField
+//-------------------------------------------------------------------------
+/*!
+ *  Sets one value per molecule (e.g. a local order parameter or a cluster id), that is used
+ *  for colorization when the color scheme "field" is set.
+ *  \param field One value per molecule.
+ *  \param min Value mapped to the first color of the colormap.
+ *  \param max Value mapped to the last color of the colormap.
+ */
+void mga::CnfFile::setColorField( const vector<double> &field, double min, double max )
+{
+    colorField    = field;
+    colorFieldMin = min;
+    colorFieldMax = max;
+}
+
+//-------------------------------------------------------------------------
+//------------- setNextDirector
+//-------------------------------------------------------------------------
+/*!
+ *  The next call of calculateDirector() (i.e. the next loaded file) takes the given director
+ *  instead of building and diagonalizing the order tensor. Used for directors taken from
+ *  the analysis cache.
+ */
+void mga::CnfFile::setNextDirector( double x, double y, double z )
+{
+    nextDirector.resize( 3 );
+    nextDirector.at(0) = x;
+    nextDirector.at(1) = y;
+    nextDirector.at(2) = z;
+}
+
 
 //-------------------------------------------------------------------------
 //------------- checkIntegrity
@@ -264,6 +264,8 @@ namespace mga
 			vector<vector<float> > *models ) const;             //!< Takes pointer to a Molecule-object and sets the color of it.
     Molecule* setColor( Molecule* moleculeTmp,
 			vector<vector<float> > *models ) const;             //!< Takes pointer to a Molecule-object and sets the color of it.
+    Molecule* setColor( Molecule* moleculeTmp, double fraction,
+			vector<vector<float> > *models ) const;             //!< Sets the color of a Molecule-object from a value between 0 and 1.
     int       getNumberOfColors()  const { return( numberOfLinesInFile ); } //!< Returns the number of color entries.
     
   private:
@@ -306,6 +308,9 @@ namespace mga
     bool      getShowFolded() const { return(showFolded); }
     void      setShowFolded( bool fold ) { showFolded = fold; }
     bool      reloadCnfFile( string cnffile );                                            //!< Loads new cnffile. No need to "delete" current one.
+    void      setMortonOrder( bool on );                                                  //!< Keeps the molecules sorted along a Z-order curve instead of in file order.
+    bool      getMortonOrder() const { return( mortonOrder ); }                           //!< Returns true if the molecules are kept in Z-order.
+    int       getFileIndex( int i ) const { return( fileIndex.empty() ? i : fileIndex[i] ); } //!< Returns the position in the file of molecule i.
     int       getNumberOfColorsInMap() const { return( colorMap->getNumberOfColors() ); } //!< Returns the number of colors in the current colormap.
     float     getRedAt  ( int pos ) const { return( colorMap -> getRed  (pos) ); }        //!< Returns pos'th redvalue of current colormap.
     float     getGreenAt( int pos ) const { return( colorMap -> getGreen(pos) ); }        //!< Returns pos'th greenvalue of current colormap.
@@ -334,6 +339,9 @@ namespace mga
     double    getDirectorZ() { return director.at(2); }
     uint      getNumberOfTypes() { return numberOfTypes; }                                //!< Gets the number of different molecule types needed for this configuration.
     void      colorizeMolecules( vector<vector<float> > *models = 0 );                    //!< Sets color values of molecules based on calculated director.
+    void      setColorField( const vector<double> &field, double min, double max );    //!< Sets per molecule values used by the color scheme "field".
+    const vector<double>& getColorField() const { return( colorField ); }              //!< Returns the values set with setColorField().
+    void      setNextDirector( double x, double y, double z );                         //!< Director to use for the next loaded file instead of calculating it.
     void      calculateBoundingBoxCoordinates();
     void      measureBox();
 private:
@@ -352,6 +360,8 @@ private:
     bool calculateDirector();                                                          //!< Calculates nematic director of the ensemble of Molecules.
     bool checkIntegrity() const;                                                       //!< Simple test to check file integrity of the .cnf file.
     bool createTmpDummy();
+    void sortMolecules();                                                              //!< Sorts the molecules along a Z-order curve.
+    void permuteMolecules( const vector<int> &order );                                 //!< Molecule k gets the data of molecule order[k].
     int       numMolFile;                                                              //!< Number of molecules in .cnf file as provided by file itself.
     int       numMolCnt;                                                               //!< Number of molecules in .cnf file as counted while loading file.
     double    boxX;                                                                    //!< x-size of the bounding box as read out of .cnf file.
@@ -365,8 +375,15 @@ private:
     bool useDirector;
     bool useUserDefinedDirector;                                                       //!< Boolean to decide, with which vector to colorize the molecules
     bool useColorByModel;
+    bool useColorField;
+    vector<double> colorField;                                                         //!< Per molecule values used for the color scheme "field".
+    double colorFieldMin;                                                              //!< Value of colorField that is mapped to the first color.
+    double colorFieldMax;                                                              //!< Value of colorField that is mapped to the last color.
+    vector<double> nextDirector;                                                       //!< Director for the next loaded file, empty if it has to be calculated.
     bool showFolded;    
     bool alreadyFolded;
+    bool mortonOrder;                                                                  //!< Molecules are sorted along a Z-order curve after loading.
+    vector<int> fileIndex;                                                             //!< Position in the file of every molecule, empty if in file order.
     uint colorScheme;    
     uint numberOfTypes;                                                                //!< The number of different molecule types found in curent file
     
@@ -448,6 +465,10 @@ namespace mga
     inline const Point3D operator/( const Point3D &p, const double &s );
     inline const Point3D operator/( const int &s, const Point3D &p );
     inline const Point3D operator/( const Point3D &p, const int &s );
+    
+    bool invertBoundingBox( const vector<vector<float> > &boundingBox, double box[3][3], double inverse[3][3] ); //!< Box vectors as columns and their inverse, false if the box has no volume.
+    void foldFractional( double *x, double *y, double *z, int n, const double box[3][3], const double inverse[3][3] ); //!< Folds positions into the box centered at the origin.
+    void radixSort( vector<unsigned int> &keys, vector<int> &order );             //!< Stable parallel sort of keys, order is filled with the original indices.
 }
 
 
@@ -0,0 +1,149 @@
+/******************************************************************************
+** This file is part of QMGA a tool to display convex bodies.
+** Phillips-University of Marburg (Germany)
+** qmga@users.sourceforge.net
+**
+** QMGA is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** QMGA is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with QMGA; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include "plotwidget.h"
+
+#include <qpainter.h>
+#include <qpixmap.h>
+
+#include <cmath>
+
+//-------------------------------------------------------------------------
+//------------- PlotWidget
+//-------------------------------------------------------------------------
+PlotWidget::PlotWidget( QWidget *parent, const char *name )
+    : QWidget( parent, name, WNoAutoErase )
+{
+    logY = false;
+    setMinimumSize( 200, 150 );
+}
+
+//-------------------------------------------------------------------------
+//------------- addCurve
+//-------------------------------------------------------------------------
+/*!
+ *  \param x x values.
+ *  \param y y values, as many as x values.
+ *  \param color Color of the curve.
+ *  \param name Name shown in the legend.
+ *  \param points true to draw single points instead of a line.
+ */
+void PlotWidget::addCurve( const vector<double> &x, const vector<double> &y, QColor color, QString name, bool points )
+{
+    Curve curve;
+    curve.x      = x;
+    curve.y      = y;
+    curve.color  = color;
+    curve.name   = name;
+    curve.points = points;
+    if( curve.y.size() > curve.x.size() ) { curve.y.resize( curve.x.size() ); }
+    if( curve.x.size() > curve.y.size() ) { curve.x.resize( curve.y.size() ); }
+    curves.push_back( curve );
+}
+
+//-------------------------------------------------------------------------
+//------------- transformY
+//-------------------------------------------------------------------------
+double PlotWidget::transformY( double y ) const
+{
+    if( logY == false ) { return( y ); }
+    return( y > 1e-12 ? log10( y ) : -12.0 );
+}
+
+//-------------------------------------------------------------------------
+//------------- paintEvent
+//-------------------------------------------------------------------------
+/*!
+ *  Draws title, axes with their ranges, labels, legend and all curves into a
+ *  pixmap, which is copied to the widget at once to avoid flickering.
+ */
+void PlotWidget::paintEvent( QPaintEvent * )
+{
+    QPixmap buffer( size() );
+    buffer.fill( white );
+    QPainter p( &buffer );
+    QFontMetrics fm = p.fontMetrics();
+    
+    // data range
+    bool   empty = true;
+    double xMin = 0.0, xMax = 1.0, yMin = 0.0, yMax = 1.0;
+    for( unsigned int c = 0; c < curves.size(); ++c )
+    {
+	for( unsigned int i = 0; i < curves[c].x.size(); ++i )
+	{
+	    double x = curves[c].x[i];
+	    double y = transformY( curves[c].y[i] );
+	    if( logY && curves[c].y[i] <= 1e-12 ) { continue; }
+	    if( empty ) { xMin = xMax = x; yMin = yMax = y; empty = false; }
+	    if( x < xMin ) { xMin = x; }
+	    if( x > xMax ) { xMax = x; }
+	    if( y < yMin ) { yMin = y; }
+	    if( y > yMax ) { yMax = y; }
+	}
+    }
+    if( xMax <= xMin ) { xMax = xMin + 1.0; }
+    if( yMax <= yMin ) { yMax = yMin + 1.0; }
+    
+    QString yMaxText = logY ? QString( "1e%1" ).arg( yMax, 0, 'f', 1 ) : QString::number( yMax, 'g', 4 );
+    QString yMinText = logY ? QString( "1e%1" ).arg( yMin, 0, 'f', 1 ) : QString::number( yMin, 'g', 4 );
+    const int left   = QMAX( fm.width( yMaxText ), fm.width( yMinText ) ) + 8;
+    const int right  = width() - 10;
+    const int top    = fm.height() + 8;
+    const int bottom = height() - 2 * fm.height() - 8;
+    if( right <= left || bottom <= top ) { bitBlt( this, 0, 0, &buffer ); return; }
+    
+    // frame, ranges and labels
+    p.setPen( black );
+    p.drawText( left, fm.ascent() + 2, title );
+    p.drawRect( left, top, right - left + 1, bottom - top + 1 );
+    p.drawText( left - fm.width( yMaxText ) - 4, top + fm.ascent(), yMaxText );
+    p.drawText( left - fm.width( yMinText ) - 4, bottom, yMinText );
+    QString xMinText = QString::number( xMin, 'g', 4 );
+    QString xMaxText = QString::number( xMax, 'g', 4 );
+    p.drawText( left, bottom + fm.height() + 2, xMinText );
+    p.drawText( right - fm.width( xMaxText ), bottom + fm.height() + 2, xMaxText );
+    p.drawText( ( left + right - fm.width( labelX ) ) / 2, bottom + 2 * fm.height() + 2, labelX );
+    p.drawText( left + 4, top + fm.ascent() + 2, labelY );
+    
+    // curves and legend
+    int legendY = top + fm.ascent() + 2;
+    for( unsigned int c = 0; c < curves.size(); ++c )
+    {
+	const Curve &curve = curves[c];
+	p.setPen( QPen( curve.color, 1 ) );
+	bool havePrevious = false;
+	int  xOld = 0, yOld = 0;
+	for( unsigned int i = 0; i < curve.x.size(); ++i )
+	{
+	    if( logY && curve.y[i] <= 1e-12 ) { havePrevious = false; continue; }
+	    int x = left   + int( ( curve.x[i] - xMin ) / ( xMax - xMin ) * ( right - left ) );
+	    int y = bottom - int( ( transformY( curve.y[i] ) - yMin ) / ( yMax - yMin ) * ( bottom - top ) );
+	    if( curve.points )      { p.drawRect( x - 1, y - 1, 3, 3 ); }
+	    else if( havePrevious ) { p.drawLine( xOld, yOld, x, y ); }
+	    xOld = x;
+	    yOld = y;
+	    havePrevious = true;
+	}
+	p.drawText( right - fm.width( curve.name ) - 4, legendY, curve.name );
+	legendY += fm.height();
+    }
+    p.end();
+    bitBlt( this, 0, 0, &buffer );
+}
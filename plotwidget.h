@@ -0,0 +1,76 @@
+/******************************************************************************
+** This file is part of QMGA a tool to display convex bodies.
+** Phillips-University of Marburg (Germany)
+** qmga@users.sourceforge.net
+**
+** QMGA is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** QMGA is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with QMGA; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef PLOTWIDGET_H
+#define PLOTWIDGET_H
+
+#include <qwidget.h>
+#include <qstring.h>
+#include <qcolor.h>
+
+#include <vector>
+
+using std::vector;
+
+//------------------------------------------------------
+//--------------- class PlotWidget
+//------------------------------------------------------
+//! A minimal x-y plot of one or more curves.
+/*!
+ *  Used to show analysis results (e.g. S(q) or the smectic order parameter
+ *  of a trajectory) inside the application. The axes are scaled to the data,
+ *  the y axis can be logarithmic.
+ */
+class PlotWidget : public QWidget
+{
+    Q_OBJECT
+    
+public:
+    PlotWidget( QWidget *parent = 0, const char *name = 0 );
+    
+    void setTitle( QString titleTmp ) { title = titleTmp; }                     //!< Sets the title shown above the plot.
+    void setLabels( QString x, QString y ) { labelX = x; labelY = y; }           //!< Sets the axis labels.
+    void setLogY( bool on ) { logY = on; }                                       //!< Switches to a logarithmic y axis.
+    void clear() { curves.clear(); }                                             //!< Removes all curves.
+    void addCurve( const vector<double> &x, const vector<double> &y,
+		   QColor color, QString name, bool points = false );           //!< Adds a curve, shown with the next repaint.
+    QSize sizeHint() const { return( QSize( 320, 220 ) ); }
+    
+protected:
+    void paintEvent( QPaintEvent *e );
+    
+private:
+    struct Curve
+    {
+	vector<double> x;
+	vector<double> y;
+	QColor  color;
+	QString name;
+	bool    points;                                                          //!< Draw single points instead of a line.
+    };
+    double transformY( double y ) const;                                         //!< Applies the logarithmic scale if set.
+    vector<Curve> curves;
+    QString title;
+    QString labelX;
+    QString labelY;
+    bool logY;
+};
+
+#endif // PLOTWIDGET_H
@@ -5,9 +5,13 @@ CONFIG	+= qt warn_on release
 
 LIBS	+= -lglut -lGLU
 
+QMAKE_CXXFLAGS	+= -fopenmp
+QMAKE_LFLAGS	+= -fopenmp
+
 INCLUDEPATH	+= -D_REENTRANT
 
 HEADERS	+= mga_tools.h \
+	mga_analysis.h \
 	renderer.h \
 	myInclude.h \
 	tr/tr.h \
@@ -18,6 +22,7 @@ HEADERS	+= mga_tools.h \
 	tnt/tnt_i_refvec.h \
 	tnt/tnt_math_utils.h \
 	dirview.h \
+	plotwidget.h \
 	mainform.includes.dec.h \
 	mainform.includes.imp.h \
 	aboutform.includes.dec.h \
@@ -35,10 +40,12 @@ HEADERS	+= mga_tools.h \
 
 SOURCES	+= main.cpp \
 	mga_tools.cpp \
+	mga_analysis.cpp \
 	renderer.cpp \
 	tr/tr.c \
 	psEncode.c \
-	dirview.cpp
+	dirview.cpp \
+	plotwidget.cpp
 
 FORMS	= mainform.ui \
 	aboutform.ui \
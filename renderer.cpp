@@ -31,9 +31,21 @@
 #include <qimage.h>
 #include <qdatetime.h>
 #include <qdragobject.h>
+#include <qtimer.h>
 
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using std::cerr;
 using std::cout;
@@ -44,6 +56,163 @@ using std::endl;
 #pragma warning(disable:4305) // init: truncation from const double to float
 #endif
 
+// per instance data of the instanced models
+struct ModelInstance {
+    float position[3];
+    float rotation[4]; // unit quaternion x, y, z, w
+    GLubyte color[4];
+};
+
+// Functions shared by the shaders of the instanced models. shade lights like the fixed
+// function pipeline does for the display lists (GL_LIGHT1, color material on the front,
+// infinite viewer).
+static const char *instanceFunctions =
+    "#version 120\n"
+    "uniform bool lighting;\n"
+    "vec3 rotate(vec4 q, vec3 v) {\n"
+    "    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);\n"
+    "}\n"
+    "vec4 shade(vec3 n, vec4 emission, vec4 ambient, vec4 diffuse, vec4 specular, float shininess) {\n"
+    "    vec3 l = normalize(gl_LightSource[1].position.xyz);\n"
+    "    float d = max(dot(n, l), 0.0);\n"
+    "    vec4 c = emission + (gl_LightModel.ambient + gl_LightSource[1].ambient) * ambient + d * gl_LightSource[1].diffuse * diffuse;\n"
+    "    if (d > 0.0) {\n"
+    "        c += pow(max(dot(n, normalize(l + vec3(0.0, 0.0, 1.0))), 0.0), shininess) * gl_LightSource[1].specular * specular;\n"
+    "    }\n"
+    "    return vec4(c.rgb, diffuse.a);\n"
+    "}\n";
+
+// Moves and rotates the model vertices by the instance attributes, the back is lit with
+// the back material for two sided models
+static const char *instanceVertexShader =
+    "attribute vec3 instancePosition;\n"
+    "attribute vec4 instanceRotation;\n"
+    "attribute vec4 instanceColor;\n"
+    "void main() {\n"
+    "    vec4 eye = gl_ModelViewMatrix * vec4(instancePosition + rotate(instanceRotation, gl_Vertex.xyz), 1.0);\n"
+    "    gl_Position = gl_ProjectionMatrix * eye;\n"
+    "    gl_ClipVertex = eye;\n"
+    "    if (lighting) {\n"
+    "        vec3 n = normalize(gl_NormalMatrix * rotate(instanceRotation, gl_Normal));\n"
+    "        gl_FrontColor = shade(n, gl_FrontMaterial.emission, instanceColor, instanceColor, gl_FrontMaterial.specular, gl_FrontMaterial.shininess);\n"
+    "        gl_BackColor = shade(-n, gl_BackMaterial.emission, gl_BackMaterial.ambient, gl_BackMaterial.diffuse, gl_BackMaterial.specular, gl_BackMaterial.shininess);\n"
+    "    } else {\n"
+    "        gl_FrontColor = instanceColor;\n"
+    "        gl_BackColor = instanceColor;\n"
+    "    }\n"
+    "}\n";
+
+// Impostors: the front faces of the bounding box of every model are drawn, the fragment
+// shader casts the view ray through the box and intersects it with the exact shape.
+// The ray is interpolated in object space (box surface and direction) and in eye space,
+// both are affine images of each other, so a hit at t is at the same t in eye space.
+static const char *impostorVertexShader =
+    "attribute vec3 instancePosition;\n"
+    "attribute vec4 instanceRotation;\n"
+    "attribute vec4 instanceColor;\n"
+    "uniform vec3 extent;\n"
+    "varying vec3 objectPosition;\n"
+    "varying vec3 objectDirection;\n"
+    "varying vec3 eyePosition;\n"
+    "varying vec3 eyeDirection;\n"
+    "varying vec4 rotation;\n"
+    "void main() {\n"
+    "    objectPosition = gl_Vertex.xyz * extent;\n"
+    "    vec4 eye = gl_ModelViewMatrix * vec4(instancePosition + rotate(instanceRotation, objectPosition), 1.0);\n"
+    "    gl_Position = gl_ProjectionMatrix * eye;\n"
+    "    gl_ClipVertex = eye;\n"
+    "    eyePosition = eye.xyz;\n"
+    "    eyeDirection = (gl_ProjectionMatrix[3][3] != 0.0) ? vec3(0.0, 0.0, -1.0) : eye.xyz;\n"
+    "    objectDirection = rotate(vec4(-instanceRotation.xyz, instanceRotation.w), mat3(gl_ModelViewMatrixInverse) * eyeDirection);\n"
+    "    rotation = instanceRotation;\n"
+    "    gl_FrontColor = instanceColor;\n"
+    "}\n";
+
+// shape 0: ellipsoid with the half axes size, 1: spherocylinder with radius size.x and
+// cylinder length 2 size.y along z, 2: spheroplatelet, all points closer than size.x to
+// a disk of radius size.y in the xy plane. The first two are solved analytically, the
+// spheroplatelet, whose rim is a torus, by sphere tracing its exact distance function.
+static const char *impostorFragmentShader =
+    "uniform int shape;\n"
+    "uniform vec3 size;\n"
+    "uniform vec3 extent;\n"
+    "varying vec3 objectPosition;\n"
+    "varying vec3 objectDirection;\n"
+    "varying vec3 eyePosition;\n"
+    "varying vec3 eyeDirection;\n"
+    "varying vec4 rotation;\n"
+    "float sphere(vec3 o, vec3 d, vec3 center, float r) {\n"
+    "    vec3 oc = o - center;\n"
+    "    float b = dot(d, oc);\n"
+    "    float h = b * b - dot(oc, oc) + r * r;\n"
+    "    return (h < 0.0) ? 1e20 : -b - sqrt(h);\n"
+    "}\n"
+    "float ellipsoid(vec3 o, vec3 d, out vec3 n) {\n"
+    "    vec3 os = o / size;\n"
+    "    vec3 ds = d / size;\n"
+    "    float a = dot(ds, ds);\n"
+    "    float b = dot(os, ds);\n"
+    "    float h = b * b - a * (dot(os, os) - 1.0);\n"
+    "    if (h < 0.0) return -1.0;\n"
+    "    float t = (-b - sqrt(h)) / a;\n"
+    "    n = (o + t * d) / (size * size);\n"
+    "    return t;\n"
+    "}\n"
+    "float spherocylinder(vec3 o, vec3 d, out vec3 n) {\n"
+    "    float r = size.x;\n"
+    "    float t = min(sphere(o, d, vec3(0.0, 0.0, size.y), r), sphere(o, d, vec3(0.0, 0.0, -size.y), r));\n"
+    "    float a = dot(d.xy, d.xy);\n"
+    "    if (a > 1e-12) {\n"
+    "        float b = dot(o.xy, d.xy);\n"
+    "        float h = b * b - a * (dot(o.xy, o.xy) - r * r);\n"
+    "        if (h >= 0.0) {\n"
+    "            float tc = (-b - sqrt(h)) / a;\n"
+    "            if (abs(o.z + tc * d.z) <= size.y) t = min(t, tc);\n"
+    "        }\n"
+    "    }\n"
+    "    if (t >= 1e20) return -1.0;\n"
+    "    vec3 p = o + t * d;\n"
+    "    n = p - vec3(0.0, 0.0, clamp(p.z, -size.y, size.y));\n"
+    "    return t;\n"
+    "}\n"
+    "float platelet(vec3 p) {\n"
+    "    return length(vec2(max(length(p.xy) - size.y, 0.0), p.z)) - size.x;\n"
+    "}\n"
+    "float spheroplatelet(vec3 o, vec3 d, out vec3 n) {\n"
+    "    vec3 exit = (extent - sign(d) * o) / max(abs(d), vec3(1e-6));\n"
+    "    float tMax = min(min(exit.x, exit.y), exit.z);\n"
+    "    float eps = 1e-4 * size.x;\n"
+    "    float t = 0.0;\n"
+    "    for (int i = 0; i < 96; i++) {\n"
+    "        float dist = platelet(o + t * d);\n"
+    "        if (dist < eps) break;\n"
+    "        t += dist;\n"
+    "        if (t > tMax) return -1.0;\n"
+    "    }\n"
+    "    vec3 p = o + t * d;\n"
+    "    float rho = length(p.xy);\n"
+    "    n = (rho > size.y) ? vec3(p.xy * (rho - size.y) / rho, p.z) : vec3(0.0, 0.0, p.z);\n"
+    "    return t;\n"
+    "}\n"
+    "void main() {\n"
+    "    float scale = 1.0 / length(objectDirection);\n"
+    "    vec3 d = objectDirection * scale;\n"
+    "    vec3 n;\n"
+    "    float t;\n"
+    "    if (shape == 0) t = ellipsoid(objectPosition, d, n);\n"
+    "    else if (shape == 1) t = spherocylinder(objectPosition, d, n);\n"
+    "    else t = spheroplatelet(objectPosition, d, n);\n"
+    "    if (t < 0.0) discard;\n"
+    "    vec4 clip = gl_ProjectionMatrix * vec4(eyePosition + t * scale * eyeDirection, 1.0);\n"
+    "    gl_FragDepth = 0.5 * (gl_DepthRange.diff * clip.z / clip.w + gl_DepthRange.near + gl_DepthRange.far);\n"
+    "    if (lighting) {\n"
+    "        vec3 en = normalize(gl_NormalMatrix * rotate(rotation, n));\n"
+    "        gl_FragColor = shade(en, gl_FrontMaterial.emission, gl_Color, gl_Color, gl_FrontMaterial.specular, gl_FrontMaterial.shininess);\n"
+    "    } else {\n"
+    "        gl_FragColor = gl_Color;\n"
+    "    }\n"
+    "}\n";
+
 /*!
   Create a Renderer widget
 */
@@ -82,6 +251,20 @@ Renderer::Renderer( QWidget* parent, const char* name )
     drawColorMap = true;
     drawAxis = true;
     drawBoundingBox = true;
+    drawDefects = false;
+    drawModels = true;
+    drawSurface = false;
+    drawOrientationGlyph = false;
+    
+    defectRadius = 0.5f;
+    defectList = 0;
+    recreateDefects = false;
+    surfaceList = 0;
+    recreateSurface = false;
+    glyphBands = 0;
+    glyphSectors = 0;
+    glyphList = 0;
+    recreateGlyph = false;
     
     maxBoundingDiff = 0.0f;
     
@@ -93,9 +276,69 @@ Renderer::Renderer( QWidget* parent, const char* name )
     modelXComplexity_min = 4;
     modelYComplexity_min = 0;
     modelLevels = 6;
+    recordMesh = 0;
+    meshCacheRead = false;
+    meshCacheModified = false;
+    if (getenv("HOME") != NULL) {
+	meshCacheFile = string(getenv("HOME")) + "/.qmga-meshes";
+    }
     
-    LODdelta = 0;
+    instancingSupported = false;
+    useInstancing = true;
+    instanceProgram = 0;
+    instanceLightingLocation = -1;
+    instanceBuffer = 0;
+    instancesValid = false;
+    instanceLighting = false;
+    activeProgram = 0;
+    useImpostors = false;
+    impostorProgram = 0;
+    impostorLightingLocation = -1;
+    impostorShapeLocation = -1;
+    impostorSizeLocation = -1;
+    impostorExtentLocation = -1;
+    
+    renderSet_FrameTimeBudget = 40.0f;
+    lodTolerance = 0.5f;
+    frameTime = 0.0f;
+    gpuFrameTime = 0.0f;
+    timerQuerySupported = false;
+    for (int i = 0; i < 4; i++) {
+	frameTimers[i] = 0;
+	frameTimerPending[i] = false;
+    }
+    frameTimer = -1;
+    nextFrameTimer = 0;
+    lodFrameTolerance = lodTolerance;
+    drawTimings = false;
+    stageTimersSupported = false;
+    currentStage = 0;
+    stageStart = 0.0;
+    for (int s = 0; s < STAGE_COUNT; s++) {
+	stageCpuTime[s] = 0.0f;
+	stageGpuTime[s] = 0.0f;
+    }
+    for (int i = 0; i < 4; i++) {
+	typeTimersUsed[i] = false;
+    }
+    typeStart = 0.0;
+    frameCount = 0;
+    gpuFrame = -1;
+    timingLogJson = false;
+    lodFinestTolerance = 0.0f;
+    lodCoarsestTolerance = 0.0f;
+    lodPixelsPerUnit = 0.0f;
+    lodNearDepth = 0.0f;
+    lodFarDepth = 0.0f;
     drawBoxes = false;
+    gridSize = 0;
+    gridCells = 0;
+    useOctree = false;
+    occlusionFrame = 0;
+    occlusionView = 0;
+    fill(occlusionMatrices, occlusionMatrices + 32, 0.0f);
+    occlusionPending = false;
+    culledGridBoxes = 0;
     
     startBox_X = 0;
     startBox_DeltaX = 1;
@@ -156,6 +399,14 @@ Renderer::Renderer( QWidget* parent, const char* name )
     sliceYHigh = 2;
     sliceZLow = 0;
     sliceZHigh = 2;
+    sliceFractional = false;
+    drawMaskValid = false;
+    for (int i = 0; i < 6; i++) {
+	sliceFractions[i] = (i % 2 == 0) ? -0.5 : 0.5;
+	gridRange[i] = (i % 2 == 0) ? -0.5 : 0.5;
+    }
+    fractionalBox = false;
+    boxOrigin[0] = boxOrigin[1] = boxOrigin[2] = 0;
     
     xAdditionalRotation = 0;
     yAdditionalRotation = 0;
@@ -183,6 +434,32 @@ Renderer::Renderer( QWidget* parent, const char* name )
 */
 Renderer::~Renderer() {
     makeCurrent();
+    deleteModelMeshes();
+    if (instanceBuffer != 0) {
+	glDeleteBuffersARB(1, &instanceBuffer);
+    }
+    if (instanceProgram != 0) {
+	glDeleteProgram(instanceProgram);
+    }
+    if (impostorProgram != 0) {
+	glDeleteProgram(impostorProgram);
+	glDeleteBuffersARB(1, &impostorBox.vertexBuffer);
+	glDeleteBuffersARB(1, &impostorBox.indexBuffer);
+    }
+    if (!gridQueries.empty()) {
+	glDeleteQueriesARB(gridQueries.size(), &gridQueries[0]);
+    }
+    if (timerQuerySupported) {
+	glDeleteQueriesARB(4, frameTimers);
+    }
+    if (stageTimersSupported) {
+	glDeleteQueriesARB(4 * (STAGE_COUNT + 1), stageTimers);
+    }
+    for (int i = 0; i < 4; i++) {
+	if (!typeTimers[i].empty()) {
+	    glDeleteQueriesARB(typeTimers[i].size(), &typeTimers[i][0]);
+	}
+    }
 }
 
 /*!
@@ -195,6 +472,13 @@ void Renderer::paintGL() {
     static QTime startTime;
     startTime.start();
     
+    if (!offScreen) {
+	readFrameTimers();
+	frameCount++;
+	beginFrameTimer();
+	beginStages();
+    }
+    
     // Clear screen
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     
@@ -222,6 +506,7 @@ void Renderer::paintGL() {
 	}
 	processInput(forceProcess);
     }
+    endStage(STAGE_INPUT);
     
     calculateRotationMatrix();
     
@@ -232,25 +517,53 @@ void Renderer::paintGL() {
     // always force gui update because we only draw if a change happens, so we need an update!
     updateGuiF(true);
     updateGuiF();
+    endStage(STAGE_CAMERA);
     
     // update line width, because we change it when we draw the axis
     glLineWidth(lineSizes[0] + (lineSizes[1]-lineSizes[0])*lineSizeRelative );
     
     // main render function  
-    displayModels();
+    if(drawSurface) {
+	displaySurface();
+    }
+    else if(drawModels) {
+	displayModels();
+    }
+    
+    if(drawDefects) {
+	displayDefects();
+    }
+    endStage(STAGE_DRAW);
     
     if(drawBoundingBox) {
 	displayBoundingBox();
     }
+    endStage(STAGE_BOUNDINGBOX);
     
     glLoadIdentity();
     
     renderColormap();
     
+    if(drawOrientationGlyph) {
+	displayOrientationGlyph();
+    }
+    
+    if (!offScreen) {
+	if (drawTimings) {
+	    renderTimings();
+	}
+	endStage(STAGE_OVERLAY);
+	endFrameTimer();
+    }
+    
     glFlush();
     
     processFPS(startTime.elapsed());
     
+    if (!offScreen && timingLog.is_open()) {
+	logTimings();
+    }
+    
     int err = glGetError();
     if (err != GL_NO_ERROR) {
 	cerr << "OpenGL Error: " << err << endl;
@@ -307,6 +620,27 @@ void Renderer::initializeGL() {
     
     string ext = (char*)(glGetString(GL_EXTENSIONS));
     renderSet_occlusionExtensionSupported = (ext.find("GL_ARB_occlusion_query") != string::npos);
+    // instancing needs vertex buffers, instanced arrays and GLSL (OpenGL 2.0), Mesa's llvmpipe has all of them
+    instancingSupported = (ext.find("GL_ARB_vertex_buffer_object") != string::npos &&
+			   ext.find("GL_ARB_instanced_arrays") != string::npos &&
+			   ext.find("GL_ARB_draw_instanced") != string::npos &&
+			   atof((char*)(glGetString(GL_VERSION))) >= 2.0 &&
+			   createInstanceProgram());
+    if (instancingSupported) {
+	createImpostorProgram();
+    }
+    // the auto LOD measures the frame time on the GPU, glFlush does not wait for it
+    timerQuerySupported = (renderSet_occlusionExtensionSupported &&
+			   (ext.find("GL_EXT_timer_query") != string::npos ||
+			    ext.find("GL_ARB_timer_query") != string::npos));
+    if (timerQuerySupported) {
+	glGenQueriesARB(4, frameTimers);
+    }
+    // timestamps between the stages of a frame
+    stageTimersSupported = (timerQuerySupported && ext.find("GL_ARB_timer_query") != string::npos);
+    if (stageTimersSupported) {
+	glGenQueriesARB(4 * (STAGE_COUNT + 1), stageTimers);
+    }
     
     glShadeModel(GL_SMOOTH);
     
@@ -361,6 +695,11 @@ void Renderer::initializeGL() {
     glMaterialfv(GL_FRONT, GL_SPECULAR, (float[]) { 1.0f,1.0f,1.0f,1.0f } );
     glMaterialfv(GL_FRONT, GL_SHININESS, (float[]) { 20.0f } );
     glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
+    // back of the two sided models (eyelenses)
+    glMaterialfv( GL_BACK, GL_AMBIENT, (float[]) { 0.0, 0.0, 0.0, 1 } );
+    glMaterialfv( GL_BACK, GL_DIFFUSE, (float[]) { 0.8, 0.8, 0.8, 1 } );
+    glMaterialfv( GL_BACK, GL_SPECULAR, (float[]) { 0, 0, 0, 1 } );
+    glMaterialf( GL_BACK, GL_SHININESS, 128.0 );
    
     glEnable(GL_COLOR_MATERIAL);
     
@@ -387,7 +726,6 @@ void Renderer::initializeGL() {
     glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
     
-    render_LastFrameStartTime = time(NULL);
     lastUpdate = time(NULL);
     //cout << "Renderer::initializeGL() end" << endl;
 }
@@ -916,8 +1254,28 @@ void Renderer::displayModels()
 {
     //cout << "Renderer::displayModels() beg" << endl;
     if (recreateModel) {
+	// drop the types that are gone, only the types whose shape, size or tessellation
+	// changed are created again
+	for (int i = objectParams.size(); i < (int)modelMeshKeys.size(); i++) {
+	    deleteModelType(i);
+	}
+	modelMeshKeys.resize(objectParams.size());
+	modelMeshes.resize(objectParams.size());
+	modelListIndex.resize(objectParams.size());
+	modelListSimpleIndex.resize(objectParams.size());
 	for( uint i=0; i < objectParams.size(); i++ )
 	{
+	    string key = modelMeshKey(i);
+	    if (key == modelMeshKeys[i]) {
+		continue;
+	    }
+	    deleteModelType(i);
+	    modelMeshKeys[i] = key;
+	    modelMeshes[i].assign(modelLevels + 1, ModelMesh());
+	    if (loadModelType(i, key)) {
+		continue;
+	    }
+	    
 	    // create the needed models
 	    switch( int(objectParams.at(i).at(0)) )
 	    {
@@ -952,7 +1310,9 @@ void Renderer::displayModels()
 	    }
 	    createModels4(i);
 	    */
+	    storeModelType(i, key);
 	}
+	writeMeshCache();
 	recreateModel = false;
 	glGetFloatv(GL_LINE_WIDTH_RANGE, lineSizes);
 	// Need to recreate subboxes
@@ -962,12 +1322,16 @@ void Renderer::displayModels()
 	updateGuiF();
     }
     
-    int tempLOD = renderSet_UseAutoLOD?LODdelta:0;
+    updateDrawMask();
+    if (useInstancing && instancingSupported) {
+	updateInstances();
+    }
+    endStage(STAGE_MODELS);
+    
     vector<int>* callIndex = &modelListIndex;
     
     if (renderSet_RenderAsLines) {
 	callIndex = &modelListSimpleIndex;
-	tempLOD = 0;
 	glDisable(GL_LIGHTING);
     } else {
 	glEnable(GL_LIGHTING);
@@ -981,49 +1345,63 @@ void Renderer::displayModels()
 	    renderSubBoundingBoxes();
 	} else {
 	    
-	    if (renderSet_RenderAsLines || !drawOptimized) {
-		// Draw everything
-		
-		if(drawAsSlice) {
-		    
-		    for (int i = 0; i < (int)middle->size(); i++) {
-			if(sliceXLow <= middle->at(i)->at(0) && sliceXHigh >= middle->at(i)->at(0)
-			    && sliceYLow <= middle->at(i)->at(1) && sliceYHigh >= middle->at(i)->at(1)
-			    && sliceZLow <= middle->at(i)->at(2) && sliceZHigh >= middle->at(i)->at(2)) {
-			    glPushMatrix();
-			    glTranslatef(middle->at(i)->at(0), middle->at(i)->at(1), middle->at(i)->at(2));
-			    
-			    if (rot->at(i)->at(0) != 0 || rot->at(i)->at(1) != 0 || rot->at(i)->at(2) != 0) {
-				glRotatef(rot->at(i)->at(3), rot->at(i)->at(0), rot->at(i)->at(1), rot->at(i)->at(2));
-			    }
-			    
-			    glColor3fv(((float*)&((*(color->at(i)))[0]))) ;
-			    glCallList(callIndex->at(modelInd->at(i)) + tempLOD);
-			    
-			    glPopMatrix();
+	    culledGridBoxes = 0;
+	    updateGridVisibility();
+	    updateGridLOD();
+	    endStage(STAGE_CULLING);
+	    
+	    if ((renderSet_RenderAsLines || !drawOptimized) && useInstancing && instancingSupported) {
+		// Draw everything in view, one call per model type and run of visible grid boxes with the same LOD
+		int boxes = gridCells;
+		beginInstances();
+		beginTypeTimings();
+		for (int type = 0; type < (int)modelMeshes.size(); type++) {
+		    int b = 0;
+		    while (b < boxes) {
+			while (b < boxes && !gridVisible[b]) {
+			    b++;
+			}
+			if (b == boxes) {
+			    break;
 			}
+			int lod = gridLOD[b];
+			int first = instanceFirst[type * boxes + b];
+			while (b < boxes && gridVisible[b] && (gridLOD[b] == lod || gridOffset[b + 1] == gridOffset[b])) {
+			    b++;
+			}
+			drawInstances(type, renderSet_RenderAsLines ? modelLevels : lod, first, instanceFirst[type * boxes + b] - first);
 		    }
-		} else {
-		    for (int i = 0; i < (int)middle->size(); i++) {
+		    endTypeTiming();
+		}
+		endInstances();
+	    } else if (renderSet_RenderAsLines || !drawOptimized) {
+		// Draw everything in view
+		
+		for (int b = 0; b < (int)gridVisible.size(); b++) {
+		    if (!gridVisible[b]) {
+			continue;
+		    }
+		    for (int slot = gridOffset[b]; slot < gridOffset[b + 1]; slot++) {
+			int i = gridModels[slot];
+			if (!isDrawn(i)) {
+			    continue;
+			}
 			glPushMatrix();
 			glTranslatef(middle->at(i)->at(0), middle->at(i)->at(1), middle->at(i)->at(2));
-			
-			if (rot->at(i)->at(0) != 0 || rot->at(i)->at(1) != 0 || rot->at(i)->at(2) != 0) {
-			    //cout << "[displayModels()] " << rot->at(i)->at(3) << " " << rot->at(i)->at(0) << " " <<  rot->at(i)->at(1) << " " <<  rot->at(i)->at(2)<< endl;
-			    glRotatef(rot->at(i)->at(3), rot->at(i)->at(0), rot->at(i)->at(1), rot->at(i)->at(2));
-			}
-			
+		    
+			glRotateQuaternion(*(rot->at(i)));
+		    
 			glColor3fv(((float*)&((*(color->at(i)))[0])));
-			
+		    
 			//cout << "-------" << endl;
 			//cout << "callIndex->size() " << callIndex->size() << endl;
 			//cout << "modelInd->size() " << modelInd->size() << endl;
 			//cout << "i " << i << endl;
 			//cout << "-------" << endl;
-			
+		    
 			// 			try
 			// 			  {
-			glCallList(callIndex->at(modelInd->at(i)) + tempLOD);
+			glCallList(callIndex->at(modelInd->at(i)) + gridLOD[b]);
 			// 			  }
 			// 			catch(...)
 			// 			  {
@@ -1031,20 +1409,38 @@ void Renderer::displayModels()
 			// 			    cout << "callIndex " << callIndex->at(modelInd->at(i)) << endl;
 			// 			    cerr << "caught\n";
 			// 			  }
-			
+		    
 			// 			cout << "modelInd " << modelInd->at(i) << endl;
-			
+		    
 			glPopMatrix();
 		    }
 		}
+	    } else if (!octree.empty()) {
+		updateOcclusionView();
+		renderOctree();
+		occlusionFrame++;
 	    } else {
+		updateOcclusionView();
+		// grid boxes out of view count as drawn
+		for (int b = 0; b < (int)gridVisible.size(); b++) {
+		    if (!gridVisible[b]) {
+			gridState[b] = !currentState;
+		    }
+		}
 		if (renderSet_RenderSide == RENDERSIDE_NONE) {
 		    renderFromCorner();
 		} else {
 		    renderFromSide();
 		}
 		currentState = !currentState;
+		occlusionFrame++;
+	    }
+	    if (occlusionPending) {
+		// the boxes skipped on old results are tested again in the next frame,
+		// so the image is complete once the view has settled
+		QTimer::singleShot(0, this, SLOT(updateGL()));
 	    }
+	    emit culledBoxesUpdate(culledGridBoxes);
 	}
     }
     //cout << "Renderer::displayModels() end" << endl;
@@ -1107,6 +1503,203 @@ void Renderer::displayModels()
 //    glEnable(GL_LIGHTING);
 //}
 
+/*!
+ *  Draws the defect lines as tubes. The tubes are compiled into a display list,
+ *  which is only rebuilt when the lines change. Every ring of a tube is oriented by
+ *  the tangent of the polyline, the normal is carried along the line by projection,
+ *  so the tubes do not twist.
+ */
+void Renderer::displayDefects() {
+    //cout << "Renderer::displayDefects beg" << endl;
+    if(recreateDefects) {
+	if(defectList != 0) {
+	    glDeleteLists(defectList, 1);
+	}
+	defectList = glGenLists(1);
+	glNewList(defectList, GL_COMPILE);
+	
+	const int sides = 12;
+	for(unsigned int l = 0; l < defectLines.size(); l++) {
+	    const vector<float> &p = defectLines.at(l);
+	    int points = p.size() / 3;
+	    if(points < 2) {
+		continue;
+	    }
+	    
+	    vector<float> rings(3 * sides * points);
+	    vector<float> normals(3 * sides * points);
+	    float n[3] = {0, 0, 0};
+	    for(int k = 0; k < points; k++) {
+		int a = (k > 0) ? k-1 : k;
+		int b = (k < points-1) ? k+1 : k;
+		float t[3] = { p[3*b]-p[3*a], p[3*b+1]-p[3*a+1], p[3*b+2]-p[3*a+2] };
+		float len = getLength(t[0], t[1], t[2]);
+		if(len > 0) {
+		    t[0] /= len; t[1] /= len; t[2] /= len;
+		}
+		
+		if(k == 0) {
+		    // any vector perpendicular to the first tangent
+		    if(fabs(t[0]) < 0.9f) { n[0] = 1; n[1] = 0; n[2] = 0; }
+		    else                  { n[0] = 0; n[1] = 1; n[2] = 0; }
+		}
+		float d = n[0]*t[0] + n[1]*t[1] + n[2]*t[2];
+		n[0] -= d*t[0]; n[1] -= d*t[1]; n[2] -= d*t[2];
+		len = getLength(n[0], n[1], n[2]);
+		if(len > 0) {
+		    n[0] /= len; n[1] /= len; n[2] /= len;
+		}
+		float bn[3] = { t[1]*n[2]-t[2]*n[1], t[2]*n[0]-t[0]*n[2], t[0]*n[1]-t[1]*n[0] };
+		
+		for(int j = 0; j < sides; j++) {
+		    float phi = 2.0f * M_PI * j / sides;
+		    int m = 3 * (k*sides + j);
+		    for(int c = 0; c < 3; c++) {
+			normals[m+c] = cos(phi)*n[c] + sin(phi)*bn[c];
+			rings[m+c] = p[3*k+c] + defectRadius * normals[m+c];
+		    }
+		}
+	    }
+	    
+	    for(int k = 0; k < points-1; k++) {
+		glBegin(GL_QUAD_STRIP);
+		for(int j = 0; j <= sides; j++) {
+		    int m0 = 3 * (k*sides + j%sides);
+		    int m1 = 3 * ((k+1)*sides + j%sides);
+		    glNormal3fv(&normals[m0]);
+		    glVertex3fv(&rings[m0]);
+		    glNormal3fv(&normals[m1]);
+		    glVertex3fv(&rings[m1]);
+		}
+		glEnd();
+	    }
+	}
+	glEndList();
+	recreateDefects = false;
+    }
+    
+    if(defectList != 0) {
+	glColor3f(1.0f, 0.85f, 0.0f);
+	glCallList(defectList);
+    }
+    //cout << "Renderer::displayDefects end" << endl;
+}
+
+/*!
+ *  Sets a mask for the models, only models with a nonzero entry are drawn.
+ *  An empty mask (or one that does not fit the number of models) shows all models.
+ *
+ *  \param mask one entry per model
+ */
+void Renderer::setModelMask(const vector<char> &mask) {
+    //cout << "Renderer::setModelMask() beg" << endl;    
+    modelMask = mask;
+    drawMaskValid = false;
+    occlusionView++;
+    //cout << "Renderer::setModelMask() end" << endl;    
+}
+
+/*!
+ *  Draws the isosurface. The triangles are compiled into a display list, which is
+ *  only rebuilt when the surface changes. In slice mode the surface is cut at the
+ *  slice bounds with clipping planes.
+ */
+void Renderer::displaySurface() {
+    //cout << "Renderer::displaySurface beg" << endl;
+    if(recreateSurface) {
+	if(surfaceList != 0) {
+	    glDeleteLists(surfaceList, 1);
+	}
+	surfaceList = glGenLists(1);
+	glNewList(surfaceList, GL_COMPILE);
+	glBegin(GL_TRIANGLES);
+	for(unsigned int i = 0; i + 2 < surfaceVertices.size() && i + 2 < surfaceNormals.size(); i += 3) {
+	    glNormal3fv(&surfaceNormals[i]);
+	    glVertex3fv(&surfaceVertices[i]);
+	}
+	glEnd();
+	glEndList();
+	recreateSurface = false;
+    }
+    if(surfaceList == 0) {
+	return;
+    }
+    
+    if(drawAsSlice) {
+	GLdouble planes[6][4];
+	getSliceClipPlanes(planes);
+	for(int i = 0; i < 6; i++) {
+	    glClipPlane(GL_CLIP_PLANE0 + i, planes[i]);
+	    glEnable(GL_CLIP_PLANE0 + i);
+	}
+    }
+    
+    // the inside of cut surfaces is visible, so light both sides
+    glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
+    glColor3f(0.35f, 0.6f, 1.0f);
+    glCallList(surfaceList);
+    glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_FALSE);
+    
+    if(drawAsSlice) {
+	for(int i = 0; i < 6; i++) {
+	    glDisable(GL_CLIP_PLANE0 + i);
+	}
+    }
+    //cout << "Renderer::displaySurface end" << endl;
+}
+
+/*!
+ *  Draws the orientation distribution as a sphere above the axis, turned like the scene,
+ *  so that the colored cells point along the molecule axes they count. The cells are
+ *  compiled into a display list, which is only rebuilt when the colors change.
+ */
+void Renderer::displayOrientationGlyph() {
+    //cout << "Renderer::displayOrientationGlyph beg" << endl;
+    if(recreateGlyph) {
+	if(glyphList != 0) {
+	    glDeleteLists(glyphList, 1);
+	}
+	glyphList = glGenLists(1);
+	glNewList(glyphList, GL_COMPILE);
+	glBegin(GL_QUADS);
+	for(int b = 0; b < glyphBands; b++) {
+	    float z0 = -1.0f + 2.0f * b / glyphBands;
+	    float z1 = -1.0f + 2.0f * (b+1) / glyphBands;
+	    float r0 = (z0*z0 < 1.0f) ? sqrt(1.0f - z0*z0) : 0.0f;
+	    float r1 = (z1*z1 < 1.0f) ? sqrt(1.0f - z1*z1) : 0.0f;
+	    for(int s = 0; s < glyphSectors; s++) {
+		float phi0 = -M_PI + 2.0f * M_PI * s / glyphSectors;
+		float phi1 = -M_PI + 2.0f * M_PI * (s+1) / glyphSectors;
+		glColor3fv(&glyphColors[3 * (b*glyphSectors + s)]);
+		glVertex3f(r0*cos(phi0), r0*sin(phi0), z0);
+		glVertex3f(r0*cos(phi1), r0*sin(phi1), z0);
+		glVertex3f(r1*cos(phi1), r1*sin(phi1), z1);
+		glVertex3f(r1*cos(phi0), r1*sin(phi0), z1);
+	    }
+	}
+	glEnd();
+	glEndList();
+	recreateGlyph = false;
+    }
+    if(glyphList == 0) {
+	return;
+    }
+    
+    float halfDist = distance/2.0;
+    float radius = halfDist/12.0;
+    glLoadIdentity();
+    glTranslatef(sideRelation * halfDist - 0.2f * halfDist, -0.45f * halfDist, -(nearClip + fabs(halfDist/4.9)));
+    glMultMatrixf(render_RotationMatrix);
+    glScalef(radius, radius, radius);
+    
+    glDisable(GL_LIGHTING);
+    glEnable(GL_DEPTH_TEST);
+    glCallList(glyphList);
+    glEnable(GL_LIGHTING);
+    glLoadIdentity();
+    //cout << "Renderer::displayOrientationGlyph end" << endl;
+}
+
 /*!
  *	Renders the Bounding Box
  *  \author Timm Meyer
@@ -1165,116 +1758,334 @@ void Renderer::displayBoundingBox()
 }
 
 /*!
- *	Auto-increases the lod layers
+ *	Reports the frame rate and passes the time of the frame on to the auto LOD. Whichever of
+ *	the CPU time and the GPU time is longer limits the frame rate.
  *
- *  \param lev how much the lod should be increased
- *  \return true if any value has changed
+ * 	\param elapsed the time needed to draw this frame (in millisecs)
  *  \author Timm Meyer
  */
-bool Renderer::increaseLOD(int lev) {
-    //cout << "Renderer::increaseLOD() beg" << endl;
-    LODdelta -= 1;
-    LODdelta = max(LODdelta, 0);
-    
-    int startlev = lev;
-    for (int i = 0; i < (int)layerLOD.size(); i++) {
-	if (layerLOD[i] > 0) {
-	    if (layerLOD[i] >= lev) {
-		layerLOD[i] -= lev;
-		//cout << "Renderer::increaseLOD() end" << endl;
-		return true;
+void  Renderer::processFPS(int elapsed) {
+    //cout << "Renderer::processFPS() beg" << endl;
+    
+    emit fpsUpdate(1000.0/(elapsed ? elapsed : 1.0) );
+    
+    if (!offScreen) {
+	processFrameTime(max((float)elapsed, gpuFrameTime));
+    }
+    //cout << "Renderer::processFPS() end" << endl;
+}
+
+/*!
+ *	Adjusts the LOD tolerance to the frame time budget. The frame time is smoothed, and the
+ *	tolerance is left alone inside a band around the budget, so the LOD settles instead of
+ *	oscillating. The triangles drawn fall about linearly with the tolerance, so it is scaled
+ *	by the ratio of the frame time to the budget, by at most 25% a frame.
+ *
+ * 	\param ms the time of the last frame
+ */
+void Renderer::processFrameTime(float ms) {
+    if (!renderSet_UseAutoLOD) {
+	frameTime = 0.0f;
+	return;
+    }
+    // a single slow frame, like the first one after loading, must not dominate the average
+    ms = min(ms, 4 * renderSet_FrameTimeBudget);
+    frameTime = (frameTime > 0.0f) ? 0.8f * frameTime + 0.2f * ms : ms;
+    
+    float ratio = frameTime / renderSet_FrameTimeBudget;
+    if (ratio > 1.1f || ratio < 0.8f) {
+	lodTolerance *= min(max(ratio, 0.8f), 1.25f);
+	if (lodFinestTolerance < lodCoarsestTolerance) {
+	    lodTolerance = min(max(lodTolerance, 0.9f * lodFinestTolerance), lodCoarsestTolerance);
+	}
+	lodTolerance = min(max(lodTolerance, LOD_MIN_TOLERANCE), LOD_MAX_TOLERANCE);
+    }
+}
+
+/*!
+ *	Reads the timer queries of the previous frames that are done, oldest first, without
+ *	waiting for the GPU.
+ */
+void Renderer::readFrameTimers() {
+    if (!timerQuerySupported) {
+	return;
+    }
+    for (int i = 0; i < 4; i++) {
+	int t = (nextFrameTimer + i) % 4;
+	if (!frameTimerPending[t]) {
+	    continue;
+	}
+	GLuint available = 0;
+	glGetQueryObjectuivARB(frameTimers[t], GL_QUERY_RESULT_AVAILABLE_ARB, &available);
+	const GLuint *stamps = &stageTimers[(STAGE_COUNT + 1) * t];
+	if (available && stageTimersSupported) {
+	    glGetQueryObjectuivARB(stamps[STAGE_COUNT], GL_QUERY_RESULT_AVAILABLE_ARB, &available);
+	}
+	if (!available) {
+	    return; // the later frames are not done either
+	}
+	GLuint64EXT ns = 0;
+	glGetQueryObjectui64vEXT(frameTimers[t], GL_QUERY_RESULT_ARB, &ns);
+	gpuFrameTime = ns / 1000000.0f;
+	if (stageTimersSupported) {
+	    GLuint64EXT stamp[STAGE_COUNT + 1];
+	    for (int stage = 0; stage <= STAGE_COUNT; stage++) {
+		glGetQueryObjectui64vEXT(stamps[stage], GL_QUERY_RESULT_ARB, &stamp[stage]);
+	    }
+	    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		stageGpuTime[stage] = (stamp[stage + 1] - stamp[stage]) / 1000000.0f;
+	    }
+	}
+	typeGpuTime.clear();
+	if (typeTimersUsed[t]) {
+	    GLuint64EXT last = 0;
+	    glGetQueryObjectui64vEXT(typeTimers[t][0], GL_QUERY_RESULT_ARB, &last);
+	    for (int i = 1; i < (int)typeTimers[t].size(); i++) {
+		GLuint64EXT stamp = 0;
+		glGetQueryObjectui64vEXT(typeTimers[t][i], GL_QUERY_RESULT_ARB, &stamp);
+		typeGpuTime.push_back((stamp - last) / 1000000.0f);
+		last = stamp;
 	    }
-	    lev -= layerLOD[i];
-	    layerLOD[i] = 0;
+	    typeTimersUsed[t] = false;
 	}
+	gpuFrame = frameTimerFrame[t];
+	frameTimerPending[t] = false;
     }
-    if (startlev == lev) {
-	//cout << "Renderer::increaseLOD() end" << endl;
-	return false; // nothing changed
+}
+
+/*!
+ *	Starts timing this frame on the GPU. The frame is not timed if the GPU is so far behind
+ *	that all queries are still pending.
+ */
+void Renderer::beginFrameTimer() {
+    frameTimer = -1;
+    if (!timerQuerySupported || frameTimerPending[nextFrameTimer]) {
+	return;
     }
-    //cout << "Renderer::increaseLOD() end" << endl;
-    return true;
+    frameTimer = nextFrameTimer;
+    frameTimerFrame[frameTimer] = frameCount;
+    glBeginQueryARB(GL_TIME_ELAPSED_EXT, frameTimers[frameTimer]);
 }
 
 /*!
- *	Auto-decreases the lod layers
+ *	Ends the timer query of this frame, it is read back by readFrameTimers in a later frame.
  *
- *  \param lev how much the lod should be decreased
- *  \return true if any value has changed
- *  \author Timm Meyer
  */
-bool Renderer::decreaseLOD(int lev) {
-    //cout << "Renderer::decreaseLOD() beg" << endl;
-    LODdelta += 1;
-    LODdelta = min(LODdelta,modelLevels - 1);
-    
-    int startlev = lev;
-    for (int i = layerLOD.size() - 1; i >= 0; i--) {
-	if (layerLOD[i] < modelLevels - 1) {
-	    if (((modelLevels - 1) - layerLOD[i]) >= lev) {
-		layerLOD[i] += lev;
-		//cout << "Renderer::decreaseLOD() end" << endl;
-		return true;
+void Renderer::endFrameTimer() {
+    if (frameTimer < 0) {
+	return;
+    }
+    glEndQueryARB(GL_TIME_ELAPSED_EXT);
+    frameTimerPending[frameTimer] = true;
+    nextFrameTimer = (frameTimer + 1) % 4;
+    frameTimer = -1;
+}
+
+// names of the stages of a frame, in the timing display and in the log
+static const char *stageNames[STAGE_COUNT] = { "input", "camera", "models", "culling", "draw", "boundingbox", "overlay" };
+
+// wall clock time in ms, for the stages of a frame
+static double wallTime() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 1000.0 + now.tv_usec / 1000.0;
+}
+
+/*!
+ *	Starts timing the stages of this frame, see endStage().
+ */
+void Renderer::beginStages() {
+    currentStage = 0;
+    stageStart = wallTime();
+    typeCpuTime.clear();
+    if (stageTimersSupported && frameTimer >= 0) {
+	glQueryCounter(stageTimers[(STAGE_COUNT + 1) * frameTimer], GL_TIMESTAMP);
+    }
+}
+
+/*!
+ *	Ends a stage of the frame. The CPU time since the end of the stage before is taken at
+ *	once, the GPU time with a timestamp query read back by readFrameTimers(). Stages that
+ *	were skipped in this frame get no time.
+ *
+ *  \param stage STAGE_...
+ */
+void Renderer::endStage(int stage) {
+    if (offScreen) {
+	return;
+    }
+    double now = wallTime();
+    for (; currentStage <= stage; currentStage++) {
+	stageCpuTime[currentStage] = (currentStage == stage) ? now - stageStart : 0.0f;
+	if (stageTimersSupported && frameTimer >= 0) {
+	    glQueryCounter(stageTimers[(STAGE_COUNT + 1) * frameTimer + currentStage + 1], GL_TIMESTAMP);
+	}
+    }
+    stageStart = now;
+}
+
+/*!
+ *	Starts timing the model types of the draw stage one by one, see endTypeTiming(). Only
+ *	the draw with one instanced call per type and run of grid boxes is timed by type.
+ */
+void Renderer::beginTypeTimings() {
+    if (offScreen) {
+	return;
+    }
+    typeStart = wallTime();
+    if (stageTimersSupported && frameTimer >= 0) {
+	vector<GLuint> &stamps = typeTimers[frameTimer];
+	if (stamps.size() != modelMeshes.size() + 1) {
+	    if (!stamps.empty()) {
+		glDeleteQueriesARB(stamps.size(), &stamps[0]);
 	    }
-	    lev -= (modelLevels - 1) - layerLOD[i];
-	    layerLOD[i] = (modelLevels - 1);
+	    stamps.resize(modelMeshes.size() + 1);
+	    glGenQueriesARB(stamps.size(), &stamps[0]);
 	}
+	glQueryCounter(stamps[0], GL_TIMESTAMP);
+	typeTimersUsed[frameTimer] = true;
+    }
+}
+
+/*!
+ *	Ends the draw of the next model type, like endStage() does for a stage.
+ */
+void Renderer::endTypeTiming() {
+    if (offScreen) {
+	return;
     }
-    if (startlev == lev) {
-	//cout << "Renderer::decreaseLOD() end" << endl;
-	return false; // nothing changed
+    double now = wallTime();
+    typeCpuTime.push_back(now - typeStart);
+    if (stageTimersSupported && frameTimer >= 0) {
+	glQueryCounter(typeTimers[frameTimer][typeCpuTime.size()], GL_TIMESTAMP);
     }
-    //cout << "Renderer::decreaseLOD() end" << endl;
-    return true;
+    typeStart = now;
+}
+
+// one row of the timing display, without GPU time if gpu is negative
+static QString timingRow(const QString &label, float cpu, float gpu) {
+    QString row;
+    if (gpu >= 0.0f) {
+	row.sprintf("%-16s %8.2f %8.2f", label.ascii(), cpu, gpu);
+    } else {
+	row.sprintf("%-16s %8.2f        -", label.ascii(), cpu);
+    }
+    return row;
 }
 
 /*!
- *	Checks if the fps amount is to low, so that we have to change the lod values, or
- *	if the fps amount is to high, and we could change the lod values to get higher quality.
- *
- * 	\param elapsed the time needed to draw this frame (in millisecs)
- *  \author Timm Meyer
+ *	Shows the time of every stage in the top right corner of the view, on the CPU for the
+ *	last frame and on the GPU for the last frame read back. The draw stage is split by model
+ *	type if the types were drawn one by one.
  */
-void  Renderer::processFPS(int elapsed) {
-    //cout << "Renderer::processFPS() beg" << endl;
+void Renderer::renderTimings() {
+    //cout << "Renderer::renderTimings() beg" << endl;
+    QFont fixedFont("Courier", 9);
+    fixedFont.setStyleHint(QFont::TypeWriter);
+    QFontMetrics metrics(fixedFont);
+    int x = width() - metrics.width("draw (all types)  0000.00  0000.00") - 10;
+    int y = metrics.height() + 5;
     
-    emit fpsUpdate(1000.0/(elapsed ? elapsed : 1.0) );
+    glDisable(GL_LIGHTING);
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_DEPTH_TEST);
+    glColor3f(boundingBoxColor.at(0), boundingBoxColor.at(1), boundingBoxColor.at(2));
+    
+    int row = 1;
+    renderText(x, y * row++, "stage              CPU ms   GPU ms", fixedFont);
+    bool gpu = (stageTimersSupported && gpuFrame >= 0);
+    float cpuTotal = 0.0f;
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+	float gpuTime = gpu ? stageGpuTime[stage] : -1.0f;
+	if (stage == STAGE_DRAW && typeCpuTime.empty()) {
+	    renderText(x, y * row++, timingRow("draw (all types)", stageCpuTime[stage], gpuTime), fixedFont);
+	} else {
+	    renderText(x, y * row++, timingRow(stageNames[stage], stageCpuTime[stage], gpuTime), fixedFont);
+	}
+	if (stage == STAGE_DRAW) {
+	    for (int type = 0; type < (int)typeCpuTime.size(); type++) {
+		QString label;
+		label.sprintf("  type %d", type);
+		float typeGpu = (gpu && type < (int)typeGpuTime.size()) ? typeGpuTime[type] : -1.0f;
+		renderText(x, y * row++, timingRow(label, typeCpuTime[type], typeGpu), fixedFont);
+	    }
+	}
+	cpuTotal += stageCpuTime[stage];
+    }
+    renderText(x, y * row, timingRow("total", cpuTotal, gpuFrame >= 0 ? gpuFrameTime : -1.0f), fixedFont);
     
-    if (difftime(time(NULL), render_LastFrameStartTime) >= 0.3) {
-	render_LastFrameStartTime = time(NULL);
-	
-	
-	if (renderSet_UseAutoLOD) {
-	    if (elapsed > 1000/2) {
-		if (decreaseLOD(25)) {
-		    //		    cout << "AUTO-ADJUST -10" << endl;
-		    //		    printLOD();
-		}
-	    } else if (elapsed > 1000/4) {
-		if (decreaseLOD(15)) {
-		    //		    cout << "AUTO-ADJUST -5" << endl;
-		    //		    printLOD();
-		}
-	    } else if (elapsed > 1000/8) {
-		if (decreaseLOD(3)) {
-		    //		    cout << "AUTO-ADJUST -3" << endl;
-		    //		    printLOD();
-		}
-	    } else if (elapsed < 1000/30) {
-		if (increaseLOD(13)) {
-		    //		    cout << "AUTO-ADJUST +8" << endl;
-		    //		    printLOD();
-		}
-	    } else if (elapsed < 1000/15) {
-		if (increaseLOD(6)) {
-		    //		    cout << "AUTO-ADJUST +3" << endl;
-		    //		    printLOD();
-		}
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_LIGHTING);
+    //cout << "Renderer::renderTimings() end" << endl;
+}
+
+// the times of the model types in the timing log, separated by sep
+static void logTypeTimes(ofstream &log, const vector<float> &times, const char *sep) {
+    for (int type = 0; type < (int)times.size(); type++) {
+	log << (type > 0 ? sep : "") << times[type];
+    }
+}
+
+/*!
+ *	Appends the stage times of this frame to the timing log, see setTimingLog(). The GPU
+ *	times are those of the last frame read back, gpu_frame tells which one.
+ */
+void Renderer::logTimings() {
+    float cpuTotal = 0.0f;
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+	cpuTotal += stageCpuTime[stage];
+    }
+    if (timingLogJson) {
+	timingLog << "{\"frame\": " << frameCount << ", \"cpu\": {";
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+	    timingLog << "\"" << stageNames[stage] << "\": " << stageCpuTime[stage] << ", ";
+	}
+	if (!typeCpuTime.empty()) {
+	    timingLog << "\"draw_types\": [";
+	    logTypeTimes(timingLog, typeCpuTime, ", ");
+	    timingLog << "], ";
+	}
+	timingLog << "\"total\": " << cpuTotal << "}";
+	if (gpuFrame >= 0) {
+	    timingLog << ", \"gpu_frame\": " << gpuFrame << ", \"gpu\": {";
+	    for (int stage = 0; stage < STAGE_COUNT && stageTimersSupported; stage++) {
+		timingLog << "\"" << stageNames[stage] << "\": " << stageGpuTime[stage] << ", ";
 	    }
-	    
+	    if (!typeGpuTime.empty()) {
+		timingLog << "\"draw_types\": [";
+		logTypeTimes(timingLog, typeGpuTime, ", ");
+		timingLog << "], ";
+	    }
+	    timingLog << "\"total\": " << gpuFrameTime << "}";
+	}
+	timingLog << "}\n";
+    } else {
+	timingLog << frameCount;
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+	    timingLog << "," << stageCpuTime[stage];
 	}
+	timingLog << "," << cpuTotal << ",";
+	if (gpuFrame >= 0) {
+	    timingLog << gpuFrame;
+	}
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+	    timingLog << ",";
+	    if (gpuFrame >= 0 && stageTimersSupported) {
+		timingLog << stageGpuTime[stage];
+	    }
+	}
+	timingLog << ",";
+	if (gpuFrame >= 0) {
+	    timingLog << gpuFrameTime;
+	}
+	timingLog << ",";
+	logTypeTimes(timingLog, typeCpuTime, ";");
+	timingLog << ",";
+	if (gpuFrame >= 0) {
+	    logTypeTimes(timingLog, typeGpuTime, ";");
+	}
+	timingLog << "\n";
     }
-    //cout << "Renderer::processFPS() end" << endl;
 }
 
 inline void Renderer::swap(int i, int j) {
@@ -1349,9 +2160,7 @@ void Renderer::updateGuiF() {
 	for (int i = -1; i < 2; i += 2) {
 	    for (int j = -1; j < 2; j += 2) {
 		for (int k = -1; k < 2; k += 2) {
-		    xCoord[count] = i == -1 ? boundingBoxCoords[BOX_COORD_X_LOW] : boundingBoxCoords[BOX_COORD_X_HIGH];
-		    yCoord[count] = j == -1 ? boundingBoxCoords[BOX_COORD_Y_LOW] : boundingBoxCoords[BOX_COORD_Y_HIGH];
-		    zCoord[count] = k == -1 ? boundingBoxCoords[BOX_COORD_Z_LOW] : boundingBoxCoords[BOX_COORD_Z_HIGH];
+		    getGridCorner(i, j, k, xCoord[count], yCoord[count], zCoord[count]);
 		    sqDist[count] = (xPos - xCoord[count]) * (xPos - xCoord[count]) + (yPos - yCoord[count]) * (yPos - yCoord[count]) + (zPos - zCoord[count]) * (zPos - zCoord[count]);
 		    xDir[count] = i;
 		    yDir[count] = j;
@@ -1405,7 +2214,7 @@ void Renderer::updateGuiF() {
 	    startBox_X = 0;
 	    startBox_DeltaX = 1;
 	} else {
-	    startBox_X = smallBoxes.size() - 1;
+	    startBox_X = gridSize - 1;
 	    startBox_DeltaX = -1;
 	}
 	
@@ -1413,7 +2222,7 @@ void Renderer::updateGuiF() {
 	    startBox_Y = 0;
 	    startBox_DeltaY = 1;
 	} else {
-	    startBox_Y = smallBoxes[0].size() - 1;
+	    startBox_Y = gridSize - 1;
 	    startBox_DeltaY = -1;
 	}
 	
@@ -1421,7 +2230,7 @@ void Renderer::updateGuiF() {
 	    startBox_Z = 0;
 	    startBox_DeltaZ = 1;
 	} else {
-	    startBox_Z = smallBoxes[0][0].size() - 1;
+	    startBox_Z = gridSize - 1;
 	    startBox_DeltaZ = -1;
 	}
     }    
@@ -1445,11 +2254,6 @@ void Renderer::setModelParams(int compxmax, int compymax, int compxmin, int comp
     
     // reihenfolge in data scaleX,Y,Z,sphRadius,sphLänge, wireframe (!= 0)
     objectParams = data;
-    modelListIndex.resize(data.size());
-    
-    //cout << "modelListIndex.resize(data.size()) " << data.size() << endl;
-    
-    modelListSimpleIndex.resize(data.size());
     
     modelXComplexity_max = compxmax;
     modelYComplexity_max = compymax;
@@ -1458,13 +2262,6 @@ void Renderer::setModelParams(int compxmax, int compymax, int compxmin, int comp
     //    modelXScale = scalX/2.0;
     //    modelYScale = scalY/2.0;
     //    modelZScale = scalZ/2.0;
-    if (levels < modelLevels) {
-	for (int i = 0; i < (int)layerLOD.size(); i++) {
-	    if (layerLOD[i] >= levels) {
-		layerLOD[i] = levels - 1;
-	    }
-	}
-    }
     modelLevels = levels;
     
     recreateModel = true;
@@ -1572,7 +2369,7 @@ void Renderer::createModels2Wireframe(int index)
     float fv[3];
     for( int actLev = 0; actLev < modelLevels; ++actLev )
     {
-	glNewList(modelListIndex.at(index) + actLev, GL_COMPILE);
+	beginModelList(index, actLev);
 	
 	int xCompl = (int) (modelXComplexity_max + actLev * ((modelXComplexity_min - modelXComplexity_max) / (modelLevels - 1.0)));
 	
@@ -1583,7 +2380,7 @@ void Renderer::createModels2Wireframe(int index)
 	
 	for( int yEbene = 0; yEbene < (yCompl-1); ++yEbene )
 	{
-	    glBegin(GL_LINES);
+	    modelBegin(GL_LINES);
 	    for( int xPart = 0; xPart <= xCompl; ++xPart )
 	    {
 		// Oben
@@ -1599,9 +2396,9 @@ void Renderer::createModels2Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((yEbene + 1) * yPiece) * radius );
 		
-		glNormal3fv( normalizeV(fv, 1, 1, 1) );
+		modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 		fv[2] += cylLength/2;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 		
 		// Unten
 		if( xPart == 0 || xPart == xCompl )
@@ -1616,9 +2413,9 @@ void Renderer::createModels2Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((yEbene+2) * yPiece) * radius );
 		
-		glNormal3fv( normalizeV(fv, 1,1,1) );
+		modelNormal3fv( normalizeV(fv, 1,1,1) );
 		fv[2] += cylLength/2;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 		
 		// Oben - waagerecht
 		if( xPart  == 0 || xPart  == xCompl )
@@ -1633,9 +2430,9 @@ void Renderer::createModels2Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((yEbene  + 1) * yPiece) * radius );
 		
-		glNormal3fv( normalizeV(fv, 1, 1, 1) );
+		modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 		fv[2] += cylLength/2;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 		
 		if( (xPart+1)  == 0 || (xPart+1)  == xCompl )
 		{
@@ -1649,9 +2446,9 @@ void Renderer::createModels2Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((yEbene  + 1) * yPiece) * radius );
 		
-		glNormal3fv( normalizeV(fv, 1, 1, 1) );
+		modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 		fv[2] += cylLength/2;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 		
 		// Unten - waagerecht
 		if( xPart == 0 || xPart == xCompl )
@@ -1666,9 +2463,9 @@ void Renderer::createModels2Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((yEbene+2) * yPiece) * radius );
 		
-		glNormal3fv( normalizeV(fv, 1,1,1) );
+		modelNormal3fv( normalizeV(fv, 1,1,1) );
 		fv[2] += cylLength/2;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 		
 		if( (xPart+1) == 0 || (xPart+1) == xCompl )
 		{
@@ -1682,14 +2479,14 @@ void Renderer::createModels2Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((yEbene+2) * yPiece) * radius );
 		
-		glNormal3fv( normalizeV(fv, 1,1,1) );
+		modelNormal3fv( normalizeV(fv, 1,1,1) );
 		fv[2] += cylLength/2;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 	    }
-	    glEnd();
+	    modelEnd();
 	}
 	
-	glBegin(GL_LINES);
+	modelBegin(GL_LINES);
 	for( int xPart = 0; xPart <= xCompl; ++xPart )
 	{
 	    if (xPart == 0 || xPart == xCompl )
@@ -1704,20 +2501,20 @@ void Renderer::createModels2Wireframe(int index)
 	    }
 	    fv[2] = 0;
 	    
-	    glNormal3fv( normalizeV(fv, 1,1,1) );
+	    modelNormal3fv( normalizeV(fv, 1,1,1) );
 	    fv[2] += cylLength/2;
-	    glVertex3fv(fv);
+	    modelVertex3fv(fv);
 	    
 	    fv[2] = 0;
-	    glNormal3fv( normalizeV(fv, 1,1,1) );
+	    modelNormal3fv( normalizeV(fv, 1,1,1) );
 	    fv[2] -= cylLength/2;
-	    glVertex3fv(fv);
+	    modelVertex3fv(fv);
 	}
-	glEnd();
+	modelEnd();
 	
 	for( int yEbene = yCompl-1; yEbene < 2*(yCompl-1); ++yEbene )
 	{
-	    glBegin(GL_LINES);
+	    modelBegin(GL_LINES);
 	    for( int xPart = 0; xPart <= xCompl; ++xPart )
 	    {
 		// Oben
@@ -1733,9 +2530,9 @@ void Renderer::createModels2Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((yEbene  + 1) * yPiece) * radius );
 		
-		glNormal3fv( normalizeV(fv, 1, 1, 1) );
+		modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 		fv[2] -= cylLength/2;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 		
 		// Unten
 		if( xPart == 0 || xPart == xCompl )
@@ -1750,9 +2547,9 @@ void Renderer::createModels2Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((yEbene+2) * yPiece) * radius );
 		
-		glNormal3fv( normalizeV(fv, 1,1,1) );
+		modelNormal3fv( normalizeV(fv, 1,1,1) );
 		fv[2] -= cylLength/2;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 		
 		// Oben - waagerecht
 		if( xPart  == 0 || xPart  == xCompl )
@@ -1767,9 +2564,9 @@ void Renderer::createModels2Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((yEbene  + 1) * yPiece) * radius );
 		
-		glNormal3fv( normalizeV(fv, 1, 1, 1) );
+		modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 		fv[2] -= cylLength/2;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 		
 		if( (xPart+1)  == 0 || (xPart+1)  == xCompl )
 		{
@@ -1783,9 +2580,9 @@ void Renderer::createModels2Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((yEbene + 1) * yPiece) * radius );
 		
-		glNormal3fv( normalizeV(fv, 1, 1, 1) );
+		modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 		fv[2] -= cylLength/2;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 		
 		// Unten - waagerecht
 		if( xPart == 0 || xPart == xCompl )
@@ -1800,9 +2597,9 @@ void Renderer::createModels2Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((yEbene+2) * yPiece) * radius );
 		
-		glNormal3fv( normalizeV(fv, 1,1,1) );
+		modelNormal3fv( normalizeV(fv, 1,1,1) );
 		fv[2] -= cylLength/2;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 		
 		if( (xPart+1) == 0 || (xPart+1) == xCompl )
 		{
@@ -1816,24 +2613,24 @@ void Renderer::createModels2Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((yEbene+2) * yPiece) * radius );
 		
-		glNormal3fv( normalizeV(fv, 1,1,1) );
+		modelNormal3fv( normalizeV(fv, 1,1,1) );
 		fv[2] -= cylLength/2;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 	    }
-	    glEnd();
+	    modelEnd();
 	}
 	
 	// OBEN
-	glBegin(GL_LINES);
+	modelBegin(GL_LINES);
 	for( int j = 0; j <=  xCompl; ++j )
 	{
 	    fv[0] = 0;
 	    fv[1] = 0;
 	    fv[2] = radius;
 	    
-	    glNormal3fv( normalizeV(fv, 1, 1, 1) );
+	    modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 	    fv[2] += cylLength/2;
-	    glVertex3fv(fv);
+	    modelVertex3fv(fv);
 	    
 	    if( j == 0 || j == xCompl )
 	    {
@@ -1847,9 +2644,9 @@ void Renderer::createModels2Wireframe(int index)
 	    }
 	    fv[2] = (float) ( cos(yPiece) * radius );
 	    
-	    glNormal3fv( normalizeV(fv, 1,1,1) );
+	    modelNormal3fv( normalizeV(fv, 1,1,1) );
 	    fv[2] += cylLength/2;
-	    glVertex3fv(fv);
+	    modelVertex3fv(fv);
 	    
 	    // Waagerecht
 	    if( j == 0 || j == xCompl )
@@ -1864,9 +2661,9 @@ void Renderer::createModels2Wireframe(int index)
 	    }
 	    fv[2] = (float) ( cos(yPiece) * radius );
 	    
-	    glNormal3fv( normalizeV(fv, 1,1,1) );
+	    modelNormal3fv( normalizeV(fv, 1,1,1) );
 	    fv[2] += cylLength/2;
-	    glVertex3fv(fv);
+	    modelVertex3fv(fv);
 	    
 	    if( (j+1) == 0 || (j+1) == xCompl )
 	    {
@@ -1880,23 +2677,23 @@ void Renderer::createModels2Wireframe(int index)
 	    }
 	    fv[2] = (float) ( cos(yPiece) * radius );
 	    
-	    glNormal3fv( normalizeV(fv, 1,1,1) );
+	    modelNormal3fv( normalizeV(fv, 1,1,1) );
 	    fv[2] += cylLength/2;
-	    glVertex3fv(fv);
+	    modelVertex3fv(fv);
 	}
-	glEnd();
+	modelEnd();
 	
 	// UNTEN
-	glBegin(GL_LINES);
+	modelBegin(GL_LINES);
 	for( int j = xCompl; j >= 0; --j )
 	{
 	    fv[0] = 0;
 	    fv[1] = 0;
 	    fv[2] = -radius;
 	    
-	    glNormal3fv( normalizeV(fv, 1,1,1) );
+	    modelNormal3fv( normalizeV(fv, 1,1,1) );
 	    fv[2] -= cylLength/2;
-	    glVertex3fv(fv);
+	    modelVertex3fv(fv);
 	    
 	    if( j == 0 || j == xCompl )
 	    {
@@ -1910,9 +2707,9 @@ void Renderer::createModels2Wireframe(int index)
 	    }
 	    fv[2] = (float) ( -cos(yPiece) * radius );
 	    
-	    glNormal3fv( normalizeV(fv, 1,1,1) );
+	    modelNormal3fv( normalizeV(fv, 1,1,1) );
 	    fv[2] -= cylLength/2;
-	    glVertex3fv(fv);
+	    modelVertex3fv(fv);
 	    
 	    // Waagerecht
 	    if( j == 0 || j == xCompl )
@@ -1927,9 +2724,9 @@ void Renderer::createModels2Wireframe(int index)
 	    }
 	    fv[2] = (float) ( -cos(yPiece) * radius );
 	    
-	    glNormal3fv( normalizeV(fv, 1,1,1) );
+	    modelNormal3fv( normalizeV(fv, 1,1,1) );
 	    fv[2] -= cylLength/2;
-	    glVertex3fv(fv);
+	    modelVertex3fv(fv);
 	    
 	    if( (j+1) == 0 || (j+1) == xCompl )
 	    {
@@ -1943,13 +2740,13 @@ void Renderer::createModels2Wireframe(int index)
 	    }
 	    fv[2] = (float) ( -cos(yPiece) * radius );
 	    
-	    glNormal3fv( normalizeV(fv, 1,1,1) );
+	    modelNormal3fv( normalizeV(fv, 1,1,1) );
 	    fv[2] -= cylLength/2;
-	    glVertex3fv(fv);
+	    modelVertex3fv(fv);
 	}
-	glEnd();
+	modelEnd();
 	
-	glEndList();
+	endModelList();
     }
     
     //cout << "Renderer::createModels2Wireframe() end" << endl;    
@@ -1960,12 +2757,12 @@ void Renderer::createModels2(int index)
     //cout << "Renderer::createModels2() beg" << endl;    
     modelListSimpleIndex.at(index) = glGenLists(1);
     
-    glNewList(modelListSimpleIndex.at(index), GL_COMPILE);
-    glBegin(GL_LINES);
-    glVertex3f( 0, 0,  0.5 );
-    glVertex3f( 0, 0, -0.5 );
-    glEnd();
-    glEndList();
+    beginModelList(index, modelLevels);
+    modelBegin(GL_LINES);
+    modelVertex3f( 0, 0,  0.5 );
+    modelVertex3f( 0, 0, -0.5 );
+    modelEnd();
+    endModelList();
     
     modelListIndex.at(index) = glGenLists( modelLevels );
     
@@ -1981,7 +2778,7 @@ void Renderer::createModels2(int index)
     float fv[3];
     for( int actLev = 0; actLev < modelLevels; ++actLev )
     {
-	glNewList( modelListIndex.at(index) + actLev, GL_COMPILE );
+	beginModelList(index, actLev);
 	
 	int xCompl = (int) ( modelXComplexity_max + actLev * ( (modelXComplexity_min - modelXComplexity_max) / (modelLevels - 1.0) ) );
 	int yCompl = xCompl/4;
@@ -1991,7 +2788,7 @@ void Renderer::createModels2(int index)
 	
 	for( int yEbene = 0; yEbene < (yCompl-1); ++yEbene )
 	{
-	    glBegin(GL_TRIANGLE_STRIP);
+	    modelBegin(GL_TRIANGLE_STRIP);
 	    for( int xPart = 0; xPart <= xCompl; ++xPart ) 
 	    {
 		if( xPart == 0 || xPart == xCompl ) 
@@ -2006,9 +2803,9 @@ void Renderer::createModels2(int index)
 		}
 		fv[2] = (float) ( cos((yEbene + 1) * yPiece) ) * radius;
 		
-		glNormal3fv( normalizeV(fv, 1, 1, 1) );
+		modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 		fv[2] += cylLength/2;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 		
 		// Unten
 		if( xPart == 0 || xPart == xCompl )
@@ -2023,14 +2820,14 @@ void Renderer::createModels2(int index)
 		}
 		fv[2] = (float) ( cos((yEbene+2) * yPiece) ) * radius;
 		
-		glNormal3fv( normalizeV(fv, 1, 1, 1) );
+		modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 		fv[2] += cylLength/2;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 	    }
-	    glEnd();
+	    modelEnd();
 	}
 	
-	glBegin(GL_TRIANGLE_STRIP);
+	modelBegin(GL_TRIANGLE_STRIP);
 	for( int xPart = 0; xPart <= xCompl; ++xPart ) 
 	{
 	    if( xPart == 0 || xPart == xCompl ) 
@@ -2045,20 +2842,20 @@ void Renderer::createModels2(int index)
 	    }
 	    fv[2] = 0;
 	    
-	    glNormal3fv( normalizeV(fv, 1, 1, 1) );
+	    modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 	    fv[2] += cylLength/2;
-	    glVertex3fv(fv);
+	    modelVertex3fv(fv);
 	    
 	    fv[2] = 0;
-	    glNormal3fv( normalizeV(fv, 1, 1, 1) );
+	    modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 	    fv[2] -= cylLength/2;
-	    glVertex3fv(fv);
+	    modelVertex3fv(fv);
 	}
-	glEnd();
+	modelEnd();
 	
 	for( int yEbene = yCompl-1; yEbene < 2*(yCompl-1); ++yEbene ) 
 	{
-	    glBegin(GL_TRIANGLE_STRIP);
+	    modelBegin(GL_TRIANGLE_STRIP);
 	    for( int xPart = 0; xPart <= xCompl; ++xPart ) 
 	    {
 		if( xPart  == 0 || xPart  == xCompl ) 
@@ -2073,9 +2870,9 @@ void Renderer::createModels2(int index)
 		}
 		fv[2] = (float) ( cos((yEbene  + 1) * yPiece) ) * radius;
 		
-		glNormal3fv( normalizeV(fv, 1, 1, 1) );
+		modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 		fv[2] -= cylLength/2;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 		
 		// Unten
 		if( xPart == 0 || xPart == xCompl )
@@ -2090,22 +2887,22 @@ void Renderer::createModels2(int index)
 		}
 		fv[2] = (float) ( cos((yEbene + 2) * yPiece) ) * radius;
 		
-		glNormal3fv( normalizeV(fv, 1, 1, 1) );
+		modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 		fv[2] -= cylLength/2;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 	    }
-	    glEnd();
+	    modelEnd();
 	}
 	
 	// OBEN
-	glBegin(GL_TRIANGLE_FAN);
+	modelBegin(GL_TRIANGLE_FAN);
 	fv[0] = 0;
 	fv[1] = 0;
 	fv[2] = radius;
 	
-	glNormal3fv( normalizeV(fv, 1, 1, 1) );
+	modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 	fv[2] += cylLength/2;
-	glVertex3fv(fv);
+	modelVertex3fv(fv);
 	
 	for( int j = 0; j <=  xCompl; ++j )
 	{
@@ -2121,21 +2918,21 @@ void Renderer::createModels2(int index)
 	    }
 	    fv[2] = (float) ( cos(yPiece) * radius );
 	    
-	    glNormal3fv( normalizeV(fv, 1, 1, 1) );
+	    modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 	    fv[2] += cylLength/2;
-	    glVertex3fv(fv);
+	    modelVertex3fv(fv);
 	}
-	glEnd();
+	modelEnd();
 	
 	// UNTEN
-	glBegin(GL_TRIANGLE_FAN);
+	modelBegin(GL_TRIANGLE_FAN);
 	fv[0] = 0;
 	fv[1] = 0;
 	fv[2] = -radius;
 	
-	glNormal3fv( normalizeV(fv, 1, 1, 1) );
+	modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 	fv[2] -= cylLength/2;
-	glVertex3fv(fv);
+	modelVertex3fv(fv);
 	
 	for( int j = xCompl; j >= 0; --j )
 	{
@@ -2151,13 +2948,13 @@ void Renderer::createModels2(int index)
 	    }
 	    fv[2] = (float) ( -cos(yPiece) * radius );
 	    
-	    glNormal3fv( normalizeV(fv, 1, 1, 1) );
+	    modelNormal3fv( normalizeV(fv, 1, 1, 1) );
 	    fv[2] -= cylLength/2;
-	    glVertex3fv(fv);
+	    modelVertex3fv(fv);
 	}
-	glEnd();
+	modelEnd();
 	
-	glEndList();
+	endModelList();
     }
     //cout << "Renderer::createModels2() end" << endl;    
 }
@@ -2174,12 +2971,12 @@ void Renderer::createModels1Wireframe(int index)
 	int actXCompl = (int) (modelXComplexity_max + actLev * ((modelXComplexity_min - modelXComplexity_max) / (modelLevels - 1.0)));
 	int actYCompl = (int) (modelYComplexity_max + actLev * ((modelYComplexity_min - modelYComplexity_max) / (modelLevels - 1.0)));
 	
-	glNewList(modelListIndex.at(index) + actLev, GL_COMPILE);
+	beginModelList(index, actLev);
 	
 	float yPiece = (float) (M_PI / ((actYCompl + 1) * 2));
 	float xPiece = (float) (2 * M_PI / actXCompl);
 	
-	glBegin(GL_LINES);
+	modelBegin(GL_LINES);
 	// WARNING - highly ineffizient... wireframe is JUST used for screenshots, so this is NOT optimized code!
 	float fv[3];
 	for( int i = 0; i < actYCompl * 2; ++i )
@@ -2199,8 +2996,8 @@ void Renderer::createModels1Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((i + 1) * yPiece) * modelZScale );
 		
-		glNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
-		glVertex3fv(fv);
+		modelNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
+		modelVertex3fv(fv);
 		
 		// Unten
 		if( j == 0 || j == actXCompl )
@@ -2215,8 +3012,8 @@ void Renderer::createModels1Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((i + 2) * yPiece) * modelZScale );
 		
-		glNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
-		glVertex3fv(fv);
+		modelNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
+		modelVertex3fv(fv);
 		
 		// Oben - waagerecht
 		if( j == 0 || j == actXCompl )
@@ -2231,8 +3028,8 @@ void Renderer::createModels1Wireframe(int index)
 		}
 		fv[2] = (float) (cos((i + 1) * yPiece) * modelZScale);
 		
-		glNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
-		glVertex3fv(fv);
+		modelNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
+		modelVertex3fv(fv);
 		
 		if( j+1 == 0 || j+1 == actXCompl )
 		{
@@ -2246,8 +3043,8 @@ void Renderer::createModels1Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((i + 1) * yPiece) * modelZScale );
 		
-		glNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
-		glVertex3fv(fv);
+		modelNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
+		modelVertex3fv(fv);
 		
 		// Unten
 		if( j == 0 || j == actXCompl )
@@ -2262,8 +3059,8 @@ void Renderer::createModels1Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((i + 2) * yPiece) * modelZScale );
 		
-		glNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
-		glVertex3fv(fv);
+		modelNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
+		modelVertex3fv(fv);
 		
 		if( (j+1) == 0 || (j+1) == actXCompl ) 
 		{
@@ -2277,22 +3074,22 @@ void Renderer::createModels1Wireframe(int index)
 		}
 		fv[2] = (float) ( cos((i + 2) * yPiece) * modelZScale );
 		
-		glNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
-		glVertex3fv(fv);
+		modelNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
+		modelVertex3fv(fv);
 	    }
 	}
-	glEnd();
+	modelEnd();
 	
 	// OBEN
-	glBegin(GL_LINES);
+	modelBegin(GL_LINES);
 	for( int j = 0; j < actXCompl + 1; ++j )
 	{
 	    fv[0] = 0;
 	    fv[1] = 0;
 	    fv[2] = modelZScale;
 	    
-	    glNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
-	    glVertex3fv(fv);
+	    modelNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
+	    modelVertex3fv(fv);
 	    
 	    if( j == 0 || j == actXCompl )
 	    {
@@ -2306,21 +3103,21 @@ void Renderer::createModels1Wireframe(int index)
 	    }
 	    fv[2] = (float) ( cos(yPiece) * modelZScale );
 	    
-	    glNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
-	    glVertex3fv(fv);
+	    modelNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
+	    modelVertex3fv(fv);
 	}
-	glEnd();
+	modelEnd();
 	
 	// UNTEN
-	glBegin(GL_LINES);
+	modelBegin(GL_LINES);
 	for( int j = actXCompl; j >= 0; --j )
 	{
 	    fv[0] = 0;
 	    fv[1] = 0;
 	    fv[2] = -modelZScale;
 	    
-	    glNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
-	    glVertex3fv(fv);
+	    modelNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
+	    modelVertex3fv(fv);
 	    if( j == 0 || j == actXCompl )
 	    {
 		fv[0] = (float) ( -modelXScale * sin(yPiece) );
@@ -2333,12 +3130,12 @@ void Renderer::createModels1Wireframe(int index)
 	    }
 	    fv[2] = (float) ( -cos(yPiece) * modelZScale );
 	    
-	    glNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
-	    glVertex3fv(fv);
+	    modelNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
+	    modelVertex3fv(fv);
 	}
-	glEnd();
+	modelEnd();
 	
-	glEndList();
+	endModelList();
     }
     //cout << "Renderer::createModels1Wireframe() end" << endl;    
 }
@@ -2353,12 +3150,12 @@ void Renderer::createModels1(int index)
     float modelZScale = objectParams.at(index).at(3);
     
     modelListSimpleIndex.at(index) = glGenLists(1);
-    glNewList(modelListSimpleIndex.at(index), GL_COMPILE);
-    glBegin(GL_LINES);
-    glVertex3f(0, 0,  modelZScale );
-    glVertex3f(0, 0, -modelZScale );
-    glEnd();
-    glEndList();
+    beginModelList(index, modelLevels);
+    modelBegin(GL_LINES);
+    modelVertex3f(0, 0,  modelZScale );
+    modelVertex3f(0, 0, -modelZScale );
+    modelEnd();
+    endModelList();
     
     modelListIndex.at(index) = glGenLists(modelLevels);
     
@@ -2373,12 +3170,12 @@ void Renderer::createModels1(int index)
 	int actXCompl = (int) ( modelXComplexity_max + actLev * ((modelXComplexity_min - modelXComplexity_max) / (modelLevels - 1.0)) );
 	int actYCompl = (int) ( modelYComplexity_max + actLev * ((modelYComplexity_min - modelYComplexity_max) / (modelLevels - 1.0)) );
 	
-	glNewList(modelListIndex.at(index) + actLev, GL_COMPILE);
+	beginModelList(index, actLev);
 	float yPiece = (float) (M_PI / ((actYCompl + 1) * 2));
 	float xPiece = (float) (2 * M_PI / actXCompl);
 	float fv[3];
 	
-	glBegin(GL_TRIANGLE_STRIP);
+	modelBegin(GL_TRIANGLE_STRIP);
 	for( int i = 0; i < actYCompl * 2; ++i )
 	{
 	    for( int j = 0; j < actXCompl + 1; ++j )
@@ -2396,8 +3193,8 @@ void Renderer::createModels1(int index)
 		}
 		fv[2] = (float) ( cos((i + 1) * yPiece) * modelZScale );
 		
-		glNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
-		glVertex3fv(fv);
+		modelNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
+		modelVertex3fv(fv);
 		
 		// Unten
 		if( j == 0 || j == actXCompl )
@@ -2412,20 +3209,20 @@ void Renderer::createModels1(int index)
 		}
 		fv[2] = (float) ( cos((i + 2) * yPiece) * modelZScale );
 		
-		glNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
-		glVertex3fv(fv);
+		modelNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
+		modelVertex3fv(fv);
 	    }
 	}
-	glEnd();
+	modelEnd();
 	
 	// OBEN
-	glBegin(GL_TRIANGLE_FAN);
+	modelBegin(GL_TRIANGLE_FAN);
 	fv[0] = 0;
 	fv[1] = 0;
 	fv[2] = modelZScale;
 	
-	glNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
-	glVertex3fv(fv);
+	modelNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
+	modelVertex3fv(fv);
 	
 	for( int j = 0; j < actXCompl + 1; ++j )
 	{
@@ -2441,19 +3238,19 @@ void Renderer::createModels1(int index)
 	    }
 	    fv[2] = (float) ( cos(yPiece) * modelZScale );
 	    
-	    glNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
-	    glVertex3fv(fv);
+	    modelNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
+	    modelVertex3fv(fv);
 	}
-	glEnd();
+	modelEnd();
 	
 	// UNTEN
-	glBegin(GL_TRIANGLE_FAN);
+	modelBegin(GL_TRIANGLE_FAN);
 	fv[0] = 0;
 	fv[1] = 0;
 	fv[2] = -modelZScale;
 	
-	glNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
-	glVertex3fv(fv);
+	modelNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
+	modelVertex3fv(fv);
 	
 	for( int j = actXCompl; j >= 0; --j )
 	{
@@ -2469,12 +3266,12 @@ void Renderer::createModels1(int index)
 	    }
 	    fv[2] = (float) ( -cos(yPiece) * modelZScale );
 	    
-	    glNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
-	    glVertex3fv(fv);
+	    modelNormal3fv( normalizeV(fv, modelXScale, modelYScale, modelZScale) );
+	    modelVertex3fv(fv);
 	}
-	glEnd();
+	modelEnd();
 	
-	glEndList();
+	endModelList();
     }
     //cout << "Renderer::createModels1() end" << endl;    
 }
@@ -2505,12 +3302,12 @@ void Renderer::createModels3(int index)
     float minusZ[3] = { 0.0, 0.0, -1.0 };
     
     modelListSimpleIndex.at(index) = glGenLists(1);
-    glNewList(modelListSimpleIndex.at(index), GL_COMPILE);
-    glBegin(GL_LINES);
-    glVertex3f( 0, 0,  radSphere );
-    glVertex3f( 0, 0, -radSphere );
-    glEnd();
-    glEndList();
+    beginModelList(index, modelLevels);
+    modelBegin(GL_LINES);
+    modelVertex3f( 0, 0,  radSphere );
+    modelVertex3f( 0, 0, -radSphere );
+    modelEnd();
+    endModelList();
     
     modelListIndex.at(index) = glGenLists(modelLevels);
     
@@ -2528,12 +3325,12 @@ void Renderer::createModels3(int index)
 	int actXCompl = (int) ( modelXComplexity_max + actLev * ((modelXComplexity_min - modelXComplexity_max) / (modelLevels - 1.0)) );
 	int actYCompl = (int) ( modelYComplexity_max + actLev * ((modelYComplexity_min - modelYComplexity_max) / (modelLevels - 1.0)) );
 	
-	glNewList(modelListIndex.at(index) + actLev, GL_COMPILE);
+	beginModelList(index, actLev);
 	float yPiece = (float) ( M_PI / (actYCompl * 2) );
 	float xPiece = (float) ( 2 * M_PI / actXCompl );
 	float fv[3];
 	
-	glBegin(GL_TRIANGLE_STRIP);
+	modelBegin(GL_TRIANGLE_STRIP);
 	for( int i = 0; i < actYCompl * 2; ++i )
 	{
 	    xyProjectionUp   = radSphere * sin(  i      * yPiece );
@@ -2554,7 +3351,7 @@ void Renderer::createModels3(int index)
 		}
 		fv[2] = (float) ( cos( i * yPiece) * radSphere );
 		
-		glNormal3fv( normalizeV(fv, 1.0, 1.0, 1.0) );
+		modelNormal3fv( normalizeV(fv, 1.0, 1.0, 1.0) );
 		
 		if( j == 0 || j == actXCompl )
 		{
@@ -2566,7 +3363,7 @@ void Renderer::createModels3(int index)
 		    fv[1] -= radCircle * sin(j * xPiece);
 		}
 		
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 		
 		// Lower part of triangle strip
 		if( j == 0 || j == actXCompl )
@@ -2581,7 +3378,7 @@ void Renderer::createModels3(int index)
 		}
 		fv[2] = (float) ( cos( (i + 1) * yPiece) * radSphere );
 		
-		glNormal3fv( normalizeV(fv, 1.0, 1.0, 1.0) );
+		modelNormal3fv( normalizeV(fv, 1.0, 1.0, 1.0) );
 		
 		if( j == 0 || j == actXCompl )
 		{
@@ -2593,19 +3390,19 @@ void Renderer::createModels3(int index)
 		    fv[1] -= radCircle * sin(j * xPiece);
 		}
 		
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 	    }
 	}
-	glEnd();
+	modelEnd();
 	
 	// upper plane
-	glBegin(GL_TRIANGLE_FAN);
+	modelBegin(GL_TRIANGLE_FAN);
 	fv[0] = 0;
 	fv[1] = 0;
 	fv[2] = radSphere;
 	
-	glNormal3fv( normalizeV(fv, 1.0, 1.0, 1.0) );
-	glVertex3fv(fv);
+	modelNormal3fv( normalizeV(fv, 1.0, 1.0, 1.0) );
+	modelVertex3fv(fv);
 	
 	for( int j = 0; j < actXCompl + 1; ++j )
 	{
@@ -2620,19 +3417,19 @@ void Renderer::createModels3(int index)
 		fv[1] = -(float) (  sin(j * xPiece) * radCircle );
 	    }
 	    
-	    glNormal3fv( plusZ );
-	    glVertex3fv(fv);
+	    modelNormal3fv( plusZ );
+	    modelVertex3fv(fv);
 	}
-	glEnd();
+	modelEnd();
 	
 	// lower plane
-	glBegin(GL_TRIANGLE_FAN);
+	modelBegin(GL_TRIANGLE_FAN);
 	fv[0] = 0;
 	fv[1] = 0;
 	fv[2] = -radSphere;
 	
-	glNormal3fv( normalizeV(fv, 1.0, 1.0, 1.0) );
-	glVertex3fv(fv);
+	modelNormal3fv( normalizeV(fv, 1.0, 1.0, 1.0) );
+	modelVertex3fv(fv);
 	
 	for( int j = actXCompl; j >= 0; --j )
 	{
@@ -2647,12 +3444,12 @@ void Renderer::createModels3(int index)
 		fv[1] = -(float) (  sin(j * xPiece) * radCircle );
 	    }
 	    
-	    glNormal3fv( minusZ );
-	    glVertex3fv(fv);
+	    modelNormal3fv( minusZ );
+	    modelVertex3fv(fv);
 	}
-	glEnd();
+	modelEnd();
 	
-	glEndList();
+	endModelList();
     }
     //cout << "Renderer::createModels3() end" << endl;    
 }
@@ -2684,12 +3481,12 @@ void Renderer::createModels4(int index)
     float minusZ[3] = { 0.0, 0.0, -1.0 };
     
     modelListSimpleIndex.at(index) = glGenLists(1);
-    glNewList(modelListSimpleIndex.at(index), GL_COMPILE);
-    glBegin(GL_LINES);
-    glVertex3f( 0, 0,  zCut );
-    glVertex3f( 0, 0, -zCut );
-    glEnd();
-    glEndList();
+    beginModelList(index, modelLevels);
+    modelBegin(GL_LINES);
+    modelVertex3f( 0, 0,  zCut );
+    modelVertex3f( 0, 0, -zCut );
+    modelEnd();
+    endModelList();
     
     modelListIndex.at(index) = glGenLists(modelLevels);
     
@@ -2704,12 +3501,12 @@ void Renderer::createModels4(int index)
 	int actXCompl = (int) ( modelXComplexity_max + actLev * ((modelXComplexity_min - modelXComplexity_max) / (modelLevels - 1.0)) );
 	int actYCompl = (int) ( modelYComplexity_max + actLev * ((modelYComplexity_min - modelYComplexity_max) / (modelLevels - 1.0)) );
 	
-	glNewList(modelListIndex.at(index) + actLev, GL_COMPILE);
+	beginModelList(index, actLev);
 	float yPiece = (float) ( (M_PI-2*angle) / (actYCompl * 2) );
 	float xPiece = (float) ( 2 * M_PI / actXCompl );
 	float fv[3];
 	
-	glBegin(GL_TRIANGLE_STRIP);
+	modelBegin(GL_TRIANGLE_STRIP);
 	for( int i = 0; i < actYCompl * 2; ++i )
 	{
 	    for( int j = 0; j < actXCompl + 1; ++j )
@@ -2727,8 +3524,8 @@ void Renderer::createModels4(int index)
 		}
 		fv[2] = (float) ( cos(angle + i * yPiece) * radius );
 		
-		glNormal3fv( normalizeV(fv, 1.0, 1.0, 1.0) );
-		glVertex3fv(fv);
+		modelNormal3fv( normalizeV(fv, 1.0, 1.0, 1.0) );
+		modelVertex3fv(fv);
 		
 		// Unten
 		if( j == 0 || j == actXCompl )
@@ -2743,20 +3540,20 @@ void Renderer::createModels4(int index)
 		}
 		fv[2] = (float) ( cos(angle + (i + 1) * yPiece) * radius );
 		
-		glNormal3fv( normalizeV(fv, 1.0, 1.0, 1.0) );
-		glVertex3fv(fv);
+		modelNormal3fv( normalizeV(fv, 1.0, 1.0, 1.0) );
+		modelVertex3fv(fv);
 	    }
 	}
-	glEnd();
+	modelEnd();
 	
 	// upper cut plane
-	glBegin(GL_TRIANGLE_FAN);
+	modelBegin(GL_TRIANGLE_FAN);
 	fv[0] = 0;
 	fv[1] = 0;
 	fv[2] = zCut;
 	
-	glNormal3fv( normalizeV(fv, 1.0, 1.0, 1.0) );
-	glVertex3fv(fv);
+	modelNormal3fv( normalizeV(fv, 1.0, 1.0, 1.0) );
+	modelVertex3fv(fv);
 	
 	for( int j = 0; j < actXCompl + 1; ++j )
 	{
@@ -2771,19 +3568,19 @@ void Renderer::createModels4(int index)
 		fv[1] = -(float) (  sin(j * xPiece) * radiusFan );
 	    }
 	    
-	    glNormal3fv( plusZ );
-	    glVertex3fv(fv);
+	    modelNormal3fv( plusZ );
+	    modelVertex3fv(fv);
 	}
-	glEnd();
+	modelEnd();
 	
 	// lower cut plane
-	glBegin(GL_TRIANGLE_FAN);
+	modelBegin(GL_TRIANGLE_FAN);
 	fv[0] = 0;
 	fv[1] = 0;
 	fv[2] = -zCut;
 	
-	glNormal3fv( normalizeV(fv, 1.0, 1.0, 1.0) );
-	glVertex3fv(fv);
+	modelNormal3fv( normalizeV(fv, 1.0, 1.0, 1.0) );
+	modelVertex3fv(fv);
 	
 	for( int j = actXCompl; j >= 0; --j )
 	{
@@ -2798,12 +3595,12 @@ void Renderer::createModels4(int index)
 		fv[1] = -(float) (  sin(j * xPiece) * radiusFan );
 	    }
 	    
-	    glNormal3fv( minusZ );
-	    glVertex3fv(fv);
+	    modelNormal3fv( minusZ );
+	    modelVertex3fv(fv);
 	}
-	glEnd();
+	modelEnd();
 	
-	glEndList();
+	endModelList();
     }
     //cout << "Renderer::createModels4() end" << endl;    
 }
@@ -2830,12 +3627,12 @@ void Renderer::createModels5(int index)
     //cout << "ang: " << angle << endl;
     
     modelListSimpleIndex.at(index) = glGenLists(1);
-    glNewList(modelListSimpleIndex.at(index), GL_COMPILE);
-    glBegin(GL_LINES);
-    glVertex3f(0, 0,  0.5 );
-    glVertex3f(0, 0, -0.5 );
-    glEnd();
-    glEndList();
+    beginModelList(index, modelLevels);
+    modelBegin(GL_LINES);
+    modelVertex3f(0, 0,  0.5 );
+    modelVertex3f(0, 0, -0.5 );
+    modelEnd();
+    endModelList();
     
     modelListIndex.at(index) = glGenLists(modelLevels);
     
@@ -2845,27 +3642,21 @@ void Renderer::createModels5(int index)
 	return;
     }
     
-    glMaterialfv( GL_BACK, GL_AMBIENT, (float[]) { 0.0, 0.0, 0.0, 1 } );
-    glMaterialfv( GL_BACK, GL_DIFFUSE, (float[]) { 0.8, 0.8, 0.8, 1 } );
-    glMaterialfv( GL_BACK, GL_SPECULAR, (float[]) { 0, 0, 0, 1 } );
-    glMaterialf( GL_BACK, GL_SHININESS, 128.0 );
-    
     for( int actLev = 0; actLev < modelLevels; ++actLev )
     {
 	int actXCompl = (int) ( modelXComplexity_max + actLev * ((modelXComplexity_min - modelXComplexity_max) / (modelLevels - 1.0)) );
 	int actYCompl = (int) ( modelYComplexity_max + actLev * ((modelYComplexity_min - modelYComplexity_max) / (modelLevels - 1.0)) );
 	
-	glNewList(modelListIndex.at(index) + actLev, GL_COMPILE);
+	beginModelList(index, actLev);
 	
-	glDisable(GL_CULL_FACE);
-	glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
+	modelTwoSided(true);
 	
 	
 	float yPiece = (float) (angle / ((actYCompl + 1) * 2));
 	float xPiece = (float) (2 * M_PI / actXCompl);
 	float fv[3];
 	
-	glBegin(GL_TRIANGLE_STRIP);
+	modelBegin(GL_TRIANGLE_STRIP);
 	for( int i = 0; i < actYCompl * 2; ++i )
 	{
 	    for( int j = 0; j < actXCompl + 1; ++j )
@@ -2883,9 +3674,9 @@ void Renderer::createModels5(int index)
 		}
 		fv[2] = (float) ( cos((i + 1) * yPiece) * radius );
 		
-		glNormal3fv( normalizeV(fv, radius, radius, radius) );
+		modelNormal3fv( normalizeV(fv, radius, radius, radius) );
 		fv[2] -=  radius;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 		
 		// Unten
 		if( j == 0 || j == actXCompl )
@@ -2900,22 +3691,22 @@ void Renderer::createModels5(int index)
 		}
 		fv[2] = (float) ( cos((i + 2) * yPiece) * radius );
 		
-		glNormal3fv( normalizeV(fv, radius, radius, radius) );
+		modelNormal3fv( normalizeV(fv, radius, radius, radius) );
 		fv[2] -=  radius;
-		glVertex3fv(fv);
+		modelVertex3fv(fv);
 	    }
 	}
-	glEnd();
+	modelEnd();
 
 	// OBEN
-	glBegin(GL_TRIANGLE_FAN);
+	modelBegin(GL_TRIANGLE_FAN);
 	fv[0] = 0;
 	fv[1] = 0;
 	fv[2] = radius;
 	
-	glNormal3fv( normalizeV(fv, radius, radius, radius) );
+	modelNormal3fv( normalizeV(fv, radius, radius, radius) );
 	fv[2] -=  radius;
-	glVertex3fv(fv);
+	modelVertex3fv(fv);
 	
 	for( int j = 0; j < actXCompl + 1; ++j )
 	{
@@ -2931,17 +3722,498 @@ void Renderer::createModels5(int index)
 	    }
 	    fv[2] = (float) ( cos(yPiece) * radius );
 	    
-	    glNormal3fv( normalizeV(fv, radius, radius, radius) );
+	    modelNormal3fv( normalizeV(fv, radius, radius, radius) );
 	    fv[2] -=  radius;
-	    glVertex3fv(fv);
+	    modelVertex3fv(fv);
 	}
-	glEnd();
+	modelEnd();
 	
+	modelTwoSided(false);
+	endModelList();
+    }
+    //cout << "Renderer::createModels5() end" << endl;    
+}
+
+/*!
+ *  Starts the display list of a model type and LOD and records the same geometry into
+ *  the matching mesh, for instancing and the mesh cache. The model... functions below
+ *  replace glBegin, glNormal, glVertex and glEnd while the models are created.
+ *
+ *  \param index model type
+ *  \param lod level of detail, modelLevels for the "line" model
+ */
+void Renderer::beginModelList(int index, int lod) {
+    if (lod < modelLevels) {
+	glNewList(modelListIndex.at(index) + lod, GL_COMPILE);
+    } else {
+	glNewList(modelListSimpleIndex.at(index), GL_COMPILE);
+    }
+    recordMesh = &modelMeshes.at(index).at(lod);
+    recordMesh->vertices.clear();
+    recordMesh->twoSided = false;
+    recordTriangles.clear();
+    recordLines.clear();
+    recordNormal[0] = 0;
+    recordNormal[1] = 0;
+    recordNormal[2] = 1;
+}
+
+void Renderer::endModelList() {
+    glEndList();
+    if (recordMesh != 0) {
+	recordMesh->indices = recordTriangles;
+	recordMesh->indices.insert(recordMesh->indices.end(), recordLines.begin(), recordLines.end());
+	recordMesh->triangleIndices = recordTriangles.size();
+	recordMesh->lineIndices = recordLines.size();
+	weldMesh(*recordMesh);
+	recordMesh = 0;
+    }
+}
+
+void Renderer::modelBegin(GLenum mode) {
+    glBegin(mode);
+    if (recordMesh != 0) {
+	recordMode = mode;
+	recordStart = recordMesh->vertices.size() / 6;
+    }
+}
+
+/*!
+ *  Ends a primitive and splits the recorded strips and fans into single triangles,
+ *  keeping the winding of OpenGL.
+ */
+void Renderer::modelEnd() {
+    glEnd();
+    if (recordMesh == 0) {
+	return;
+    }
+    GLuint s = recordStart;
+    int n = recordMesh->vertices.size() / 6 - recordStart;
+    switch (recordMode) {
+    case GL_TRIANGLES:
+	for (int k = 0; k + 2 < n; k += 3) {
+	    recordTriangles.push_back(s + k);
+	    recordTriangles.push_back(s + k + 1);
+	    recordTriangles.push_back(s + k + 2);
+	}
+	break;
+    case GL_TRIANGLE_STRIP:
+	for (int k = 2; k < n; k++) {
+	    recordTriangles.push_back(s + ((k % 2 == 0) ? k - 2 : k - 1));
+	    recordTriangles.push_back(s + ((k % 2 == 0) ? k - 1 : k - 2));
+	    recordTriangles.push_back(s + k);
+	}
+	break;
+    case GL_TRIANGLE_FAN:
+	for (int k = 2; k < n; k++) {
+	    recordTriangles.push_back(s);
+	    recordTriangles.push_back(s + k - 1);
+	    recordTriangles.push_back(s + k);
+	}
+	break;
+    case GL_LINES:
+	for (int k = 0; k + 1 < n; k += 2) {
+	    recordLines.push_back(s + k);
+	    recordLines.push_back(s + k + 1);
+	}
+	break;
+    case GL_LINE_STRIP:
+	for (int k = 1; k < n; k++) {
+	    recordLines.push_back(s + k - 1);
+	    recordLines.push_back(s + k);
+	}
+	break;
+    default:
+	cerr << "Warning: primitive " << recordMode << " is not supported for instanced drawing" << endl;
+	break;
+    }
+}
+
+void Renderer::modelNormal3fv(const float *n) {
+    glNormal3fv(n);
+    if (recordMesh != 0) {
+	recordNormal[0] = n[0];
+	recordNormal[1] = n[1];
+	recordNormal[2] = n[2];
+    }
+}
+
+void Renderer::modelVertex3fv(const float *v) {
+    modelVertex3f(v[0], v[1], v[2]);
+}
+
+void Renderer::modelVertex3f(float x, float y, float z) {
+    glVertex3f(x, y, z);
+    if (recordMesh != 0) {
+	recordMesh->vertices.push_back(x);
+	recordMesh->vertices.push_back(y);
+	recordMesh->vertices.push_back(z);
+	recordMesh->vertices.insert(recordMesh->vertices.end(), recordNormal, recordNormal + 3);
+    }
+}
+
+/*!
+ *  Lights both sides of open models, like the eyelenses.
+ *
+ *  \param on true at the beginning of the model, false at its end
+ */
+void Renderer::modelTwoSided(bool on) {
+    if (on) {
+	glDisable(GL_CULL_FACE);
+	glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
+	if (recordMesh != 0) {
+	    recordMesh->twoSided = true;
+	}
+    } else {
 	glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_FALSE);
 	glEnable(GL_CULL_FACE);
-	glEndList();
     }
-    //cout << "Renderer::createModels5() end" << endl;    
+}
+
+// orders the vertices of a mesh by position and normal
+struct MeshVertexLess {
+    const float *v;
+    bool operator()(GLuint a, GLuint b) const {
+	return std::lexicographical_compare(v + 6 * a, v + 6 * a + 6, v + 6 * b, v + 6 * b + 6);
+    }
+};
+
+/*!
+ *  Merges the vertices with the same position and normal, the strips and the seams of
+ *  the models repeat most of them. The vertices are renumbered in the order they are
+ *  first used.
+ *
+ *  \param mesh recorded mesh
+ */
+void Renderer::weldMesh(ModelMesh &mesh) {
+    int n = mesh.vertices.size() / 6;
+    if (n == 0) {
+	return;
+    }
+    MeshVertexLess less;
+    less.v = &mesh.vertices[0];
+    vector<GLuint> order(n);
+    for (int k = 0; k < n; k++) {
+	order[k] = k;
+    }
+    std::sort(order.begin(), order.end(), less);
+    vector<GLuint> same(n); // first vertex equal to every vertex
+    same[order[0]] = order[0];
+    for (int k = 1; k < n; k++) {
+	same[order[k]] = less(order[k - 1], order[k]) ? order[k] : same[order[k - 1]];
+    }
+    
+    const GLuint unused = (GLuint) -1;
+    vector<GLuint> renumber(n, unused);
+    vector<float> vertices;
+    for (int k = 0; k < (int)mesh.indices.size(); k++) {
+	GLuint v = same[mesh.indices[k]];
+	if (renumber[v] == unused) {
+	    renumber[v] = vertices.size() / 6;
+	    vertices.insert(vertices.end(), mesh.vertices.begin() + 6 * v, mesh.vertices.begin() + 6 * v + 6);
+	}
+	mesh.indices[k] = renumber[v];
+    }
+    mesh.vertices.swap(vertices);
+}
+
+/*!
+ *  Moves a mesh into vertex and index buffers, without instancing it is only needed
+ *  for the display lists. Frees the copy in main memory.
+ *
+ *  \param mesh the mesh
+ */
+void Renderer::uploadMesh(ModelMesh &mesh) {
+    if (mesh.vertices.empty() || mesh.indices.empty()) {
+	mesh.triangleIndices = 0;
+	mesh.lineIndices = 0;
+    } else if (instancingSupported) {
+	glGenBuffersARB(1, &mesh.vertexBuffer);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, mesh.vertexBuffer);
+	glBufferDataARB(GL_ARRAY_BUFFER_ARB, mesh.vertices.size() * sizeof(float), &mesh.vertices[0], GL_STATIC_DRAW_ARB);
+	glGenBuffersARB(1, &mesh.indexBuffer);
+	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, mesh.indexBuffer);
+	glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, mesh.indices.size() * sizeof(GLuint), &mesh.indices[0], GL_STATIC_DRAW_ARB);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+    }
+    vector<float>().swap(mesh.vertices);
+    vector<GLuint>().swap(mesh.indices);
+}
+
+void Renderer::deleteModelMeshes() {
+    for (int i = 0; i < (int)modelMeshKeys.size(); i++) {
+	deleteModelType(i);
+    }
+    modelMeshKeys.clear();
+    modelMeshes.clear();
+}
+
+/*!
+ *  Frees the display lists and buffers of a model type.
+ *
+ *  \param index model type
+ */
+void Renderer::deleteModelType(int index) {
+    if (index >= (int)modelMeshKeys.size() || modelMeshKeys[index].empty()) {
+	return;
+    }
+    // the lists were created with as many levels as there are meshes besides the "line" model
+    glDeleteLists(modelListIndex.at(index), modelMeshes.at(index).size() - 1);
+    glDeleteLists(modelListSimpleIndex.at(index), 1);
+    for (int j = 0; j < (int)modelMeshes[index].size(); j++) {
+	if (modelMeshes[index][j].vertexBuffer != 0) {
+	    glDeleteBuffersARB(1, &modelMeshes[index][j].vertexBuffer);
+	    glDeleteBuffersARB(1, &modelMeshes[index][j].indexBuffer);
+	}
+    }
+    modelMeshes[index].clear();
+    modelMeshKeys[index] = "";
+}
+
+/*!
+ *  Describes everything the models of a type depend on: the kind of model, its sizes,
+ *  the wireframe flag and the complexity of the levels of detail.
+ *
+ *  \param index model type
+ *  \return the key, meshCache holds the meshes under the key followed by the LOD
+ */
+string Renderer::modelMeshKey(int index) const {
+    // parameters used by the five kinds of models, see createModels1..5
+    static const int firstParam[5] = { 1, 4, 6, 8, 10 };
+    static const int numParams[5] = { 3, 2, 2, 2, 2 };
+    const vector<float> &param = objectParams.at(index);
+    int kind = (int) param.at(0);
+    if (kind < 0 || kind > 4) {
+	kind = 0; // drawn as ellipsoid
+    }
+    std::ostringstream key;
+    key << std::setprecision(9) << kind;
+    for (int k = firstParam[kind]; k < firstParam[kind] + numParams[kind]; k++) {
+	key << " " << param.at(k);
+    }
+    key << " " << (param.at(12) != 0) << " " << modelXComplexity_max << " " << modelYComplexity_max
+	<< " " << modelXComplexity_min << " " << modelYComplexity_min << " " << modelLevels;
+    return key.str();
+}
+
+/*!
+ *  Creates the models of a type from the mesh cache instead of tessellating them.
+ *
+ *  \param index model type
+ *  \param key modelMeshKey of the type
+ *  \return false if not all levels of detail are cached
+ */
+bool Renderer::loadModelType(int index, const string &key) {
+    if (!meshCacheRead) {
+	readMeshCache();
+    }
+    vector<map<string, ModelMesh>::const_iterator> cached;
+    for (int lod = 0; lod <= modelLevels; lod++) {
+	std::ostringstream name;
+	name << key << " " << lod;
+	map<string, ModelMesh>::const_iterator it = meshCache.find(name.str());
+	if (it == meshCache.end()) {
+	    return false;
+	}
+	cached.push_back(it);
+    }
+    modelListSimpleIndex.at(index) = glGenLists(1);
+    modelListIndex.at(index) = glGenLists(modelLevels);
+    for (int lod = 0; lod <= modelLevels; lod++) {
+	modelMeshes[index][lod] = cached[lod]->second;
+	compileModelList(index, lod);
+	uploadMesh(modelMeshes[index][lod]);
+    }
+    return true;
+}
+
+/*!
+ *  Copies the freshly created models of a type into the mesh cache and uploads them.
+ *
+ *  \param index model type
+ *  \param key modelMeshKey of the type
+ */
+void Renderer::storeModelType(int index, const string &key) {
+    // keep the cache small, drop all models that are not in use if it grew too large
+    if (meshCache.size() > 512) {
+	map<string, ModelMesh> used;
+	for (map<string, ModelMesh>::iterator it = meshCache.begin(); it != meshCache.end(); ++it) {
+	    string typeKey = it->first.substr(0, it->first.rfind(' '));
+	    if (std::find(modelMeshKeys.begin(), modelMeshKeys.end(), typeKey) != modelMeshKeys.end()) {
+		used.insert(*it);
+	    }
+	}
+	meshCache.swap(used);
+    }
+    for (int lod = 0; lod <= modelLevels; lod++) {
+	std::ostringstream name;
+	name << key << " " << lod;
+	meshCache[name.str()] = modelMeshes[index][lod];
+	uploadMesh(modelMeshes[index][lod]);
+    }
+    meshCacheModified = true;
+}
+
+/*!
+ *  Compiles the display list of a model type and LOD from its mesh, it draws the same
+ *  as the list compiled while the model was tessellated.
+ *
+ *  \param index model type
+ *  \param lod level of detail, modelLevels for the "line" model
+ */
+void Renderer::compileModelList(int index, int lod) {
+    const ModelMesh &mesh = modelMeshes.at(index).at(lod);
+    if (lod < modelLevels) {
+	glNewList(modelListIndex.at(index) + lod, GL_COMPILE);
+    } else {
+	glNewList(modelListSimpleIndex.at(index), GL_COMPILE);
+    }
+    if (mesh.twoSided) {
+	glDisable(GL_CULL_FACE);
+	glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
+    }
+    if (!mesh.indices.empty()) {
+	// the arrays are copied into the list when it is compiled
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 6 * sizeof(float), &mesh.vertices[0]);
+	glNormalPointer(GL_FLOAT, 6 * sizeof(float), &mesh.vertices[3]);
+	if (mesh.triangleIndices > 0) {
+	    glDrawElements(GL_TRIANGLES, mesh.triangleIndices, GL_UNSIGNED_INT, &mesh.indices[0]);
+	}
+	if (mesh.lineIndices > 0) {
+	    glDrawElements(GL_LINES, mesh.lineIndices, GL_UNSIGNED_INT, &mesh.indices[mesh.triangleIndices]);
+	}
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+    }
+    if (mesh.twoSided) {
+	glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_FALSE);
+	glEnable(GL_CULL_FACE);
+    }
+    glEndList();
+}
+
+/*!
+ *  Reads the mesh cache file. The format is line based: MESH_CACHE_VERSION, then per mesh
+ *  "mesh <floats> <indices> <triangle indices> <two sided> <key>" followed by a line with
+ *  the vertices (position and normal) and a line with the indices. A file of another
+ *  version is ignored, damaged entries are skipped.
+ */
+void Renderer::readMeshCache() {
+    meshCacheRead = true;
+    if (meshCacheFile.empty()) {
+	return;
+    }
+    std::ifstream in(meshCacheFile.c_str());
+    string line;
+    if (!getline(in, line) || line != MESH_CACHE_VERSION) {
+	return; // written by another version, it is replaced by the next writeMeshCache()
+    }
+    while (getline(in, line)) {
+	std::istringstream words(line);
+	string tag, key, vertexLine, indexLine;
+	unsigned int floats = 0, indices = 0;
+	ModelMesh mesh;
+	words >> tag >> floats >> indices >> mesh.triangleIndices >> mesh.twoSided;
+	getline(words >> std::ws, key);
+	if (tag != "mesh" || !getline(in, vertexLine) || !getline(in, indexLine)) {
+	    continue;
+	}
+	std::istringstream vertexWords(vertexLine), indexWords(indexLine);
+	float v;
+	GLuint i;
+	while (mesh.vertices.size() < floats && vertexWords >> v) {
+	    mesh.vertices.push_back(v);
+	}
+	while (mesh.indices.size() < indices && indexWords >> i) {
+	    mesh.indices.push_back(i);
+	}
+	mesh.lineIndices = mesh.indices.size() - mesh.triangleIndices;
+	if (mesh.vertices.size() != floats || mesh.indices.size() != indices || mesh.lineIndices < 0) {
+	    cerr << "Warning: damaged mesh " << key << " in " << meshCacheFile << endl;
+	    continue;
+	}
+	meshCache[key] = mesh;
+    }
+}
+
+/*!
+ *  Writes the mesh cache file if meshes were added. Without a home directory, or if it
+ *  is not writable, the cache is only kept in memory. The file is written under a
+ *  temporary name and renamed, so a crash or a second qmga never leaves half a cache.
+ */
+void Renderer::writeMeshCache() {
+    if (!meshCacheModified || meshCacheFile.empty()) {
+	return;
+    }
+    meshCacheModified = false;
+    std::ostringstream tmpName;
+    tmpName << meshCacheFile << "." << getpid() << ".tmp";
+    std::ofstream out(tmpName.str().c_str());
+    if (!out.is_open()) {
+	return;
+    }
+    out << MESH_CACHE_VERSION << endl;
+    out << "# QMGA model mesh cache, models by kind, sizes, wireframe, complexity and LOD" << endl;
+    out << std::setprecision(9);
+    for (map<string, ModelMesh>::const_iterator it = meshCache.begin(); it != meshCache.end(); ++it) {
+	const ModelMesh &mesh = it->second;
+	out << "mesh " << mesh.vertices.size() << " " << mesh.indices.size() << " " << mesh.triangleIndices
+	    << " " << mesh.twoSided << " " << it->first << endl;
+	for (int k = 0; k < (int)mesh.vertices.size(); k++) {
+	    out << ((k == 0) ? "" : " ") << mesh.vertices[k];
+	}
+	out << endl;
+	for (int k = 0; k < (int)mesh.indices.size(); k++) {
+	    out << ((k == 0) ? "" : " ") << mesh.indices[k];
+	}
+	out << endl;
+    }
+    out.close();
+    if (!out.good() || rename(tmpName.str().c_str(), meshCacheFile.c_str()) != 0) {
+	remove(tmpName.str().c_str());
+    }
+}
+
+/*!
+ *  Combines the slices and the model mask into one flag per model, so the draw loops
+ *  only look up a byte instead of checking every filter again. Only rebuilt after
+ *  the models, the slices or the mask changed.
+ */
+void Renderer::updateDrawMask() {
+    //cout << "Renderer::updateDrawMask() beg" << endl;
+    if (drawMaskValid) {
+	return;
+    }
+    drawMaskValid = true;
+    instancesValid = false;
+    const int n = (int)middle->size();
+    bool masked = ((int)modelMask.size() == n);
+    if (!drawAsSlice && !masked) {
+	drawMask.clear();
+	return;
+    }
+    drawMask.resize(n);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++) {
+	bool drawn = !masked || modelMask[i] != 0;
+	if (drawn && drawAsSlice) {
+	    drawn = isInsideSlice(middle->at(i)->at(0), middle->at(i)->at(1), middle->at(i)->at(2));
+	}
+	drawMask[i] = drawn;
+    }
+    //cout << "Renderer::updateDrawMask() end" << endl;
+}
+
+// number of threads of the parallel loops, 1 without OpenMP
+static int maxThreads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
 }
 
 /*!
@@ -2957,99 +4229,82 @@ void Renderer::createGridBoxes(int x) {
 	makeCurrent();
     }
     
+    instancesValid = false;
     if(middle->size() == 0) {
 	//cout << "Renderer::createGridBoxes() end" << endl;    
 	return;
     }
     
-    smallBoxes.clear();
-    smallBoxCounter.clear();
-    smallBoxState.clear();
-    
-    smallBoxes.resize(x, vector< vector <vector <int > > >(x,vector< vector< int > > (x, vector<int>() )));
-    smallBoxCounter.resize(x, vector< vector <int > >(x,vector<  int > (x, 0)));
-    smallBoxState.resize(x, vector < vector <bool> >(x, vector < bool >(x, false)));
-    
-    static int xOld = 0;
-    for (int i = 0; i < xOld; i++) {
-	for (int j = 0; j < xOld; j++) {
-	    for (int k = 0; k < xOld; k++) {
-		if(smallBoxCoords[i][j][k] != 0)
-		    delete smallBoxCoords[i][j][k];
-	    }
+    // Sort the models into the grid along the box vectors. With a known box this is
+    // done in fractional coordinates, so the cells follow the shape of triclinic boxes.
+    int numModels = (int)middle->size();
+    vector<float> gridCoords(3*numModels);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < numModels; i++) {
+	const vector<float> &pos = *(middle->at(i));
+	if (fractionalBox) {
+	    toBoxFractions(pos[0], pos[1], pos[2], &gridCoords[3*i]);
+	} else {
+	    gridCoords[3*i] = pos[0];
+	    gridCoords[3*i+1] = pos[1];
+	    gridCoords[3*i+2] = pos[2];
 	}
     }
-    xOld = x;
     
-    smallBoxCoords.clear();   
-    smallBoxCoords.resize(x, vector< vector <float * > >(x,vector<  float * > (x)));
-    for (int i = 0; i < x; i++) {
-	for (int j = 0; j < x; j++) {
-	    for (int k = 0; k < x; k++) {
-		//cout << i << " " << j << " " << k << endl;
-		smallBoxCoords[i][j][k] = new float[6];
-	    }
+    if (fractionalBox) {
+	for (int d = 0; d < 3; d++) {
+	    gridRange[2*d] = -0.5;
+	    gridRange[2*d+1] = 0.5;
 	}
-    }
-    
-    layerLOD.resize(x,0);
-    
-    for (int i = 0; i < x; i++) {
-	for (int j = 0; j < x; j++) {
-	    for (int k = 0; k < x; k++) {
-		smallBoxCounter[i][j][k] = 0;
+	for (int i = 0; i < numModels; i++) { // unfolded models may be outside the box
+	    for (int d = 0; d < 3; d++) {
+		gridRange[2*d] = min(gridRange[2*d], gridCoords[3*i+d]);
+		gridRange[2*d+1] = max(gridRange[2*d+1], gridCoords[3*i+d]);
 	    }
 	}
-    }
-    
-    float subLengthX = (boundingBoxCoords[BOX_COORD_X_HIGH] - boundingBoxCoords[BOX_COORD_X_LOW]) / x;
-    float subLengthY = (boundingBoxCoords[BOX_COORD_Y_HIGH] - boundingBoxCoords[BOX_COORD_Y_LOW]) / x;
-    float subLengthZ = (boundingBoxCoords[BOX_COORD_Z_HIGH] - boundingBoxCoords[BOX_COORD_Z_LOW]) / x;
-    
-    // Count
-    for (int i = 0; i < (int)middle->size(); i++) {
-	int boxX = (int) (((middle->at(i)->at(0) - boundingBoxCoords[BOX_COORD_X_LOW]) / subLengthX));
-	int boxY = (int) (((middle->at(i)->at(1) - boundingBoxCoords[BOX_COORD_Y_LOW]) / subLengthY));
-	int boxZ = (int) (((middle->at(i)->at(2) - boundingBoxCoords[BOX_COORD_Z_LOW]) / subLengthZ));
-	
-	if (boxX >= x) {
-	    boxX = x-1;
-	}
-	if (boxY >= x) {
-	    boxY = x-1;
-	}
-	if (boxZ >= x) {
-	    boxZ = x-1;
-	}
-	smallBoxCounter[boxX][boxY][boxZ]++;
-    }
-    
-    // Allocate
-    for (int i = 0; i < x; i++) {
-	for (int j = 0; j < x; j++) {
-	    for (int k = 0; k < x; k++) {
-		smallBoxes[i][j][k].resize(smallBoxCounter[i][j][k]);
-	    }
+    } else {
+	for (int d = 0; d < 6; d++) {
+	    gridRange[d] = boundingBoxCoords[d];
 	}
     }
     
-    // Save
-    for (int i = 0; i < (int)middle->size(); i++) {
-	int boxX = (int) (((middle->at(i)->at(0) - boundingBoxCoords[BOX_COORD_X_LOW]) / subLengthX));
-	int boxY = (int) (((middle->at(i)->at(1) - boundingBoxCoords[BOX_COORD_Y_LOW]) / subLengthY));
-	int boxZ = (int) (((middle->at(i)->at(2) - boundingBoxCoords[BOX_COORD_Z_LOW]) / subLengthZ));
+    // The cells are the leaves of an octree, which holds about as many models in each
+    // leaf as the uniform grid holds on average, or the boxes of the uniform grid.
+    vector<int> gridCell(numModels);
+    int boxes;
+    if (useOctree) {
+	boxes = buildOctree(gridCoords, max((numModels + x*x*x - 1) / (x*x*x), 1), gridCell);
+	gridSize = 0;
+    } else {
+	octree.clear();
+	boxes = x * x * x;
+	gridSize = x;
 	
-	if (boxX >= x) {
-	    boxX = x-1;
-	}
-	if (boxY >= x) {
-	    boxY = x-1;
+	float cellsPerLength[3];
+	for (int d = 0; d < 3; d++) {
+	    cellsPerLength[d] = x / (gridRange[2*d+1] - gridRange[2*d]);
 	}
-	if (boxZ >= x) {
-	    boxZ = x-1;
+	
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < numModels; i++) {
+	    int box = 0;
+	    for (int d = 0; d < 3; d++) {
+		int cell = (int) ((gridCoords[3*i+d] - gridRange[2*d]) * cellsPerLength[d]);
+		if (cell >= x) {
+		    cell = x-1;
+		}
+		if (cell < 0) {
+		    cell = 0;
+		}
+		box = box * x + cell;
+	    }
+	    gridCell[i] = box;
 	}
-	smallBoxes[boxX][boxY][boxZ][--smallBoxCounter[boxX][boxY][boxZ]] = i;
     }
+    gridCells = boxes;
+    gridState.assign(boxes, false);
+    // the queries still pending were issued for the old boxes
+    fill(gridTestFrame.begin(), gridTestFrame.end(), -1);
     
     // Small Boundingboxes berechnen
     float maxModelSize[objectParams.size()];
@@ -3081,69 +4336,111 @@ void Renderer::createGridBoxes(int x) {
 	{
 	    maxModelSize[i] = objectParams.at(i).at(8);
 	}
+	else if( objectParams.at(i).at(0) == 4 )
+	{
+	    // the eyelens lies on a sphere through the center
+	    maxModelSize[i] = 2 * objectParams.at(i).at(10);
+	}
+	// the line drawn instead of the model has length 1 at least
+	maxModelSize[i] = max( maxModelSize[i], 0.5f );
 	
 	globalMaxModelSize = max(globalMaxModelSize, maxModelSize[i]);
 	//cout << maxModelSize[i] << " " << objectParams.at(i).at(0) << " " << objectParams.at(i).at(1) << " " << objectParams.at(i).at(2) << " " << (objectParams.at(i).at(3)*2+objectParams.at(i).at(4)/2) << endl;
     }
-    for (int i = 0; i < x; i++) {
-	for (int j = 0; j < x; j++) {
-	    for (int k = 0; k < x; k++) {
-		int usedModels[objectParams.size()];
-		for(uint hg = 0; hg < objectParams.size(); hg++) {
-		    usedModels[hg] = 0;
+    
+    // Counting sort in two passes over the same chunks of models: every chunk counts its
+    // models per box, the counts are summed up box by box and chunk by chunk, then every
+    // chunk writes its models from its own start in each box. The models of a box stay in
+    // their original order. The first pass also takes the bounding box of the models
+    // per chunk and box, while the models are read in memory order.
+    const int chunks = maxThreads();
+    const int types = objectParams.size();
+    vector<int> chunkCount(chunks * boxes, 0);
+    vector<float> chunkBounds(chunks * 6 * boxes);
+    vector<float> chunkModelSize(chunks * boxes, 0.0f);
+    #pragma omp parallel for schedule(static, 1)
+    for (int c = 0; c < chunks; c++) {
+	int *count = &chunkCount[c * boxes];
+	float *bounds = &chunkBounds[c * 6 * boxes];
+	float *modelSize = &chunkModelSize[c * boxes];
+	for (int i = (long long)numModels * c / chunks; i < (long long)numModels * (c + 1) / chunks; i++) {
+	    int b = gridCell[i];
+	    const vector<float> &pos = *(middle->at(i));
+	    for (int d = 0; d < 3; d++) {
+		if (count[b] == 0 || pos[d] < bounds[6*b+2*d]) {
+		    bounds[6*b+2*d] = pos[d];
 		}
-		// Coordinaten berechnen
-		if (smallBoxes[i][j][k].size() > 0) {
-		    float x_low, x_high, y_low, y_high, z_low, z_high;
-		    x_low = x_high = middle->at(smallBoxes[i][j][k][0])->at(0);
-		    y_low = y_high = middle->at(smallBoxes[i][j][k][0])->at(1);
-		    z_low = z_high = middle->at(smallBoxes[i][j][k][0])->at(2);
-		    
-		    for (int index = 0; index < (int)smallBoxes[i][j][k].size(); index++) {
-			if (middle->at(smallBoxes[i][j][k][index])->at(0) < x_low) {
-			    x_low = middle->at(smallBoxes[i][j][k][index])->at(0);
-			} else if (middle->at(smallBoxes[i][j][k][index])->at(0) > x_high) {
-			    x_high = middle->at(smallBoxes[i][j][k][index])->at(0);
-			}
-			if (middle->at(smallBoxes[i][j][k][index])->at(1) < y_low) {
-			    y_low = middle->at(smallBoxes[i][j][k][index])->at(1);
-			} else if (middle->at(smallBoxes[i][j][k][index])->at(1) > y_high) {
-			    y_high = middle->at(smallBoxes[i][j][k][index])->at(1);
-			}
-			if (middle->at(smallBoxes[i][j][k][index])->at(2) < z_low) {
-			    z_low = middle->at(smallBoxes[i][j][k][index])->at(2);
-			} else if (middle->at(smallBoxes[i][j][k][index])->at(2) > z_high) {
-			    z_high = middle->at(smallBoxes[i][j][k][index])->at(2);
-			}
-			usedModels[modelInd->at(smallBoxes[i][j][k][index])] = 1;
-		    }
-		    
-		    float maxUseSize = 0;
-		    for(uint hg = 0; hg < objectParams.size(); hg++) {
-			maxUseSize = max(maxUseSize, usedModels[hg]*(maxModelSize[hg]));
-		    }
-		    
-		    smallBoxCoords.at(i).at(j).at(k)[BOX_COORD_X_LOW] = x_low - maxUseSize;
-		    smallBoxCoords.at(i).at(j).at(k)[BOX_COORD_X_HIGH] = x_high + maxUseSize;
-		    smallBoxCoords.at(i).at(j).at(k)[BOX_COORD_Y_LOW] = y_low - maxUseSize;
-		    smallBoxCoords.at(i).at(j).at(k)[BOX_COORD_Y_HIGH] = y_high + maxUseSize;
-		    smallBoxCoords.at(i).at(j).at(k)[BOX_COORD_Z_LOW] = z_low - maxUseSize;
-		    smallBoxCoords.at(i).at(j).at(k)[BOX_COORD_Z_HIGH] = z_high + maxUseSize;
-		    //		    cout << i << " " << j << " " << k << " " << maxModelSize << " " << endl;
-		    //		    cout << smallBoxCoords.at(i).at(j).at(k)[BOX_COORD_X_LOW] << endl;
-		    //		    cout << smallBoxCoords.at(i).at(j).at(k)[BOX_COORD_X_HIGH] << endl;
-		    //		    cout << smallBoxCoords.at(i).at(j).at(k)[BOX_COORD_Y_LOW] << endl;
-		    //		    cout << smallBoxCoords.at(i).at(j).at(k)[BOX_COORD_Y_HIGH] << endl;
-		    //		    cout << smallBoxCoords.at(i).at(j).at(k)[BOX_COORD_Z_LOW] << endl;
-		    //		    cout << smallBoxCoords.at(i).at(j).at(k)[BOX_COORD_Z_HIGH] << endl;
+		if (count[b] == 0 || pos[d] > bounds[6*b+2*d+1]) {
+		    bounds[6*b+2*d+1] = pos[d];
 		}
 	    }
+	    count[b]++;
+	    int type = modelInd->at(i);
+	    if (type >= 0 && type < types) {
+		modelSize[b] = max(modelSize[b], maxModelSize[type]);
+	    }
 	}
-    }  
+    }
     
-    //    float d = max ( 
-    //	    max(abs(boundingBoxCoords[BOX_COORD_X_LOW]),abs(boundingBoxCoords[BOX_COORD_X_HIGH])) ,
-    //	      max(
+    // Offsets and the bounding boxes of the grid boxes, grown by the largest model type in them
+    gridOffset.resize(boxes + 1);
+    gridBounds.assign(6 * boxes, 0.0f);
+    gridModelSize.resize(boxes);
+    int total = 0;
+    for (int b = 0; b < boxes; b++) {
+	gridOffset[b] = total;
+	float *bounds = &gridBounds[6 * b];
+	float maxUseSize = 0;
+	for (int c = 0; c < chunks; c++) {
+	    int count = chunkCount[c * boxes + b];
+	    if (count > 0) {
+		const float *chunk = &chunkBounds[(c * boxes + b) * 6];
+		for (int d = 0; d < 3; d++) {
+		    bounds[2*d] = (total == gridOffset[b]) ? chunk[2*d] : min(bounds[2*d], chunk[2*d]);
+		    bounds[2*d+1] = (total == gridOffset[b]) ? chunk[2*d+1] : max(bounds[2*d+1], chunk[2*d+1]);
+		}
+		maxUseSize = max(maxUseSize, chunkModelSize[c * boxes + b]);
+	    }
+	    chunkCount[c * boxes + b] = total;
+	    total += count;
+	}
+	for (int d = 0; d < 3; d++) {
+	    bounds[2*d] -= maxUseSize;
+	    bounds[2*d+1] += maxUseSize;
+	}
+	gridModelSize[b] = maxUseSize;
+    }
+    gridOffset[boxes] = total;
+    
+    gridModels.resize(numModels);
+    #pragma omp parallel for schedule(static, 1)
+    for (int c = 0; c < chunks; c++) {
+	int *next = &chunkCount[c * boxes];
+	for (int i = (long long)numModels * c / chunks; i < (long long)numModels * (c + 1) / chunks; i++) {
+	    gridModels[next[gridCell[i]]++] = i;
+	}
+    }
+    
+    // Bounding boxes and model sizes of the octree nodes, from the leaves up; the children of a node come after it
+    for (int node = (int)octree.size() - 1; node >= 0; node--) {
+	OctreeNode &n = octree[node];
+	const float *first = (n.children == 0) ? &gridBounds[6 * n.firstCell] : octree[n.firstChild].bounds;
+	for (int d = 0; d < 6; d++) {
+	    n.bounds[d] = first[d];
+	}
+	n.modelSize = (n.children == 0) ? gridModelSize[n.firstCell] : 0.0f;
+	for (int child = n.firstChild; child < n.firstChild + n.children; child++) {
+	    for (int d = 0; d < 3; d++) {
+		n.bounds[2*d] = min(n.bounds[2*d], octree[child].bounds[2*d]);
+		n.bounds[2*d+1] = max(n.bounds[2*d+1], octree[child].bounds[2*d+1]);
+	    }
+	    n.modelSize = max(n.modelSize, octree[child].modelSize);
+	}
+    }
+    
+    //    float d = max ( 
+    //	    max(abs(boundingBoxCoords[BOX_COORD_X_LOW]),abs(boundingBoxCoords[BOX_COORD_X_HIGH])) ,
+    //	      max(
     //	      max(abs(boundingBoxCoords[BOX_COORD_Y_LOW]),abs(boundingBoxCoords[BOX_COORD_Y_HIGH])),
     //	      max(abs(boundingBoxCoords[BOX_COORD_Z_LOW]),abs(boundingBoxCoords[BOX_COORD_Z_HIGH]))
     //	      )
@@ -3166,21 +4463,458 @@ void Renderer::createGridBoxes(int x) {
     //cout << "Renderer::createGridBoxes end" << endl;
 }
 
+/*!
+ *  Builds the octree over the grid range. The models are sorted along a Z-order curve
+ *  (10 bits per axis, like CnfFile::sortMolecules()), so the models of every node are
+ *  a contiguous run of the sorted models.
+ *
+ *  \param coords the model positions in grid coordinates, xyz interleaved
+ *  \param leafModels nodes with more models are split
+ *  \param cell is filled with the leaf of every model
+ *  \return the number of leaves
+ */
+int Renderer::buildOctree(const vector<float> &coords, int leafModels, vector<int> &cell) {
+    const int numModels = cell.size();
+    float scale[3];
+    for (int d = 0; d < 3; d++) {
+	float length = gridRange[2*d+1] - gridRange[2*d];
+	scale[d] = (length > 0) ? 1024 / length : 0;
+    }
+    vector<unsigned int> keys(numModels);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < numModels; i++) {
+	unsigned int key = 0;
+	for (int d = 0; d < 3; d++) {
+	    int c = min(max((int) ((coords[3*i+d] - gridRange[2*d]) * scale[d]), 0), 1023);
+	    for (int b = 0; b < 10; b++) {
+		key |= ((c >> b) & 1u) << (3*b + d);
+	    }
+	}
+	keys[i] = key;
+    }
+    vector<int> order;
+    mga::radixSort(keys, order);
+    
+    octree.assign(1, OctreeNode());
+    int cells = 0;
+    splitOctreeNode(0, keys, order, 0, numModels, 10, leafModels, cell, cells);
+    return cells;
+}
+
+/*!
+ *  Fills in an octree node and adds its children. Nodes are split into their octants
+ *  until they hold at most leafModels models; the leaves are numbered depth first, so
+ *  the leaves below a node are contiguous, too. Octants without models are left out,
+ *  a node with a single octant is not split but continues one level down.
+ *
+ *  \param node the node
+ *  \param keys the sorted Z-order keys
+ *  \param order the model of every key
+ *  \param first first key of the node
+ *  \param end key after the last one
+ *  \param levels levels of the keys below the node
+ *  \param leafModels nodes with more models are split
+ *  \param cell is filled with the leaf of every model
+ *  \param cells number of leaves so far
+ */
+void Renderer::splitOctreeNode(int node, const vector<unsigned int> &keys, const vector<int> &order, int first, int end, int levels, int leafModels, vector<int> &cell, int &cells) {
+    if (end - first <= leafModels || levels == 0) {
+	for (int k = first; k < end; k++) {
+	    cell[order[k]] = cells;
+	}
+	octree[node].firstCell = cells;
+	octree[node].endCell = ++cells;
+	octree[node].firstChild = 0;
+	octree[node].children = 0;
+	return;
+    }
+    
+    // the octants differ in the next three bits of the keys
+    const int shift = 3 * (levels - 1);
+    const unsigned int prefix = (keys[first] >> (shift + 3)) << (shift + 3);
+    int split[9];
+    split[0] = first;
+    split[8] = end;
+    for (int o = 1; o < 8; o++) {
+	split[o] = lower_bound(keys.begin() + split[o-1], keys.begin() + end, prefix | (o << shift)) - keys.begin();
+    }
+    int children = 0;
+    for (int o = 0; o < 8; o++) {
+	if (split[o+1] > split[o]) {
+	    children++;
+	}
+    }
+    if (children == 1) {
+	splitOctreeNode(node, keys, order, first, end, levels - 1, leafModels, cell, cells);
+	return;
+    }
+    
+    int child = octree.size();
+    octree.resize(child + children);
+    octree[node].firstCell = cells;
+    octree[node].firstChild = child;
+    octree[node].children = children;
+    for (int o = 0; o < 8; o++) {
+	if (split[o+1] > split[o]) {
+	    splitOctreeNode(child++, keys, order, split[o], split[o+1], levels - 1, leafModels, cell, cells);
+	}
+    }
+    octree[node].endCell = cells;
+}
+
 /*
  * 
  * RENDERING 
  * 
  */
+/*!
+ *  Compiles a shader from the shared instance functions and the given main part.
+ *
+ *  \param type GL_VERTEX_SHADER or GL_FRAGMENT_SHADER
+ *  \param main source with the main function
+ *  \return the shader, 0 if it did not compile
+ */
+GLuint Renderer::compileShader(GLenum type, const char *main) {
+    const char *sources[2] = { instanceFunctions, main };
+    GLint status = 0;
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 2, sources, NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+	char log[1024];
+	glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+	cerr << "Warning: the " << ((type == GL_VERTEX_SHADER) ? "vertex" : "fragment") << " shader did not compile: " << log << endl;
+	glDeleteShader(shader);
+	return 0;
+    }
+    return shader;
+}
+
+/*!
+ *  Links a program for the instanced models, the instance attributes are bound to
+ *  the INSTANCE_ATTRIB locations.
+ *
+ *  \param vertexMain main part of the vertex shader
+ *  \param fragmentMain main part of the fragment shader, NULL for the fixed function one
+ *  \return the program, 0 if a shader did not compile or the program did not link
+ */
+GLuint Renderer::createShaderProgram(const char *vertexMain, const char *fragmentMain) {
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexMain);
+    GLuint fragmentShader = (fragmentMain != NULL) ? compileShader(GL_FRAGMENT_SHADER, fragmentMain) : 0;
+    if (vertexShader == 0 || (fragmentMain != NULL && fragmentShader == 0)) {
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	return 0;
+    }
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glDeleteShader(vertexShader); // freed together with the program
+    if (fragmentShader != 0) {
+	glAttachShader(program, fragmentShader);
+	glDeleteShader(fragmentShader);
+    }
+    glBindAttribLocation(program, INSTANCE_ATTRIB_POSITION, "instancePosition");
+    glBindAttribLocation(program, INSTANCE_ATTRIB_ROTATION, "instanceRotation");
+    glBindAttribLocation(program, INSTANCE_ATTRIB_COLOR, "instanceColor");
+    glLinkProgram(program);
+    GLint status = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+	char log[1024];
+	glGetProgramInfoLog(program, sizeof(log), NULL, log);
+	cerr << "Warning: the shader program did not link: " << log << endl;
+	glDeleteProgram(program);
+	return 0;
+    }
+    return program;
+}
+
+/*!
+ *  Compiles the vertex shader of the instanced models and creates the buffer for the
+ *  instance data.
+ *
+ *  \return false if the shader could not be compiled or linked
+ */
+bool Renderer::createInstanceProgram() {
+    //cout << "Renderer::createInstanceProgram() beg" << endl;
+    instanceProgram = createShaderProgram(instanceVertexShader, NULL);
+    if (instanceProgram == 0) {
+	cerr << "Warning: instanced drawing disabled" << endl;
+	return false;
+    }
+    instanceLightingLocation = glGetUniformLocation(instanceProgram, "lighting");
+    glGenBuffersARB(1, &instanceBuffer);
+    //cout << "Renderer::createInstanceProgram() end" << endl;
+    return true;
+}
+
+/*!
+ *  Compiles the ray casting shaders and uploads the box the impostors are drawn with.
+ *  Without them the models are always drawn as meshes.
+ */
+void Renderer::createImpostorProgram() {
+    //cout << "Renderer::createImpostorProgram() beg" << endl;
+    impostorProgram = createShaderProgram(impostorVertexShader, impostorFragmentShader);
+    if (impostorProgram == 0) {
+	cerr << "Warning: impostors disabled" << endl;
+	return;
+    }
+    impostorLightingLocation = glGetUniformLocation(impostorProgram, "lighting");
+    impostorShapeLocation = glGetUniformLocation(impostorProgram, "shape");
+    impostorSizeLocation = glGetUniformLocation(impostorProgram, "size");
+    impostorExtentLocation = glGetUniformLocation(impostorProgram, "extent");
+    
+    // cube with the faces counterclockwise seen from outside, the normals are not used
+    for (int v = 0; v < 8; v++) {
+	impostorBox.vertices.push_back((v & 1) ? 1.0f : -1.0f);
+	impostorBox.vertices.push_back((v & 2) ? 1.0f : -1.0f);
+	impostorBox.vertices.push_back((v & 4) ? 1.0f : -1.0f);
+	impostorBox.vertices.insert(impostorBox.vertices.end(), 3, 0.0f);
+    }
+    const GLuint faces[6][4] = { {0, 4, 6, 2}, {1, 3, 7, 5}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 2, 3, 1}, {4, 5, 7, 6} };
+    for (int f = 0; f < 6; f++) {
+	const GLuint triangles[6] = { faces[f][0], faces[f][1], faces[f][2], faces[f][0], faces[f][2], faces[f][3] };
+	impostorBox.indices.insert(impostorBox.indices.end(), triangles, triangles + 6);
+    }
+    impostorBox.triangleIndices = impostorBox.indices.size();
+    uploadMesh(impostorBox);
+    //cout << "Renderer::createImpostorProgram() end" << endl;
+}
+
+/*!
+ *  Fills the instance buffer with the position, rotation and color of every drawn
+ *  model. The instances are sorted by model type and then by grid box, so each type
+ *  and each type in a grid box is one consecutive range. Only rebuilt after the models,
+ *  the grid or the draw mask changed.
+ */
+void Renderer::updateInstances() {
+    //cout << "Renderer::updateInstances() beg" << endl;
+    if (instancesValid) {
+	return;
+    }
+    instancesValid = true;
+    const int types = objectParams.size();
+    const int boxes = gridCells;
+    
+    // Count
+    vector<int> counts(types * boxes, 0);
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int b = 0; b < boxes; b++) {
+	for (int slot = gridOffset[b]; slot < gridOffset[b + 1]; slot++) {
+	    int type = modelInd->at(gridModels[slot]);
+	    if (type >= 0 && type < types && isDrawn(gridModels[slot])) {
+		counts[type * boxes + b]++;
+	    }
+	}
+    }
+    instanceFirst.resize(types * boxes + 1);
+    int total = 0;
+    for (int j = 0; j < types * boxes; j++) {
+	instanceFirst[j] = total;
+	total += counts[j];
+    }
+    instanceFirst[types * boxes] = total;
+    
+    // Save
+    vector<ModelInstance> instances(total);
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int b = 0; b < boxes; b++) {
+	vector<int> next(types);
+	for (int type = 0; type < types; type++) {
+	    next[type] = instanceFirst[type * boxes + b];
+	}
+	for (int slot = gridOffset[b]; slot < gridOffset[b + 1]; slot++) {
+	    int i = gridModels[slot];
+	    int type = modelInd->at(i);
+	    if (type < 0 || type >= types || !isDrawn(i)) {
+		continue;
+	    }
+	    ModelInstance &instance = instances[next[type]++];
+	    for (int d = 0; d < 3; d++) {
+		instance.position[d] = middle->at(i)->at(d);
+		instance.color[d] = (GLubyte) (min(max(color->at(i)->at(d), 0.0f), 1.0f) * 255 + 0.5);
+	    }
+	    for (int d = 0; d < 4; d++) {
+		instance.rotation[d] = rot->at(i)->at(d);
+	    }
+	    instance.color[3] = 255;
+	}
+    }
+    
+    glBindBufferARB(GL_ARRAY_BUFFER_ARB, instanceBuffer);
+    glBufferDataARB(GL_ARRAY_BUFFER_ARB, total * sizeof(ModelInstance), (total > 0) ? &instances[0] : NULL, GL_DYNAMIC_DRAW_ARB);
+    glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+    //cout << "Renderer::updateInstances() end" << endl;
+}
+
+/*!
+ *  Enables the vertex arrays for drawInstances. The lighting is taken from the current
+ *  OpenGL state.
+ */
+void Renderer::beginInstances() {
+    instanceLighting = glIsEnabled(GL_LIGHTING);
+    activeProgram = 0;
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    for (int a = INSTANCE_ATTRIB_POSITION; a <= INSTANCE_ATTRIB_COLOR; a++) {
+	glEnableVertexAttribArrayARB(a);
+	glVertexAttribDivisorARB(a, 1);
+    }
+}
+
+/*!
+ *  Draws a range of the instance buffer with one call. Ellipsoids, spherocylinders and
+ *  spheroplatelets are ray cast in their bounding box if impostors are on, the "line"
+ *  and the wireframe models are always meshes.
+ *
+ *  \param type model type of the instances
+ *  \param lod level of detail, modelLevels for the "line" model
+ *  \param first first instance
+ *  \param count number of instances
+ */
+void Renderer::drawInstances(int type, int lod, int first, int count) {
+    const vector<float> &param = objectParams.at(type);
+    int shape = (int) param.at(0);
+    bool impostor = (useImpostors && impostorProgram != 0 && lod < modelLevels &&
+		     shape >= 0 && shape <= 2 && param.at(12) == 0);
+    const ModelMesh &mesh = impostor ? impostorBox : modelMeshes.at(type).at(lod);
+    if (count <= 0 || mesh.vertexBuffer == 0) {
+	return;
+    }
+    GLuint program = impostor ? impostorProgram : instanceProgram;
+    if (program != activeProgram) {
+	glUseProgram(program);
+	glUniform1i(impostor ? impostorLightingLocation : instanceLightingLocation, instanceLighting);
+	activeProgram = program;
+    }
+    if (impostor) {
+	// size of the shape and half size of its bounding box, see impostorFragmentShader
+	float size[3] = { param.at(1), param.at(2), param.at(3) };
+	float extent[3] = { param.at(1), param.at(2), param.at(3) };
+	if (shape == 1) {
+	    size[0] = param.at(4);
+	    size[1] = param.at(5) / 2;
+	    extent[0] = extent[1] = size[0];
+	    extent[2] = size[0] + size[1];
+	} else if (shape == 2) {
+	    size[0] = param.at(6);
+	    size[1] = param.at(7);
+	    extent[0] = extent[1] = size[0] + size[1];
+	    extent[2] = size[0];
+	}
+	glUniform1i(impostorShapeLocation, shape);
+	glUniform3fv(impostorSizeLocation, 1, size);
+	glUniform3fv(impostorExtentLocation, 1, extent);
+    }
+    
+    glBindBufferARB(GL_ARRAY_BUFFER_ARB, mesh.vertexBuffer);
+    glVertexPointer(3, GL_FLOAT, 6 * sizeof(float), (char*)0);
+    glNormalPointer(GL_FLOAT, 6 * sizeof(float), (char*)0 + 3 * sizeof(float));
+    
+    // the attribute pointers start at the first instance
+    const char *instance = (char*)0 + first * sizeof(ModelInstance);
+    glBindBufferARB(GL_ARRAY_BUFFER_ARB, instanceBuffer);
+    glVertexAttribPointerARB(INSTANCE_ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(ModelInstance), instance);
+    glVertexAttribPointerARB(INSTANCE_ATTRIB_ROTATION, 4, GL_FLOAT, GL_FALSE, sizeof(ModelInstance), instance + 3 * sizeof(float));
+    glVertexAttribPointerARB(INSTANCE_ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ModelInstance), instance + 7 * sizeof(float));
+    
+    if (mesh.twoSided) {
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_VERTEX_PROGRAM_TWO_SIDE);
+    }
+    glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, mesh.indexBuffer);
+    if (mesh.triangleIndices > 0) {
+	glDrawElementsInstancedARB(GL_TRIANGLES, mesh.triangleIndices, GL_UNSIGNED_INT, (char*)0, count);
+    }
+    if (mesh.lineIndices > 0) {
+	glDrawElementsInstancedARB(GL_LINES, mesh.lineIndices, GL_UNSIGNED_INT, (char*)0 + mesh.triangleIndices * sizeof(GLuint), count);
+    }
+    if (mesh.twoSided) {
+	glDisable(GL_VERTEX_PROGRAM_TWO_SIDE);
+	glEnable(GL_CULL_FACE);
+    }
+}
+
+void Renderer::endInstances() {
+    for (int a = INSTANCE_ATTRIB_POSITION; a <= INSTANCE_ATTRIB_COLOR; a++) {
+	glVertexAttribDivisorARB(a, 0);
+	glDisableVertexAttribArrayARB(a);
+    }
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+    glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+    glUseProgram(0);
+    activeProgram = 0;
+}
+
+/*!
+ *  Draws the models of a grid box at its LOD, instanced if possible.
+ *
+ *  \param x, y, z the grid box
+ */
+void Renderer::drawGridBox(int x, int y, int z) {
+    int b = gridBox(x, y, z);
+    drawGridCells(b, b + 1, gridLOD[b]);
+}
+
+/*!
+ *  Draws the models of a range of grid cells, instanced with one call per model type
+ *  if possible.
+ *
+ *  \param first first grid cell
+ *  \param end grid cell after the last one
+ *  \param lod level of detail
+ */
+void Renderer::drawGridCells(int first, int end, int lod) {
+    if (gridOffset[first] == gridOffset[end]) {
+	return;
+    }
+    if (useInstancing && instancingSupported) {
+	beginInstances();
+	for (int type = 0; type < (int)modelMeshes.size(); type++) {
+	    int firstInstance = instanceFirst[type * gridCells + first];
+	    drawInstances(type, lod, firstInstance, instanceFirst[type * gridCells + end] - firstInstance);
+	}
+	endInstances();
+	return;
+    }
+    for (int slot = gridOffset[first]; slot < gridOffset[end]; slot++) {
+	int index = gridModels[slot];
+	glTranslateRotateCallList(index, modelListIndex.at(modelInd->at(index)) + lod);
+    }
+}
+
+/*!
+ *  Multiplies the modelview matrix with the rotation of a unit quaternion, without
+ *  the detour over axis and angle.
+ *
+ *  \param q quaternion x, y, z, w
+ */
+inline void Renderer::glRotateQuaternion(const vector<float> &q) {
+    float x = q[0], y = q[1], z = q[2], w = q[3];
+    if (x == 0 && y == 0 && z == 0) {
+	return;
+    }
+    GLfloat m[16] = { // column major
+	1 - 2*(y*y + z*z),     2*(x*y + w*z),     2*(x*z - w*y), 0,
+	    2*(x*y - w*z), 1 - 2*(x*x + z*z),     2*(y*z + w*x), 0,
+	    2*(x*z + w*y),     2*(y*z - w*x), 1 - 2*(x*x + y*y), 0,
+	                0,                 0,                 0, 1
+    };
+    glMultMatrixf(m);
+}
+
 inline void Renderer::glTranslateRotateCallList(int objectIndex, int glListIndex) {
     //cout << "Renderer::glTranslateRotateCallList() beg" << endl;    
+    if (!isDrawn(objectIndex)) {
+	return;
+    }
     glPushMatrix();
     glTranslatef(middle->at(objectIndex)->at(0), middle->at(objectIndex)->at(1), middle->at(objectIndex)->at(2));
     
-    if (rot->at(objectIndex)->at(0) != 0 || rot->at(objectIndex)->at(1) != 0 || rot->at(objectIndex)->at(2) != 0) {
-	glRotatef(rot->at(objectIndex)->at(3), rot->at(objectIndex)->at(0), rot->at(objectIndex)->at(1), rot->at(objectIndex)->at(2));
-    }
-    
-    //mga::MoleculeBiax::QuaternionFromAxisAngle(rot->at(objectIndex)->at(3), rot->at(objectIndex)->at(0), rot->at(objectIndex)->at(1), rot->at(objectIndex)->at(2));
+    glRotateQuaternion(*(rot->at(objectIndex)));
     
     glColor3fv(((float*)&((*(color->at(objectIndex)))[0])));
     glCallList(glListIndex);
@@ -3199,159 +4933,36 @@ inline void Renderer::glTranslateRotateCallList(int objectIndex, int glListIndex
 void Renderer::renderFromSide() {
     //cout << "Renderer::renderFromSide() beg" << endl;    
     
-    int layerCounter = 0; // für LOD!
+    int layerCounter = 0; // the occlusion test starts after some layers
     int delta = 1;
     int start = 0;
     
-    int countBlockedBoxes = 0;
-    int countNonBlockedBoxes = 0;
-    
     if (renderSet_RenderSide == RENDERSIDE_X) {
 	//cout << "-------- hallo x" << endl;
 	if (xDir[0] > 0) {
 	    delta = -1;
-	    start = smallBoxes.size() - 1;
+	    start = gridSize - 1;
 	}
-	for (int x = start; x < (int)smallBoxes.size() && x >= 0; x += delta) {
+	for (int x = start; x < gridSize && x >= 0; x += delta) {
 	    
-	    if (renderSet_UseOcclusionTest && renderSet_occlusionExtensionSupported && layerCounter >= (int)smallBoxes.size() / renderSet_occlusionLayerStartFactor) {
-		int querLen = smallBoxes.size() * smallBoxes.size();
-		GLuint queries[smallBoxes.size() * smallBoxes.size()];
-		
-		glGenQueriesARB(smallBoxes.size() * smallBoxes.size(), queries);
-		
-		glColorMask(false, false, false, false);
-		glDepthMask(false);
-		
-		
-		int count = 0;
-		for (int y = 0; y < (int)smallBoxes.size(); y++) {
-		    for (int z = 0; z < (int)smallBoxes.size(); z++) {
-			glBeginQueryARB(GL_SAMPLES_PASSED_ARB, queries[count]);
-			// ========================================
-			// ========================================
-			// ========================================
-			if (smallBoxes[x][y][z].size() > 0) {
-			    glBegin(GL_TRIANGLES);
-			    // left side
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    // right side
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    // front
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    // back
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    
-			    // top
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    
-			    // down
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glEnd();
-			}
-			// ========================================
-			// ========================================
-			// ========================================
-			
-			glEndQueryARB(GL_SAMPLES_PASSED_ARB);
-			
-			count++;
-		    }
-		}
-		
-		glFlush();
-		
-		glColorMask(true, true, true, true);
-		glDepthMask(true);
-		
-		count = 0;
-		GLuint samples;
-		for (int y = 0; y < (int)smallBoxes.size(); y++) {
-		    for (int z = 0; z < (int)smallBoxes.size(); z++) {
-			glGetQueryObjectuivARB(queries[count], GL_QUERY_RESULT_ARB, &samples);
-			
-			if ((int)samples < renderSet_minimumPixelsToDraw) {
+	    if (renderSet_UseOcclusionTest && renderSet_occlusionExtensionSupported && layerCounter >= gridSize / renderSet_occlusionLayerStartFactor) {
+		beginGridQueries();
+		for (int y = 0; y < gridSize; y++) {
+		    for (int z = 0; z < gridSize; z++) {
+			if (testGridBox(x, y, z)) {
 			    // DONT DRAW!
-			    smallBoxState[x][y][z] = !currentState;
-			    countBlockedBoxes++;
-			} else {
-			    countNonBlockedBoxes++;
+			    gridState[gridBox(x, y, z)] = !currentState;
 			}
-			
-			count++;
 		    }
 		}
-		
-		glDeleteQueriesARB(querLen, queries);
+		endGridQueries();
 	    }
 	    
-	    if(drawAsSlice) {
-		for (int y = 0; y < (int)smallBoxes.size(); y++) {
-		    for (int z = 0; z < (int)smallBoxes.size(); z++) {
-			if (smallBoxState[x][y][z] == currentState) {
-			    smallBoxState[x][y][z] = !smallBoxState[x][y][z];
-			    for (int actI = 0; actI < (int)smallBoxes[x][y][z].size(); actI++) {
-				int index = smallBoxes[x][y][z][actI];
-				
-				if(sliceXLow <= middle->at(index)->at(0) && sliceXHigh >= middle->at(index)->at(0)
-				    && sliceYLow <= middle->at(index)->at(1) && sliceYHigh >= middle->at(index)->at(1)
-				    && sliceZLow <= middle->at(index)->at(2) && sliceZHigh >= middle->at(index)->at(2)) {
-				    glTranslateRotateCallList(index, modelListIndex.at(modelInd->at(index)) + layerLOD[layerCounter]);
-				}
-				
-			    }
-			}
-		    }
-		}
-	    } else {
-		for (int y = 0; y < (int)smallBoxes.size(); y++) {
-		    for (int z = 0; z < (int)smallBoxes.size(); z++) {
-			if (smallBoxState[x][y][z] == currentState) {
-			    smallBoxState[x][y][z] = !smallBoxState[x][y][z];
-			    for (int actI = 0; actI < (int)smallBoxes[x][y][z].size(); actI++) {
-				int index = smallBoxes[x][y][z][actI];
-				glTranslateRotateCallList(index,modelListIndex.at(modelInd->at(index)) + layerLOD[layerCounter]);
-			    }
-			}
+	    for (int y = 0; y < gridSize; y++) {
+		for (int z = 0; z < gridSize; z++) {
+		    if (gridState[gridBox(x, y, z)] == currentState) {
+			gridState[gridBox(x, y, z)] = !gridState[gridBox(x, y, z)];
+			drawGridBox(x, y, z);
 		    }
 		}
 	    }
@@ -3365,154 +4976,32 @@ void Renderer::renderFromSide() {
 	//cout << "-------- hallo y" << endl;
 	if (yDir[0] > 0) {
 	    delta = -1;
-	    start = smallBoxes.size() - 1;
+	    start = gridSize - 1;
 	}
-	for (int y = start; y < (int)smallBoxes.size() && y >= 0; y += delta) {
+	for (int y = start; y < gridSize && y >= 0; y += delta) {
 	    
-	    if (renderSet_UseOcclusionTest && renderSet_occlusionExtensionSupported && layerCounter >= (int)smallBoxes.size() / renderSet_occlusionLayerStartFactor) {
-		GLuint queries[smallBoxes.size() * smallBoxes.size()];
-		
-		glGenQueriesARB(smallBoxes.size() * smallBoxes.size(), queries);
-		int querLen = smallBoxes.size() * smallBoxes.size();
-		
-		glColorMask(false, false, false, false);
-		glDepthMask(false);
-		
-		int count = 0;
-		for (int x = 0; x < (int)smallBoxes.size(); x++) {
-		    for (int z = 0; z < (int)smallBoxes.size(); z++) {
-			glBeginQueryARB(GL_SAMPLES_PASSED_ARB, queries[count]);
-			// ========================================
-			// ========================================
-			// ========================================
-			if (smallBoxes[x][y][z].size() > 0) {
-			    glBegin(GL_TRIANGLES);
-			    // left side
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    // right side
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    // front
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    // back
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    
-			    // top
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    
-			    // down
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glEnd();
-			}
-			// ========================================
-			// ========================================
-			// ========================================
-			
-			glEndQueryARB(GL_SAMPLES_PASSED_ARB);
-			
-			count++;
-		    }
-		}
-		
-		glFlush();
-		
-		glColorMask(true, true, true, true);
-		glDepthMask(true);
-		
-		count = 0;
-		GLuint samples;
-		for (int x = 0; x < (int)smallBoxes.size(); x++) {
-		    for (int z = 0; z < (int)smallBoxes.size(); z++) {
-			glGetQueryObjectuivARB(queries[count], GL_QUERY_RESULT_ARB, &samples);
-			
-			if ((int)samples < renderSet_minimumPixelsToDraw) {
+	    if (renderSet_UseOcclusionTest && renderSet_occlusionExtensionSupported && layerCounter >= gridSize / renderSet_occlusionLayerStartFactor) {
+		beginGridQueries();
+		for (int x = 0; x < gridSize; x++) {
+		    for (int z = 0; z < gridSize; z++) {
+			if (testGridBox(x, y, z)) {
 			    // DONT DRAW!
-			    smallBoxState[x][y][z] = !currentState;
-			    countBlockedBoxes++;
-			} else {
-			    countNonBlockedBoxes++;
+			    gridState[gridBox(x, y, z)] = !currentState;
 			}
-			
-			count++;
 		    }
 		}
-		
-		glDeleteQueriesARB(querLen, queries);
+		endGridQueries();
 	    }
 	    
-	    if(drawAsSlice) {
-		for (int x = 0; x < (int)smallBoxes.size(); ++x) {
-		    for (int z = 0; z < (int)smallBoxes.size(); ++z) {
-			if (smallBoxState[x][y][z] == currentState) {
-			    smallBoxState[x][y][z] = !smallBoxState[x][y][z];
-			    for (int actI = 0; actI < (int)smallBoxes[x][y][z].size(); actI++) {
-				int index = smallBoxes[x][y][z][actI];
-				
-				if(sliceXLow <= middle->at(index)->at(0) && sliceXHigh >= middle->at(index)->at(0)
-				    && sliceYLow <= middle->at(index)->at(1) && sliceYHigh >= middle->at(index)->at(1)
-				    && sliceZLow <= middle->at(index)->at(2) && sliceZHigh >= middle->at(index)->at(2)) {
-				    glTranslateRotateCallList(index, modelListIndex.at(modelInd->at(index)) + layerLOD[layerCounter]);
-				}
-				
-			    }
-			}
-		    }
-		}
-	    } else {
-		for (int x = 0; x < (int)smallBoxes.size(); ++x)
+	    for (int x = 0; x < gridSize; ++x)
+	    {
+		for (int z = 0; z < gridSize; ++z)
 		{
-		    for (int z = 0; z < (int)smallBoxes.size(); ++z)
+		    if( gridState[gridBox(x, y, z)] == currentState )
 		    {
-			if( smallBoxState[x][y][z] == currentState )
-			{
-			    //cout << " ---------------- hallo" << endl;
-			    smallBoxState[x][y][z] = !smallBoxState[x][y][z];
-			    for (int actI = 0; actI < (int)smallBoxes[x][y][z].size(); actI++)
-			    {
-				int index = smallBoxes[x][y][z][actI];
-				
-				glTranslateRotateCallList(index, modelListIndex.at(modelInd->at(index)) + layerLOD[layerCounter]);
-				
-			    }
-			}
+			//cout << " ---------------- hallo" << endl;
+			gridState[gridBox(x, y, z)] = !gridState[gridBox(x, y, z)];
+			drawGridBox(x, y, z);
 		    }
 		}
 	    }
@@ -3525,147 +5014,26 @@ void Renderer::renderFromSide() {
 	//cout << "-------- hallo z" << endl;
 	if (zDir[0] > 0) {
 	    delta = -1;
-	    start = smallBoxes.size() - 1;
+	    start = gridSize - 1;
 	}
-	for (int z = start; z < (int)smallBoxes.size() && z >= 0; z += delta) {
-	    if (renderSet_UseOcclusionTest && renderSet_occlusionExtensionSupported && layerCounter >= (int)smallBoxes.size() / renderSet_occlusionLayerStartFactor) {
-		GLuint queries[smallBoxes.size() * smallBoxes.size()];
-		
-		glGenQueriesARB(smallBoxes.size() * smallBoxes.size(), queries);
-		int querLen = smallBoxes.size()*smallBoxes.size();
-		glColorMask(false, false, false, false);
-		glDepthMask(false);
-		
-		
-		int count = 0;
-		for (int x = 0; x < (int)smallBoxes.size(); x++) {
-		    for (int y = 0; y < (int)smallBoxes.size(); y++) {
-			glBeginQueryARB(GL_SAMPLES_PASSED_ARB, queries[count]);
-			// ========================================
-			// ========================================
-			// ========================================
-			if (smallBoxes[x][y][z].size() > 0) {
-			    glBegin(GL_TRIANGLES);
-			    // left side
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    // right side
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    // front
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    // back
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    
-			    // top
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    
-			    // down
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			    glEnd();
-			}
-			// ========================================
-			// ========================================
-			// ========================================
-			
-			glEndQueryARB(GL_SAMPLES_PASSED_ARB);
-			
-			count++;
-		    }
-		}
-		
-		glFlush();
-		
-		glColorMask(true, true, true, true);
-		glDepthMask(true);
-		
-		count = 0;
-		GLuint samples;
-		for (int x = 0; x < (int)smallBoxes.size(); x++) {
-		    for (int y = 0; y < (int)smallBoxes.size(); y++) {
-			glGetQueryObjectuivARB(queries[count], GL_QUERY_RESULT_ARB, &samples);
-			
-			if ((int)samples < renderSet_minimumPixelsToDraw) {
+	for (int z = start; z < gridSize && z >= 0; z += delta) {
+	    if (renderSet_UseOcclusionTest && renderSet_occlusionExtensionSupported && layerCounter >= gridSize / renderSet_occlusionLayerStartFactor) {
+		beginGridQueries();
+		for (int x = 0; x < gridSize; x++) {
+		    for (int y = 0; y < gridSize; y++) {
+			if (testGridBox(x, y, z)) {
 			    // DONT DRAW!
-			    smallBoxState[x][y][z] = !currentState;
-			    countBlockedBoxes++;
-			} else {
-			    countNonBlockedBoxes++;
+			    gridState[gridBox(x, y, z)] = !currentState;
 			}
-			
-			count++;
 		    }
 		}
-		
-		glDeleteQueriesARB(querLen, queries);
+		endGridQueries();
 	    }
-	    if(drawAsSlice) {
-		for (int x = 0; x < (int)smallBoxes.size(); x++) {
-		    for (int y = 0; y < (int)smallBoxes.size(); y++) {
-			if (smallBoxState[x][y][z] == currentState) {
-			    smallBoxState[x][y][z] = !smallBoxState[x][y][z];
-			    for (int actI = 0; actI < (int)smallBoxes[x][y][z].size(); actI++) {
-				int index = smallBoxes[x][y][z][actI];
-				
-				if(sliceXLow <= middle->at(index)->at(0) && sliceXHigh >= middle->at(index)->at(0)
-				    && sliceYLow <= middle->at(index)->at(1) && sliceYHigh >= middle->at(index)->at(1)
-				    && sliceZLow <= middle->at(index)->at(2) && sliceZHigh >= middle->at(index)->at(2)) {
-				    glTranslateRotateCallList(index,modelListIndex.at(modelInd->at(index)) + layerLOD[layerCounter]);
-				}
-				
-			    }
-			}
-		    }
-		}
-	    } else {
-		for (int x = 0; x < (int)smallBoxes.size(); x++) {
-		    for (int y = 0; y < (int)smallBoxes.size(); y++) {
-			if (smallBoxState[x][y][z] == currentState) {
-			    smallBoxState[x][y][z] = !smallBoxState[x][y][z];
-			    for (int actI = 0; actI < (int)smallBoxes[x][y][z].size(); actI++) {
-				int index = smallBoxes[x][y][z][actI];
-				glTranslateRotateCallList(index, modelListIndex.at(modelInd->at(index)) + layerLOD[layerCounter]);
-				
-				
-			    }
-			}
+	    for (int x = 0; x < gridSize; x++) {
+		for (int y = 0; y < gridSize; y++) {
+		    if (gridState[gridBox(x, y, z)] == currentState) {
+			gridState[gridBox(x, y, z)] = !gridState[gridBox(x, y, z)];
+			drawGridBox(x, y, z);
 		    }
 		}
 	    }
@@ -3706,441 +5074,78 @@ void Renderer::renderFromCorner() {
     int currentBoxY = startBox_Y;
     int currentBoxZ = startBox_Z;
     int layerCounter = 0;
-    int countBlockedBoxes = 0;
-    int countNonBlockedBoxes = 0;
     
-    while (currentBoxX >= 0 && currentBoxX < (int)smallBoxes.size() && currentBoxY >= 0 && currentBoxY < (int)smallBoxes.size() && currentBoxZ >= 0 && currentBoxZ < (int)smallBoxes.size()) {
+    while (currentBoxX >= 0 && currentBoxX < gridSize && currentBoxY >= 0 && currentBoxY < gridSize && currentBoxZ >= 0 && currentBoxZ < gridSize) {
 	
-	if (renderSet_UseOcclusionTest && renderSet_occlusionExtensionSupported && layerCounter >= (int)smallBoxes.size() / renderSet_occlusionLayerStartFactor) {
-	    GLuint queries[smallBoxes.size() * smallBoxes.size()];
-	    
-	    glGenQueriesARB((smallBoxes.size() - layerCounter) * (smallBoxes.size() - layerCounter), queries);
-	    int querLen = (smallBoxes.size() - layerCounter) * (smallBoxes.size() - layerCounter);
-	    glColorMask(false, false, false, false);
-	    glDepthMask(false);
-	    
-	    
-	    int count = 0;
+	if (renderSet_UseOcclusionTest && renderSet_occlusionExtensionSupported && layerCounter >= gridSize / renderSet_occlusionLayerStartFactor) {
+	    beginGridQueries();
 	    int z = currentBoxZ;
-	    for (int x = currentBoxX; x >= 0 && x < (int)smallBoxes.size(); x += startBox_DeltaX) {
-		for (int y = currentBoxY; y >= 0 && y < (int)smallBoxes.size(); y += startBox_DeltaY) {
-		    glBeginQueryARB(GL_SAMPLES_PASSED_ARB, queries[count]);
-		    // ========================================
-		    // ========================================
-		    // ========================================
-		    if (smallBoxes[x][y][z].size() > 0) {
-			glColor4f(1,0,0,1);
-			glBegin(GL_TRIANGLES);
-			// left side
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			// right side
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			// front
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			// back
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			
-			// top
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			
-			// down
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glEnd();
-			
-		    }
-		    // ========================================
-		    // ========================================
-		    // ========================================
-		    
-		    glEndQueryARB(GL_SAMPLES_PASSED_ARB);
-		    
-		    count++;
-		}
-	    }
-	    
-	    glFlush();
-	    
-	    glColorMask(true, true, true, true);
-	    glDepthMask(true);
-	    
-	    count = 0;
-	    GLuint samples;
-	    for (int x = currentBoxX; x >= 0 && x < (int)smallBoxes.size(); x += startBox_DeltaX) {
-		for (int y = currentBoxY; y >= 0 && y < (int)smallBoxes.size(); y += startBox_DeltaY) {
-		    glGetQueryObjectuivARB(queries[count], GL_QUERY_RESULT_ARB, &samples);
-		    
-		    if ((int)samples < renderSet_minimumPixelsToDraw) {
+	    for (int x = currentBoxX; x >= 0 && x < gridSize; x += startBox_DeltaX) {
+		for (int y = currentBoxY; y >= 0 && y < gridSize; y += startBox_DeltaY) {
+		    if (testGridBox(x, y, z)) {
 			// DONT DRAW!
-			smallBoxState[x][y][z] = !currentState;
-			countBlockedBoxes++;
-		    } else {
-			countNonBlockedBoxes++;
+			gridState[gridBox(x, y, z)] = !currentState;
 		    }
-		    
-		    count++;
 		}
 	    }
-	    
-	    glDeleteQueriesARB(querLen, queries);
+	    endGridQueries();
 	}
 	
-	if(drawAsSlice) {
-	    // Draw Code
-	    // Oberste Ebene... bis rum Rand
-	    for (int x = currentBoxX; x >= 0 && x < (int)smallBoxes.size(); x += startBox_DeltaX) {
-		for (int y = currentBoxY; y >= 0 && y < (int)smallBoxes.size(); y += startBox_DeltaY) {
-		    if (smallBoxState[x][y][currentBoxZ] == currentState) {
-			smallBoxState[x][y][currentBoxZ] = !smallBoxState[x][y][currentBoxZ];
-			for (int actI = 0; actI < (int)smallBoxes[x][y][currentBoxZ].size(); actI++) {
-			    int index = smallBoxes[x][y][currentBoxZ][actI];
-			    if(sliceXLow <= middle->at(index)->at(0) && sliceXHigh >= middle->at(index)->at(0)
-				&& sliceYLow <= middle->at(index)->at(1) && sliceYHigh >= middle->at(index)->at(1)
-				&& sliceZLow <= middle->at(index)->at(2) && sliceZHigh >= middle->at(index)->at(2)) {
-				glTranslateRotateCallList(index, modelListIndex.at(modelInd->at(index)) + layerLOD[layerCounter]);
-			    }
-			    
-			}
-		    }
-		}
-	    }
-	} else {
-	    // Draw Code
-	    // Oberste Ebene... bis rum Rand
-	    for (int x = currentBoxX; x >= 0 && x < (int)smallBoxes.size(); x += startBox_DeltaX) {
-		for (int y = currentBoxY; y >= 0 && y < (int)smallBoxes.size(); y += startBox_DeltaY) {
-		    if (smallBoxState[x][y][currentBoxZ] == currentState) {
-			smallBoxState[x][y][currentBoxZ] = !smallBoxState[x][y][currentBoxZ];
-			for (int actI = 0; actI < (int)smallBoxes[x][y][currentBoxZ].size(); actI++) {
-			    int index = smallBoxes[x][y][currentBoxZ][actI];
-			    glTranslateRotateCallList(index, modelListIndex.at(modelInd->at(index)) + layerLOD[layerCounter]);
-			}
-		    }
+	// Draw Code
+	// Oberste Ebene... bis rum Rand
+	for (int x = currentBoxX; x >= 0 && x < gridSize; x += startBox_DeltaX) {
+	    for (int y = currentBoxY; y >= 0 && y < gridSize; y += startBox_DeltaY) {
+		if (gridState[gridBox(x, y, currentBoxZ)] == currentState) {
+		    gridState[gridBox(x, y, currentBoxZ)] = !gridState[gridBox(x, y, currentBoxZ)];
+		    drawGridBox(x, y, currentBoxZ);
 		}
 	    }
 	}
 	
-	if (renderSet_UseOcclusionTest && renderSet_occlusionExtensionSupported && layerCounter >= (int)smallBoxes.size() / renderSet_occlusionLayerStartFactor) {
-	    GLuint queries[smallBoxes.size() * smallBoxes.size()];
-	    
-	    glGenQueriesARB((smallBoxes.size() - layerCounter) * (smallBoxes.size() - layerCounter), queries);
-	    int querLen = (smallBoxes.size() - layerCounter) * (smallBoxes.size() - layerCounter);
-	    glColorMask(false, false, false, false);
-	    glDepthMask(false);
-	    
-	    int count = 0;
+	if (renderSet_UseOcclusionTest && renderSet_occlusionExtensionSupported && layerCounter >= gridSize / renderSet_occlusionLayerStartFactor) {
+	    beginGridQueries();
 	    int y = currentBoxY;
-	    for (int x = currentBoxX; x >= 0 && x < (int)smallBoxes.size(); x += startBox_DeltaX) {
-		for (int z = currentBoxZ + startBox_DeltaZ; z >= 0 && z < (int)smallBoxes.size(); z += startBox_DeltaZ) {
-		    glBeginQueryARB(GL_SAMPLES_PASSED_ARB, queries[count]);
-		    // ========================================
-		    // ========================================
-		    // ========================================
-		    if (smallBoxes[x][y][z].size() > 0) {
-			glBegin(GL_TRIANGLES);
-			// left side
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			// right side
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			// front
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			// back
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			
-			// top
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			
-			// down
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glEnd();
-		    }
-		    // ========================================
-		    // ========================================
-		    // ========================================
-		    
-		    glEndQueryARB(GL_SAMPLES_PASSED_ARB);
-		    
-		    count++;
-		}
-	    }
-	    
-	    glFlush();
-	    
-	    glColorMask(true, true, true, true);
-	    glDepthMask(true);
-	    
-	    count = 0;
-	    GLuint samples;
-	    for (int x = currentBoxX; x >= 0 && x < (int)smallBoxes.size(); x += startBox_DeltaX) {
-		for (int z = currentBoxZ + startBox_DeltaZ; z >= 0 && z < (int)smallBoxes.size(); z += startBox_DeltaZ) {
-		    glGetQueryObjectuivARB(queries[count], GL_QUERY_RESULT_ARB, &samples);
-		    
-		    if ((int)samples < renderSet_minimumPixelsToDraw) {
+	    for (int x = currentBoxX; x >= 0 && x < gridSize; x += startBox_DeltaX) {
+		for (int z = currentBoxZ + startBox_DeltaZ; z >= 0 && z < gridSize; z += startBox_DeltaZ) {
+		    if (testGridBox(x, y, z)) {
 			// DONT DRAW!
-			smallBoxState[x][y][z] = !currentState;
-			countBlockedBoxes++;
-		    } else {
-			countNonBlockedBoxes++;
+			gridState[gridBox(x, y, z)] = !currentState;
 		    }
-		    
-		    count++;
 		}
 	    }
-	    
-	    glDeleteQueriesARB(querLen, queries);
+	    endGridQueries();
 	}
 	
-	if(drawAsSlice) {
-	    // Ein Streifen weniger
-	    for (int x = currentBoxX; x >= 0 && x < (int)smallBoxes.size(); x += startBox_DeltaX) {
-		for (int z = currentBoxZ + startBox_DeltaZ; z >= 0 && z < (int)smallBoxes.size(); z += startBox_DeltaZ) {
-		    if (smallBoxState[x][currentBoxY][z] == currentState) {
-			smallBoxState[x][currentBoxY][z] = !smallBoxState[x][currentBoxY][z];
-			for (int actI = 0; actI < (int)smallBoxes[x][currentBoxY][z].size(); actI++) {
-			    int index = smallBoxes[x][currentBoxY][z][actI];
-			    if(sliceXLow <= middle->at(index)->at(0) && sliceXHigh >= middle->at(index)->at(0)
-				&& sliceYLow <= middle->at(index)->at(1) && sliceYHigh >= middle->at(index)->at(1)
-				&& sliceZLow <= middle->at(index)->at(2) && sliceZHigh >= middle->at(index)->at(2)) {
-				
-				glTranslateRotateCallList(index, modelListIndex.at(modelInd->at(index)) + layerLOD[layerCounter]);
-			    }
-			}
-		    }
-		}
-	    }
-	} else {
-	    // Ein Streifen weniger
-	    for (int x = currentBoxX; x >= 0 && x < (int)smallBoxes.size(); x += startBox_DeltaX) {
-		for (int z = currentBoxZ + startBox_DeltaZ; z >= 0 && z < (int)smallBoxes.size(); z += startBox_DeltaZ) {
-		    if (smallBoxState[x][currentBoxY][z] == currentState) {
-			smallBoxState[x][currentBoxY][z] = !smallBoxState[x][currentBoxY][z];
-			for (int actI = 0; actI < (int)smallBoxes[x][currentBoxY][z].size(); actI++) {
-			    int index = smallBoxes[x][currentBoxY][z][actI];
-			    
-			    glTranslateRotateCallList(index, modelListIndex.at(modelInd->at(index)) + layerLOD[layerCounter]);
-			}
-		    }
+	// Ein Streifen weniger
+	for (int x = currentBoxX; x >= 0 && x < gridSize; x += startBox_DeltaX) {
+	    for (int z = currentBoxZ + startBox_DeltaZ; z >= 0 && z < gridSize; z += startBox_DeltaZ) {
+		if (gridState[gridBox(x, currentBoxY, z)] == currentState) {
+		    gridState[gridBox(x, currentBoxY, z)] = !gridState[gridBox(x, currentBoxY, z)];
+		    drawGridBox(x, currentBoxY, z);
 		}
 	    }
 	}
 	
-	if (renderSet_UseOcclusionTest && renderSet_occlusionExtensionSupported && layerCounter >= (int)smallBoxes.size() / renderSet_occlusionLayerStartFactor) {
-	    GLuint queries[smallBoxes.size() * smallBoxes.size()];
-	    
-	    glGenQueriesARB((smallBoxes.size() - layerCounter) * (smallBoxes.size() - layerCounter), queries);
-	    int querLen = (smallBoxes.size() - layerCounter) * (smallBoxes.size() - layerCounter);
-	    
-	    glColorMask(false, false, false, false);
-	    glDepthMask(false);
-	    
-	    int count = 0;
+	if (renderSet_UseOcclusionTest && renderSet_occlusionExtensionSupported && layerCounter >= gridSize / renderSet_occlusionLayerStartFactor) {
+	    beginGridQueries();
 	    int x = currentBoxX;
-	    for (int y = currentBoxY + startBox_DeltaY; y >= 0 && y < (int)smallBoxes.size(); y += startBox_DeltaY) {
-		for (int z = currentBoxZ + startBox_DeltaZ; z >= 0 && z < (int)smallBoxes.size(); z += startBox_DeltaZ) {
-		    glBeginQueryARB(GL_SAMPLES_PASSED_ARB, queries[count]);
-		    // ========================================
-		    // ========================================
-		    // ========================================
-		    if (smallBoxes[x][y][z].size() > 0) {
-			glBegin(GL_TRIANGLES);
-			// left side
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			// right side
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			// front
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			// back
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			
-			// top
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			
-			// down
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-			glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-			glEnd();
-		    }
-		    // ========================================
-		    // ========================================
-		    // ========================================
-		    
-		    glEndQueryARB(GL_SAMPLES_PASSED_ARB);
-		    
-		    count++;
-		}
-	    }
-	    
-	    glFlush();
-	    
-	    glColorMask(true, true, true, true);
-	    glDepthMask(true);
-	    
-	    count = 0;
-	    GLuint samples;
-	    for (int y = currentBoxY + startBox_DeltaY; y >= 0 && y < (int)smallBoxes.size(); y += startBox_DeltaY) {
-		for (int z = currentBoxZ + startBox_DeltaZ; z >= 0 && z < (int)smallBoxes.size(); z += startBox_DeltaZ) {
-		    glGetQueryObjectuivARB(queries[count], GL_QUERY_RESULT_ARB, &samples);
-		    
-		    if ((int)samples < renderSet_minimumPixelsToDraw) {
+	    for (int y = currentBoxY + startBox_DeltaY; y >= 0 && y < gridSize; y += startBox_DeltaY) {
+		for (int z = currentBoxZ + startBox_DeltaZ; z >= 0 && z < gridSize; z += startBox_DeltaZ) {
+		    if (testGridBox(x, y, z)) {
 			// DONT DRAW!
-			smallBoxState[x][y][z] = !currentState;
-			countBlockedBoxes++;
-		    } else {
-			countNonBlockedBoxes++;
-		    }
-		    
-		    count++;
-		}
-	    }
-	    
-	    glDeleteQueriesARB(querLen, queries);
-	}
-	
-	if(drawAsSlice) {
-	    // Zwei Streifen weniger
-	    for (int y = currentBoxY + startBox_DeltaY; y >= 0 && y < (int)smallBoxes.size(); y += startBox_DeltaY) {
-		for (int z = currentBoxZ + startBox_DeltaZ; z >= 0 && z < (int)smallBoxes.size(); z += startBox_DeltaZ) {
-		    if (smallBoxState[currentBoxX][y][z] == currentState) {
-			smallBoxState[currentBoxX][y][z] = !smallBoxState[currentBoxX][y][z];
-			for (int actI = 0; actI < (int)smallBoxes[currentBoxX][y][z].size(); actI++) {
-			    int index = smallBoxes[currentBoxX][y][z][actI];
-			    if(sliceXLow <= middle->at(index)->at(0) && sliceXHigh >= middle->at(index)->at(0)
-				&& sliceYLow <= middle->at(index)->at(1) && sliceYHigh >= middle->at(index)->at(1)
-				&& sliceZLow <= middle->at(index)->at(2) && sliceZHigh >= middle->at(index)->at(2)) {
-				
-				glTranslateRotateCallList(index, modelListIndex.at(modelInd->at(index)) + layerLOD[layerCounter]);
-			    }
-			}
+			gridState[gridBox(x, y, z)] = !currentState;
 		    }
 		}
 	    }
-	} else {
-	    // Zwei Streifen weniger
-	    for (int y = currentBoxY + startBox_DeltaY; y >= 0 && y < (int)smallBoxes.size(); y += startBox_DeltaY) {
-		for (int z = currentBoxZ + startBox_DeltaZ; z >= 0 && z < (int)smallBoxes.size(); z += startBox_DeltaZ) {
-		    if (smallBoxState[currentBoxX][y][z] == currentState) {
-			smallBoxState[currentBoxX][y][z] = !smallBoxState[currentBoxX][y][z];
-			for (int actI = 0; actI < (int)smallBoxes[currentBoxX][y][z].size(); actI++) {
-			    int index = smallBoxes[currentBoxX][y][z][actI];
-			    
-			    glTranslateRotateCallList(index, modelListIndex.at(modelInd->at(index)) + layerLOD[layerCounter]);
-			}
-		    }
+	    endGridQueries();
+	}
+	
+	// Zwei Streifen weniger
+	for (int y = currentBoxY + startBox_DeltaY; y >= 0 && y < gridSize; y += startBox_DeltaY) {
+	    for (int z = currentBoxZ + startBox_DeltaZ; z >= 0 && z < gridSize; z += startBox_DeltaZ) {
+		if (gridState[gridBox(currentBoxX, y, z)] == currentState) {
+		    gridState[gridBox(currentBoxX, y, z)] = !gridState[gridBox(currentBoxX, y, z)];
+		    drawGridBox(currentBoxX, y, z);
 		}
 	    }
 	}
@@ -4169,6 +5174,448 @@ void Renderer::renderFromCorner() {
  * 
  */
 
+/*!
+ *  Sends the 12 triangles of a bounding box, between glBegin(GL_TRIANGLES) and glEnd.
+ *
+ *  \param c the 6 coordinates of the box (BOX_COORD_...)
+ */
+void Renderer::boxTriangles(const float *c) {
+    // left side
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_LOW]);
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_HIGH]);
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_LOW]);
+    
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_LOW]);
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_HIGH]);
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_HIGH]);
+    
+    // right side
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_LOW]);
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_LOW]);
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_HIGH]);
+    
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_LOW]);
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_HIGH]);
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_HIGH]);
+    
+    // front
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_HIGH]);
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_HIGH]);
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_HIGH]);
+    
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_HIGH]);
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_HIGH]);
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_HIGH]);
+    
+    // back
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_LOW]);
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_LOW]);
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_LOW]);
+    
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_LOW]);
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_LOW]);
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_LOW]);
+    
+    // top
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_LOW]);
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_HIGH]);
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_HIGH]);
+    
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_LOW]);
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_HIGH]);
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_HIGH], c[BOX_COORD_Z_LOW]);
+    
+    // down
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_LOW]);
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_HIGH]);
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_HIGH]);
+    
+    glVertex3f(c[BOX_COORD_X_LOW], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_LOW]);
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_LOW]);
+    glVertex3f(c[BOX_COORD_X_HIGH], c[BOX_COORD_Y_LOW], c[BOX_COORD_Z_HIGH]);
+}
+
+/*!
+ *  Starts testing grid boxes against the depth buffer. Creates the occlusion queries,
+ *  one per grid box or octree node, if the grid has changed, and disables color and
+ *  depth writes.
+ */
+void Renderer::beginGridQueries() {
+    int boxes = octree.empty() ? gridCells : (int)octree.size();
+    if ((int)gridQueries.size() != boxes) {
+	if (!gridQueries.empty()) {
+	    glDeleteQueriesARB(gridQueries.size(), &gridQueries[0]);
+	}
+	gridQueries.resize(boxes);
+	glGenQueriesARB(boxes, &gridQueries[0]);
+	gridQueryFrame.assign(boxes, -1);
+	gridTestFrame.assign(boxes, -1);
+	gridOccluded.assign(boxes, false);
+	gridQueryView.assign(boxes, -1);
+	gridResultView.assign(boxes, -1);
+    }
+    glColorMask(false, false, false, false);
+    glDepthMask(false);
+}
+
+/*!
+ *  Restores color and depth writes after testing grid boxes.
+ */
+void Renderer::endGridQueries() {
+    glColorMask(true, true, true, true);
+    glDepthMask(true);
+}
+
+// 0 if the box is out of the frustum given by its planes, 2 if it is completely inside, 1 else
+static int frustumTest(const float planes[6][4], const float *bounds) {
+    int result = 2;
+    for (int p = 0; p < 6; p++) {
+	// the corners farthest along and against the plane normal
+	float along = planes[p][3];
+	float against = planes[p][3];
+	for (int c = 0; c < 3; c++) {
+	    bool positive = (planes[p][c] > 0);
+	    along += planes[p][c] * bounds[2*c + (positive ? 1 : 0)];
+	    against += planes[p][c] * bounds[2*c + (positive ? 0 : 1)];
+	}
+	if (along < 0) {
+	    return 0;
+	}
+	if (against < 0) {
+	    result = 1;
+	}
+    }
+    return result;
+}
+
+/*!
+ *  Tests the bounding boxes of the grid boxes against the view frustum of the current
+ *  projection and modelview matrix, which is the frustum of the tile while a snapshot
+ *  is rendered in tiles. Empty grid boxes count as visible. The octree is tested from
+ *  the root down, nodes completely in or out of view decide for all their leaves.
+ */
+void Renderer::updateGridVisibility() {
+    const int boxes = gridCells;
+    GLfloat projection[16], modelview[16], m[16];
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+    for (int i = 0; i < 4; i++) { // column major
+	for (int j = 0; j < 4; j++) {
+	    m[4*j+i] = 0;
+	    for (int k = 0; k < 4; k++) {
+		m[4*j+i] += projection[4*k+i] * modelview[4*j+k];
+	    }
+	}
+    }
+    // the planes of the clip volume, -w <= x, y, z <= w, pointing inwards, widened
+    // in x and y by the line width, as wide lines reach out of their bounding box
+    GLint viewport[4];
+    GLfloat lineWidth;
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetFloatv(GL_LINE_WIDTH, &lineWidth);
+    float margin[3] = { 1 + lineWidth / max(viewport[2], 1), 1 + lineWidth / max(viewport[3], 1), 1 };
+    float planes[6][4];
+    for (int r = 0; r < 3; r++) {
+	for (int c = 0; c < 4; c++) {
+	    planes[2*r][c] = margin[r] * m[4*c+3] + m[4*c+r];
+	    planes[2*r+1][c] = margin[r] * m[4*c+3] - m[4*c+r];
+	}
+    }
+    
+    gridVisible.resize(boxes);
+    int culled = 0;
+    if (!octree.empty()) {
+	octreeVisible.resize(octree.size());
+	vector<int> stack(1, 0);
+	while (!stack.empty()) {
+	    int node = stack.back();
+	    stack.pop_back();
+	    const OctreeNode &n = octree[node];
+	    int visible = frustumTest(planes, n.bounds);
+	    octreeVisible[node] = visible;
+	    if (visible == 1 && n.children > 0) {
+		for (int child = n.firstChild; child < n.firstChild + n.children; child++) {
+		    stack.push_back(child);
+		}
+	    } else {
+		fill(gridVisible.begin() + n.firstCell, gridVisible.begin() + n.endCell, visible != 0);
+		if (visible == 0) {
+		    culled += n.endCell - n.firstCell;
+		}
+	    }
+	}
+    } else {
+	#pragma omp parallel for schedule(static) reduction(+:culled)
+	for (int b = 0; b < boxes; b++) {
+	    bool visible = (gridOffset[b + 1] == gridOffset[b] || frustumTest(planes, &gridBounds[6 * b]) != 0);
+	    gridVisible[b] = visible;
+	    if (!visible) {
+		culled++;
+	    }
+	}
+    }
+    culledGridBoxes += culled;
+}
+
+/*!
+ *  Starts a new view for the occlusion results if the modelview or the projection
+ *  matrix has changed since the last frame drawn optimized, see testOcclusion().
+ */
+void Renderer::updateOcclusionView() {
+    GLfloat matrices[32];
+    glGetFloatv(GL_MODELVIEW_MATRIX, matrices);
+    glGetFloatv(GL_PROJECTION_MATRIX, matrices + 16);
+    if (!equal(matrices, matrices + 32, occlusionMatrices)) {
+	copy(matrices, matrices + 32, occlusionMatrices);
+	occlusionView++;
+    }
+    occlusionPending = false;
+}
+
+/*!
+ *  Decides whether a box is hidden, from the query issued for it in an earlier frame.
+ *  The result is only read if it is available, so the CPU never waits for the GPU; until
+ *  then the last result is kept. A new query is issued when the box has none pending.
+ *  Boxes that were not tested in the last frame have no usable result and are drawn.
+ *  A box skipped on a result of an earlier view sets occlusionPending, so the frame is
+ *  drawn again until every hidden box is confirmed in the current view. Snapshots are
+ *  drawn in tiles with their own projections and test nothing.
+ *  Between beginGridQueries() and endGridQueries() only.
+ *
+ *  \param q the query of the box, the grid box or the octree node
+ *  \param bounds the 6 coordinates of the box (BOX_COORD_...)
+ *  \return true if the box is occluded and need not be drawn
+ */
+bool Renderer::testOcclusion(int q, const float *bounds) {
+    if (offScreen) {
+	return false;
+    }
+    if (gridTestFrame[q] != occlusionFrame - 1) {
+	gridOccluded[q] = false;
+    }
+    if (gridQueryFrame[q] >= 0) {
+	GLuint available;
+	glGetQueryObjectuivARB(gridQueries[q], GL_QUERY_RESULT_AVAILABLE_ARB, &available);
+	if (available) {
+	    GLuint samples;
+	    glGetQueryObjectuivARB(gridQueries[q], GL_QUERY_RESULT_ARB, &samples);
+	    if (gridTestFrame[q] == occlusionFrame - 1) {
+		gridOccluded[q] = ((int)samples < renderSet_minimumPixelsToDraw);
+		gridResultView[q] = gridQueryView[q];
+	    }
+	    gridQueryFrame[q] = -1;
+	}
+    }
+    if (gridQueryFrame[q] < 0) {
+	glBeginQueryARB(GL_SAMPLES_PASSED_ARB, gridQueries[q]);
+	glBegin(GL_TRIANGLES);
+	boxTriangles(bounds);
+	glEnd();
+	glEndQueryARB(GL_SAMPLES_PASSED_ARB);
+	gridQueryFrame[q] = occlusionFrame;
+	gridQueryView[q] = occlusionView;
+    }
+    gridTestFrame[q] = occlusionFrame;
+    if (gridOccluded[q] && gridResultView[q] != occlusionView) {
+	occlusionPending = true;
+    }
+    return gridOccluded[q];
+}
+
+/*!
+ *  Decides whether a grid box in view is hidden, see testOcclusion().
+ *
+ *  \param x, y, z the grid box
+ *  \return true if the box is occluded and need not be drawn
+ */
+bool Renderer::testGridBox(int x, int y, int z) {
+    int b = gridBox(x, y, z);
+    if (gridOffset[b + 1] == gridOffset[b] || !gridVisible[b]) {
+	return false;
+    }
+    if (testOcclusion(b, &gridBounds[6 * b])) {
+	culledGridBoxes++;
+	return true;
+    }
+    return false;
+}
+
+// eye z of the nearest and of the farthest corner of a box, the view is along -z
+static void depthRange(const float *modelview, const float *bounds, float &nearest, float &farthest) {
+    nearest = modelview[14];
+    farthest = modelview[14];
+    for (int c = 0; c < 3; c++) {
+	float low = modelview[4*c+2] * bounds[2*c];
+	float high = modelview[4*c+2] * bounds[2*c+1];
+	nearest += max(low, high);
+	farthest += min(low, high);
+    }
+}
+
+/*!
+ *  Sets the LOD of the grid boxes in view for this frame, from the size of their models
+ *  on the screen. A level with n segments around the model deviates from it by
+ *  r (1 - cos(pi / n)), every box gets the coarsest level that stays within lodTolerance
+ *  pixels. The view is orthographic, so the size on the screen does not change with the
+ *  depth; the tolerance grows to twice its value from the front to the back of the models
+ *  instead, so the near models keep their detail while the far ones degrade first.
+ */
+void Renderer::updateGridLOD() {
+    //cout << "Renderer::updateGridLOD() beg" << endl;
+    gridLOD.assign(gridCells, 0);
+    if (!renderSet_UseAutoLOD || renderSet_RenderAsLines) {
+	return;
+    }
+    
+    GLfloat projection[16], modelview[16];
+    GLint viewport[4];
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    lodPixelsPerUnit = fabs(projection[5]) * viewport[3] / 2;
+    
+    // snapshots are drawn with the finest tolerance
+    lodFrameTolerance = offScreen ? LOD_MIN_TOLERANCE : lodTolerance;
+    lodError.resize(modelLevels);
+    for (int lev = 0; lev < modelLevels; lev++) {
+	int segments = (modelLevels > 1) ? (int) (modelXComplexity_max + lev * ((modelXComplexity_min - modelXComplexity_max) / (modelLevels - 1.0))) : modelXComplexity_max;
+	lodError[lev] = 1 - cos(M_PI / max(segments, 3));
+    }
+    
+    // the depth range of all models, not only of those in view, so it does not change with panning
+    bool first = true;
+    for (int b = 0; b < gridCells; b++) {
+	if (gridOffset[b + 1] == gridOffset[b]) {
+	    continue;
+	}
+	float nearest, farthest;
+	depthRange(modelview, &gridBounds[6 * b], nearest, farthest);
+	lodNearDepth = first ? nearest : max(lodNearDepth, nearest);
+	lodFarDepth = first ? farthest : min(lodFarDepth, farthest);
+	first = false;
+    }
+    
+    // the range of tolerances that changes anything in view, so the tolerance does not run
+    // away while all boxes are at the finest or at the coarsest level
+    lodFinestTolerance = LOD_MAX_TOLERANCE;
+    lodCoarsestTolerance = 0.0f;
+    for (int b = 0; b < gridCells; b++) {
+	if (gridVisible[b] && gridOffset[b + 1] > gridOffset[b]) {
+	    float nearest, farthest;
+	    depthRange(modelview, &gridBounds[6 * b], nearest, farthest);
+	    gridLOD[b] = modelLOD(gridModelSize[b], nearest);
+	    if (modelLevels > 1) {
+		float radius = lodRadius(gridModelSize[b], nearest);
+		lodFinestTolerance = min(lodFinestTolerance, radius * lodError[1]);
+		lodCoarsestTolerance = max(lodCoarsestTolerance, radius * lodError[modelLevels - 1]);
+	    }
+	}
+    }
+    //cout << "Renderer::updateGridLOD() end" << endl;
+}
+
+/*!
+ *  The radius in pixels of models up to a size at a depth, shrunk towards the back of the
+ *  models as the tolerance grows there, see updateGridLOD().
+ *
+ *  \param size largest model
+ *  \param depth eye z of the models
+ */
+float Renderer::lodRadius(float size, float depth) const {
+    float back = (lodNearDepth > lodFarDepth) ? (lodNearDepth - depth) / (lodNearDepth - lodFarDepth) : 0;
+    return size * lodPixelsPerUnit / (1 + min(max(back, 0.0f), 1.0f));
+}
+
+/*!
+ *  The LOD of models up to a size at a depth, see updateGridLOD().
+ *
+ *  \param size largest model
+ *  \param depth eye z of the models
+ *  \return the coarsest level that is good enough
+ */
+int Renderer::modelLOD(float size, float depth) const {
+    if (!renderSet_UseAutoLOD || renderSet_RenderAsLines) {
+	return 0;
+    }
+    float radius = lodRadius(size, depth);
+    int lod = modelLevels - 1;
+    while (lod > 0 && radius * lodError[lod] > lodFrameTolerance) {
+	lod--;
+    }
+    return lod;
+}
+
+/*!
+ *  Draws the octree front to back. Nodes out of view are skipped with all their leaves,
+ *  the others are tested for occlusion if the test is on, see testOcclusion(). A node
+ *  in view, whose models all get the same LOD at its front and its back, is drawn with
+ *  one call per model type, unless its children are to be tested for occlusion.
+ */
+void Renderer::renderOctree() {
+    //cout << "Renderer::renderOctree() beg" << endl;
+    if (octreeVisible[0] == 0) {
+	return;
+    }
+    bool occlusion = renderSet_UseOcclusionTest && renderSet_occlusionExtensionSupported && !offScreen;
+    GLfloat modelview[16];
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+    
+    // the entries are 2 * node, plus 1 if the node is completely in view
+    vector<int> stack(1, (octreeVisible[0] == 2) ? 1 : 0);
+    while (!stack.empty()) {
+	int node = stack.back() / 2;
+	bool inside = (stack.back() % 2 == 1);
+	stack.pop_back();
+	const OctreeNode &n = octree[node];
+	
+	if (occlusion && node != 0) {
+	    beginGridQueries();
+	    bool hidden = testOcclusion(node, n.bounds);
+	    endGridQueries();
+	    if (hidden) {
+		culledGridBoxes += n.endCell - n.firstCell;
+		continue;
+	    }
+	}
+	
+	if (n.children == 0) {
+	    drawGridCells(n.firstCell, n.endCell, gridLOD[n.firstCell]);
+	    continue;
+	}
+	if (inside && !occlusion) {
+	    float nearest, farthest;
+	    depthRange(modelview, n.bounds, nearest, farthest);
+	    int lod = modelLOD(n.modelSize, nearest);
+	    if (lod == modelLOD(n.modelSize, farthest)) {
+		drawGridCells(n.firstCell, n.endCell, lod);
+		continue;
+	    }
+	}
+	
+	// the children in view, sorted back to front, so the nearest one is drawn next
+	int children[8];
+	float depth[8];
+	int count = 0;
+	for (int child = n.firstChild; child < n.firstChild + n.children; child++) {
+	    int visible = inside ? 2 : octreeVisible[child];
+	    if (visible == 0) {
+		continue;
+	    }
+	    const float *b = octree[child].bounds;
+	    float z = modelview[2] * (b[0] + b[1]) + modelview[6] * (b[2] + b[3]) + modelview[10] * (b[4] + b[5]);
+	    int k = count++;
+	    for (; k > 0 && depth[k-1] > z; k--) {
+		children[k] = children[k-1];
+		depth[k] = depth[k-1];
+	    }
+	    children[k] = 2 * child + ((visible == 2) ? 1 : 0);
+	    depth[k] = z;
+	}
+	stack.insert(stack.end(), children, children + count);
+    }
+    //cout << "Renderer::renderOctree() end" << endl;
+}
+
 /*!
  *	Used for debugging purposes, to show the created sub-boxes.
  *
@@ -4177,65 +5624,9 @@ void Renderer::renderFromCorner() {
 void Renderer::renderSubBoundingBoxes() {
     //cout << "Renderer::renderSubBoundingBoxes() beg" << endl;    
     glBegin(GL_TRIANGLES);
-    for (int x = 0; x < (int)smallBoxes.size(); x++) {
-	for (int y = 0; y < (int)smallBoxes.size(); y++) {
-	    for (int z = 0; z < (int)smallBoxes.size(); z++) {
-		if (smallBoxes[x][y][z].size() > 0) {
-		    // left side
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    
-		    // right side
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    
-		    // front
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    
-		    // back
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    
-		    // top
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    
-		    // down
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		    
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_LOW], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_LOW]);
-		    glVertex3f(smallBoxCoords[x][y][z][BOX_COORD_X_HIGH], smallBoxCoords[x][y][z][BOX_COORD_Y_LOW], smallBoxCoords[x][y][z][BOX_COORD_Z_HIGH]);
-		}
-	    }
+    for (int b = 0; b < gridCells; b++) {
+	if (gridOffset[b + 1] > gridOffset[b]) {
+	    boxTriangles(&gridBounds[6 * b]);
 	}
     }
     glEnd();
@@ -4248,6 +5639,8 @@ void Renderer::setModels(vector<vector<float>*> *mittelpunkte, vector<vector<flo
     rot = rotation;
     color = col;
     modelInd = modelNr;
+    drawMaskValid = false;
+    occlusionView++;
     //cout << "modelInd->size() " << modelInd->size() << endl;
     calculateBoundingBox(sizeX,sizeY,sizeZ);
     createGridBoxes(renderSet_BoxCount);
@@ -4569,6 +5962,104 @@ void Renderer::setDrawBoundingBox(bool t) {
     //cout << "Renderer::setDrawBoundingBox() end" << endl;    
 }
 
+/*!
+ *  Switches drawing of the defect lines on and off.
+ *
+ *  \param t true to draw the defect lines
+ */
+void Renderer::setDrawDefects(bool t) {
+    //cout << "Renderer::setDrawDefects() beg" << endl;    
+    drawDefects = t;
+    repaint();
+    //cout << "Renderer::setDrawDefects() end" << endl;    
+}
+
+/*!
+ *  Switches drawing of the molecules on and off.
+ *
+ *  \param t true to draw the molecules
+ */
+void Renderer::setDrawModels(bool t) {
+    //cout << "Renderer::setDrawModels() beg" << endl;    
+    drawModels = t;
+    repaint();
+    //cout << "Renderer::setDrawModels() end" << endl;    
+}
+
+/*!
+ *  Sets the defect lines, the tubes are rebuilt with the next frame.
+ *
+ *  \param lines polylines, xyz interleaved
+ *  \param radius radius of the tubes
+ */
+void Renderer::setDefectLines(const vector<vector<float> > &lines, float radius) {
+    //cout << "Renderer::setDefectLines() beg" << endl;    
+    defectLines = lines;
+    defectRadius = radius;
+    recreateDefects = true;
+    //cout << "Renderer::setDefectLines() end" << endl;    
+}
+
+/*!
+ *  Switches between the isosurface and the molecules.
+ *
+ *  \param t true to draw the isosurface instead of the molecules
+ */
+void Renderer::setDrawSurface(bool t) {
+    //cout << "Renderer::setDrawSurface() beg" << endl;    
+    drawSurface = t;
+    repaint();
+    //cout << "Renderer::setDrawSurface() end" << endl;    
+}
+
+/*!
+ *  Switches drawing of the orientation distribution sphere on and off.
+ *
+ *  \param t true to draw the sphere
+ */
+void Renderer::setDrawOrientationGlyph(bool t) {
+    //cout << "Renderer::setDrawOrientationGlyph() beg" << endl;    
+    drawOrientationGlyph = t;
+    repaint();
+    //cout << "Renderer::setDrawOrientationGlyph() end" << endl;    
+}
+
+/*!
+ *  Sets the colors of the orientation distribution sphere, the display list is rebuilt
+ *  with the next frame. The cells are bands of equal height in z times sectors of
+ *  equal width in phi (starting at phi = -180 degrees).
+ *
+ *  \param colors rgb per cell, band major
+ *  \param bands number of bands
+ *  \param sectors number of sectors
+ */
+void Renderer::setOrientationGlyph(const vector<float> &colors, int bands, int sectors) {
+    //cout << "Renderer::setOrientationGlyph() beg" << endl;    
+    if((int)colors.size() != 3 * bands * sectors) {
+	cerr << "Error: Renderer::setOrientationGlyph: " << colors.size() << " colors for " << bands*sectors << " cells" << endl;
+	return;
+    }
+    glyphColors = colors;
+    glyphBands = bands;
+    glyphSectors = sectors;
+    recreateGlyph = true;
+    //cout << "Renderer::setOrientationGlyph() end" << endl;    
+}
+
+/*!
+ *  Sets the triangles of the isosurface, the display list is rebuilt with the next frame.
+ *
+ *  \param vertices three vertices per triangle, xyz interleaved
+ *  \param normals one normal per vertex, xyz interleaved
+ */
+void Renderer::setSurface(const vector<float> &vertices, const vector<float> &normals) {
+    //cout << "Renderer::setSurface() beg" << endl;    
+    surfaceVertices = vertices;
+    surfaceNormals = normals;
+    recreateSurface = true;
+    //cout << "Renderer::setSurface() end" << endl;    
+}
+
 /*!
  *
  *
@@ -4737,9 +6228,125 @@ void Renderer::setSliceBounds(float x_lo, float x_hi, float y_lo, float y_hi, fl
     sliceYHigh = y_hi;
     sliceZLow = z_lo;
     sliceZHigh = z_hi;
+    sliceFractional = false;
+    drawMaskValid = false;
     //cout << "Renderer::setSliceBounds() end" << endl;
 }
 
+/*!
+ *  Sets the slices as fractions of the box vectors (-0.5 to 0.5 is the whole box).
+ *  They are used instead of the cartesian slice bounds as long as the box matrix is known,
+ *  so slices of triclinic boxes are parallel to the box faces.
+ *
+ *  \param a_lo, a_hi, b_lo, b_hi, c_lo, c_hi the bounds along the three box vectors
+ */
+void Renderer::setSliceFractions(float a_lo, float a_hi, float b_lo, float b_hi, float c_lo, float c_hi) {
+    sliceFractions[0] = a_lo;
+    sliceFractions[1] = a_hi;
+    sliceFractions[2] = b_lo;
+    sliceFractions[3] = b_hi;
+    sliceFractions[4] = c_lo;
+    sliceFractions[5] = c_hi;
+    sliceFractional = true;
+    drawMaskValid = false;
+}
+
+/*!
+ *  Checks a position against the current slices.
+ *
+ *  \param x, y, z the position (as drawn, i.e. including the translation)
+ *  \return true if the position is inside the slices
+ */
+bool Renderer::isInsideSlice(float x, float y, float z) const {
+    if (sliceFractional && fractionalBox) {
+	float s[3];
+	toBoxFractions(x, y, z, s);
+	return (sliceFractions[0] <= s[0] && sliceFractions[1] >= s[0]
+		&& sliceFractions[2] <= s[1] && sliceFractions[3] >= s[1]
+		&& sliceFractions[4] <= s[2] && sliceFractions[5] >= s[2]);
+    }
+    return (sliceXLow <= x && sliceXHigh >= x
+	    && sliceYLow <= y && sliceYHigh >= y
+	    && sliceZLow <= z && sliceZHigh >= z);
+}
+
+/*!
+ *  Returns the six clip planes (for glClipPlane) of the current slices.
+ *
+ *  \param planes the planes, pairwise low and high bound along x (a), y (b), z (c)
+ */
+void Renderer::getSliceClipPlanes(GLdouble planes[6][4]) const {
+    for (int d = 0; d < 3; d++) {
+	if (sliceFractional && fractionalBox) {
+	    // s_d = inverse_d . (r - origin), keep lo <= s_d <= hi
+	    double shift = inverseBoxMatrix[d][0]*boxOrigin[0] + inverseBoxMatrix[d][1]*boxOrigin[1] + inverseBoxMatrix[d][2]*boxOrigin[2];
+	    for (int j = 0; j < 3; j++) {
+		planes[2*d][j] = inverseBoxMatrix[d][j];
+		planes[2*d+1][j] = -inverseBoxMatrix[d][j];
+	    }
+	    planes[2*d][3] = -shift - sliceFractions[2*d];
+	    planes[2*d+1][3] = shift + sliceFractions[2*d+1];
+	} else {
+	    float lo = d == 0 ? sliceXLow : (d == 1 ? sliceYLow : sliceZLow);
+	    float hi = d == 0 ? sliceXHigh : (d == 1 ? sliceYHigh : sliceZHigh);
+	    for (int j = 0; j < 3; j++) {
+		planes[2*d][j] = (j == d) ? 1 : 0;
+		planes[2*d+1][j] = (j == d) ? -1 : 0;
+	    }
+	    planes[2*d][3] = -lo;
+	    planes[2*d+1][3] = hi;
+	}
+    }
+}
+
+/*!
+ *  Sets the periodic box. The grid boxes and the slices are then built in
+ *  fractional coordinates, which keeps the cells of triclinic boxes as well
+ *  filled as those of rectangular ones. Has to be called before setModels().
+ *
+ *  \param matrix the box vectors in rows (see mga::CnfFile::getBoundingBoxMatrix())
+ *  \param originX, originY, originZ the center of the box (e.g. the translation)
+ */
+void Renderer::setBoxMatrix(const vector<vector<float> > &matrix, float originX, float originY, float originZ) {
+    fractionalBox = mga::invertBoundingBox(matrix, boxMatrix, inverseBoxMatrix);
+    boxOrigin[0] = originX;
+    boxOrigin[1] = originY;
+    boxOrigin[2] = originZ;
+    drawMaskValid = false;
+}
+
+/*!
+ *  Converts a position to fractional coordinates of the box (the box is -0.5 to 0.5).
+ */
+inline void Renderer::toBoxFractions(float x, float y, float z, float *s) const {
+    x -= boxOrigin[0];
+    y -= boxOrigin[1];
+    z -= boxOrigin[2];
+    for (int d = 0; d < 3; d++) {
+	s[d] = inverseBoxMatrix[d][0]*x + inverseBoxMatrix[d][1]*y + inverseBoxMatrix[d][2]*z;
+    }
+}
+
+/*!
+ *  Returns a corner of the range covered by the grid boxes.
+ *
+ *  \param i, j, k -1 for the low, 1 for the high corner along each axis (box vector)
+ */
+void Renderer::getGridCorner(int i, int j, int k, float &x, float &y, float &z) const {
+    float s[3] = { gridRange[i == -1 ? BOX_COORD_X_LOW : BOX_COORD_X_HIGH],
+		   gridRange[j == -1 ? BOX_COORD_Y_LOW : BOX_COORD_Y_HIGH],
+		   gridRange[k == -1 ? BOX_COORD_Z_LOW : BOX_COORD_Z_HIGH] };
+    if (!fractionalBox) {
+	x = s[0];
+	y = s[1];
+	z = s[2];
+	return;
+    }
+    x = boxOrigin[0] + boxMatrix[0][0]*s[0] + boxMatrix[0][1]*s[1] + boxMatrix[0][2]*s[2];
+    y = boxOrigin[1] + boxMatrix[1][0]*s[0] + boxMatrix[1][1]*s[1] + boxMatrix[1][2]*s[2];
+    z = boxOrigin[2] + boxMatrix[2][0]*s[0] + boxMatrix[2][1]*s[1] + boxMatrix[2][2]*s[2];
+}
+
 /*!
  *
  *
@@ -4750,6 +6357,7 @@ void Renderer::setSliceBounds(float x_lo, float x_hi, float y_lo, float y_hi, fl
 void Renderer::setDrawSlices(bool on) {
     //cout << "Renderer::setDrawSlices() beg" << endl;
     drawAsSlice = on;
+    drawMaskValid = false;
     repaint();
     //cout << "Renderer::setDrawSlices() end" << endl;
 }
@@ -4773,16 +6381,58 @@ void Renderer::setLOD(bool on) {
     //cout << "Renderer::setLOD() beg" << endl;
     renderSet_UseAutoLOD = on;
     if(!on) {
-	LODdelta = 0;
-	for(unsigned int i=0; i < layerLOD.size(); i++) {
-	    layerLOD.at(i) = 0;
-	}
+	lodTolerance = 0.5f;
     }
     
     repaint();
     //cout << "Renderer::setLOD() end" << endl;
 }
 
+/*!
+ *  Switches between instanced drawing and the display lists. Without the needed
+ *  extensions the display lists are always used.
+ *
+ *  \param on true to draw all models of a type with one instanced call
+ */
+void Renderer::setInstancing(bool on) {
+    //cout << "Renderer::setInstancing() beg" << endl;
+    useInstancing = on;
+    instancesValid = false;
+    repaint();
+    //cout << "Renderer::setInstancing() end" << endl;
+}
+
+/*!
+ *  Switches between meshes and ray-cast impostors for the ellipsoids, spherocylinders
+ *  and spheroplatelets. Only used by the instanced drawing.
+ *
+ *  \param on true for impostors
+ */
+void Renderer::setImpostors(bool on) {
+    //cout << "Renderer::setImpostors() beg" << endl;
+    useImpostors = on;
+    repaint();
+    //cout << "Renderer::setImpostors() end" << endl;
+}
+
+/*!
+ *  Switches between the uniform grid and the octree for the optimized drawing and
+ *  the culling.
+ *
+ *  \param on true for the octree
+ */
+void Renderer::setOctree(bool on) {
+    //cout << "Renderer::setOctree() beg" << endl;
+    if (on != useOctree) {
+	useOctree = on;
+	if (middle != 0) {
+	    createGridBoxes(renderSet_BoxCount);
+	}
+    }
+    repaint();
+    //cout << "Renderer::setOctree() end" << endl;
+}
+
 /*!
  *
  *
@@ -4948,13 +6598,69 @@ void Renderer::setUseLOD(bool use) {
     //cout << "Renderer::setUseLOD() beg" << endl;
     renderSet_UseAutoLOD = use;
     if(!use) {
-	for (int i = 0; i < (int)layerLOD.size(); i++) {
-	    layerLOD.at(i) = 0;
-	}
+	lodTolerance = 0.5f;
     }
     //cout << "Renderer::setUseLOD() end" << endl;
 }
 
+/*!
+ *	Sets the time a frame may take, the auto LOD adjusts the detail of the models to it.
+ *
+ *  \param ms the frame time budget in millisecs
+ */
+void Renderer::setFrameTimeBudget(int ms) {
+    //cout << "Renderer::setFrameTimeBudget() beg" << endl;
+    renderSet_FrameTimeBudget = max(ms, 1);
+    //cout << "Renderer::setFrameTimeBudget() end" << endl;
+}
+
+void Renderer::setDrawTimings(bool on) {
+    //cout << "Renderer::setDrawTimings() beg" << endl;
+    drawTimings = on;
+    repaint();
+    //cout << "Renderer::setDrawTimings() end" << endl;
+}
+
+/*!
+ *	Starts logging the stage times of every frame drawn, as CSV with a header line, or as
+ *	one JSON object per line if the file name ends with .json. An empty name stops logging.
+ *	The times of the model types in the draw stage are a list separated by ';' in the CSV
+ *	(draw_types in JSON), left out if the types were drawn together.
+ *
+ *  \param fileName the log, it is overwritten
+ *  \return false if the log could not be opened
+ */
+bool Renderer::setTimingLog(const QString &fileName) {
+    //cout << "Renderer::setTimingLog() beg" << endl;
+    if (timingLog.is_open()) {
+	timingLog.close();
+    }
+    timingLog.clear();
+    if (fileName.isEmpty()) {
+	return true;
+    }
+    timingLog.open(fileName.ascii());
+    if (!timingLog) {
+	cerr << "Warning: cannot write the timing log " << fileName.ascii() << endl;
+	return false;
+    }
+    timingLogJson = fileName.endsWith(".json");
+    timingLog << fixed << setprecision(3);
+    if (!timingLogJson) {
+	timingLog << "frame";
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+	    timingLog << ",cpu_" << stageNames[stage];
+	}
+	timingLog << ",cpu_total,gpu_frame";
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+	    timingLog << ",gpu_" << stageNames[stage];
+	}
+	timingLog << ",gpu_total,cpu_draw_types,gpu_draw_types\n";
+    }
+    //cout << "Renderer::setTimingLog() end" << endl;
+    return true;
+}
+
 void Renderer::setBoxCount(int x) {
     //cout << "Renderer::setBoxCount() beg" << endl;
     renderSet_BoxCount = x;
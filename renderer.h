@@ -27,6 +27,9 @@ using namespace std;
 #include <qgl.h>
 
 #include <vector>
+#include <map>
+#include <string>
+#include <fstream>
 #include <sys/time.h>
 
 #include "tr/tr.h"
@@ -45,6 +48,25 @@ class MainForm;
 #define BOX_COORD_Z_LOW 4
 #define BOX_COORD_Z_HIGH 5
 #define CLK_MIL (CLOCKS_PER_SEC/1000)
+// generic vertex attributes of the instanced models, clear of the ones aliased by vertex, normal and color
+#define INSTANCE_ATTRIB_POSITION 5
+#define INSTANCE_ATTRIB_ROTATION 6
+#define INSTANCE_ATTRIB_COLOR 7
+
+// first line of the mesh cache file, raise the number whenever the tessellation changes
+#define MESH_CACHE_VERSION "qmga-meshes 1"
+// range of the error the auto LOD allows for the models, in pixels
+#define LOD_MIN_TOLERANCE 0.25f
+#define LOD_MAX_TOLERANCE 64.0f
+// stages of a frame, timed on the CPU and on the GPU
+#define STAGE_INPUT 0
+#define STAGE_CAMERA 1
+#define STAGE_MODELS 2
+#define STAGE_CULLING 3
+#define STAGE_DRAW 4
+#define STAGE_BOUNDINGBOX 5
+#define STAGE_OVERLAY 6
+#define STAGE_COUNT 7
 
 class Renderer : public QGLWidget
 {
@@ -63,6 +85,14 @@ public:
     void setDrawColorMap(bool t);
     void setDrawAxis(bool t);
     void setDrawBoundingBox(bool t);
+    void setDrawDefects(bool t);
+    void setDrawModels(bool t);
+    void setDefectLines(const vector<vector<float> > &lines, float radius);
+    void setDrawSurface(bool t);
+    void setSurface(const vector<float> &vertices, const vector<float> &normals);
+    void setModelMask(const vector<char> &mask);
+    void setDrawOrientationGlyph(bool t);
+    void setOrientationGlyph(const vector<float> &colors, int bands, int sectors);
     void setBoundingBox(float x, float y, float z, bool resetDistance);
     void setBoundingBox( vector<vector<float> > bbox, bool resetDistance );
     void setColorMap(vector <float *> *f);
@@ -79,11 +109,22 @@ public:
 	z_lo = sliceZLow;
 	z_hi = sliceZHigh;
     }
+    void setSliceFractions(float a_lo, float a_hi, float b_lo, float b_hi, float c_lo, float c_hi);
+    bool isInsideSlice(float x, float y, float z) const;
+    void updateDrawMask();
+    bool isDrawn(int objectIndex) const { return (drawMask.empty() || drawMask[objectIndex] != 0); }
+    void setBoxMatrix(const vector<vector<float> > &matrix, float originX, float originY, float originZ);
     void setDrawSlices(bool on);
     bool getDrawSlices() { return(drawAsSlice); }
     void setOptimized(bool on);
     void setLOD(bool on);
+    void setInstancing(bool on);
+    void setImpostors(bool on);
+    void setOctree(bool on);
     void setUseLOD(bool use);
+    void setFrameTimeBudget(int ms);
+    void setDrawTimings(bool on);
+    bool setTimingLog(const QString &fileName);
     void getSnapShot(int w, int h, QString pFileName, bool png, bool eps );
     
     vector<vector<float> > *getObjectParams() { return( &objectParams ); }
@@ -125,18 +166,43 @@ signals:
     void angleZChanged(int);
     void keyPress(int);
     void fpsUpdate(double);
+    void culledBoxesUpdate(int);
     void translate(vector<float>);
     
 private:
+    // a model as vertex and index buffers
+    struct ModelMesh {
+	ModelMesh() : triangleIndices(0), lineIndices(0), twoSided(false), vertexBuffer(0), indexBuffer(0) {}
+	vector<float> vertices; // position and normal interleaved, dropped after the upload
+	vector<GLuint> indices; // triangles first, then lines
+	int triangleIndices;
+	int lineIndices;
+	bool twoSided;
+	GLuint vertexBuffer;
+	GLuint indexBuffer;
+    };
+    
+    // a node of the octree, its leaves are the grid cells
+    struct OctreeNode {
+	float bounds[6]; // of the models below the node (BOX_COORD_...)
+	int firstCell; // the leaves below the node are the cells firstCell ... endCell - 1
+	int endCell;
+	int firstChild; // the children are firstChild ... firstChild + children - 1
+	int children; // 0 for a leaf
+	float modelSize; // largest model below the node
+    };
+    
 	vector<int> howManyDraw;
 	vector<int> howManyIndices;
 	vector<int> modelNArray;
 	vector<int> modelIArray;
 
     inline void glTranslateRotateCallList(int objectIndex, int glListIndex);
+    inline void glRotateQuaternion(const vector<float> &q);
     void calculateBoundingBox(float sizeX, float sizeY, float sizeZ);
     void renderFromSide();
     void renderFromCorner();
+    void renderOctree();
     void renderSubBoundingBoxes();
     void processInput(bool v);
     void calculateRotationMatrix();
@@ -145,9 +211,23 @@ private:
     void updateGuiF();
     void displayModels();
     void displayBoundingBox();
+    void displayDefects();
+    void displaySurface();
+    void displayOrientationGlyph();
     void processFPS(int x);
-    bool increaseLOD(int x);
-    bool decreaseLOD(int x);
+    void processFrameTime(float ms);
+    void beginFrameTimer();
+    void endFrameTimer();
+    void readFrameTimers();
+    void beginStages();
+    void endStage(int stage);
+    void beginTypeTimings();
+    void endTypeTiming();
+    void renderTimings();
+    void logTimings();
+    void updateGridLOD();
+    float lodRadius(float size, float depth) const;
+    int modelLOD(float size, float depth) const;
     void updateGuiF(bool force);
     inline void swap(int i, int j);
     void createModels1(int x);
@@ -166,8 +246,46 @@ private:
     float* normalizeV(float* b, float scaleX, float scaleY, float scaleZ);
     float* normalizeV(float* b, float scaleY);
     void createGridBoxes(int x);
+    void beginModelList(int index, int lod);
+    void endModelList();
+    void modelBegin(GLenum mode);
+    void modelEnd();
+    void modelNormal3fv(const float *n);
+    void modelVertex3fv(const float *v);
+    void modelVertex3f(float x, float y, float z);
+    void modelTwoSided(bool on);
+    void weldMesh(ModelMesh &mesh);
+    void uploadMesh(ModelMesh &mesh);
+    void deleteModelMeshes();
+    void deleteModelType(int index);
+    string modelMeshKey(int index) const;
+    bool loadModelType(int index, const string &key);
+    void storeModelType(int index, const string &key);
+    void compileModelList(int index, int lod);
+    void readMeshCache();
+    void writeMeshCache();
+    GLuint compileShader(GLenum type, const char *main);
+    GLuint createShaderProgram(const char *vertexMain, const char *fragmentMain);
+    bool createInstanceProgram();
+    void createImpostorProgram();
+    void updateInstances();
+    void beginInstances();
+    void drawInstances(int type, int lod, int first, int count);
+    void endInstances();
+    void drawGridBox(int x, int y, int z);
+    void drawGridCells(int first, int end, int lod);
+    int gridBox(int x, int y, int z) const { return ((x * gridSize + y) * gridSize + z); }
+    int gridBoxSize(int x, int y, int z) const { int b = gridBox(x, y, z); return (gridOffset[b + 1] - gridOffset[b]); }
+    void boxTriangles(const float *c);
+    int buildOctree(const vector<float> &coords, int leafModels, vector<int> &cell);
+    void splitOctreeNode(int node, const vector<unsigned int> &keys, const vector<int> &order, int first, int end, int levels, int leafModels, vector<int> &cell, int &cells);
+    void updateGridVisibility();
+    void updateOcclusionView();
+    void beginGridQueries();
+    bool testOcclusion(int q, const float *bounds);
+    bool testGridBox(int x, int y, int z);
+    void endGridQueries();
     void resetRotation();
-    time_t render_LastFrameStartTime;
     float render_RotationMatrix[16];
     
     bool renderSet_RenderAsLines;
@@ -184,6 +302,10 @@ private:
     bool drawAxis;
     bool drawBoundingBox;
     bool drawAsSlice;
+    bool drawDefects;
+    bool drawModels;
+    bool drawSurface;
+    bool drawOrientationGlyph;
     
     bool rendering;
     bool initialized;
@@ -213,21 +335,52 @@ private:
     float boundingBoxCoords[6];
     float maxBoundingDiff;
     
+    // periodic box, the grid and the slices work in fractional coordinates if it is known
+    bool fractionalBox;
+    double boxMatrix[3][3]; // box vectors in columns
+    double inverseBoxMatrix[3][3];
+    float boxOrigin[3]; // center of the box
+    float gridRange[6]; // range covered by the grid boxes, fractional if fractionalBox is set (BOX_COORD_* order)
+    void toBoxFractions(float x, float y, float z, float *s) const;
+    void getGridCorner(int i, int j, int k, float &x, float &y, float &z) const;
+    
     // Drawing BB
     float boundingBoxXDraw;
     float boundingBoxYDraw;
     float boundingBoxZDraw;
     bool freeBoundingBox;
     vector<vector<float> > boundingBoxCoordinates;
+    
+    // defect lines, drawn as tubes
+    vector<vector<float> > defectLines; // polylines, xyz interleaved
+    float defectRadius;
+    GLuint defectList; // display list with the tubes, 0 if not yet created
+    bool recreateDefects;
+    
+    // isosurface, drawn instead of the models
+    vector<float> surfaceVertices; // three vertices per triangle
+    vector<float> surfaceNormals;
+    GLuint surfaceList; // display list with the triangles, 0 if not yet created
+    bool recreateSurface;
+    
+    // orientation distribution, drawn as a colored sphere next to the axis
+    vector<float> glyphColors; // rgb per cell, band major
+    int glyphBands; // cells of equal height in z
+    int glyphSectors; // cells of equal width in phi
+    GLuint glyphList; // display list with the sphere, 0 if not yet created
+    bool recreateGlyph;
 
     // Used for marking gridboxes, which have to be drawn this frame  
     bool currentState;
     
     // data about the models
     vector<vector<float>*> *middle; // center
-    vector<vector<float>*> *rot; // rotation
+    vector<vector<float>*> *rot; // rotation, unit quaternion x, y, z, w
     vector<vector<float>*> *color; // color
     vector<int> *modelInd; // model type
+    vector<char> modelMask; // models with mask 0 are not drawn, empty to draw all
+    vector<char> drawMask; // slices and modelMask combined, empty to draw all
+    bool drawMaskValid;
     
     // lighting, axis, color stuff
     float axisColors[3][3];
@@ -240,6 +393,39 @@ private:
     vector<int> modelListIndex;
     // "line" model
     vector<int> modelListSimpleIndex;
+    // the same models as vertex and index buffers, recorded while the display lists are compiled
+    vector<vector<ModelMesh> > modelMeshes; // [model type][LOD], LOD modelLevels is the "line" model
+    vector<string> modelMeshKeys; // modelMeshKey the models of every type were created with, "" if none
+    // tessellated models by modelMeshKey and LOD, read from and written to meshCacheFile
+    map<string, ModelMesh> meshCache;
+    string meshCacheFile;
+    bool meshCacheRead;
+    bool meshCacheModified;
+    ModelMesh *recordMesh; // mesh recorded along with the current display list, 0 if none
+    vector<GLuint> recordTriangles;
+    vector<GLuint> recordLines;
+    GLenum recordMode;
+    int recordStart; // first vertex of the current primitive
+    float recordNormal[3];
+    // instanced drawing, all visible models of a type are drawn with one call
+    bool instancingSupported;
+    bool useInstancing;
+    GLuint instanceProgram;
+    GLint instanceLightingLocation;
+    GLuint instanceBuffer;
+    bool instancesValid;
+    vector<int> instanceFirst; // first instance of every model type and grid box, [type * boxes + box]
+    bool instanceLighting; // lighting state taken by beginInstances
+    GLuint activeProgram; // program bound between beginInstances and endInstances
+    // ray-cast impostors for ellipsoids, spherocylinders and spheroplatelets, drawn instead
+    // of the meshes by the instanced path
+    bool useImpostors;
+    GLuint impostorProgram;
+    GLint impostorLightingLocation;
+    GLint impostorShapeLocation;
+    GLint impostorSizeLocation;
+    GLint impostorExtentLocation;
+    ModelMesh impostorBox; // the cube [-1, 1]^3, scaled to the bounding box of the model
     // used to signal that we have to recreate the model, either because of a restart, or
     // because of a parameter change caused by the user
     bool recreateModel;
@@ -250,23 +436,83 @@ private:
     int modelYComplexity_min;
     int modelLevels; // how many LOD levels we have
     vector<vector<float> > objectParams;
-    vector<int> layerLOD; // different LOD layers
     // maximum Model Size
     float globalMaxModelSize;
     
     // shared array for different calculations  
     float speedArr[3];
     
-    // used if we have LOD enabled, but not in layers   
-    int LODdelta;
+    // auto LOD: the models of every grid box get the coarsest level whose tessellation error,
+    // projected to the screen, stays below lodTolerance. The tolerance follows the frame time.
+    float renderSet_FrameTimeBudget; // target time of a frame in ms
+    float lodTolerance; // allowed error of the tessellated models in pixels
+    float frameTime; // smoothed time of the last frames in ms
+    float gpuFrameTime; // time the GPU needed for the last frame read back, in ms
+    bool timerQuerySupported;
+    GLuint frameTimers[4]; // timer queries of the last frames, read back when available
+    bool frameTimerPending[4];
+    int frameTimer; // query used by this frame, -1 if all are still pending
+    int nextFrameTimer;
+    vector<char> gridLOD; // LOD of every grid box this frame
+    vector<float> gridModelSize; // largest model in every grid box
+    vector<float> lodError; // deviation of every level from the model, relative to its radius
+    float lodFrameTolerance; // tolerance used this frame
+    float lodFinestTolerance; // below, all grid boxes in view get the finest level
+    float lodCoarsestTolerance; // above, all get the coarsest one
+    float lodPixelsPerUnit; // scale of the projection this frame
+    float lodNearDepth; // eye z of the front and the back of the models
+    float lodFarDepth;
+    
+    // times of the stages of a frame (STAGE_...) in ms, see endStage()
+    bool drawTimings; // show them in the view
+    bool stageTimersSupported;
+    GLuint stageTimers[4 * (STAGE_COUNT + 1)]; // timestamps between the stages, for every frame timer
+    int currentStage; // the stage running
+    double stageStart;
+    float stageCpuTime[STAGE_COUNT]; // of the last frame
+    float stageGpuTime[STAGE_COUNT]; // of frame gpuFrame
+    int frameCount; // frames drawn on the screen
+    int frameTimerFrame[4]; // the frame every timer query belongs to
+    int gpuFrame; // the frame gpuFrameTime and stageGpuTime belong to, -1 if none was read yet
+    // times of the model types in the draw stage, if they are drawn with one instanced call each
+    vector<GLuint> typeTimers[4]; // timestamps before the first and after every type, for every frame timer
+    bool typeTimersUsed[4]; // the frame of the timer was drawn by type
+    double typeStart;
+    vector<float> typeCpuTime; // of the last frame, empty if it drew all types together
+    vector<float> typeGpuTime; // of frame gpuFrame, empty if it drew all types together
+    ofstream timingLog;
+    bool timingLogJson;
     // used to show the distribution of the grid, not available via the UserInterface
     bool drawBoxes;
     
-    // Grid Boxes  
-    vector< vector< vector< vector<int> > > > smallBoxes; // contains the indexes of the models belonging to each grid box
-    vector< vector< vector<int> > > smallBoxCounter; // counts the elements inside the grid boxes
-    vector< vector< vector< float* > > > smallBoxCoords; // coordinates of the grid box
-    vector< vector< vector<bool> > > smallBoxState; // drawing state for the grid box for the actual frame
+    // Grid Boxes, stored flat: the models of box b = gridBox(x, y, z) are
+    // gridModels[gridOffset[b]] ... gridModels[gridOffset[b + 1] - 1]. With the octree the
+    // cells are its leaves instead, and gridSize is 0.
+    int gridSize; // number of grid boxes along each axis
+    int gridCells; // number of grid boxes, gridSize^3 or the leaves of the octree
+    vector<int> gridOffset; // first slot of every grid box in gridModels, gridCells + 1 entries
+    vector<int> gridModels; // indexes of the models, sorted by grid box
+    vector<float> gridBounds; // 6 coordinates (BOX_COORD_...) of the models in every grid box
+    vector<char> gridState; // drawing state for the grid box for the actual frame
+    vector<char> gridVisible; // grid box is in the view frustum this frame
+    
+    // adaptive alternative to the uniform grid, for systems with empty space and dense regions
+    bool useOctree;
+    vector<OctreeNode> octree; // root first, empty with the uniform grid
+    vector<char> octreeVisible; // 0 out of view, 1 partly, 2 completely in view, this frame
+    
+    // occlusion queries of the grid boxes, or of the octree nodes, read back in a later frame
+    vector<GLuint> gridQueries; // one query per grid box or node, created on the first test
+    vector<int> gridQueryFrame; // frame the pending query was issued in, -1 if none is pending
+    vector<int> gridTestFrame; // last frame the grid box was tested in
+    vector<char> gridOccluded; // last query result read: box is hidden
+    vector<int> gridQueryView; // view the pending query was issued in
+    vector<int> gridResultView; // view the last result read was taken in
+    int occlusionFrame; // counts the frames drawn optimized
+    int occlusionView; // counts the changes of the matrices and of the models drawn
+    GLfloat occlusionMatrices[32]; // modelview and projection of the current view
+    bool occlusionPending; // a box was skipped on a result of an earlier view
+    int culledGridBoxes; // grid boxes skipped in the last frame, out of view or occluded
     
     // used for rendering from the side
     int startBox_X;
@@ -312,6 +558,9 @@ private:
     float sliceYHigh;
     float sliceZLow;
     float sliceZHigh;
+    bool sliceFractional; // slices are given as fractions of the box vectors
+    float sliceFractions[6];
+    void getSliceClipPlanes(GLdouble planes[6][4]) const;
     
     // Screenshot stuff  
     bool offScreen; // User for screenshot taking
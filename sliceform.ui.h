@@ -278,11 +278,29 @@ void SliceForm::setSliceBounds()
 				    float( slider_slice_y_right -> value() * cnf -> getBoxY() ) / 1001.0,
 				    float( slider_slice_z_left  -> value() * cnf -> getBoxZ() ) / 1001.0,
 				    float( slider_slice_z_right -> value() * cnf -> getBoxZ() ) / 1001.0 );
+	// along the box vectors, used whenever the box is known (also for triclinic boxes)
+	glWindow -> setSliceFractions( sliceFraction( slider_slice_x_left  ), sliceFraction( slider_slice_x_right ),
+				       sliceFraction( slider_slice_y_left  ), sliceFraction( slider_slice_y_right ),
+				       sliceFraction( slider_slice_z_left  ), sliceFraction( slider_slice_z_right ) );
 	glWindow -> repaint();
     }
     //cout << "SliceForm::setSliceBounds end" << endl;
 }
 
+//-------------------------------------------------------------------------
+//------------- sliceFraction
+//-------------------------------------------------------------------------
+/*! 
+ *  Converts a slider value to a fraction of the box vector (-0.5 to 0.5).
+ *  A slider at its end does not cut at all, so unfolded molecules outside the box stay visible.
+ */
+float SliceForm::sliceFraction( QSlider *slider )
+{
+    if( slider -> value() <= slider -> minValue() ) { return( -1.0e30 ); }
+    if( slider -> value() >= slider -> maxValue() ) { return(  1.0e30 ); }
+    return( float( slider -> value() ) / 1000.0 );
+}
+
 //-------------------------------------------------------------------------
 //------------- setCnfFile
 //-------------------------------------------------------------------------